@@ -0,0 +1,461 @@
+/**
+ * bench/bench_3d.c — engine_3d シーンベンチマーク
+ *
+ * C API を直接叩いて代表的なシーンを一定フレーム回し、
+ * フレーム時間の p50/p95/p99 とフェーズ毎の CPU 時間を JSON で出力する。
+ * 既定はヘッドレス (eng3d_create_headless)。--window で vsync OFF のウィンドウ。
+ *
+ *   cmake --build build --target bench && ./build/bench --out result.json
+ *
+ * Copyright (c) 2026 Reo Shiozawa — MIT License
+ */
+#include "eng_3d.h"
+
+#ifdef __APPLE__
+#  define GL_SILENCE_DEPRECATION
+#  include <OpenGL/gl3.h>
+#elif defined(_WIN32)
+#  include <SDL2/SDL_opengl.h>
+#else
+#  include <GL/gl.h>
+#endif
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* ══════════════════════════════════════════════════════
+ * 設定
+ * ══════════════════════════════════════════════════════*/
+typedef struct {
+    int         w, h;
+    int         frames, warmup;
+    int         cubes;          /* cubes 系シーンの個数 */
+    int         obj_reps;       /* OBJ ロードの繰り返し回数 */
+    int         mesh_flags;     /* eng3d_mesh_build_flags に渡す ENG_3D_MESH_* */
+    bool        window;
+    const char* only;           /* 部分一致でシーンを絞る */
+    const char* obj;            /* 任意の OBJ (無ければ生成) */
+    const char* out;            /* JSON 出力先 (無ければ stdout) */
+} BenchCfg;
+
+/* 1 フレーム分の計測 (ms) */
+enum { PH_UPDATE, PH_RECORD, PH_SUBMIT, PH_GPU, PH_COUNT };
+static const char* PH_NAME[PH_COUNT]={"update","record","submit","gpu_wait"};
+
+typedef struct {
+    double* frame;              /* [frames] */
+    double* phase[PH_COUNT];
+    int     n;
+    long    draws;              /* eng3d_draw 呼び出し (計測区間の合計) */
+    ENG_3D_FrameStats sum;      /* eng3d_frame_stats の合計 */
+} Samples;
+
+/* ══════════════════════════════════════════════════════
+ * シーン
+ * ══════════════════════════════════════════════════════*/
+#define BENCH_EMITTERS  16
+#define BENCH_NODES    512
+#define BENCH_ANIMS     32
+
+typedef struct {
+    ENG_3D_MeshID    cube, ground;
+    ENG_3D_EmitterID em[BENCH_EMITTERS];
+    ENG_3D_NodeID    node[BENCH_NODES];
+    ENG_3D_AnimID    anim[BENCH_ANIMS];
+    int              n_obj;
+    float            t;
+} SceneState;
+
+typedef struct {
+    const char* name;
+    void (*setup)(ENG_3D*, SceneState*, const BenchCfg*);
+    void (*update)(ENG_3D*, SceneState*, float dt);
+    int  (*record)(ENG_3D*, SceneState*);   /* 戻り値: eng3d_draw 呼び出し数 */
+    bool shadow, bloom;
+} Scene;
+
+static void base_setup(ENG_3D* ctx, SceneState* s, float cam_dist){
+    eng3d_cam_perspective(ctx,60.f,0.1f,cam_dist*4.f);
+    eng3d_cam_lookat(ctx,0,cam_dist*0.6f,cam_dist, 0,0,0);
+    eng3d_ambient(ctx,0.2f,0.2f,0.25f);
+    eng3d_dir_light(ctx,0.4f,-1.f,0.3f, 1.f,0.95f,0.85f);
+    s->cube  =eng3d_mesh_cube(ctx,1,1,1);
+    s->ground=eng3d_mesh_plane(ctx,cam_dist*4.f,cam_dist*4.f);
+    eng3d_mesh_color(ctx,s->cube,0.8f,0.5f,0.2f,1.f);
+    eng3d_mesh_color(ctx,s->ground,0.3f,0.35f,0.3f,1.f);
+}
+
+/* ── 大量キューブ (インスタンシング経路) ───────────────*/
+static void cubes_setup(ENG_3D* ctx, SceneState* s, const BenchCfg* cfg){
+    s->n_obj=cfg->cubes;
+    int side=(int)ceilf(sqrtf((float)s->n_obj));
+    base_setup(ctx,s,(float)side*1.1f);
+    eng3d_mesh_emissive(ctx,s->cube,1.f,0.6f,0.2f,0.4f);   /* ブルームの閾値を越えさせる */
+}
+static void cubes_update(ENG_3D* ctx, SceneState* s, float dt){ s->t+=dt; }
+static int cubes_record(ENG_3D* ctx, SceneState* s){
+    int side=(int)ceilf(sqrtf((float)s->n_obj));
+    float half=(float)side;
+    eng3d_draw(ctx,s->ground,0,-0.5f,0, 0,0,0, 1,1,1);
+    for(int i=0;i<s->n_obj;i++){
+        float x=(float)(i%side)*2.f-half, z=(float)(i/side)*2.f-half;
+        eng3d_draw(ctx,s->cube,x,0.5f,z, 0,s->t*45.f+(float)i,0, 1,1,1);
+    }
+    return s->n_obj+1;
+}
+
+/* ── パーティクル (16 エミッタ × 上限数) ───────────────*/
+static void particles_setup(ENG_3D* ctx, SceneState* s, const BenchCfg* cfg){
+    base_setup(ctx,s,30.f);
+    s->n_obj=BENCH_EMITTERS;
+    for(int i=0;i<BENCH_EMITTERS;i++){
+        ENG_3D_EmitterID e=eng3d_emitter_create(ctx,4096);
+        float a=(float)i/(float)BENCH_EMITTERS*6.2831853f;
+        eng3d_emitter_pos(ctx,e,cosf(a)*12.f,0,sinf(a)*12.f);
+        eng3d_emitter_life(ctx,e,1.5f,2.f);
+        eng3d_emitter_rate(ctx,e,4096.f/2.f);               /* 常に上限付近を維持 */
+        eng3d_emitter_velocity(ctx,e,0,6,0,2.f);
+        eng3d_emitter_gravity(ctx,e,0,-4,0);
+        eng3d_emitter_color(ctx,e,1.f,0.7f,0.2f,1.f);
+        eng3d_emitter_color_end(ctx,e,0.8f,0.1f,0.f,0.f);
+        eng3d_emitter_size(ctx,e,0.3f,0.05f);
+        eng3d_emitter_burst(ctx,e,4096);
+        s->em[i]=e;
+    }
+}
+static int particles_record(ENG_3D* ctx, SceneState* s){
+    eng3d_draw(ctx,s->ground,0,-0.5f,0, 0,0,0, 1,1,1);
+    for(int i=0;i<s->n_obj;i++) eng3d_emitter_update_draw(ctx,s->em[i]);
+    return 1;
+}
+
+/* ── 512 ノードの階層 ───────────────────────────────*/
+static void nodes_setup(ENG_3D* ctx, SceneState* s, const BenchCfg* cfg){
+    base_setup(ctx,s,40.f);
+    s->n_obj=BENCH_NODES;
+    for(int i=0;i<s->n_obj;i++){
+        ENG_3D_NodeID n=eng3d_node_create(ctx);
+        eng3d_node_mesh(ctx,n,s->cube);
+        if(i==0){ s->node[i]=n; continue; }
+        eng3d_node_parent(ctx,n,s->node[(i-1)/2]);          /* 二分木: 深さ 9 */
+        eng3d_node_pos(ctx,n,(i&1)?1.5f:-1.5f,0.5f,(float)(i%7)*0.3f);
+        eng3d_node_scale(ctx,n,0.9f,0.9f,0.9f);
+        s->node[i]=n;
+    }
+}
+static void nodes_update(ENG_3D* ctx, SceneState* s, float dt){
+    s->t+=dt;
+    for(int i=0;i<s->n_obj;i+=8) eng3d_node_rot(ctx,s->node[i],0,s->t*30.f+(float)i,0);
+}
+static int nodes_record(ENG_3D* ctx, SceneState* s){
+    eng3d_draw(ctx,s->ground,0,-0.5f,0, 0,0,0, 1,1,1);
+    for(int i=0;i<s->n_obj;i++) eng3d_node_draw(ctx,s->node[i]);
+    return s->n_obj+1;
+}
+static int nodes_all_record(ENG_3D* ctx, SceneState* s){
+    eng3d_draw(ctx,s->ground,0,-0.5f,0, 0,0,0, 1,1,1);
+    eng3d_scene_draw_all(ctx);
+    return s->n_obj+1;
+}
+
+/* ── 32 アニメーション × 16 ノード ─────────────────────*/
+static void anims_setup(ENG_3D* ctx, SceneState* s, const BenchCfg* cfg){
+    base_setup(ctx,s,40.f);
+    s->n_obj=BENCH_NODES;
+    int per=BENCH_NODES/BENCH_ANIMS;
+    for(int a=0;a<BENCH_ANIMS;a++){
+        ENG_3D_AnimID an=eng3d_anim_create(ctx);
+        float x=(float)(a%8)*5.f-17.5f, z=(float)(a/8)*5.f-7.5f;
+        for(int k=0;k<=4;k++){
+            float t=(float)k*0.5f;
+            eng3d_anim_key_pos(ctx,an,t,x,(k&1)?2.f:0.f,z);
+            eng3d_anim_key_rot(ctx,an,t,0,(float)k*90.f,0);
+        }
+        eng3d_anim_loop(ctx,an,true);
+        eng3d_anim_play(ctx,an);
+        s->anim[a]=an;
+        for(int j=0;j<per;j++){
+            ENG_3D_NodeID n=eng3d_node_create(ctx);
+            eng3d_node_mesh(ctx,n,s->cube);
+            if(j>0){
+                eng3d_node_parent(ctx,n,s->node[a*per]);
+                eng3d_node_pos(ctx,n,cosf((float)j)*1.5f,(float)j*0.1f,sinf((float)j)*1.5f);
+                eng3d_node_scale(ctx,n,0.4f,0.4f,0.4f);
+            }
+            s->node[a*per+j]=n;
+        }
+    }
+}
+static void anims_update(ENG_3D* ctx, SceneState* s, float dt){
+    int per=BENCH_NODES/BENCH_ANIMS;
+    for(int a=0;a<BENCH_ANIMS;a++){
+        float x,y,z,rx,ry,rz;
+        eng3d_anim_update(ctx,s->anim[a],dt);
+        eng3d_anim_get_pos(ctx,s->anim[a],&x,&y,&z);
+        eng3d_anim_get_rot(ctx,s->anim[a],&rx,&ry,&rz);
+        eng3d_node_pos(ctx,s->node[a*per],x,y,z);
+        eng3d_node_rot(ctx,s->node[a*per],rx,ry,rz);
+    }
+}
+
+static const Scene SCENES[]={
+    {"cubes",            cubes_setup,     cubes_update, cubes_record,     false,false},
+    {"cubes_shadow",     cubes_setup,     cubes_update, cubes_record,     true, false},
+    {"cubes_bloom",      cubes_setup,     cubes_update, cubes_record,     false,true },
+    {"cubes_shadow_bloom",cubes_setup,    cubes_update, cubes_record,     true, true },
+    {"particles",        particles_setup, NULL,         particles_record, false,false},
+    {"nodes",            nodes_setup,     nodes_update, nodes_record,     true, false},
+    {"nodes_all",        nodes_setup,     nodes_update, nodes_all_record, true, false},
+    {"anims",            anims_setup,     anims_update, nodes_record,     true, false},
+};
+#define N_SCENES ((int)(sizeof(SCENES)/sizeof(SCENES[0])))
+
+/* ══════════════════════════════════════════════════════
+ * 計測ユーティリティ
+ * ══════════════════════════════════════════════════════*/
+static double now_ms(void){
+    return (double)SDL_GetPerformanceCounter()*1000.0/(double)SDL_GetPerformanceFrequency();
+}
+
+static int cmp_double(const void* a, const void* b){
+    double x=*(const double*)a, y=*(const double*)b;
+    return (x>y)-(x<y);
+}
+
+/* 最近傍順位法。v は並べ替えられる */
+static void percentiles(double* v, int n, double out[4]){
+    if(n<=0){ out[0]=out[1]=out[2]=out[3]=0; return; }
+    qsort(v,(size_t)n,sizeof(double),cmp_double);
+    static const double P[3]={0.50,0.95,0.99};
+    for(int i=0;i<3;i++){
+        int k=(int)ceil(P[i]*(double)n)-1;
+        out[i]=v[k<0?0:k];
+    }
+    double sum=0; for(int i=0;i<n;i++) sum+=v[i];
+    out[3]=sum/(double)n;
+}
+
+static void json_stat(FILE* fp, const char* name, double* v, int n){
+    double p[4]; percentiles(v,n,p);
+    fprintf(fp,"\"%s\":{\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"mean\":%.4f}",
+            name,p[0],p[1],p[2],p[3]);
+}
+
+static ENG_3D* open_ctx(const BenchCfg* cfg){
+    ENG_3D* ctx;
+    if(!cfg->window) ctx=eng3d_create_headless(cfg->w,cfg->h);
+    else {
+        ctx=eng3d_create("engine_3d bench",cfg->w,cfg->h);
+        if(ctx) SDL_GL_SetSwapInterval(0);   /* vsync OFF: 表示間隔で頭打ちにさせない */
+    }
+    if(ctx) eng3d_mesh_build_flags(ctx,cfg->mesh_flags);
+    return ctx;
+}
+
+/* ══════════════════════════════════════════════════════
+ * シーン実行
+ * ══════════════════════════════════════════════════════*/
+static bool run_scene(const Scene* sc, const BenchCfg* cfg, Samples* out, int* n_obj){
+    ENG_3D* ctx=open_ctx(cfg);
+    if(!ctx){ fprintf(stderr,"[bench] コンテキスト作成失敗: %s\n",sc->name); return false; }
+    SceneState* s=(SceneState*)calloc(1,sizeof(SceneState));
+    sc->setup(ctx,s,cfg);
+    eng3d_shadow_enable(ctx,sc->shadow);
+    eng3d_bloom_enable(ctx,sc->bloom);
+    *n_obj=s->n_obj;
+
+    int total=cfg->warmup+cfg->frames;
+    for(int f=0;f<total;f++){
+        double t0=now_ms();
+        if(!eng3d_update(ctx)) break;
+        if(sc->update) sc->update(ctx,s,1.f/60.f);   /* シーン更新は固定刻み (再現性のため) */
+        double t1=now_ms();
+        eng3d_begin(ctx,0.1f,0.1f,0.15f);
+        int draws=sc->record(ctx,s);
+        double t2=now_ms();
+        eng3d_end(ctx);
+        double t3=now_ms();
+        glFinish();                                   /* GPU 完了まで待ってフレームを閉じる */
+        double t4=now_ms();
+        if(f<cfg->warmup) continue;
+        int i=out->n++;
+        out->frame[i]          =t4-t0;
+        out->phase[PH_UPDATE][i]=t1-t0;
+        out->phase[PH_RECORD][i]=t2-t1;
+        out->phase[PH_SUBMIT][i]=t3-t2;
+        out->phase[PH_GPU][i]   =t4-t3;
+        ENG_3D_FrameStats fs; eng3d_frame_stats(ctx,&fs);
+        out->draws+=draws;
+        out->sum.draw_calls     +=fs.draw_calls;
+        out->sum.triangles      +=fs.triangles;
+        out->sum.program_binds  +=fs.program_binds;
+        out->sum.texture_binds  +=fs.texture_binds;
+        out->sum.vao_binds      +=fs.vao_binds;
+        out->sum.uniform_uploads+=fs.uniform_uploads;
+        out->sum.upload_bytes   +=fs.upload_bytes;
+        out->sum.culled         +=fs.culled;
+        out->sum.particles      +=fs.particles;
+    }
+    free(s);
+    eng3d_destroy(ctx);
+    return out->n>0;
+}
+
+/* 200x200 分割のグリッド OBJ (v/vt/vn 付き, 8 万三角形) を生成する */
+static bool write_grid_obj(const char* path, int n){
+    FILE* fp=fopen(path,"w"); if(!fp) return false;
+    for(int z=0;z<=n;z++) for(int x=0;x<=n;x++){
+        float fx=(float)x/(float)n, fz=(float)z/(float)n;
+        fprintf(fp,"v %f %f %f\n",fx*20.f-10.f,sinf(fx*12.f)*cosf(fz*9.f)*0.5f,fz*20.f-10.f);
+        fprintf(fp,"vt %f %f\n",fx,fz);
+    }
+    fprintf(fp,"vn 0 1 0\n");
+    for(int z=0;z<n;z++) for(int x=0;x<n;x++){
+        int a=z*(n+1)+x+1, b=a+1, c=a+n+1, d=c+1;
+        fprintf(fp,"f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n",a,a,c,c,d,d,b,b);
+    }
+    fclose(fp);
+    return true;
+}
+
+/* OBJ ロードは 1 回の呼び出しを 1 サンプルとして計る。
+ * cached=false はテキストのパース、true は .e3dm キャッシュからの読込 */
+static bool run_obj(const BenchCfg* cfg, Samples* out, int* n_verts, float acmr[2], bool cached){
+    const char* path=cfg->obj;
+    const char* tmp="bench_3d_grid.obj";
+    const char* tmp_cache="bench_3d_grid.obj.e3dm";
+    if(!path){
+        if(!write_grid_obj(tmp,200)){ fprintf(stderr,"[bench] %s を書けません\n",tmp); return false; }
+        path=tmp;
+    }
+    ENG_3D* ctx=open_ctx(cfg);
+    if(!ctx){ if(!cfg->obj) remove(tmp); return false; }
+    eng3d_mesh_obj_cache(ctx,cached);
+    if(cached) eng3d_mesh_destroy(ctx,eng3d_mesh_load_obj(ctx,path));   /* キャッシュを作っておく */
+    *n_verts=0;
+    for(int r=0;r<cfg->obj_reps;r++){
+        double t0=now_ms();
+        ENG_3D_MeshID m=eng3d_mesh_load_obj(ctx,path);
+        glFinish();
+        double t1=now_ms();
+        if(!m) break;
+        *n_verts=eng3d_mesh_vertex_count(ctx,m);
+        eng3d_mesh_acmr(ctx,m,&acmr[0],&acmr[1]);
+        eng3d_mesh_destroy(ctx,m);
+        out->frame[out->n++]=t1-t0;
+    }
+    eng3d_destroy(ctx);
+    if(!cfg->obj){ remove(tmp); remove(tmp_cache); }
+    return out->n>0;
+}
+
+static Samples samples_new(int n){
+    Samples s; memset(&s,0,sizeof(s));
+    s.frame=(double*)calloc((size_t)n,sizeof(double));
+    for(int p=0;p<PH_COUNT;p++) s.phase[p]=(double*)calloc((size_t)n,sizeof(double));
+    return s;
+}
+static void samples_free(Samples* s){
+    free(s->frame);
+    for(int p=0;p<PH_COUNT;p++) free(s->phase[p]);
+}
+
+/* ══════════════════════════════════════════════════════
+ * main
+ * ══════════════════════════════════════════════════════*/
+static void usage(const char* argv0){
+    fprintf(stderr,
+        "使い方: %s [オプション]\n"
+        "  --window          vsync OFF のウィンドウで計測 (既定: ヘッドレス)\n"
+        "  --size W H        描画解像度 (既定 1280 720)\n"
+        "  --frames N        計測フレーム数 (既定 300)\n"
+        "  --warmup N        捨てるフレーム数 (既定 30)\n"
+        "  --cubes N         cubes 系シーンの個数 (既定 10000)\n"
+        "  --scene NAME      名前に NAME を含むシーンだけ実行\n"
+        "  --obj PATH        OBJ ロード計測に使うファイル (既定: 生成)\n"
+        "  --obj-reps N      OBJ ロード回数 (既定 5)\n"
+        "  --mesh-flags N    メッシュ構築フラグ (1=圧縮頂点 2=キャッシュ最適化 4=LOD 8=アリーナ, 既定 0)\n"
+        "  --out PATH        JSON の出力先 (既定: 標準出力)\n",argv0);
+}
+
+int main(int argc, char** argv){
+    BenchCfg cfg={1280,720, 300,30, 10000, 5, 0, false, NULL,NULL,NULL};
+    for(int i=1;i<argc;i++){
+        const char* a=argv[i];
+        bool more=i+1<argc;
+        if     (!strcmp(a,"--window"))         cfg.window=true;
+        else if(!strcmp(a,"--size")&&i+2<argc){ cfg.w=atoi(argv[++i]); cfg.h=atoi(argv[++i]); }
+        else if(!strcmp(a,"--frames")&&more)   cfg.frames=atoi(argv[++i]);
+        else if(!strcmp(a,"--warmup")&&more)   cfg.warmup=atoi(argv[++i]);
+        else if(!strcmp(a,"--cubes")&&more)    cfg.cubes=atoi(argv[++i]);
+        else if(!strcmp(a,"--scene")&&more)    cfg.only=argv[++i];
+        else if(!strcmp(a,"--obj")&&more)      cfg.obj=argv[++i];
+        else if(!strcmp(a,"--obj-reps")&&more) cfg.obj_reps=atoi(argv[++i]);
+        else if(!strcmp(a,"--mesh-flags")&&more) cfg.mesh_flags=atoi(argv[++i]);
+        else if(!strcmp(a,"--out")&&more)      cfg.out=argv[++i];
+        else { usage(argv[0]); return 2; }
+    }
+    if(cfg.frames<1||cfg.warmup<0||cfg.cubes<1||cfg.obj_reps<1||cfg.w<1||cfg.h<1){
+        usage(argv[0]); return 2;
+    }
+
+    FILE* fp=cfg.out?fopen(cfg.out,"w"):stdout;
+    if(!fp){ fprintf(stderr,"[bench] %s を開けません\n",cfg.out); return 1; }
+    fprintf(fp,"{\"engine\":\"engine_3d\",\"mode\":\"%s\",\"width\":%d,\"height\":%d,"
+               "\"frames\":%d,\"warmup\":%d,\"mesh_flags\":%d,\"scenes\":[",
+            cfg.window?"window":"headless",cfg.w,cfg.h,cfg.frames,cfg.warmup,cfg.mesh_flags);
+
+    int failed=0, written=0;
+    for(int i=0;i<N_SCENES;i++){
+        const Scene* sc=&SCENES[i];
+        if(cfg.only&&!strstr(sc->name,cfg.only)) continue;
+        fprintf(stderr,"[bench] %s ...\n",sc->name);
+        Samples s=samples_new(cfg.frames);
+        int n_obj=0;
+        if(run_scene(sc,&cfg,&s,&n_obj)){
+            fprintf(fp,"%s\n{\"name\":\"%s\",\"objects\":%d,\"shadow\":%s,\"bloom\":%s,",
+                    written++?",":"",sc->name,n_obj,
+                    sc->shadow?"true":"false",sc->bloom?"true":"false");
+            double n=(double)s.n;
+            fprintf(fp,"\"per_frame\":{\"api_draws\":%.1f,\"draw_calls\":%.1f,\"triangles\":%.0f,"
+                       "\"program_binds\":%.1f,\"texture_binds\":%.1f,\"vao_binds\":%.1f,"
+                       "\"uniform_uploads\":%.1f,\"upload_bytes\":%.0f,\"culled\":%.1f,\"particles\":%.0f},",
+                    (double)s.draws/n,s.sum.draw_calls/n,(double)s.sum.triangles/n,
+                    s.sum.program_binds/n,s.sum.texture_binds/n,s.sum.vao_binds/n,
+                    s.sum.uniform_uploads/n,(double)s.sum.upload_bytes/n,s.sum.culled/n,s.sum.particles/n);
+            json_stat(fp,"frame_ms",s.frame,s.n);
+            fprintf(fp,",\"cpu_ms\":{");
+            for(int p=0;p<PH_COUNT;p++){
+                if(p) fputc(',',fp);
+                json_stat(fp,PH_NAME[p],s.phase[p],s.n);
+            }
+            fprintf(fp,"}}");
+        } else failed++;
+        samples_free(&s);
+    }
+
+    static const char* OBJ_SCENES[2]={"obj_load","obj_load_cached"};
+    for(int c=0;c<2;c++){
+        if(cfg.only&&!strstr(OBJ_SCENES[c],cfg.only)) continue;
+        fprintf(stderr,"[bench] %s ...\n",OBJ_SCENES[c]);
+        Samples s=samples_new(cfg.obj_reps);
+        int n_verts=0;
+        float acmr[2]={0,0};
+        if(run_obj(&cfg,&s,&n_verts,acmr,c==1)){
+            fprintf(fp,"%s\n{\"name\":\"%s\",\"vertices\":%d,\"loads\":%d,"
+                       "\"acmr_before\":%.3f,\"acmr_after\":%.3f,",
+                    written++?",":"",OBJ_SCENES[c],n_verts,s.n,acmr[0],acmr[1]);
+            json_stat(fp,"load_ms",s.frame,s.n);
+            fprintf(fp,"}");
+        } else failed++;
+        samples_free(&s);
+    }
+
+    fprintf(fp,"\n]}\n");
+    if(fp!=stdout) fclose(fp);
+    return failed?1:0;
+}
@@ -19,21 +19,26 @@ extern "C" {
 /* ── 不透明構造体 ──────────────────────────────────────*/
 typedef struct ENG_3D ENG_3D;
 
-/* ── ID 型 ─────────────────────────────────────────────*/
-typedef int ENG_3D_MeshID;     /* 1-origin; 0=無効 */
-typedef int ENG_3D_TexID;      /* 1-origin; 0=なし */
-typedef int ENG_3D_EmitterID;  /* 1-origin; 0=無効 */
-typedef int ENG_3D_NodeID;     /* 1-origin; 0=無効 */
-typedef int ENG_3D_AnimID;     /* 1-origin; 0=無効 */
+/* ── ID 型 ─────────────────────────────────────────────
+ * 下位 20bit がスロット+1、上位が世代。破棄した ID は
+ * スロットが再利用されても無効のまま (作り直すまでは 1,2,3…) */
+typedef int ENG_3D_MeshID;     /* 0=無効 */
+typedef int ENG_3D_TexID;      /* 0=なし */
+typedef int ENG_3D_EmitterID;  /* 0=無効 */
+typedef int ENG_3D_NodeID;     /* 0=無効 */
+typedef int ENG_3D_AnimID;     /* 0=無効 */
 
-/* ── 上限 ──────────────────────────────────────────────*/
-#define ENG_3D_MAX_MESHES    256
-#define ENG_3D_MAX_TEXTURES  128
+/* ── 上限 (メッシュ・テクスチャ・エミッター・ノード・アニメは無制限) ──*/
 #define ENG_3D_MAX_LIGHTS      8   /* ポイントライト */
 #define ENG_3D_MAX_SPOTS       4   /* スポットライト */
-#define ENG_3D_MAX_EMITTERS   16
-#define ENG_3D_MAX_NODES     512
-#define ENG_3D_MAX_ANIMS      32
+#define ENG_3D_MAX_CASCADES    4   /* シャドウカスケード */
+
+/* ── メッシュ構築フラグ (eng3d_mesh_build_flags) ────────*/
+#define ENG_3D_MESH_PACKED  0x01   /* 圧縮頂点 44→20 バイト (位置 snorm16, 法線/接線 八面体, UV half) */
+#define ENG_3D_MESH_OPTIMIZE 0x02  /* 頂点キャッシュ/オーバードロー/フェッチ順の最適化 */
+#define ENG_3D_MESH_LOD      0x04  /* 簡略化 LOD を自動生成 (eng3d_draw が投影サイズで選ぶ) */
+#define ENG_3D_MESH_ARENA    0x08  /* 共有の頂点/インデックスバッファに置く (VAO 切替を省く) */
+#define ENG_3D_MAX_LODS      4     /* LOD0 (元の形) を含む段数 */
 
 /* ── レイキャスト結果 ──────────────────────────────────*/
 typedef struct {
@@ -42,6 +47,7 @@ typedef struct {
     float nx, ny, nz;         /* 法線 */
     float dist;               /* 距離 */
     ENG_3D_MeshID mesh_id;
+    ENG_3D_NodeID node_id;    /* 当たったシーンノード */
 } ENG_3D_RayHit;
 
 /* ── AABB ─────────────────────────────────────────────*/
@@ -50,10 +56,41 @@ typedef struct {
     float max[3];
 } ENG_3D_AABB;
 
+/* ── GPU 時間 (ms, パス別) ──────────────────────────────*/
+typedef struct {
+    float shadow_ms;          /* シャドウマップ (全カスケード) */
+    float main_ms;            /* メッシュ + スカイボックス */
+    float particle_ms;        /* パーティクル */
+    float post_ms;            /* ブルームのブラー + 合成 */
+    float total_ms;
+    int   latency;            /* 何フレーム前の計測か */
+    bool  valid;              /* false = まだ結果が無い */
+} ENG_3D_GpuStats;
+
+/* ── フレーム統計 (eng3d_begin〜eng3d_end の CPU 側カウンタ) ──*/
+typedef struct {
+    int     draw_calls;       /* glDraw* の発行数 (シャドウ/ブルーム含む) */
+    int     instanced_draws;  /* うち 2 インスタンス以上 */
+    int64_t triangles;        /* index_count/3 × インスタンス数 */
+    int     program_binds;
+    int     texture_binds;
+    int     vao_binds;
+    int     uniform_uploads;  /* glUniform* + Frame UBO 転送 */
+    int64_t upload_bytes;     /* glBufferSubData + テクスチャ転送の合計バイト数 */
+    int     culled;           /* 視錐台カリングされた描画 */
+    int     particles;        /* 生存パーティクル */
+} ENG_3D_FrameStats;
+
 /* ══════════════════════════════════════════════════════
  * ライフサイクル
  * ══════════════════════════════════════════════════════*/
 ENG_3D* eng3d_create(const char* title, int w, int h);
+/** ウィンドウを出さずオフスクリーン FBO に描くコンテキスト。
+ *  EGL 対応ビルドでは surfaceless で作るのでディスプレイ/GPU 無し (llvmpipe) でも動く。
+ *  EGL が無ければ非表示 SDL ウィンドウで代用する。入力は常に無し */
+ENG_3D* eng3d_create_headless(int w, int h);
+/** 直前に描いたフレームを RGBA8 で読み出す (上の行から, w*h*4 バイト) */
+bool    eng3d_read_pixels(ENG_3D* ctx, uint8_t* rgba);
 void    eng3d_destroy(ENG_3D* ctx);
 bool    eng3d_update(ENG_3D* ctx);
 float   eng3d_delta(ENG_3D* ctx);
@@ -102,7 +139,11 @@ void eng3d_spot_light_off(ENG_3D* ctx, int slot);
  * ══════════════════════════════════════════════════════*/
 void eng3d_shadow_enable(ENG_3D* ctx, bool on);
 void eng3d_shadow_bias(ENG_3D* ctx, float bias);
-void eng3d_shadow_size(ENG_3D* ctx, float ortho_size);  /* 平行光源の正射影範囲 */
+/** 平行光源の影が届くカメラからの距離 (既定 60) */
+void eng3d_shadow_size(ENG_3D* ctx, float distance);
+/** カスケード数 1..ENG_3D_MAX_CASCADES (既定 3)。
+ *  カメラ視錐台を分割し、手前ほど高解像度の 2048² マップを割り当てる */
+void eng3d_shadow_cascades(ENG_3D* ctx, int count);
 
 /* ══════════════════════════════════════════════════════
  * フォグ
@@ -132,15 +173,57 @@ ENG_3D_MeshID eng3d_mesh_plane(ENG_3D* ctx, float w, float d);
 ENG_3D_MeshID eng3d_mesh_cylinder(ENG_3D* ctx, float r, float h, int segs);
 ENG_3D_MeshID eng3d_mesh_capsule(ENG_3D* ctx, float r, float h, int segs);
 ENG_3D_MeshID eng3d_mesh_torus(ENG_3D* ctx, float R, float r, int segsR, int segsr);
+/** OBJ 読込。"<path>.e3dm" にバイナリキャッシュを書き、
+ *  次回以降はソースのサイズと更新時刻が一致すればそちらを読む */
 ENG_3D_MeshID eng3d_mesh_load_obj(ENG_3D* ctx, const char* path);
+/** eng3d_mesh_load_obj を ENG_3D_MESH_* 指定で (このメッシュにだけ適用) */
+ENG_3D_MeshID eng3d_mesh_load_obj_flags(ENG_3D* ctx, const char* path, int flags);
+/** .e3dm (GPU 向けの並びそのままのバイナリメッシュ) を mmap して読む */
+ENG_3D_MeshID eng3d_mesh_load_bin(ENG_3D* ctx, const char* path);
+/** OBJ 読込時の .e3dm キャッシュの読み書き (既定 ON) */
+void           eng3d_mesh_obj_cache(ENG_3D* ctx, bool on);
+/** 以降に作成/読込するメッシュに適用する ENG_3D_MESH_* の既定値 (既定 0)。
+ *  フラグは作成時にメッシュごとに記録される */
+void           eng3d_mesh_build_flags(ENG_3D* ctx, int flags);
 void           eng3d_mesh_destroy(ENG_3D* ctx, ENG_3D_MeshID id);
 int            eng3d_mesh_vertex_count(ENG_3D* ctx, ENG_3D_MeshID id);
 ENG_3D_AABB    eng3d_mesh_bounds(ENG_3D* ctx, ENG_3D_MeshID id);
+/** LOD の段数 (1=LOD 無し)。tris が非 NULL なら各段の三角形数 */
+int            eng3d_mesh_lod_info(ENG_3D* ctx, ENG_3D_MeshID id, int tris[ENG_3D_MAX_LODS]);
+/** 最適化前後の ACMR (三角形あたりの頂点キャッシュミス, FIFO 16)。未最適化なら false */
+bool           eng3d_mesh_acmr(ENG_3D* ctx, ENG_3D_MeshID id, float* before, float* after);
 
 /* ══════════════════════════════════════════════════════
  * テクスチャ
  * ══════════════════════════════════════════════════════*/
+typedef enum {
+    ENG_3D_TEX_NONE,      /* 無効な ID */
+    ENG_3D_TEX_LOADING,   /* デコード中 / 転送中 (1×1 の白で描画される) */
+    ENG_3D_TEX_READY,
+    ENG_3D_TEX_FAILED     /* 読めなかった (白のまま) */
+} ENG_3D_TexStatus;
+
+/** PNG/JPG/BMP と DDS/KTX2 (BC1/BC3/BC5/BC7, RGBA8)。圧縮コンテナはミップチェーンごと転送し、
+ *  GL が対応しない BC は RGBA8 に展開する。行は GL の下原点の並びで書き出しておくこと */
 ENG_3D_TexID eng3d_tex_load(ENG_3D* ctx, const char* path);
+/** ワーカースレッドでデコードし、eng3d_begin ごとに予算分ずつ GPU へ送る。ID はすぐ使える */
+ENG_3D_TexID eng3d_tex_load_async(ENG_3D* ctx, const char* path);
+/** 状態と転送の進み具合 (0〜1) */
+ENG_3D_TexStatus eng3d_tex_status(ENG_3D* ctx, ENG_3D_TexID id, float* progress);
+/** 読込中のテクスチャ数 */
+int          eng3d_tex_pending(ENG_3D* ctx);
+/** 非同期読込で 1 フレームに転送するバイト数の上限 (既定 4MB)。
+ *  行 (非圧縮) またはミップ段 (圧縮・プール) 単位で数え、1 件につき最低 1 単位は送る */
+void         eng3d_tex_upload_budget(ENG_3D* ctx, int bytes_per_frame);
+/** 以降読む PNG/JPG を BC1 (アルファ付きは BC3) + ミップに変換し "<path>.dds" にキャッシュ (既定 OFF) */
+void         eng3d_tex_compress(ENG_3D* ctx, bool on);
+/** 以降読むテクスチャを共有の 2D 配列に入れる (既定 OFF)。同じ大きさ・形式はレイヤーに、
+ *  256 以下で 2 冪でない小物は 1024² のアトラスに詰めて UV を付け替える。
+ *  同じ配列のテクスチャ同士はバッチ・インスタンシングを切らない。メッシュ専用
+ *  (パーティクルでは無地)。アトラスの繰り返しは端がクランプ相当になる */
+void         eng3d_tex_pool(ENG_3D* ctx, bool on);
+/** テクスチャの VRAM 見積り (バイト)。id=0 なら全体 */
+int64_t      eng3d_tex_memory(ENG_3D* ctx, ENG_3D_TexID id);
 void         eng3d_tex_destroy(ENG_3D* ctx, ENG_3D_TexID id);
 
 /* ══════════════════════════════════════════════════════
@@ -160,11 +243,39 @@ void eng3d_mesh_transparent(ENG_3D* ctx, ENG_3D_MeshID id, bool on);
  * 描画
  * ══════════════════════════════════════════════════════*/
 void eng3d_begin(ENG_3D* ctx, float r, float g, float b);
+/** 描画を記録する。GL への発行は eng3d_end でまとめて行い、
+ *  スカイボックス・パーティクルとの前後は呼び出し順のまま保つ。
+ *  シャドウマップはフレーム中の全キャスター (画面外のものも含む) で 1 回だけ描画される。
+ *  発行順は呼び出し順ではなく、不透明はマテリアル毎に手前→奥、
+ *  半透明 (eng3d_mesh_transparent) は奥→手前に並べ替えられる */
 void eng3d_draw(ENG_3D* ctx, ENG_3D_MeshID mesh_id,
                  float px, float py, float pz,
                  float rx, float ry, float rz,
                  float sx, float sy, float sz);
+/** アルベドを tex に差し替えて描く (0 ならメッシュのもの)。
+ *  プールのテクスチャなら同じメッシュの描画は 1 回のインスタンス描画にまとまる */
+void eng3d_draw_tex(ENG_3D* ctx, ENG_3D_MeshID mesh_id, ENG_3D_TexID tex,
+                 float px, float py, float pz,
+                 float rx, float ry, float rz,
+                 float sx, float sy, float sz);
 void eng3d_end(ENG_3D* ctx);
+/** 視錐台カリング (既定 ON)。メッシュの AABB が画面外の描画は GL に送らない */
+void eng3d_cull_enable(ENG_3D* ctx, bool on);
+/** 今フレーム (eng3d_begin 以降) にカリングされた描画数 */
+int  eng3d_cull_count(ENG_3D* ctx);
+/** LOD の切替閾値: 画面高さに対する境界球の直径が s1/s2/s3 未満で LOD1/2/3
+ *  (既定 0.3/0.15/0.07)。hysteresis は前回の段に留まる幅 (既定 0.1 = ±10%)。
+ *  ヒステリシスはシーンノードごとに効く (eng3d_draw の直接描画には効かない) */
+void eng3d_lod_params(ENG_3D* ctx, float s1, float s2, float s3, float hysteresis);
+
+/* ══════════════════════════════════════════════════════
+ * 統計
+ * ══════════════════════════════════════════════════════*/
+/** パス別の GPU 時間。数フレーム遅れで読むので待ちは発生しない。
+ *  まだ結果が無ければ false (out->valid も false) */
+bool eng3d_gpu_stats(ENG_3D* ctx, ENG_3D_GpuStats* out);
+/** 直前に eng3d_end まで終えたフレームのカウンタ */
+bool eng3d_frame_stats(ENG_3D* ctx, ENG_3D_FrameStats* out);
 
 /* ══════════════════════════════════════════════════════
  * ポストプロセス — ブルーム
@@ -204,6 +315,7 @@ void          eng3d_node_rot(ENG_3D* ctx, ENG_3D_NodeID id, float x, float y, fl
 void          eng3d_node_scale(ENG_3D* ctx, ENG_3D_NodeID id, float x, float y, float z);
 void          eng3d_node_active(ENG_3D* ctx, ENG_3D_NodeID id, bool on);
 void          eng3d_node_draw(ENG_3D* ctx, ENG_3D_NodeID id);
+void          eng3d_scene_draw_all(ENG_3D* ctx);   /* 有効な全ノードをワールド行列で描く */
 void          eng3d_node_world_pos(ENG_3D* ctx, ENG_3D_NodeID id, float* x, float* y, float* z);
 
 /* ══════════════════════════════════════════════════════
@@ -228,9 +340,10 @@ bool          eng3d_anim_is_playing(ENG_3D* ctx, ENG_3D_AnimID id);
 /* ══════════════════════════════════════════════════════
  * レイキャスト
  * ══════════════════════════════════════════════════════*/
-/** スクリーン座標からレイを飛ばして全メッシュの AABB テスト */
+/** スクリーン座標からレイを飛ばして、表示中のシーンノードのワールド AABB をテスト */
 ENG_3D_RayHit eng3d_raycast_screen(ENG_3D* ctx, float sx, float sy);
-/** ワールド座標 + 方向でレイを飛ばす */
+/** ワールド座標 + 方向でレイを飛ばす (ノードの BVH を手前から辿り、最も近い当たりを返す)。
+ *  ノードを介さない eng3d_draw / eng3d_draw_tex の描画は対象外 */
 ENG_3D_RayHit eng3d_raycast(ENG_3D* ctx,
                               float ox, float oy, float oz,
                               float dx, float dy, float dz);
@@ -239,6 +352,10 @@ ENG_3D_AABB    eng3d_aabb_transform(ENG_3D_AABB aabb,
                                      float px, float py, float pz,
                                      float rx, float ry, float rz,
                                      float sx, float sy, float sz);
+/** n 個の TRS (位置 3・回転 3 (度)・スケール 3 の 9 float ずつ) を列優先 4x4 行列 (16 float ずつ) へ */
+void           eng3d_trs_batch(const float* trs, int n, float* out_mats);
+/** n 個の AABB を対応する列優先 4x4 行列 (16 float ずつ) で変換。in と out は同じでもよい */
+void           eng3d_aabb_transform_batch(const ENG_3D_AABB* in, const float* mats, int n, ENG_3D_AABB* out);
 
 /* ══════════════════════════════════════════════════════
  * 入力
@@ -28,11 +28,37 @@
 
 #include <SDL2/SDL.h>
 
+#ifdef ENG3D_HAVE_EGL
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#  ifndef EGL_PLATFORM_SURFACELESS_MESA
+#    define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#  endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include <limits.h>
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE__)||defined(_M_X64)
+#  include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+#include <sys/stat.h>
 
 /* ══════════════════════════════════════════════════════
  * 定数 / マクロ
@@ -44,10 +70,13 @@
 #define RAD2DEG(r)   ((float)((r) * 180.0 / M_PI))
 #define CLAMP(v,a,b) ((v)<(a)?(a):(v)>(b)?(b):(v))
 
-#define SHADOW_MAP_W 2048
+#define SHADOW_MAP_W 2048     /* カスケード 1 段あたり */
 #define SHADOW_MAP_H 2048
+#define CASCADE_LAMBDA 0.75f  /* 分割位置: 1=対数 0=一様 */
 #define MAX_ANIM_KEYS 128
 #define MAX_PARTICLES 4096
+#define GPU_TIMER_FRAMES 4    /* クエリのリング段数 = 読み出しの遅延フレーム数 */
+#define GPU_TIMER_SLOTS  32   /* 1 フレームで発行できるクエリ数 */
 
 /* ══════════════════════════════════════════════════════
  * 線形代数
@@ -59,13 +88,46 @@ typedef float vec4[4];
 static void m4_id(mat4 m) { memset(m,0,64); m[0]=m[5]=m[10]=m[15]=1.f; }
 static void m4_copy(mat4 d, const mat4 s) { memcpy(d,s,64); }
 
+/* dst = a*b (列優先)。結果の列 c = Σk a の列 k × b[c][k]。
+ * a を全部読んでから列毎に b を読んで書くので dst は a とも b とも重なってよい */
 static void m4_mul(mat4 dst, const mat4 a, const mat4 b) {
+#if defined(__AVX__)
+    __m256 a0=_mm256_broadcast_ps((const __m128*)(a)),   a1=_mm256_broadcast_ps((const __m128*)(a+4));
+    __m256 a2=_mm256_broadcast_ps((const __m128*)(a+8)), a3=_mm256_broadcast_ps((const __m128*)(a+12));
+    for(int c=0;c<4;c+=2){                                  /* 2 列ずつ (下位レーン c, 上位 c+1) */
+        __m256 v=_mm256_loadu_ps(b+c*4);
+        __m256 r=_mm256_mul_ps(a0,_mm256_shuffle_ps(v,v,0x00));
+        r=_mm256_add_ps(r,_mm256_mul_ps(a1,_mm256_shuffle_ps(v,v,0x55)));
+        r=_mm256_add_ps(r,_mm256_mul_ps(a2,_mm256_shuffle_ps(v,v,0xAA)));
+        r=_mm256_add_ps(r,_mm256_mul_ps(a3,_mm256_shuffle_ps(v,v,0xFF)));
+        _mm256_storeu_ps(dst+c*4,r);
+    }
+#elif defined(__SSE__)||defined(_M_X64)
+    __m128 a0=_mm_loadu_ps(a), a1=_mm_loadu_ps(a+4), a2=_mm_loadu_ps(a+8), a3=_mm_loadu_ps(a+12);
+    for(int c=0;c<4;c++){
+        __m128 v=_mm_loadu_ps(b+c*4);
+        __m128 r=_mm_mul_ps(a0,_mm_shuffle_ps(v,v,0x00));
+        r=_mm_add_ps(r,_mm_mul_ps(a1,_mm_shuffle_ps(v,v,0x55)));
+        r=_mm_add_ps(r,_mm_mul_ps(a2,_mm_shuffle_ps(v,v,0xAA)));
+        r=_mm_add_ps(r,_mm_mul_ps(a3,_mm_shuffle_ps(v,v,0xFF)));
+        _mm_storeu_ps(dst+c*4,r);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t a0=vld1q_f32(a), a1=vld1q_f32(a+4), a2=vld1q_f32(a+8), a3=vld1q_f32(a+12);
+    for(int c=0;c<4;c++){
+        float b0=b[c*4],b1=b[c*4+1],b2=b[c*4+2],b3=b[c*4+3];
+        float32x4_t r=vmulq_n_f32(a0,b0);
+        r=vmlaq_n_f32(r,a1,b1); r=vmlaq_n_f32(r,a2,b2); r=vmlaq_n_f32(r,a3,b3);
+        vst1q_f32(dst+c*4,r);
+    }
+#else
     mat4 t;
     for(int c=0;c<4;c++) for(int r=0;r<4;r++){
         t[c*4+r]=0;
         for(int k=0;k<4;k++) t[c*4+r]+=a[k*4+r]*b[c*4+k];
     }
     memcpy(dst,t,64);
+#endif
 }
 
 static void m4_perspective(mat4 m, float fov_rad, float aspect, float n, float f) {
@@ -94,6 +156,14 @@ static void  v3_lerp(vec3 r,const vec3 a,const vec3 b,float t){
     r[0]=a[0]+(b[0]-a[0])*t; r[1]=a[1]+(b[1]-a[1])*t; r[2]=a[2]+(b[2]-a[2])*t;
 }
 
+/* 法線行列 (列優先 3×3)。余因子行列 = det·逆転置 なので割り算は要らず、
+ * 向きだけ det の符号で揃える (シェーダーで正規化する前提。非一様スケール可) */
+static void m4_normal(float nm[9], const mat4 m) {
+    const float *a=m, *b=m+4, *c=m+8;
+    v3_cross(nm,b,c); v3_cross(nm+3,c,a); v3_cross(nm+6,a,b);
+    if(v3_dot(a,nm)<0.f) for(int k=0;k<9;k++) nm[k]=-nm[k];
+}
+
 static void m4_lookat(mat4 m, const vec3 eye, const vec3 at, const vec3 up_hint) {
     vec3 f,s,u;
     v3_sub(f,at,eye); v3_norm(f);
@@ -106,28 +176,57 @@ static void m4_lookat(mat4 m, const vec3 eye, const vec3 at, const vec3 up_hint)
     m[12]=-v3_dot(s,eye); m[13]=-v3_dot(u,eye); m[14]=v3_dot(f,eye); m[15]=1.f;
 }
 
-static void m4_normal(float nm[9], const mat4 m) {
-    nm[0]=m[0]; nm[1]=m[1]; nm[2]=m[2];
-    nm[3]=m[4]; nm[4]=m[5]; nm[5]=m[6];
-    nm[6]=m[8]; nm[7]=m[9]; nm[8]=m[10];
-}
-
 static void m4_trs(mat4 out,
     float px,float py,float pz,
     float rx,float ry,float rz,
     float sx,float sy,float sz)
 {
+    /* T * (Ry*Rx*Rz) * S を展開したもの */
     float cx=cosf(DEG2RAD(rx)),sx_=sinf(DEG2RAD(rx));
     float cy=cosf(DEG2RAD(ry)),sy_=sinf(DEG2RAD(ry));
     float cz=cosf(DEG2RAD(rz)),sz_=sinf(DEG2RAD(rz));
-    mat4 T,S,Rx,Ry,Rz,R,tmp;
-    m4_id(T); T[12]=px; T[13]=py; T[14]=pz;
-    m4_id(S); S[0]=sx; S[5]=sy; S[10]=sz;
-    m4_id(Rx); Rx[5]=cx; Rx[6]=-sx_; Rx[9]=sx_; Rx[10]=cx;
-    m4_id(Ry); Ry[0]=cy; Ry[2]=sy_; Ry[8]=-sy_; Ry[10]=cy;
-    m4_id(Rz); Rz[0]=cz; Rz[1]=sz_; Rz[4]=-sz_; Rz[5]=cz;
-    m4_mul(tmp,Ry,Rx); m4_mul(R,tmp,Rz);
-    m4_mul(tmp,R,S);   m4_mul(out,T,tmp);
+    float ss=sy_*sx_, cs=cy*sx_;
+    out[0]=(cy*cz+ss*sz_)*sx;  out[1]=cx*sz_*sx; out[2] =(sy_*cz-cs*sz_)*sx;  out[3]=0.f;
+    out[4]=(ss*cz-cy*sz_)*sy;  out[5]=cx*cz*sy;  out[6] =(-sy_*sz_-cs*cz)*sy; out[7]=0.f;
+    out[8]=-sy_*cx*sz;         out[9]=sx_*sz;    out[10]=cy*cx*sz;            out[11]=0.f;
+    out[12]=px; out[13]=py; out[14]=pz; out[15]=1.f;
+}
+
+/* AABB を行列で変換 (8 頂点を包む AABB)。中心を変換し、半径は |M| で広げる
+ * (Arvo の方法。アフィン変換なら 8 頂点版と同じ箱になる) */
+static ENG_3D_AABB aabb_mat_internal(ENG_3D_AABB aabb,const mat4 M){
+    ENG_3D_AABB out;
+    float c[3],e[3];
+    for(int k=0;k<3;k++){
+        c[k]=0.5f*aabb.min[k]+0.5f*aabb.max[k];     /* 空の箱 (±FLT_MAX) でも溢れない */
+        e[k]=0.5f*aabb.max[k]-0.5f*aabb.min[k];
+    }
+#if defined(__SSE__)||defined(_M_X64)
+    const __m128 sign=_mm_set1_ps(-0.f);
+    __m128 m0=_mm_loadu_ps(M), m1=_mm_loadu_ps(M+4), m2=_mm_loadu_ps(M+8), m3=_mm_loadu_ps(M+12);
+    __m128 wc=_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0,_mm_set1_ps(c[0])),_mm_mul_ps(m1,_mm_set1_ps(c[1]))),
+                         _mm_add_ps(_mm_mul_ps(m2,_mm_set1_ps(c[2])),m3));
+    __m128 we=_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign,m0),_mm_set1_ps(e[0])),
+                                    _mm_mul_ps(_mm_andnot_ps(sign,m1),_mm_set1_ps(e[1]))),
+                         _mm_mul_ps(_mm_andnot_ps(sign,m2),_mm_set1_ps(e[2])));
+    float lo[4],hi[4];
+    _mm_storeu_ps(lo,_mm_sub_ps(wc,we)); _mm_storeu_ps(hi,_mm_add_ps(wc,we));
+#elif defined(__ARM_NEON)
+    float32x4_t m0=vld1q_f32(M), m1=vld1q_f32(M+4), m2=vld1q_f32(M+8), m3=vld1q_f32(M+12);
+    float32x4_t wc=vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(m3,m0,c[0]),m1,c[1]),m2,c[2]);
+    float32x4_t we=vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vabsq_f32(m0),e[0]),vabsq_f32(m1),e[1]),vabsq_f32(m2),e[2]);
+    float lo[4],hi[4];
+    vst1q_f32(lo,vsubq_f32(wc,we)); vst1q_f32(hi,vaddq_f32(wc,we));
+#else
+    float lo[3],hi[3];
+    for(int r=0;r<3;r++){
+        float wc=M[r]*c[0]+M[4+r]*c[1]+M[8+r]*c[2]+M[12+r];
+        float we=fabsf(M[r])*e[0]+fabsf(M[4+r])*e[1]+fabsf(M[8+r])*e[2];
+        lo[r]=wc-we; hi[r]=wc+we;
+    }
+#endif
+    for(int k=0;k<3;k++){ out.min[k]=lo[k]; out.max[k]=hi[k]; }
+    return out;
 }
 
 /* AABB をワールド変換 */
@@ -137,32 +236,110 @@ static ENG_3D_AABB aabb_transform_internal(ENG_3D_AABB aabb,
     float sx,float sy,float sz)
 {
     mat4 M; m4_trs(M,px,py,pz,rx,ry,rz,sx,sy,sz);
-    float corners[8][3];
-    float mins[3]={aabb.min[0],aabb.min[1],aabb.min[2]};
-    float maxs[3]={aabb.max[0],aabb.max[1],aabb.max[2]};
-    for(int i=0;i<8;i++){
-        corners[i][0]=(i&1)?maxs[0]:mins[0];
-        corners[i][1]=(i&2)?maxs[1]:mins[1];
-        corners[i][2]=(i&4)?maxs[2]:mins[2];
+    return aabb_mat_internal(aabb,M);
+}
+
+/* 視錐台 6 平面を VP 行列から抽出 (ax+by+cz+d>=0 が内側) */
+static void frustum_from_mat(float pl[6][4],const mat4 m){
+    for(int i=0;i<6;i++){
+        int row=i>>1; float s=(i&1)?-1.f:1.f;
+        for(int k=0;k<4;k++) pl[i][k]=m[k*4+3]+s*m[k*4+row];
+        float l=sqrtf(pl[i][0]*pl[i][0]+pl[i][1]*pl[i][1]+pl[i][2]*pl[i][2]);
+        if(l>1e-8f) for(int k=0;k<4;k++) pl[i][k]/=l;
     }
-    ENG_3D_AABB out;
-    out.min[0]=out.min[1]=out.min[2]=FLT_MAX;
-    out.max[0]=out.max[1]=out.max[2]=-FLT_MAX;
-    for(int i=0;i<8;i++){
-        float wx=M[0]*corners[i][0]+M[4]*corners[i][1]+M[8] *corners[i][2]+M[12];
-        float wy=M[1]*corners[i][0]+M[5]*corners[i][1]+M[9] *corners[i][2]+M[13];
-        float wz=M[2]*corners[i][0]+M[6]*corners[i][1]+M[10]*corners[i][2]+M[14];
-        if(wx<out.min[0])out.min[0]=wx; if(wx>out.max[0])out.max[0]=wx;
-        if(wy<out.min[1])out.min[1]=wy; if(wy>out.max[1])out.max[1]=wy;
-        if(wz<out.min[2])out.min[2]=wz; if(wz>out.max[2])out.max[2]=wz;
+}
+
+/* 各平面で最も内側の頂点だけを調べる。完全に外側なら false */
+static bool aabb_in_frustum(const float pl[6][4],const ENG_3D_AABB* b){
+    for(int i=0;i<6;i++){
+        float x=pl[i][0]>=0.f?b->max[0]:b->min[0];
+        float y=pl[i][1]>=0.f?b->max[1]:b->min[1];
+        float z=pl[i][2]>=0.f?b->max[2]:b->min[2];
+        if(pl[i][0]*x+pl[i][1]*y+pl[i][2]*z+pl[i][3]<0.f) return false;
     }
-    return out;
+    return true;
 }
 
 /* ══════════════════════════════════════════════════════
  * 内部構造体
  * ══════════════════════════════════════════════════════*/
 typedef struct { float p[3], n[3], uv[2], t[3]; } Vertex3D; /* pos/normal/uv/tangent */
+typedef struct { int16_t p[4], n[2], t[2]; uint16_t uv[2]; } PackedVertex3D;   /* 20 バイト */
+
+/* ── ジオメトリアリーナ: 頂点形式ごとの共有 VBO/EBO (単位は要素) ─*/
+typedef struct { uint32_t off, len; } Span3D;
+typedef struct { Span3D* span; int n, cap; uint32_t size; } FreeList3D;
+typedef struct {
+    unsigned int vao, vbo, ebo;
+    FreeList3D   verts, idx;
+} GeoArena3D;
+
+/* ── ジョブプール ─*/
+#define JOB_MAX_THREADS 8
+typedef void (*JobFn3D)(void* arg);
+typedef struct { JobFn3D fn; void* arg; SDL_atomic_t* group; } Job3D;
+typedef struct {
+    SDL_Thread* threads[JOB_MAX_THREADS];
+    int         n_threads;
+    SDL_mutex*  mtx;
+    SDL_cond*   cv;
+    SDL_cond*   done;           /* グループの残りが 0 になった通知 */
+    Job3D*      q;              /* リングバッファ */
+    int         head, count, cap;
+    bool        quit;
+} JobPool3D;
+
+/* ── ハンドルプール: ID → 実体 (handle_* 参照) ─*/
+#define HANDLE_SLOT_BITS 20
+#define HANDLE_SLOT_MASK ((1u<<HANDLE_SLOT_BITS)-1u)
+#define HANDLE_GEN_MAX   0x7FFu     /* 残り 11bit。ID は正の int に収まる */
+#define HANDLE_PAGE_MAX  6          /* 1 ページ最大 64 要素 */
+typedef struct { uint16_t gen; bool used; uint32_t next; } HandleSlot3D;   /* next: 空きリスト (スロット+1) */
+typedef struct {
+    size_t        elem;
+    int           page_bits;
+    uint8_t**     pages;
+    size_t        cap_pages;
+    HandleSlot3D* slots;
+    size_t        cap_slots;
+    uint32_t      n_slots, free_head;   /* free_head: スロット+1 (0=なし) */
+    int           live;
+} HandlePool3D;
+
+/* ── 非同期テクスチャ読込 ─*/
+#define TEX_PBO_RING  3
+#define TEX_PBO_BYTES (4*1024*1024)
+enum { TEXLOAD_QUEUED, TEXLOAD_DECODED, TEXLOAD_FAILED };
+typedef struct TexLoad3D TexLoad3D;   /* 本体は圧縮テクスチャ節 (TexSrc3D を持つ) */
+
+/* ── テクスチャプール: 同じ形のテクスチャを 2D 配列のレイヤーに集める ─*/
+#define TEX_POOL_MAX     16
+#define TEX_POOL_LAYERS  256     /* GL 3.3 の GL_MAX_ARRAY_TEXTURE_LAYERS 最低保証 */
+#define TEX_ATLAS_SIZE   1024
+#define TEX_ATLAS_ENTRY  256     /* これ以下で 2 冪でないものはアトラスへ */
+#define TEX_ATLAS_PAD    4       /* 端の複製幅 (ミップ 2 段まで隣に滲まない) */
+#define TEX_ATLAS_LEVELS 3
+typedef struct { uint16_t layer, x, y, h; } Shelf3D;   /* アトラスの棚 (x=次の空き) */
+typedef struct {
+    unsigned int tex;           /* GL_TEXTURE_2D_ARRAY */
+    bool         used, atlas;
+    int          fmt, w, h, levels;   /* 全レイヤー共通 (TEXFMT_*) */
+    int          cap;           /* 確保済みレイヤー数 */
+    uint16_t*    live;          /* レイヤー毎の使用数 (配列は 0/1, アトラスは矩形数) */
+    Shelf3D*     shelves;
+    int          n_shelves;
+    size_t       cap_shelves;
+} TexPool3D;
+
+typedef struct {
+    unsigned int gl;            /* GL_TEXTURE_2D (プールに入ったものは 0) */
+    uint8_t      state;         /* ENG_3D_TexStatus */
+    uint8_t      pool;          /* 0=単独, p+1=pools[p] のレイヤー */
+    uint16_t     layer;
+    float        progress;
+    int64_t      bytes;         /* VRAM の見積り */
+    float        rect[4];       /* UV 変換 xy=倍率 zw=オフセット */
+} Tex3D;
 
 typedef struct {
     unsigned int vao, vbo, ebo;
@@ -171,8 +348,19 @@ typedef struct {
     float        emissive[3]; float emissive_int;
     float        spec_intensity, shininess;
     int          tex_id, normal_map_id;
-    bool         wireframe, cast_shadow, receive_shadow, transparent, used;
+    bool         wireframe, cast_shadow, receive_shadow, transparent;
     ENG_3D_AABB  bounds;
+    bool         packed;                  /* 圧縮頂点 */
+    float        pos_scale[3], pos_bias[3];   /* 位置 = a*scale + bias (非圧縮は 1/0) */
+    int          flags;                   /* 構築フラグ ENG_3D_MESH_* (作成時に決まる) */
+    bool         optimized;               /* 頂点キャッシュ最適化済み */
+    float        acmr_before, acmr_after; /* 最適化前後の ACMR (不明は 0) */
+    /* LOD: EBO 内のインデックス範囲 (lod[0] は元の形) */
+    int          n_lods;
+    struct { uint32_t first, count; } lod[ENG_3D_MAX_LODS];
+    /* アリーナ上の区間 (in_arena 時。vbo/ebo は 0) */
+    bool         in_arena;
+    uint32_t     base_vertex, first_index, arena_indices;
 } Mesh3D;
 
 typedef struct { float x,y,z,r,g,b,radius; bool active; } PointLight3D;
@@ -201,18 +389,74 @@ typedef struct {
     float     color_s[4], color_e[4];
     float     size_s, size_e;
     int       tex_id;
-    bool      active, used;
+    bool      active;
     unsigned int vao, vbo;
 } Emitter3D;
 
-/* ── シーングラフ ─*/
+/* ── シーングラフ ─
+ * ノードの実体は SceneGraph3D の各列 (SoA) にあり、親が子より前に並ぶ。
+ * ハンドルプールは ID → 並び位置の対応だけを持つ */
 typedef struct SceneNode {
-    float       lpos[3], lrot[3], lscale[3];
-    ENG_3D_MeshID mesh;
-    int          parent;   /* -1=なし */
-    bool         active, used;
+    int idx;
 } SceneNode;
 
+#define NODE_ACTIVE      0x01
+#define NODE_LOCAL_DIRTY 0x02   /* 位置・回転・スケールが変わった */
+#define NODE_WORLD_DIRTY 0x04   /* 親が替わった */
+#define NODE_MOVED       0x08   /* 直前の更新でワールド行列が変わった (子へ伝える) */
+#define NODE_VISIBLE     0x10   /* 自身と祖先が全て有効 (描画・BVH 更新のたびに計算し直す) */
+#define NODE_BVH_DIRTY   0x20   /* 箱が変わり BVH の詰め直し待ち (bvh.dirty に載っている) */
+#define NODE_LOD_NONE    0xFF   /* lod 列: まだ段を選んでいない */
+#define SCENE_COLS       9
+
+/* ── シーン BVH (レイキャスト用) ─
+ * 全ノード行のワールド AABB の二分木。内部ノードの子は left と left+1 で、
+ * 親より後ろに置くので逆順に走れば下から詰め直せる */
+#define BVH_LEAF_MAX     4
+#define BVH_BINS         16
+#define BVH_DEPTH_MAX    64     /* 構築で打ち切る深さ = 走査スタックの上限 */
+#define BVH_REFIT_SLACK  1.5f   /* 詰め直しで SAH コストがこの倍を超えたら作り直す */
+#define BVH_REFIT_FULL   16     /* 印の付いた行数 × これが全行数を超えたら全体を一括で詰める */
+
+typedef struct {
+    float min[3]; int left;     /* 内部: 子の先頭 / 葉: prim の先頭 */
+    float max[3]; int count;    /* 0=内部 */
+} BvhNode3D;
+
+typedef struct {
+    BvhNode3D*   nodes; size_t cap_nodes; int n_nodes;
+    int*         prim;  size_t cap_prim;        /* 葉順の行番号 */
+    ENG_3D_AABB* pbox;  size_t cap_pbox;        /* prim と同じ並びのワールド AABB */
+    float*       cent;  size_t cap_cent;        /* 構築用: 重心 (3 float ずつ) */
+    int*         up;    size_t cap_up;          /* ノードの親 (根は -1) */
+    int*         slot;  size_t cap_slot;        /* 行 → prim/pbox の位置 */
+    int*         leaf;  size_t cap_leaf;        /* 行 → 入っている葉 */
+    int*         dirty; size_t cap_dirty;       /* 箱が変わった行 */
+    int          n_dirty;
+    float        cost_sum;                      /* SAH コスト × 根の面積 (詰め直しで差し替える) */
+    float        cost_built;                    /* 構築直後の SAH コスト */
+} SceneBVH3D;
+
+typedef struct {
+    int            n, cap;
+    ENG_3D_NodeID* id;
+    ENG_3D_NodeID* parent;      /* 0=なし (破棄済みの親もなし扱い) */
+    int*           pidx;        /* 親の並び位置 (-1=根)。order_dirty の間は古い */
+    ENG_3D_MeshID* mesh;
+    uint8_t*       flags;       /* NODE_* */
+    float        (*trs)[9];     /* 位置・回転 (度)・スケール */
+    mat4*          local;
+    mat4*          world;
+    uint8_t*       lod;         /* 前回選んだ LOD 段 (ヒステリシス用, NODE_LOD_NONE=未選択) */
+    int*           sort_tmp;    /* 並べ替え用: 深さ・順列・度数 (3cap+1) */
+    uint8_t*       scratch;     /* 並べ替え用: 1 列分 */
+    bool           order_dirty; /* 親子関係が変わった / 破棄で詰めた */
+    bool           dirty;       /* どこかに DIRTY がある */
+    SceneBVH3D     bvh;
+    bool           bvh_rebuild; /* 行が増えた・並びが変わった */
+    bool           vis_dirty;   /* 有効・親子が変わった (NODE_VISIBLE を計算し直す) */
+} SceneGraph3D;
+
 /* ── アニメーションキー ─*/
 typedef struct {
     float t;
@@ -224,35 +468,118 @@ typedef struct {
     AnimKey rot_keys[MAX_ANIM_KEYS];   int n_rot;
     AnimKey scale_keys[MAX_ANIM_KEYS]; int n_scale;
     float   time, duration;
-    bool    playing, loop, used;
+    bool    playing, loop;
     float   cur_pos[3], cur_rot[3], cur_scale[3];
 } Anim3D;
 
+/* ── 描画コマンド (eng3d_draw で記録しフラッシュ時にキー順で実行) ─*/
+typedef struct {
+    uint64_t      key;     /* draw_sort_key 参照 */
+    ENG_3D_MeshID mesh;
+    ENG_3D_TexID  tex;     /* アルベドの差し替え (0=メッシュのもの) */
+    int           lod;
+    uint8_t       cascades;   /* 入っているライト視錐台のビット (影を落とさないなら 0) */
+    mat4          model;
+} DrawCmd3D;
+
+typedef struct {
+    uint64_t key;
+    uint32_t idx;          /* draws[] のインデックス */
+} DrawSort3D;
+
+/* ── フレーム内の区切り (スカイボックス・パーティクル)。eng3d_end で
+ *    それより前に記録された描画を流した直後に実行する ─*/
+enum { FRAME_OP_SKYBOX, FRAME_OP_PARTICLES };
+typedef struct {
+    int              type;
+    int              end;        /* 区切りの時点の n_draws */
+    ENG_3D_EmitterID emitter;
+    size_t           first;      /* fx_data 内の先頭 (float) */
+    int              count;      /* 粒子数 (8 float/個) */
+} FrameOp3D;
+
+/* ── シェーダープログラム + uniform ロケーションキャッシュ ─*/
+enum {
+    U_COLOR, U_EMISSIVE, U_EMISSIVE_INT, U_SPEC_INT, U_SHININESS,
+    U_ALBEDO, U_NORMAL_MAP, U_SHADOW_MAP, U_HAS_TEX, U_HAS_NM, U_HAS_SHADOW,
+    U_CASCADE, U_SKYBOX, U_IMAGE, U_HORIZONTAL, U_SCENE, U_BLOOM, U_THRESHOLD, U_INTENSITY,
+    U_TEX, U_POS_SCALE, U_POS_BIAS, U_PACKED,
+    U_ALBEDO_ARR, U_NORMAL_ARR, U_NM_RECT, U_NM_LAYER,
+    U_COUNT
+};
+static const char* const UNIFORM_NAMES[U_COUNT]={
+    "uColor","uEmissive","uEmissiveInt","uSpecInt","uShininess",
+    "uAlbedo","uNormalMap","uShadowMap","uHasTex","uHasNM","uHasShadow",
+    "uCascade","uSkybox","uImage","uHorizontal","uScene","uBloom","uThreshold","uIntensity",
+    "uTex","uPosScale","uPosBias","uPacked",
+    "uAlbedoArr","uNormalArr","uNmRect","uNmLayer",
+};
+typedef struct {
+    unsigned int id;
+    int          loc[U_COUNT];
+} Program3D;
+
+/* ── フレーム共通 UBO (GLSL_FRAME_BLOCK と同じ std140 レイアウト) ─*/
+typedef struct {
+    float view[16], proj[16], light_space[ENG_3D_MAX_CASCADES][16];
+    float cam_pos[4], ambient[4], dir_dir[4], dir_col[4];
+    float pt_pos[ENG_3D_MAX_LIGHTS][4], pt_col[ENG_3D_MAX_LIGHTS][4];
+    float sp_pos[ENG_3D_MAX_SPOTS][4], sp_dir[ENG_3D_MAX_SPOTS][4], sp_col[ENG_3D_MAX_SPOTS][4];
+    float fog_color[4], fog_range[4];
+    float cascade_splits[4];
+    int   counts[4];
+} FrameUBO;
+
+/* GPU タイマー (GL_TIME_ELAPSED)。パスは 1 フレームに何度も開閉されうるので
+ * 区間毎にクエリを取り、読み出し時にパス別に合算する */
+enum { GPU_PASS_SHADOW, GPU_PASS_MAIN, GPU_PASS_PARTICLE, GPU_PASS_POST, GPU_PASS_COUNT };
+typedef struct {
+    unsigned int q[GPU_TIMER_SLOTS];
+    uint8_t      pass[GPU_TIMER_SLOTS];
+    int          n;
+} GpuFrame3D;
+
 struct ENG_3D {
     SDL_Window*   window;
     SDL_GLContext gl_ctx;
     int           w, h;
+#ifdef ENG3D_HAVE_EGL
+    EGLDisplay    egl_dpy;      /* ヘッドレス (EGL) の時のみ */
+    EGLContext    egl_ctx;
+#endif
+    /* ヘッドレス: 画面の代わりに描く FBO (ウィンドウ時は 0) */
+    bool          headless;
+    unsigned int  target_fbo, target_color_rbo, target_depth_rbo;
 
     /* カメラ */
     vec3  cam_pos, cam_target;
     float fov, near_z, far_z;
     mat4  mat_proj, mat_view;
+    float frustum[6][4];        /* eng3d_begin で更新 */
+    bool  cull_on;
+    int   n_culled;             /* 今フレームでカリングされた描画数 */
+    /* LOD: 画面高さに対する境界球の直径がこれ未満なら段 k+1 */
+    float lod_screen[ENG_3D_MAX_LODS-1], lod_hyst;
+    float lod_proj;             /* 1/tan(fov/2)。eng3d_begin で更新 */
     /* 前frame のキー状態 (KeyDown/Up 判定用) */
     uint8_t prev_keys[SDL_NUM_SCANCODES];
 
     /* シェーダー (Phong + 法線マップ + シャドウ) */
-    unsigned int shader_main;
+    Program3D    shader_main;
     /* シャドウパス */
-    unsigned int shader_shadow;
+    Program3D    shader_shadow;
     unsigned int shadow_fbo, shadow_depth_tex;
     bool         shadow_on;
-    float        shadow_bias, shadow_ortho;
-    mat4         mat_light_space;
+    float        shadow_bias, shadow_dist;
+    int          shadow_cascades;
+    mat4         mat_light_space[ENG_3D_MAX_CASCADES];
+    float        light_frustum[ENG_3D_MAX_CASCADES][6][4];
+    float        cascade_splits[ENG_3D_MAX_CASCADES];   /* 各段の奥側ビュー深度 */
 
     /* ブルーム FBO */
     unsigned int bloom_fbo, bloom_color_tex, bloom_depth_rbo;
     unsigned int bloom_fbo2, bloom_color_tex2;
-    unsigned int shader_blur, shader_combine;
+    Program3D    shader_blur, shader_combine;
     unsigned int quad_vao, quad_vbo;
     bool         bloom_on;
     float        bloom_threshold, bloom_intensity;
@@ -260,7 +587,7 @@ struct ENG_3D {
     /* スカイボックス */
     unsigned int skybox_vao, skybox_vbo;
     unsigned int skybox_cubemap;
-    unsigned int shader_skybox;
+    Program3D    shader_skybox;
     bool         skybox_on;
 
     /* ライティング */
@@ -276,19 +603,64 @@ struct ENG_3D {
     bool  fog_on;
 
     /* メッシュ / テクスチャ */
-    Mesh3D       meshes  [ENG_3D_MAX_MESHES];
-    unsigned int textures[ENG_3D_MAX_TEXTURES];
-    bool         tex_used[ENG_3D_MAX_TEXTURES];
+    HandlePool3D meshes;                             /* Mesh3D */
+    HandlePool3D textures;                           /* Tex3D */
+    unsigned     tex_caps;                           /* 1<<TEXFMT_* = GL がそのまま扱える */
+    bool         tex_compress;                       /* PNG/JPG を BC に変換してキャッシュ */
+    TexPool3D    pools[TEX_POOL_MAX];
+    bool         tex_pooling;                        /* 以降の読込をプールへ */
+
+    /* 非同期テクスチャ読込 */
+    JobPool3D    jobs;
+    TexLoad3D**  tex_loads;
+    int          n_tex_loads;
+    size_t       cap_tex_loads;
+    int          tex_budget;                         /* 1 フレームの転送上限 (バイト) */
+    unsigned int pbo[TEX_PBO_RING];
+    int          pbo_next;
 
     /* パーティクル */
-    Emitter3D    emitters[ENG_3D_MAX_EMITTERS];
-    unsigned int shader_particle;
+    HandlePool3D emitters;                           /* Emitter3D */
+    Program3D    shader_particle;
+
+    /* フレーム共通 UBO (内容が変わった時だけ転送) */
+    unsigned int frame_ubo;
+    FrameUBO     frame_data;
+    bool         frame_valid;
 
     /* シーングラフ */
-    SceneNode    nodes[ENG_3D_MAX_NODES];
+    HandlePool3D nodes;                              /* SceneNode */
+    SceneGraph3D scene;
 
     /* アニメーション */
-    Anim3D       anims[ENG_3D_MAX_ANIMS];
+    HandlePool3D anims;                              /* Anim3D */
+
+    /* 描画キュー (フレーム単位) */
+    DrawCmd3D*   draws;
+    int          n_draws, cap_draws;
+    DrawSort3D*  sort_buf;      /* ソート用 (cap_sort × 2: 本体 + 作業領域) */
+    int          cap_sort;
+    unsigned int inst_vbo;      /* インスタンス行列 (ソート順) */
+    float*       inst_data;
+    int          cap_inst;
+    FrameOp3D*   ops;           /* 区切り (記録順) */
+    size_t       n_ops, cap_ops;
+    float*       fx_data;       /* パーティクルの頂点 (区切りから参照) */
+    size_t       n_fx, cap_fx;
+
+    /* GPU タイマー */
+    GpuFrame3D   gpu_frames[GPU_TIMER_FRAMES];
+    int          gpu_frame;     /* 今フレームが書き込むリング位置 */
+    bool         gpu_open;      /* クエリ区間が開いている */
+    ENG_3D_GpuStats gpu_stats;
+
+    /* フレーム統計 (eng3d_begin で 0 に戻し eng3d_end で確定) */
+    ENG_3D_FrameStats stats, stats_last;
+
+    /* OBJ の .e3dm キャッシュ (既定 ON) */
+    bool         obj_cache_off;
+    int          mesh_flags;    /* 以降に作るメッシュの ENG_3D_MESH_* */
+    GeoArena3D   arena[2];      /* [0]=float 頂点, [1]=圧縮頂点 */
 
     /* 入力 */
     const uint8_t* keys;
@@ -307,41 +679,82 @@ struct ENG_3D {
  * シェーダーソース
  * ══════════════════════════════════════════════════════*/
 
+/* ── フレーム共通 UBO (std140, binding=0) ─
+ *   カメラ / ライト / フォグ / シャドウ。FrameUBO と同じ並びにすること */
+#define FRAME_UBO_BINDING 0
+#define GLSL_FRAME_BLOCK \
+"layout(std140) uniform Frame {\n" \
+"  mat4  uView;\n" \
+"  mat4  uProj;\n" \
+"  mat4  uLightSpace[4];\n"   /* カスケード毎 */ \
+"  vec4  uCamPos;\n" \
+"  vec4  uAmbient;\n" \
+"  vec4  uDirDir;\n" \
+"  vec4  uDirCol;\n" \
+"  vec4  uPtPos[8];\n"     /* xyz=位置 w=半径 */ \
+"  vec4  uPtCol[8];\n" \
+"  vec4  uSpPos[4];\n"     /* xyz=位置 w=半径 */ \
+"  vec4  uSpDir[4];\n"     /* xyz=方向 w=cutoff cos */ \
+"  vec4  uSpCol[4];\n"     /* rgb=色   w=outer cos */ \
+"  vec4  uFogColor;\n"     /* rgb=色   w=密度 */ \
+"  vec4  uFogRange;\n"     /* x=start y=end z=シャドウバイアス */ \
+"  vec4  uCascadeSplits;\n" /* 各カスケードの奥側ビュー深度 */ \
+"  ivec4 uCounts;\n"       /* x=点光源数 y=スポット数 z=フォグモード w=カスケード数 */ \
+"};\n"
+
 /* ── メインシェーダー 頂点 ─*/
 static const char* VERT_MAIN =
 "#version 330 core\n"
+GLSL_FRAME_BLOCK
 "layout(location=0) in vec3 aPos;\n"
-"layout(location=1) in vec3 aNormal;\n"
+"layout(location=1) in vec3 aNormal;\n"     /* 圧縮時は八面体 (xy) */
 "layout(location=2) in vec2 aUV;\n"
-"layout(location=3) in vec3 aTangent;\n"
-"uniform mat4 uMVP;\n"
-"uniform mat4 uModel;\n"
-"uniform mat3 uNM;\n"       /* 法線行列 */
-"uniform mat4 uLightSpace;\n"
+"layout(location=3) in vec3 aTangent;\n"    /* 同上 */
+"layout(location=4) in mat4 aModel;\n"   /* インスタンス毎 (4..7) */
+"layout(location=8) in vec4 aTexRect;\n"    /* プールの UV 矩形 xy=倍率 zw=オフセット */
+"layout(location=9) in float aTexLayer;\n"
+"layout(location=10) in mat3 aNormalMat;\n"  /* インスタンス毎の法線行列 (10..12) */
+"uniform vec3 uPosScale;\n"
+"uniform vec3 uPosBias;\n"
+"uniform int  uPacked;\n"
 "out vec3 vFragPos;\n"
 "out vec2 vUV;\n"
-"out vec4 vFragPosLS;\n"    /* ライト空間 */
+"out float vViewZ;\n"        /* カスケード選択用 */
 "out mat3 vTBN;\n"
+"out vec4 vTexRect;\n"
+"flat out float vTexLayer;\n"
+"vec3 octDecode(vec2 e){\n"
+"  vec3 v=vec3(e,1.0-abs(e.x)-abs(e.y));\n"
+"  if(v.z<0.0) v.xy=(1.0-abs(v.yx))*vec2(v.x>=0.0?1.0:-1.0,v.y>=0.0?1.0:-1.0);\n"
+"  return v;\n"
+"}\n"
 "void main(){\n"
-"  vec4 wPos=uModel*vec4(aPos,1.0);\n"
+"  vec4 wPos=aModel*vec4(aPos*uPosScale+uPosBias,1.0);\n"
+"  vec3 n=uPacked!=0?octDecode(aNormal.xy):aNormal;\n"
+"  vec3 t=uPacked!=0?octDecode(aTangent.xy):aTangent;\n"
 "  vFragPos=wPos.xyz;\n"
 "  vUV=aUV;\n"
-"  vFragPosLS=uLightSpace*wPos;\n"
-"  vec3 T=normalize(uNM*aTangent);\n"
-"  vec3 N=normalize(uNM*aNormal);\n"
+"  vTexRect=aTexRect;\n"
+"  vTexLayer=aTexLayer;\n"
+"  vViewZ=-(uView*wPos).z;\n"
+"  vec3 T=normalize(aNormalMat*t);\n"
+"  vec3 N=normalize(aNormalMat*n);\n"
 "  T=normalize(T-dot(T,N)*N);\n"
 "  vec3 B=cross(N,T);\n"
 "  vTBN=mat3(T,B,N);\n"
-"  gl_Position=uMVP*vec4(aPos,1.0);\n"
+"  gl_Position=uProj*uView*wPos;\n"
 "}\n";
 
 /* ── メインシェーダー フラグメント ─*/
 static const char* FRAG_MAIN =
 "#version 330 core\n"
+GLSL_FRAME_BLOCK
 "in vec3 vFragPos;\n"
 "in vec2 vUV;\n"
-"in vec4 vFragPosLS;\n"
+"in float vViewZ;\n"
 "in mat3 vTBN;\n"
+"in vec4 vTexRect;\n"
+"flat in float vTexLayer;\n"
 "out vec4 FragColor;\n"
 "uniform vec4  uColor;\n"
 "uniform vec3  uEmissive;\n"
@@ -350,95 +763,85 @@ static const char* FRAG_MAIN =
 "uniform float uShininess;\n"
 "uniform sampler2D uAlbedo;\n"
 "uniform sampler2D uNormalMap;\n"
-"uniform sampler2D uShadowMap;\n"
-"uniform int   uHasTex;\n"
-"uniform int   uHasNM;\n"
+"uniform sampler2DArray uShadowMap;\n"
+"uniform sampler2DArray uAlbedoArr;\n"
+"uniform sampler2DArray uNormalArr;\n"
+"uniform int   uHasTex;\n"     /* 0=なし 1=2D 2=プール */
+"uniform int   uHasNM;\n"      /* 同上 */
+"uniform vec4  uNmRect;\n"
+"uniform float uNmLayer;\n"
 "uniform int   uHasShadow;\n"
-"uniform float uShadowBias;\n"
-"uniform vec3  uCamPos;\n"
-"uniform vec3  uAmbient;\n"
-"uniform vec3  uDirDir;\n"
-"uniform vec3  uDirCol;\n"
-"/* point lights */\n"
-"uniform vec3  uPtPos[8];\n"
-"uniform vec3  uPtCol[8];\n"
-"uniform float uPtRad[8];\n"
-"uniform int   uPtCount;\n"
-"/* spot lights */\n"
-"uniform vec3  uSpPos[4];\n"
-"uniform vec3  uSpDir[4];\n"
-"uniform vec3  uSpCol[4];\n"
-"uniform float uSpRad[4];\n"
-"uniform float uSpCut[4];\n"
-"uniform float uSpOut[4];\n"
-"uniform int   uSpCount;\n"
-"/* fog */\n"
-"uniform int   uFogMode;\n"
-"uniform vec3  uFogColor;\n"
-"uniform float uFogStart;\n"
-"uniform float uFogEnd;\n"
-"uniform float uFogDensity;\n"
 "\n"
-"float shadow(vec4 ls, vec3 N, vec3 L){\n"
+"float shadow(vec3 N, vec3 L){\n"
 "  if(uHasShadow==0) return 0.0;\n"
+"  int c=0;\n"
+"  while(c<uCounts.w && vViewZ>uCascadeSplits[c]) c++;\n"
+"  if(c>=uCounts.w) return 0.0;\n"   /* 影の届く距離より奥 */
+"  vec4 ls=uLightSpace[c]*vec4(vFragPos,1.0);\n"
 "  vec3 pc=ls.xyz/ls.w*0.5+0.5;\n"
 "  if(pc.z>1.0) return 0.0;\n"
-"  float bias=max(uShadowBias*8.0*(1.0-dot(N,L)),uShadowBias);\n"
+"  float bias=max(uFogRange.z*8.0*(1.0-dot(N,L)),uFogRange.z)*float(c+1);\n"
 "  float shadow=0.0;\n"
-"  vec2 texelSize=1.0/vec2(textureSize(uShadowMap,0));\n"
+"  vec2 texelSize=1.0/vec2(textureSize(uShadowMap,0).xy);\n"
 "  for(int x=-1;x<=1;x++) for(int y=-1;y<=1;y++){\n"
-"    float d=texture(uShadowMap,pc.xy+vec2(x,y)*texelSize).r;\n"
+"    float d=texture(uShadowMap,vec3(pc.xy+vec2(x,y)*texelSize,float(c))).r;\n"
 "    shadow+=(pc.z-bias>d)?1.0:0.0;\n"
 "  }\n"
 "  return shadow/9.0;\n"
 "}\n"
 "\n"
+/* プールの参照。アトラスは fract で繰り返し、ミップは折り返す前の UV の微分で選ぶ */
+"vec4 poolTex(sampler2DArray s,vec4 r,float layer){\n"
+"  return textureGrad(s,vec3(fract(vUV)*r.xy+r.zw,layer),dFdx(vUV)*r.xy,dFdy(vUV)*r.xy);\n"
+"}\n"
+"\n"
 "void main(){\n"
-"  vec3 base=(uHasTex!=0)?texture(uAlbedo,vUV).rgb:uColor.rgb;\n"
+"  vec3 base=uHasTex==2?poolTex(uAlbedoArr,vTexRect,vTexLayer).rgb\n"
+"           :uHasTex!=0?texture(uAlbedo,vUV).rgb:uColor.rgb;\n"
 "  vec3 N;\n"
 "  if(uHasNM!=0){\n"
-"    N=texture(uNormalMap,vUV).rgb*2.0-1.0;\n"
+"    N=(uHasNM==2?poolTex(uNormalArr,uNmRect,uNmLayer).rgb:texture(uNormalMap,vUV).rgb)*2.0-1.0;\n"
 "    N=normalize(vTBN*N);\n"
 "  } else { N=normalize(vTBN[2]); }\n"
-"  vec3 V=normalize(uCamPos-vFragPos);\n"
+"  vec3 V=normalize(uCamPos.xyz-vFragPos);\n"
 "\n"
 "  /* 方向ライト */\n"
-"  vec3 L=normalize(-uDirDir);\n"
+"  vec3 L=normalize(-uDirDir.xyz);\n"
 "  float diff=max(dot(N,L),0.0);\n"
 "  vec3 H=normalize(L+V);\n"
 "  float spec=pow(max(dot(N,H),0.0),uShininess)*uSpecInt;\n"
-"  float sh=shadow(vFragPosLS,N,L);\n"
-"  vec3 lighting=uAmbient+(diff*uDirCol+spec*uDirCol)*(1.0-sh*0.8);\n"
+"  float sh=shadow(N,L);\n"
+"  vec3 lighting=uAmbient.rgb+(diff*uDirCol.rgb+spec*uDirCol.rgb)*(1.0-sh*0.8);\n"
 "\n"
 "  /* ポイントライト */\n"
-"  for(int i=0;i<uPtCount;i++){\n"
-"    vec3 PL=uPtPos[i]-vFragPos;\n"
+"  for(int i=0;i<uCounts.x;i++){\n"
+"    vec3 PL=uPtPos[i].xyz-vFragPos;\n"
 "    float dist=length(PL);\n"
-"    if(dist<uPtRad[i]){\n"
-"      float att=clamp(1.0-dist/uPtRad[i],0.0,1.0);\n"
+"    if(dist<uPtPos[i].w){\n"
+"      float att=clamp(1.0-dist/uPtPos[i].w,0.0,1.0);\n"
 "      att*=att;\n"
 "      vec3 PL_n=normalize(PL);\n"
 "      float pd=max(dot(N,PL_n),0.0)*att;\n"
 "      vec3 PH=normalize(PL_n+V);\n"
 "      float ps=pow(max(dot(N,PH),0.0),uShininess)*uSpecInt*att;\n"
-"      lighting+=pd*uPtCol[i]+ps*uPtCol[i];\n"
+"      lighting+=pd*uPtCol[i].rgb+ps*uPtCol[i].rgb;\n"
 "    }\n"
 "  }\n"
 "\n"
 "  /* スポットライト */\n"
-"  for(int i=0;i<uSpCount;i++){\n"
-"    vec3 SL=uSpPos[i]-vFragPos;\n"
+"  for(int i=0;i<uCounts.y;i++){\n"
+"    vec3 SL=uSpPos[i].xyz-vFragPos;\n"
 "    float dist=length(SL);\n"
-"    if(dist<uSpRad[i]){\n"
+"    if(dist<uSpPos[i].w){\n"
 "      vec3 SL_n=normalize(SL);\n"
-"      float theta=dot(SL_n,normalize(-uSpDir[i]));\n"
-"      float eps=uSpCut[i]-uSpOut[i];\n"
-"      float intensity=clamp((theta-uSpOut[i])/eps,0.0,1.0);\n"
-"      float att=clamp(1.0-dist/uSpRad[i],0.0,1.0); att*=att;\n"
+"      float theta=dot(SL_n,normalize(-uSpDir[i].xyz));\n"
+"      float eps=uSpDir[i].w-uSpCol[i].w;\n"
+"      float intensity=clamp((theta-uSpCol[i].w)/eps,0.0,1.0);\n"
+"      float att=clamp(1.0-dist/uSpPos[i].w,0.0,1.0); att*=att;\n"
 "      float sd=max(dot(N,SL_n),0.0)*att*intensity;\n"
 "      vec3 SH=normalize(SL_n+V);\n"
 "      float ss=pow(max(dot(N,SH),0.0),uShininess)*uSpecInt*att*intensity;\n"
-"      lighting+=sd*uSpCol[i]+ss*uSpCol[i];\n"
+"      lighting+=sd*uSpCol[i].rgb+ss*uSpCol[i].rgb;\n"
 "    }\n"
 "  }\n"
 "\n"
@@ -446,14 +849,14 @@ static const char* FRAG_MAIN =
 "  vec3 final_color=clamp(lighting,0.0,1.0)*base+emissive;\n"
 "\n"
 "  /* フォグ */\n"
-"  if(uFogMode>0){\n"
-"    float dist=length(uCamPos-vFragPos);\n"
+"  if(uCounts.z>0){\n"
+"    float dist=length(uCamPos.xyz-vFragPos);\n"
 "    float factor=0.0;\n"
-"    if(uFogMode==1) factor=1.0-exp(-uFogDensity*dist);\n"
-"    else            factor=1.0-exp(-uFogDensity*uFogDensity*dist*dist);\n"
+"    if(uCounts.z==1) factor=1.0-exp(-uFogColor.w*dist);\n"
+"    else             factor=1.0-exp(-uFogColor.w*uFogColor.w*dist*dist);\n"
 "    factor=clamp(factor,0.0,1.0);\n"
-"    final_color=mix(final_color,uFogColor,factor);\n"
-"  } else if(uFogMode==0 && uFogEnd>uFogStart){\n"
+"    final_color=mix(final_color,uFogColor.rgb,factor);\n"
+"  } else if(uCounts.z==0 && uFogRange.y>uFogRange.x){\n"
 "    /* linear fog は fogMode==-1 を使わず別扱いにするため ここには来ない */\n"
 "  }\n"
 "  FragColor=vec4(final_color,uColor.a);\n"
@@ -462,10 +865,13 @@ static const char* FRAG_MAIN =
 /* ── シャドウパス 頂点 ─*/
 static const char* VERT_SHADOW =
 "#version 330 core\n"
+GLSL_FRAME_BLOCK
 "layout(location=0) in vec3 aPos;\n"
-"uniform mat4 uLightSpace;\n"
-"uniform mat4 uModel;\n"
-"void main(){ gl_Position=uLightSpace*uModel*vec4(aPos,1.0); }\n";
+"layout(location=4) in mat4 aModel;\n"
+"uniform int uCascade;\n"
+"uniform vec3 uPosScale;\n"
+"uniform vec3 uPosBias;\n"
+"void main(){ gl_Position=uLightSpace[uCascade]*aModel*vec4(aPos*uPosScale+uPosBias,1.0); }\n";
 
 static const char* FRAG_SHADOW =
 "#version 330 core\n"
@@ -474,13 +880,12 @@ static const char* FRAG_SHADOW =
 /* ── スカイボックス ─*/
 static const char* VERT_SKY =
 "#version 330 core\n"
+GLSL_FRAME_BLOCK
 "layout(location=0) in vec3 aPos;\n"
 "out vec3 vTexCoord;\n"
-"uniform mat4 uView;\n"
-"uniform mat4 uProj;\n"
 "void main(){\n"
 "  vTexCoord=aPos;\n"
-"  vec4 pos=uProj*uView*vec4(aPos,1.0);\n"
+"  vec4 pos=uProj*mat4(mat3(uView))*vec4(aPos,1.0);\n"
 "  gl_Position=pos.xyww;\n"
 "}\n";
 
@@ -489,9 +894,6 @@ static const char* FRAG_SKY =
 "in vec3 vTexCoord;\n"
 "out vec4 FragColor;\n"
 "uniform samplerCube uSkybox;\n"
-"uniform vec3 uFogColor;\n"
-"uniform float uFogDensity;\n"
-"uniform int uHasFog;\n"
 "void main(){\n"
 "  vec3 c=texture(uSkybox,vTexCoord).rgb;\n"
 "  FragColor=vec4(c,1.0);\n"
@@ -547,14 +949,13 @@ static const char* FRAG_COMBINE =
 /* ── パーティクルシェーダー ─*/
 static const char* VERT_PARTICLE =
 "#version 330 core\n"
+GLSL_FRAME_BLOCK
 "layout(location=0) in vec2 aQuad;\n"
 "layout(location=1) in vec3 aPos;\n"    /* per-instance */
 "layout(location=2) in vec4 aColor;\n"
 "layout(location=3) in float aSize;\n"
 "out vec2 vUV;\n"
 "out vec4 vColor;\n"
-"uniform mat4 uView;\n"
-"uniform mat4 uProj;\n"
 "void main(){\n"
 "  vec3 camR=vec3(uView[0][0],uView[1][0],uView[2][0]);\n"
 "  vec3 camU=vec3(uView[0][1],uView[1][1],uView[2][1]);\n"
@@ -590,7 +991,7 @@ static unsigned int compile_shader(const char* src, GLenum type) {
              fprintf(stderr,"[3D] シェーダーエラー: %s\n",buf); }
     return s;
 }
-static unsigned int build_program2(const char* vs_src, const char* fs_src) {
+static Program3D build_program2(const char* vs_src, const char* fs_src) {
     unsigned int vs=compile_shader(vs_src,GL_VERTEX_SHADER);
     unsigned int fs=compile_shader(fs_src,GL_FRAGMENT_SHADER);
     unsigned int p=glCreateProgram();
@@ -600,454 +1001,2868 @@ static unsigned int build_program2(const char* vs_src, const char* fs_src) {
     if(!ok){ char buf[512]; glGetProgramInfoLog(p,512,NULL,buf);
              fprintf(stderr,"[3D] リンクエラー: %s\n",buf); }
     glDeleteShader(vs); glDeleteShader(fs);
-    return p;
+    /* uniform ロケーションはここで一度だけ解決する (未使用は -1) */
+    Program3D prog; prog.id=p;
+    for(int i=0;i<U_COUNT;i++) prog.loc[i]=glGetUniformLocation(p,UNIFORM_NAMES[i]);
+    unsigned int blk=glGetUniformBlockIndex(p,"Frame");
+    if(blk!=GL_INVALID_INDEX) glUniformBlockBinding(p,blk,FRAME_UBO_BINDING);
+    return prog;
 }
 
-/* uniform ヘルパー */
-#define UL(prog,name) glGetUniformLocation((prog),(name))
-#define U1I(p,n,v)    glUniform1i(UL(p,n),(v))
-#define U1F(p,n,v)    glUniform1f(UL(p,n),(v))
-#define U3F(p,n,a)    glUniform3fv(UL(p,n),1,(a))
-#define U4F(p,n,a)    glUniform4fv(UL(p,n),1,(a))
-#define UM4(p,n,a)    glUniformMatrix4fv(UL(p,n),1,GL_FALSE,(a))
-#define UM3(p,n,a)    glUniformMatrix3fv(UL(p,n),1,GL_FALSE,(a))
+/* uniform ヘルパー (ロケーションは Program3D のテーブルから引く)。ctx のフレーム統計に数える */
+#define UL(p,u)        ((p)->loc[(u)])
+#define U1I(ctx,p,u,v) ((ctx)->stats.uniform_uploads++,glUniform1i(UL(p,u),(v)))
+#define U1F(ctx,p,u,v) ((ctx)->stats.uniform_uploads++,glUniform1f(UL(p,u),(v)))
+#define U3F(ctx,p,u,a) ((ctx)->stats.uniform_uploads++,glUniform3fv(UL(p,u),1,(a)))
+#define U4F(ctx,p,u,a) ((ctx)->stats.uniform_uploads++,glUniform4fv(UL(p,u),1,(a)))
+#define UM4(ctx,p,u,a) ((ctx)->stats.uniform_uploads++,glUniformMatrix4fv(UL(p,u),1,GL_FALSE,(a)))
+#define UM3(ctx,p,u,a) ((ctx)->stats.uniform_uploads++,glUniformMatrix3fv(UL(p,u),1,GL_FALSE,(a)))
+
+/* フレーム統計付きのバインド/転送/描画 (毎フレーム通る経路でだけ使う) */
+#define ST_PROG(ctx,id)          ((ctx)->stats.program_binds++,glUseProgram(id))
+#define ST_TEX(ctx,tg,t)         ((ctx)->stats.texture_binds++,glBindTexture((tg),(t)))
+#define ST_VAO(ctx,v)            ((ctx)->stats.vao_binds++,glBindVertexArray(v))
+#define ST_SUBDATA(ctx,tg,o,n,d) ((ctx)->stats.upload_bytes+=(int64_t)(n),glBufferSubData((tg),(o),(n),(d)))
+static void stat_draw(ENG_3D* ctx,int64_t tris,int inst){
+    ctx->stats.draw_calls++;
+    if(inst>1) ctx->stats.instanced_draws++;
+    ctx->stats.triangles+=tris*inst;
+}
 
 /* ══════════════════════════════════════════════════════
- * メッシュ内部ユーティリティ
+ * ジョブプール
+ *   SDL スレッドのワーカーがリングバッファのジョブを先着順に実行する。
+ *   最初の投入で起動し、eng3d_destroy で残りを片付けてから止める。
+ *   ワーカーは GL に触れない (GL はメインスレッドだけ)
+ *   ジョブはグループ (残り件数のカウンタ) に属せる。終わるとプールが
+ *   減らし、0 になったら done で待ち手を起こす
  * ══════════════════════════════════════════════════════*/
-static void upload_mesh(Mesh3D* m, Vertex3D* verts, uint32_t vcnt,
-                         uint32_t* idx, uint32_t icnt)
-{
-    glGenVertexArrays(1,&m->vao);
-    glGenBuffers(1,&m->vbo);
-    glGenBuffers(1,&m->ebo);
-    glBindVertexArray(m->vao);
-    glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
-    glBufferData(GL_ARRAY_BUFFER,(GLsizeiptr)(vcnt*sizeof(Vertex3D)),verts,GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,(GLsizeiptr)(icnt*sizeof(uint32_t)),idx,GL_STATIC_DRAW);
-    /* pos */ glEnableVertexAttribArray(0); glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,p));
-    /* nor */ glEnableVertexAttribArray(1); glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,n));
-    /* uv  */ glEnableVertexAttribArray(2); glVertexAttribPointer(2,2,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,uv));
-    /* tan */ glEnableVertexAttribArray(3); glVertexAttribPointer(3,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,t));
-    glBindVertexArray(0);
-    m->vertex_count=vcnt;
-    m->index_count =icnt;
+static void job_run(JobPool3D* jp,Job3D j){
+    j.fn(j.arg);
+    if(j.group&&SDL_AtomicAdd(j.group,-1)==1&&jp->done){
+        SDL_LockMutex(jp->mtx);                     /* 待ち手の確認と通知の間に割り込ませない */
+        SDL_CondBroadcast(jp->done);
+        SDL_UnlockMutex(jp->mtx);
+    }
 }
 
-static void compute_tangents(Vertex3D* verts, uint32_t vcnt,
-                               uint32_t* idx, uint32_t icnt)
-{
-    for(uint32_t i=0;i<vcnt;i++){ verts[i].t[0]=verts[i].t[1]=verts[i].t[2]=0.f; }
-    for(uint32_t i=0;i<icnt;i+=3){
-        Vertex3D *v0=&verts[idx[i]],*v1=&verts[idx[i+1]],*v2=&verts[idx[i+2]];
-        float e1[3]={v1->p[0]-v0->p[0],v1->p[1]-v0->p[1],v1->p[2]-v0->p[2]};
-        float e2[3]={v2->p[0]-v0->p[0],v2->p[1]-v0->p[1],v2->p[2]-v0->p[2]};
-        float du1=v1->uv[0]-v0->uv[0], dv1=v1->uv[1]-v0->uv[1];
-        float du2=v2->uv[0]-v0->uv[0], dv2=v2->uv[1]-v0->uv[1];
-        float f=1.f/(du1*dv2-du2*dv1+1e-8f);
-        float tx=f*(dv2*e1[0]-dv1*e2[0]);
-        float ty=f*(dv2*e1[1]-dv1*e2[1]);
-        float tz=f*(dv2*e1[2]-dv1*e2[2]);
-        for(int k=0;k<3;k++){
-            verts[idx[i+k]].t[0]+=tx;
-            verts[idx[i+k]].t[1]+=ty;
-            verts[idx[i+k]].t[2]+=tz;
-        }
-    }
-    for(uint32_t i=0;i<vcnt;i++){
-        float* t=verts[i].t, len=sqrtf(t[0]*t[0]+t[1]*t[1]+t[2]*t[2])+1e-8f;
-        t[0]/=len; t[1]/=len; t[2]/=len;
+static int job_worker(void* arg){
+    JobPool3D* jp=(JobPool3D*)arg;
+    SDL_LockMutex(jp->mtx);
+    for(;;){
+        while(!jp->count&&!jp->quit) SDL_CondWait(jp->cv,jp->mtx);
+        if(!jp->count) break;                       /* quit かつ空 */
+        Job3D j=jp->q[jp->head];
+        jp->head=(jp->head+1)%jp->cap; jp->count--;
+        SDL_UnlockMutex(jp->mtx);
+        job_run(jp,j);
+        SDL_LockMutex(jp->mtx);
     }
+    SDL_UnlockMutex(jp->mtx);
+    return 0;
 }
 
-static void compute_bounds(Mesh3D* m, Vertex3D* verts, uint32_t vcnt){
-    if(!vcnt)return;
-    for(int k=0;k<3;k++) m->bounds.min[k]=m->bounds.max[k]=verts[0].p[k];
-    for(uint32_t i=1;i<vcnt;i++) for(int k=0;k<3;k++){
-        if(verts[i].p[k]<m->bounds.min[k]) m->bounds.min[k]=verts[i].p[k];
-        if(verts[i].p[k]>m->bounds.max[k]) m->bounds.max[k]=verts[i].p[k];
+static bool job_start(JobPool3D* jp){
+    if(jp->n_threads) return true;
+    if(!jp->mtx) jp->mtx=SDL_CreateMutex();
+    if(!jp->cv)  jp->cv =SDL_CreateCond();
+    if(!jp->done) jp->done=SDL_CreateCond();
+    if(!jp->mtx||!jp->cv||!jp->done) return false;
+    int n=SDL_GetCPUCount()-1;                      /* 1 コアはメインスレッド用 */
+    n=n<1?1:n>JOB_MAX_THREADS?JOB_MAX_THREADS:n;
+    for(int i=0;i<n;i++){
+        SDL_Thread* t=SDL_CreateThread(job_worker,"eng3d_job",jp);
+        if(!t) break;
+        jp->threads[jp->n_threads++]=t;
     }
+    return jp->n_threads>0;
 }
 
-static int alloc_mesh_slot(ENG_3D* ctx){
-    for(int i=0;i<ENG_3D_MAX_MESHES;i++) if(!ctx->meshes[i].used) return i;
-    return -1;
+/* ジョブを積む。group が非 NULL なら終了時に *group を 1 減らす
+ * (呼び出し元が件数で初期化しておく)。プールが使えなければその場で実行する */
+static void job_submit(JobPool3D* jp,SDL_atomic_t* group,JobFn3D fn,void* arg){
+    Job3D j={fn,arg,group};
+    if(!job_start(jp)){ job_run(jp,j); return; }
+    SDL_LockMutex(jp->mtx);
+    if(jp->count==jp->cap){
+        int nc=jp->cap?jp->cap*2:64;
+        Job3D* nq=(Job3D*)malloc((size_t)nc*sizeof(Job3D));
+        if(!nq){ SDL_UnlockMutex(jp->mtx); job_run(jp,j); return; }
+        for(int i=0;i<jp->count;i++) nq[i]=jp->q[(jp->head+i)%jp->cap];
+        free(jp->q); jp->q=nq; jp->cap=nc; jp->head=0;
+    }
+    jp->q[(jp->head+jp->count)%jp->cap]=j;
+    jp->count++;
+    SDL_CondSignal(jp->cv);
+    SDL_UnlockMutex(jp->mtx);
 }
 
-static void mesh_default(Mesh3D* m){
-    m->color[0]=m->color[1]=m->color[2]=m->color[3]=1.f;
-    m->spec_intensity=0.5f; m->shininess=32.f;
-    m->cast_shadow=true; m->receive_shadow=true; m->used=true;
+/* キューから group のジョブを 1 件抜き出す (mtx を持って呼ぶ)。無ければ false */
+static bool job_take(JobPool3D* jp,SDL_atomic_t* group,Job3D* out){
+    for(int i=0;i<jp->count;i++){
+        int k=(jp->head+i)%jp->cap;
+        if(jp->q[k].group!=group) continue;
+        *out=jp->q[k];
+        for(int e=i;e>0;e--)                        /* 前の分を 1 つ後ろへ詰める */
+            jp->q[(jp->head+e)%jp->cap]=jp->q[(jp->head+e-1)%jp->cap];
+        jp->head=(jp->head+1)%jp->cap; jp->count--;
+        return true;
+    }
+    return false;
 }
 
-/* ══════════════════════════════════════════════════════
- * メッシュ生成 プリミティブ
- * ══════════════════════════════════════════════════════*/
-ENG_3D_MeshID eng3d_mesh_cube(ENG_3D* ctx, float w, float h, float d){
-    int slot=alloc_mesh_slot(ctx); if(slot<0) return 0;
-    float hx=w*0.5f,hy=h*0.5f,hz=d*0.5f;
-    /* 面ごとに 4 頂点、法線を持つ */
-    Vertex3D verts[24]; uint32_t idx[36]; memset(verts,0,sizeof(verts));
-    /* front */
-    float faces[6][3]={{0,0,1},{0,0,-1},{0,1,0},{0,-1,0},{1,0,0},{-1,0,0}};
-    /* 簡略: 一面ずつ手打ち */
-    int vi=0,ii=0;
-    /* +Z */
-    float nx=0,ny=0,nz=1;
-    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{0,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
-    for(int f=0;f<6;f++) idx[ii+f]=((uint32_t[]){0,1,2,0,2,3}[f])+(uint32_t)(vi-4); ii+=6;
-    /* -Z */
-    nx=0;ny=0;nz=-1;
-    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
-    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{0,1}};vi++;
-    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
-    /* +Y */
-    nx=0;ny=1;nz=0;
-    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{0,0}};vi++;
-    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
-    /* -Y */
-    nx=0;ny=-1;nz=0;
-    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{0,1}};vi++;
-    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
-    /* +X */
-    nx=1;ny=0;nz=0;
-    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{0,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
-    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
-    /* -X */
-    nx=-1;ny=0;nz=0;
-    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
-    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{1,0}};vi++;
-    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
-    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{0,1}};vi++;
-    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
-
-    (void)faces;
-    compute_tangents(verts,24,idx,36);
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,24);
-    upload_mesh(m,verts,24,idx,36);
-    return slot+1;
+/* *group が 0 になるまで待つ。待つ間は同じグループのジョブだけを手伝い
+ * (無関係なデコード等は拾わない)、残りがワーカー実行中なら done で眠る */
+static void job_wait(JobPool3D* jp,SDL_atomic_t* group){
+    if(!jp->n_threads) return;                      /* 全部 job_submit 内で実行済み */
+    SDL_LockMutex(jp->mtx);
+    while(SDL_AtomicGet(group)>0){
+        Job3D j;
+        if(job_take(jp,group,&j)){
+            SDL_UnlockMutex(jp->mtx);
+            job_run(jp,j);
+            SDL_LockMutex(jp->mtx);
+        }else SDL_CondWait(jp->done,jp->mtx);
+    }
+    SDL_UnlockMutex(jp->mtx);
 }
 
-ENG_3D_MeshID eng3d_mesh_sphere(ENG_3D* ctx, float r, int slices, int stacks){
-    if(slices<3) slices=16; if(stacks<2) stacks=8;
-    int vcnt=(slices+1)*(stacks+1);
-    int icnt=slices*stacks*6;
-    Vertex3D* verts=(Vertex3D*)malloc((size_t)vcnt*sizeof(Vertex3D));
-    uint32_t* idx=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
-    int vi=0;
-    for(int j=0;j<=stacks;j++){
-        float phi=(float)j/(float)stacks*(float)M_PI;
-        for(int i=0;i<=slices;i++){
-            float theta=(float)i/(float)slices*2.f*(float)M_PI;
-            float nx=sinf(phi)*cosf(theta), ny=cosf(phi), nz=sinf(phi)*sinf(theta);
-            verts[vi].p[0]=r*nx; verts[vi].p[1]=r*ny; verts[vi].p[2]=r*nz;
-            verts[vi].n[0]=nx;   verts[vi].n[1]=ny;   verts[vi].n[2]=nz;
-            verts[vi].uv[0]=(float)i/(float)slices;
-            verts[vi].uv[1]=(float)j/(float)stacks;
-            vi++;
-        }
+static void job_stop(JobPool3D* jp){
+    if(jp->n_threads){
+        SDL_LockMutex(jp->mtx);
+        jp->quit=true;
+        SDL_CondBroadcast(jp->cv);
+        SDL_UnlockMutex(jp->mtx);
+        for(int i=0;i<jp->n_threads;i++) SDL_WaitThread(jp->threads[i],NULL);
     }
-    int ii=0;
-    for(int j=0;j<stacks;j++) for(int i=0;i<slices;i++){
-        uint32_t a=(uint32_t)(j*(slices+1)+i);
-        uint32_t b=a+(uint32_t)(slices+1);
-        idx[ii++]=a; idx[ii++]=b; idx[ii++]=a+1;
-        idx[ii++]=a+1; idx[ii++]=b; idx[ii++]=b+1;
-    }
-    compute_tangents(verts,(uint32_t)vcnt,idx,(uint32_t)icnt);
-    int slot=alloc_mesh_slot(ctx);
-    if(slot<0){free(verts);free(idx);return 0;}
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,(uint32_t)vcnt);
-    upload_mesh(m,verts,(uint32_t)vcnt,idx,(uint32_t)icnt);
-    free(verts); free(idx);
-    return slot+1;
+    if(jp->cv)  SDL_DestroyCond(jp->cv);
+    if(jp->done) SDL_DestroyCond(jp->done);
+    if(jp->mtx) SDL_DestroyMutex(jp->mtx);
+    free(jp->q);
+    memset(jp,0,sizeof(*jp));
 }
 
-ENG_3D_MeshID eng3d_mesh_plane(ENG_3D* ctx, float w, float d){
-    float hw=w*0.5f, hd=d*0.5f;
-    Vertex3D verts[4]={
-        {{-hw,0, hd},{0,1,0},{0,1}},
-        {{ hw,0, hd},{0,1,0},{1,1}},
-        {{ hw,0,-hd},{0,1,0},{1,0}},
-        {{-hw,0,-hd},{0,1,0},{0,0}}
-    };
-    uint32_t idx[6]={0,1,2,0,2,3};
-    compute_tangents(verts,4,idx,6);
-    int slot=alloc_mesh_slot(ctx); if(slot<0) return 0;
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,4);
-    upload_mesh(m,verts,4,idx,6);
-    return slot+1;
-}
+/* ── 範囲分割: [0,n) を塊に分けて 0 番は呼び出し元、残りはワーカーで回す ─*/
+#define JOB_GRAIN 32768             /* 1 塊の最小要素数 (これ未満なら分けない) */
+typedef void (*RangeFn3D)(void* arg,uint32_t begin,uint32_t end,int chunk);
+typedef struct { RangeFn3D fn; void* arg; uint32_t begin, end; int chunk; } RangeJob3D;
 
-ENG_3D_MeshID eng3d_mesh_cylinder(ENG_3D* ctx, float r, float h, int segs){
-    if(segs<3) segs=16;
-    int vcnt=(segs+1)*4+2; /* side top+bot caps */
-    int icnt=segs*6 + segs*3*2;
-    Vertex3D* verts=(Vertex3D*)calloc((size_t)vcnt,sizeof(Vertex3D));
-    uint32_t* idx=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
-    float hh=h*0.5f; int vi=0,ii=0;
-    /* side */
-    for(int i=0;i<=segs;i++){
-        float th=(float)i/(float)segs*2.f*(float)M_PI;
-        float cx=cosf(th), cz=sinf(th);
-        verts[vi].p[0]=r*cx; verts[vi].p[1]=-hh; verts[vi].p[2]=r*cz;
-        verts[vi].n[0]=cx; verts[vi].n[2]=cz; verts[vi].uv[0]=(float)i/(float)segs; verts[vi].uv[1]=0; vi++;
-        verts[vi].p[0]=r*cx; verts[vi].p[1]= hh; verts[vi].p[2]=r*cz;
-        verts[vi].n[0]=cx; verts[vi].n[2]=cz; verts[vi].uv[0]=(float)i/(float)segs; verts[vi].uv[1]=1; vi++;
-    }
-    for(int i=0;i<segs;i++){
-        uint32_t b=(uint32_t)(i*2);
-        idx[ii++]=b; idx[ii++]=b+2; idx[ii++]=b+1;
-        idx[ii++]=b+1; idx[ii++]=b+2; idx[ii++]=b+3;
-    }
-    /* top cap center */
-    uint32_t tc=(uint32_t)vi;
-    verts[vi].p[1]=hh; verts[vi].n[1]=1.f; verts[vi].uv[0]=verts[vi].uv[1]=0.5f; vi++;
-    for(int i=0;i<=segs;i++){
-        float th=(float)i/(float)segs*2.f*(float)M_PI;
-        verts[vi].p[0]=r*cosf(th); verts[vi].p[1]=hh; verts[vi].p[2]=r*sinf(th);
-        verts[vi].n[1]=1.f;
-        verts[vi].uv[0]=cosf(th)*0.5f+0.5f; verts[vi].uv[1]=sinf(th)*0.5f+0.5f; vi++;
-    }
-    for(int i=0;i<segs;i++){
-        idx[ii++]=tc; idx[ii++]=tc+1+(uint32_t)i+1; idx[ii++]=tc+1+(uint32_t)i;
-    }
-    /* bot cap */
-    uint32_t bc=(uint32_t)vi;
-    verts[vi].p[1]=-hh; verts[vi].n[1]=-1.f; verts[vi].uv[0]=verts[vi].uv[1]=0.5f; vi++;
-    for(int i=0;i<=segs;i++){
-        float th=(float)i/(float)segs*2.f*(float)M_PI;
-        verts[vi].p[0]=r*cosf(th); verts[vi].p[1]=-hh; verts[vi].p[2]=r*sinf(th);
-        verts[vi].n[1]=-1.f;
-        verts[vi].uv[0]=cosf(th)*0.5f+0.5f; verts[vi].uv[1]=sinf(th)*0.5f+0.5f; vi++;
-    }
-    for(int i=0;i<segs;i++){
-        idx[ii++]=bc; idx[ii++]=bc+1+(uint32_t)i; idx[ii++]=bc+1+(uint32_t)i+1;
-    }
-    compute_tangents(verts,(uint32_t)vi,idx,(uint32_t)ii);
-    int slot=alloc_mesh_slot(ctx);
-    if(slot<0){free(verts);free(idx);return 0;}
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,(uint32_t)vi);
-    upload_mesh(m,verts,(uint32_t)vi,idx,(uint32_t)ii);
-    free(verts); free(idx);
-    return slot+1;
+static void range_job(void* arg){
+    RangeJob3D* r=(RangeJob3D*)arg;
+    r->fn(r->arg,r->begin,r->end,r->chunk);
 }
 
-ENG_3D_MeshID eng3d_mesh_capsule(ENG_3D* ctx, float r, float h, int segs){
-    /* カプセル = 2 球端 + 円柱中間 で UV スフィア風に生成 */
-    if(segs<4) segs=16;
-    int hemi=segs/2;
-    int vcnt=(segs+1)*(hemi*2+1+1);
-    int icnt= segs*(hemi*2)*6;
-    Vertex3D* verts=(Vertex3D*)calloc((size_t)vcnt,sizeof(Vertex3D));
-    uint32_t* idx  =(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
-    float hh=h*0.5f; int vi=0,ii=0,tot_stacks=hemi*2;
-    for(int j=0;j<=tot_stacks;j++){
-        float phi;
-        float yoffset=0;
-        if(j<=hemi){
-            phi=(float)j/(float)hemi*(float)M_PI_2;
-            yoffset=-hh;
-        } else {
-            phi=(float)M_PI_2+(float)(j-hemi)/(float)hemi*(float)M_PI_2;
-            yoffset= hh;
-        }
-        float sp=sinf(phi), cp=cosf(phi);
-        for(int i=0;i<=segs;i++){
-            float th=(float)i/(float)segs*2.f*(float)M_PI;
-            float nx=sp*cosf(th), ny=cp, nz=sp*sinf(th);
-            verts[vi].p[0]=r*nx; verts[vi].p[1]=r*ny+yoffset; verts[vi].p[2]=r*nz;
-            verts[vi].n[0]=nx; verts[vi].n[1]=ny; verts[vi].n[2]=nz;
-            verts[vi].uv[0]=(float)i/(float)segs;
-            verts[vi].uv[1]=(float)j/(float)tot_stacks;
-            vi++;
-        }
-    }
-    for(int j=0;j<tot_stacks;j++) for(int i=0;i<segs;i++){
-        uint32_t a=(uint32_t)(j*(segs+1)+i), b=a+(uint32_t)(segs+1);
-        idx[ii++]=a; idx[ii++]=b; idx[ii++]=a+1;
-        idx[ii++]=a+1; idx[ii++]=b; idx[ii++]=b+1;
-    }
-    compute_tangents(verts,(uint32_t)vi,idx,(uint32_t)ii);
-    int slot=alloc_mesh_slot(ctx);
-    if(slot<0){free(verts);free(idx);return 0;}
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,(uint32_t)vi);
-    upload_mesh(m,verts,(uint32_t)vi,idx,(uint32_t)ii);
-    free(verts); free(idx);
-    return slot+1;
+/* n 要素を grain 以上ずつに分けたときの塊数 (1..JOB_MAX_THREADS+1)。1 ならスレッドは起こさない */
+static int job_chunks(JobPool3D* jp,uint32_t n,uint32_t grain){
+    uint32_t c=grain?n/grain:n;
+    if(c<=1||!job_start(jp)) return 1;
+    return c>(uint32_t)jp->n_threads+1?jp->n_threads+1:(int)c;
 }
 
-ENG_3D_MeshID eng3d_mesh_torus(ENG_3D* ctx, float R, float r, int segsR, int segsr){
-    if(segsR<4) segsR=32; if(segsr<4) segsr=16;
-    int vcnt=(segsR+1)*(segsr+1);
-    int icnt=segsR*segsr*6;
-    Vertex3D* verts=(Vertex3D*)calloc((size_t)vcnt,sizeof(Vertex3D));
-    uint32_t* idx  =(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
-    int vi=0,ii=0;
-    for(int i=0;i<=segsR;i++){
-        float u=(float)i/(float)segsR*2.f*(float)M_PI;
-        for(int j=0;j<=segsr;j++){
-            float v=(float)j/(float)segsr*2.f*(float)M_PI;
-            float cx=(R+r*cosf(v))*cosf(u);
-            float cy=r*sinf(v);
-            float cz=(R+r*cosf(v))*sinf(u);
-            float nx=cosf(v)*cosf(u), ny=sinf(v), nz=cosf(v)*sinf(u);
-            verts[vi].p[0]=cx; verts[vi].p[1]=cy; verts[vi].p[2]=cz;
-            verts[vi].n[0]=nx; verts[vi].n[1]=ny; verts[vi].n[2]=nz;
-            verts[vi].uv[0]=(float)i/(float)segsR;
-            verts[vi].uv[1]=(float)j/(float)segsr;
-            vi++;
-        }
+static void job_range(JobPool3D* jp,int chunks,uint32_t n,RangeFn3D fn,void* arg){
+    if(chunks<=1){ fn(arg,0,n,0); return; }
+    RangeJob3D rj[JOB_MAX_THREADS+1];
+    SDL_atomic_t pending; SDL_AtomicSet(&pending,chunks-1);
+    for(int c=1;c<chunks;c++){
+        rj[c].fn=fn; rj[c].arg=arg; rj[c].chunk=c;
+        rj[c].begin=(uint32_t)((uint64_t)n*(uint64_t)c/(uint64_t)chunks);
+        rj[c].end  =(uint32_t)((uint64_t)n*(uint64_t)(c+1)/(uint64_t)chunks);
+        job_submit(jp,&pending,range_job,&rj[c]);
     }
-    for(int i=0;i<segsR;i++) for(int j=0;j<segsr;j++){
-        uint32_t a=(uint32_t)(i*(segsr+1)+j), b=a+(uint32_t)(segsr+1);
-        idx[ii++]=a; idx[ii++]=b; idx[ii++]=a+1;
-        idx[ii++]=a+1; idx[ii++]=b; idx[ii++]=b+1;
-    }
-    compute_tangents(verts,(uint32_t)vi,idx,(uint32_t)ii);
-    int slot=alloc_mesh_slot(ctx);
-    if(slot<0){free(verts);free(idx);return 0;}
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,(uint32_t)vi);
-    upload_mesh(m,verts,(uint32_t)vi,idx,(uint32_t)ii);
-    free(verts); free(idx);
-    return slot+1;
+    fn(arg,0,(uint32_t)((uint64_t)n/(uint64_t)chunks),0);
+    job_wait(jp,&pending);
 }
 
 /* ══════════════════════════════════════════════════════
- * OBJ ローダー (簡易)
+ * ハンドルプール
+ *   メッシュ・テクスチャ・エミッター・ノード・アニメの実体を
+ *   固定長のページに置く (伸ばしても要素は動かないのでポインタは保てる)。
+ *   空きスロットは単方向リストで O(1) に取り出す。
+ *   ID = (世代 << HANDLE_SLOT_BITS) | (スロット+1)。解放で世代を進めるので
+ *   破棄済みの ID は再利用されたスロットを指さず無効になる。
+ *   初回の世代は 0 なので、作り直していないスロットの ID は 1,2,3…のまま。
+ *   世代を使い切ったスロットは空きに戻さない
  * ══════════════════════════════════════════════════════*/
-#define OBJ_MAX 131072
-ENG_3D_MeshID eng3d_mesh_load_obj(ENG_3D* ctx, const char* path){
-    FILE* fp=fopen(path,"r"); if(!fp){ fprintf(stderr,"[3D] OBJ: %s\n",path); return 0; }
-    float* pos=(float*)malloc(OBJ_MAX*3*sizeof(float));
-    float* nor=(float*)malloc(OBJ_MAX*3*sizeof(float));
-    float* uv =(float*)malloc(OBJ_MAX*2*sizeof(float));
-    Vertex3D* verts=(Vertex3D*)malloc(OBJ_MAX*3*sizeof(Vertex3D));
-    uint32_t* idx  =(uint32_t*)malloc(OBJ_MAX*3*sizeof(uint32_t));
-    int np=0,nn=0,nu=0,vi=0,ii=0;
-    char line[512];
-    while(fgets(line,sizeof(line),fp)){
-        if(line[0]=='v'&&line[1]==' '){ sscanf(line+2,"%f%f%f",&pos[np*3],&pos[np*3+1],&pos[np*3+2]); np++; }
-        else if(line[0]=='v'&&line[1]=='n'){ sscanf(line+3,"%f%f%f",&nor[nn*3],&nor[nn*3+1],&nor[nn*3+2]); nn++; }
-        else if(line[0]=='v'&&line[1]=='t'){ sscanf(line+3,"%f%f",&uv[nu*2],&uv[nu*2+1]); nu++; }
-        else if(line[0]=='f'&&line[1]==' '){
-            int pi[4]={0},ti[4]={0},ni[4]={0},fc=0;
-            char* p=line+2;
-            while(*p&&fc<4){
-                int a=0,b=0,c=0;
-                if(sscanf(p,"%d/%d/%d",&a,&b,&c)==3){ pi[fc]=a-1; ti[fc]=b-1; ni[fc]=c-1; }
-                else if(sscanf(p,"%d//%d",&a,&c)==2){ pi[fc]=a-1; ni[fc]=c-1; }
-                else if(sscanf(p,"%d",&a)==1){ pi[fc]=a-1; }
-                fc++;
-                while(*p&&*p!=' '&&*p!='\n') p++;
-                while(*p==' ') p++;
-            }
-            int faces=fc-2;
-            for(int f=0;f<faces;f++){
-                int tris[3]={0,f+1,f+2};
-                for(int k=0;k<3;k++){
-                    int ti2=tris[k];
-                    Vertex3D v; memset(&v,0,sizeof(v));
-                    int pi2=pi[ti2];
-                    v.p[0]=pos[pi2*3]; v.p[1]=pos[pi2*3+1]; v.p[2]=pos[pi2*3+2];
-                    if(nn>0){ int ni2=ni[ti2]; v.n[0]=nor[ni2*3]; v.n[1]=nor[ni2*3+1]; v.n[2]=nor[ni2*3+2]; }
-                    if(nu>0){ int ui=ti[ti2]; v.uv[0]=uv[ui*2]; v.uv[1]=uv[ui*2+1]; }
-                    verts[vi]=v; idx[ii++]=(uint32_t)vi; vi++;
-                }
-            }
-        }
-    }
-    fclose(fp);
-    compute_tangents(verts,(uint32_t)vi,idx,(uint32_t)ii);
-    int slot=alloc_mesh_slot(ctx);
-    if(slot<0){ free(pos);free(nor);free(uv);free(verts);free(idx); return 0; }
-    Mesh3D* m=&ctx->meshes[slot]; mesh_default(m);
-    compute_bounds(m,verts,(uint32_t)vi);
-    upload_mesh(m,verts,(uint32_t)vi,idx,(uint32_t)ii);
-    free(pos);free(nor);free(uv);free(verts);free(idx);
-    return slot+1;
-}
+static bool grow_buf(void** p,size_t* cap,size_t need,size_t elem);
 
-void eng3d_mesh_destroy(ENG_3D* ctx, ENG_3D_MeshID id){
-    if(id<1||id>ENG_3D_MAX_MESHES||!ctx->meshes[id-1].used) return;
-    Mesh3D* m=&ctx->meshes[id-1];
-    glDeleteVertexArrays(1,&m->vao);
-    glDeleteBuffers(1,&m->vbo);
-    glDeleteBuffers(1,&m->ebo);
-    memset(m,0,sizeof(*m));
+static void handle_init(HandlePool3D* p,size_t elem){
+    memset(p,0,sizeof(*p));
+    p->elem=elem;
+    while(p->page_bits<HANDLE_PAGE_MAX&&(elem<<(p->page_bits+1))<=65536) p->page_bits++;
 }
 
-int          eng3d_mesh_vertex_count(ENG_3D* ctx,ENG_3D_MeshID id){ return (id>=1&&id<=ENG_3D_MAX_MESHES)?ctx->meshes[id-1].vertex_count:0; }
-ENG_3D_AABB  eng3d_mesh_bounds     (ENG_3D* ctx,ENG_3D_MeshID id){
-    if(id>=1&&id<=ENG_3D_MAX_MESHES) return ctx->meshes[id-1].bounds;
-    ENG_3D_AABB a; memset(&a,0,sizeof(a)); return a;
+static void* handle_at(const HandlePool3D* p,uint32_t s){
+    return p->pages[s>>p->page_bits]+(size_t)(s&((1u<<p->page_bits)-1u))*p->elem;
+}
+static int handle_id(const HandlePool3D* p,uint32_t s){
+    return (int)(((uint32_t)p->slots[s].gen<<HANDLE_SLOT_BITS)|(s+1));
+}
+
+/* 生きている ID なら実体、そうでなければ NULL */
+static void* handle_get(const HandlePool3D* p,int id){
+    if(id<=0) return NULL;
+    uint32_t s=((uint32_t)id&HANDLE_SLOT_MASK)-1u;
+    if(s>=p->n_slots||!p->slots[s].used||p->slots[s].gen!=((uint32_t)id>>HANDLE_SLOT_BITS)) return NULL;
+    return handle_at(p,s);
+}
+
+/* 0 で埋めた実体を確保して ID を返す (0=メモリ不足) */
+static int handle_alloc(HandlePool3D* p){
+    uint32_t s;
+    if(p->free_head){
+        s=p->free_head-1;
+        p->free_head=p->slots[s].next;
+    } else {
+        s=p->n_slots;
+        if(s>=HANDLE_SLOT_MASK) return 0;
+        if(!grow_buf((void**)&p->slots,&p->cap_slots,(size_t)s+1,sizeof(HandleSlot3D))) return 0;
+        if(!(s&((1u<<p->page_bits)-1u))){
+            size_t pg=s>>p->page_bits;
+            if(!grow_buf((void**)&p->pages,&p->cap_pages,pg+1,sizeof(uint8_t*))) return 0;
+            if(!(p->pages[pg]=(uint8_t*)malloc(p->elem<<p->page_bits))) return 0;
+        }
+        p->slots[s].gen=0;
+        p->n_slots++;
+    }
+    p->slots[s].used=true; p->live++;
+    memset(handle_at(p,s),0,p->elem);
+    return handle_id(p,s);
+}
+
+static void handle_free(HandlePool3D* p,int id){
+    if(!handle_get(p,id)) return;
+    uint32_t s=((uint32_t)id&HANDLE_SLOT_MASK)-1u;
+    HandleSlot3D* h=&p->slots[s];
+    h->used=false; p->live--;
+    if(h->gen==HANDLE_GEN_MAX) return;
+    h->gen++;
+    h->next=p->free_head; p->free_head=s+1;
+}
+
+static void handle_destroy(HandlePool3D* p){
+    size_t elem=p->elem;
+    for(uint32_t s=0;s<p->n_slots;s+=1u<<p->page_bits) free(p->pages[s>>p->page_bits]);
+    free(p->pages); free(p->slots);
+    handle_init(p,elem);
+}
+
+/* 生きているスロットを順に: for(uint32_t s=0;handle_next(p,&s);s++) */
+static bool handle_next(const HandlePool3D* p,uint32_t* s){
+    while(*s<p->n_slots&&!p->slots[*s].used) (*s)++;
+    return *s<p->n_slots;
+}
+
+#define mesh_get(ctx,id)    ((Mesh3D*)   handle_get(&(ctx)->meshes,(id)))
+#define tex_get(ctx,id)     ((Tex3D*)    handle_get(&(ctx)->textures,(id)))
+#define emitter_get(ctx,id) ((Emitter3D*)handle_get(&(ctx)->emitters,(id)))
+#define node_get(ctx,id)    ((SceneNode*)handle_get(&(ctx)->nodes,(id)))
+#define anim_get(ctx,id)    ((Anim3D*)   handle_get(&(ctx)->anims,(id)))
+
+/* ══════════════════════════════════════════════════════
+ * 頂点キャッシュ最適化 (ENG_3D_MESH_OPTIMIZE)
+ *   1. Tipsify (Sander 2007) で変換後キャッシュに乗るよう三角形を並べ替え
+ *   2. 行き止まり/キャッシュ効率の切れ目でクラスタに分け、
+ *      外向きのクラスタを先に描くよう並べてオーバードローを減らす
+ *   3. 頂点を初出順に並べ直して頂点フェッチを連続させる
+ *   ACMR (三角形あたりのキャッシュミス) は FIFO OPT_CACHE 個で見積もる
+ * ══════════════════════════════════════════════════════*/
+#define OPT_CACHE     16
+#define OPT_SOFT_SPLIT 1.05f      /* クラスタ内 ACMR がこの倍率以下になったら分ける */
+
+static float acmr_fifo(const uint32_t* idx,uint32_t icnt,uint32_t vcnt,uint32_t* ts){
+    uint32_t t=OPT_CACHE+1, miss=0;
+    memset(ts,0,vcnt*sizeof(uint32_t));
+    for(uint32_t i=0;i<icnt;i++){
+        uint32_t v=idx[i];
+        if(t-ts[v]>OPT_CACHE){ ts[v]=t++; miss++; }
+    }
+    return icnt>=3?(float)miss/(float)(icnt/3):0.f;
+}
+
+typedef struct {
+    uint32_t *adj_off, *adj, *live, *ts, *stack, *cand;
+    uint8_t*  emitted;
+} Tipsify3D;
+
+/* 次の扇の中心: 候補のうちキャッシュに残っていて生きた三角形を持つもの。
+ * 無ければ行き止まりスタック → 先頭からの走査 (*dead=true) */
+static int64_t tipsify_next(Tipsify3D* w,uint32_t nc,uint32_t t,uint32_t* sp,uint32_t* cursor,
+                            uint32_t vcnt,bool* dead)
+{
+    int64_t best=-1; uint32_t bp=0;
+    for(uint32_t i=0;i<nc;i++){
+        uint32_t v=w->cand[i];
+        if(!w->live[v]) continue;
+        uint32_t p=0;
+        if(t-w->ts[v]+2*w->live[v]<=OPT_CACHE) p=t-w->ts[v];
+        if(best<0||p>bp){ best=v; bp=p; }
+    }
+    if(best>=0){ *dead=false; return best; }
+    *dead=true;
+    while(*sp){ uint32_t d=w->stack[--*sp]; if(w->live[d]) return d; }
+    while(*cursor<vcnt){ uint32_t v=(*cursor)++; if(w->live[v]) return v; }
+    return -1;
+}
+
+/* 並べ替えた三角形番号を order に、ハードな切れ目の直後に hard[tri]=1 */
+static bool tipsify(const uint32_t* idx,uint32_t tcnt,uint32_t vcnt,uint32_t* order,uint8_t* hard){
+    Tipsify3D w; memset(&w,0,sizeof(w));
+    uint32_t icnt=tcnt*3;
+    w.adj_off=(uint32_t*)calloc(vcnt+1,sizeof(uint32_t));
+    w.adj    =(uint32_t*)malloc(icnt*sizeof(uint32_t));
+    w.live   =(uint32_t*)calloc(vcnt,sizeof(uint32_t));
+    w.ts     =(uint32_t*)calloc(vcnt,sizeof(uint32_t));
+    w.stack  =(uint32_t*)malloc(icnt*sizeof(uint32_t));
+    w.cand   =(uint32_t*)malloc(icnt*sizeof(uint32_t));
+    w.emitted=(uint8_t*)calloc(tcnt,1);
+    bool ok=w.adj_off&&w.adj&&w.live&&w.ts&&w.stack&&w.cand&&w.emitted;
+    if(ok){
+        for(uint32_t i=0;i<icnt;i++) w.live[idx[i]]++;
+        for(uint32_t v=0;v<vcnt;v++) w.adj_off[v+1]=w.adj_off[v]+w.live[v];
+        for(uint32_t v=0;v<vcnt;v++) w.ts[v]=w.adj_off[v];           /* 書き込み位置に流用 */
+        for(uint32_t i=0;i<icnt;i++) w.adj[w.ts[idx[i]]++]=i/3;
+        memset(w.ts,0,vcnt*sizeof(uint32_t));
+        uint32_t t=OPT_CACHE+1, sp=0, cursor=0, out=0;
+        bool dead=true;
+        int64_t f=0;
+        while(f>=0){
+            uint32_t nc=0;
+            for(uint32_t a=w.adj_off[f];a<w.adj_off[f+1];a++){
+                uint32_t tri=w.adj[a];
+                if(w.emitted[tri]) continue;
+                hard[out]=dead; dead=false;
+                order[out++]=tri; w.emitted[tri]=1;
+                for(int k=0;k<3;k++){
+                    uint32_t v=idx[tri*3+k];
+                    w.stack[sp++]=v; w.cand[nc++]=v; w.live[v]--;
+                    if(t-w.ts[v]>OPT_CACHE) w.ts[v]=t++;
+                }
+            }
+            f=tipsify_next(&w,nc,t,&sp,&cursor,vcnt,&dead);
+        }
+        ok=out==tcnt;
+    }
+    free(w.adj_off); free(w.adj); free(w.live); free(w.ts);
+    free(w.stack); free(w.cand); free(w.emitted);
+    return ok;
+}
+
+typedef struct { float key; uint32_t start, count; } OptCluster3D;
+static int cluster_cmp(const void* a,const void* b){
+    const OptCluster3D *x=(const OptCluster3D*)a, *y=(const OptCluster3D*)b;
+    if(x->key!=y->key) return x->key>y->key?-1:1;                  /* 外向き (大きい) が先 */
+    return x->start<y->start?-1:(x->start>y->start);
+}
+
+/* 並べ替え済み三角形列 (idx) をクラスタ単位で外向き順に並べ直す */
+static bool order_clusters(const Vertex3D* verts,uint32_t vcnt,uint32_t* idx,uint32_t tcnt,
+                           const uint8_t* hard,uint32_t* ts)
+{
+    OptCluster3D* cl=(OptCluster3D*)malloc(tcnt*sizeof(OptCluster3D));
+    uint32_t* tmp=(uint32_t*)malloc((size_t)tcnt*3*sizeof(uint32_t));
+    if(!cl||!tmp){ free(cl); free(tmp); return false; }
+    /* ハードな切れ目の区間ごとに, 累積 ACMR が区間全体の OPT_SOFT_SPLIT 倍以下で切る */
+    uint32_t nclu=0;
+    for(uint32_t s=0;s<tcnt;){
+        uint32_t e=s+1; while(e<tcnt&&!hard[e]) e++;
+        float whole=acmr_fifo(idx+s*3,(e-s)*3,vcnt,ts);
+        memset(ts,0,vcnt*sizeof(uint32_t));
+        uint32_t t=OPT_CACHE+1, miss=0, cs=s;
+        for(uint32_t i=s;i<e;i++){
+            for(int k=0;k<3;k++){ uint32_t v=idx[i*3+k]; if(t-ts[v]>OPT_CACHE){ ts[v]=t++; miss++; } }
+            uint32_t n=i-cs+1;
+            if(i+1<e&&(float)miss<=whole*OPT_SOFT_SPLIT*(float)n){
+                cl[nclu].start=cs; cl[nclu++].count=n;
+                cs=i+1; miss=0; t+=OPT_CACHE+1;                 /* キャッシュを空にする */
+            }
+        }
+        cl[nclu].start=cs; cl[nclu++].count=e-cs;
+        s=e;
+    }
+    /* 並べ替えの鍵: (クラスタ重心 - メッシュ重心)・クラスタ法線 */
+    float mc[3]={0,0,0};
+    for(uint32_t i=0;i<vcnt;i++) for(int k=0;k<3;k++) mc[k]+=verts[i].p[k];
+    for(int k=0;k<3;k++) mc[k]/=(float)(vcnt?vcnt:1);
+    for(uint32_t c=0;c<nclu;c++){
+        float cen[3]={0,0,0}, nrm[3]={0,0,0}, area=0.f;
+        for(uint32_t i=cl[c].start;i<cl[c].start+cl[c].count;i++){
+            const float *a=verts[idx[i*3]].p, *b=verts[idx[i*3+1]].p, *d=verts[idx[i*3+2]].p;
+            float e1[3]={b[0]-a[0],b[1]-a[1],b[2]-a[2]}, e2[3]={d[0]-a[0],d[1]-a[1],d[2]-a[2]};
+            float n[3]={e1[1]*e2[2]-e1[2]*e2[1],e1[2]*e2[0]-e1[0]*e2[2],e1[0]*e2[1]-e1[1]*e2[0]};
+            float w=sqrtf(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+            for(int k=0;k<3;k++){ cen[k]+=(a[k]+b[k]+d[k])*w; nrm[k]+=n[k]; }
+            area+=w;
+        }
+        float nl=sqrtf(nrm[0]*nrm[0]+nrm[1]*nrm[1]+nrm[2]*nrm[2]);
+        float key=0.f;
+        if(area>0.f&&nl>0.f)
+            for(int k=0;k<3;k++) key+=(cen[k]/(area*3.f)-mc[k])*nrm[k]/nl;
+        cl[c].key=key;
+    }
+    qsort(cl,nclu,sizeof(OptCluster3D),cluster_cmp);
+    uint32_t o=0;
+    for(uint32_t c=0;c<nclu;c++){
+        memcpy(tmp+o,idx+cl[c].start*3,(size_t)cl[c].count*3*sizeof(uint32_t));
+        o+=cl[c].count*3;
+    }
+    memcpy(idx,tmp,(size_t)tcnt*3*sizeof(uint32_t));
+    free(cl); free(tmp);
+    return true;
+}
+
+/* 頂点を初出順に詰め直す (使われない頂点は末尾へ) */
+static bool remap_fetch(Vertex3D* verts,uint32_t vcnt,uint32_t* idx,uint32_t icnt,uint32_t* map){
+    Vertex3D* tmp=(Vertex3D*)malloc((size_t)vcnt*sizeof(Vertex3D));
+    if(!tmp) return false;
+    memset(map,0xFF,vcnt*sizeof(uint32_t));
+    uint32_t n=0;
+    for(uint32_t i=0;i<icnt;i++){
+        uint32_t v=idx[i];
+        if(map[v]==UINT32_MAX){ map[v]=n; tmp[n++]=verts[v]; }
+        idx[i]=map[v];
+    }
+    for(uint32_t v=0;v<vcnt;v++) if(map[v]==UINT32_MAX) tmp[n++]=verts[v];
+    memcpy(verts,tmp,(size_t)vcnt*sizeof(Vertex3D));
+    free(tmp);
+    return true;
+}
+
+/* その場で最適化し m->acmr_* を埋める。失敗時は元の並びのまま false */
+static bool optimize_mesh(Mesh3D* m,Vertex3D* verts,uint32_t vcnt,uint32_t* idx,uint32_t icnt){
+    uint32_t tcnt=icnt/3;
+    if(tcnt<2||icnt%3) return false;
+    uint32_t* ts   =(uint32_t*)malloc(vcnt*sizeof(uint32_t));
+    uint32_t* order=(uint32_t*)malloc(tcnt*sizeof(uint32_t));
+    uint32_t* sorted=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+    uint8_t*  hard =(uint8_t*)malloc(tcnt);
+    bool ok=ts&&order&&sorted&&hard;
+    if(ok){
+        m->acmr_before=acmr_fifo(idx,icnt,vcnt,ts);
+        ok=tipsify(idx,tcnt,vcnt,order,hard);
+    }
+    if(ok){
+        for(uint32_t i=0;i<tcnt;i++) memcpy(sorted+i*3,idx+order[i]*3,3*sizeof(uint32_t));
+        ok=order_clusters(verts,vcnt,sorted,tcnt,hard,ts)
+         &&remap_fetch(verts,vcnt,sorted,icnt,ts);
+    }
+    if(ok){
+        memcpy(idx,sorted,(size_t)icnt*sizeof(uint32_t));
+        m->acmr_after=acmr_fifo(idx,icnt,vcnt,ts);
+        m->optimized=true;
+    }
+    free(ts); free(order); free(sorted); free(hard);
+    return ok;
+}
+
+/* ══════════════════════════════════════════════════════
+ * LOD 生成 (ENG_3D_MESH_LOD)
+ *   二次誤差 (Garland-Heckbert) の小さいエッジから縮退させる。
+ *   頂点は既存の頂点へ寄せるだけなので全 LOD が同じ VBO を共有し、
+ *   EBO には LOD0..n のインデックスを続けて置く。
+ *   同じ位置に頂点が複数ある継ぎ目 (UV/法線の切れ目) と開いた縁は動かさない。
+ *   1 パスで費用順に縮退させ、触れた頂点はそのパスでは再び使わない
+ * ══════════════════════════════════════════════════════*/
+#define LOD_MIN_TRIS 64            /* これ未満のメッシュは LOD を作らない */
+#define LOD_MIN_GAIN 0.8f          /* 前段の 8 割以下に減らなければ打ち切り */
+
+typedef struct { double q[10]; } Quadric3D;
+typedef struct { float cost; uint32_t a, b; } LodEdge3D;
+
+typedef struct {
+    const Vertex3D* verts;
+    uint32_t*  tri;            /* 3×tcnt。縮退で書き換わる */
+    uint8_t*   dead;
+    uint32_t   tcnt, alive;
+    uint32_t*  wid;            /* 頂点 → 位置の番号 */
+    uint8_t*   locked;         /* 位置ごと: 継ぎ目/縁/縮退済み */
+    uint32_t*  stamp;          /* 位置ごと: 最後に触れたパス */
+    Quadric3D* Q;              /* 位置ごと */
+    uint32_t  *head, *next;    /* 位置 → 角 (tri*3+k) の連結リスト */
+} Lod3D;
+
+static void quadric_plane(Quadric3D* Q,double a,double b,double c,double d,double w){
+    double* q=Q->q;
+    q[0]+=w*a*a; q[1]+=w*a*b; q[2]+=w*a*c; q[3]+=w*a*d;
+    q[4]+=w*b*b; q[5]+=w*b*c; q[6]+=w*b*d;
+    q[7]+=w*c*c; q[8]+=w*c*d; q[9]+=w*d*d;
+}
+static float quadric_cost(const Quadric3D* A,const Quadric3D* B,const float p[3]){
+    double q[10]; for(int i=0;i<10;i++) q[i]=A->q[i]+B->q[i];
+    double x=p[0], y=p[1], z=p[2];
+    double e=q[0]*x*x+2*q[1]*x*y+2*q[2]*x*z+2*q[3]*x
+            +q[4]*y*y+2*q[5]*y*z+2*q[6]*y
+            +q[7]*z*z+2*q[8]*z+q[9];
+    return (float)fabs(e);
+}
+static int lod_edge_cmp(const void* a,const void* b){
+    float x=((const LodEdge3D*)a)->cost, y=((const LodEdge3D*)b)->cost;
+    return (x>y)-(x<y);
+}
+static int lod_pair_cmp(const void* a,const void* b){
+    const LodEdge3D *x=(const LodEdge3D*)a, *y=(const LodEdge3D*)b;
+    if(x->a!=y->a) return x->a<y->a?-1:1;
+    return (x->b>y->b)-(x->b<y->b);
+}
+
+/* 位置が同じ頂点に同じ番号を振る。戻り値は番号の数 (失敗 0) */
+static uint32_t lod_weld(const Vertex3D* verts,uint32_t vcnt,uint32_t* wid){
+    size_t cap=16; while(cap<(size_t)vcnt*2) cap<<=1;
+    uint32_t* slot=(uint32_t*)malloc(cap*sizeof(uint32_t));
+    if(!slot) return 0;
+    memset(slot,0xFF,cap*sizeof(uint32_t));
+    uint32_t nw=0;
+    for(uint32_t v=0;v<vcnt;v++){
+        uint32_t h[3]; memcpy(h,verts[v].p,12);
+        size_t i=(size_t)((h[0]*0x9E3779B1u)^(h[1]*0x85EBCA77u)^(h[2]*0xC2B2AE3Du))&(cap-1);
+        for(;;i=(i+1)&(cap-1)){
+            uint32_t s=slot[i];
+            if(s==UINT32_MAX){ slot[i]=v; wid[v]=nw++; break; }
+            if(!memcmp(verts[s].p,verts[v].p,12)){ wid[v]=wid[s]; break; }
+        }
+    }
+    free(slot);
+    return nw;
+}
+
+/* 位置 w の角を順に辿る */
+#define LOD_EACH(L,w,c) for(uint32_t c=(L)->head[w];c!=UINT32_MAX;c=(L)->next[c])
+
+static bool lod_tri_has(const Lod3D* L,uint32_t t,uint32_t w){
+    return L->wid[L->tri[t*3]]==w||L->wid[L->tri[t*3+1]]==w||L->wid[L->tri[t*3+2]]==w;
+}
+
+/* a を b の位置へ動かすと裏返る三角形があれば false */
+static bool lod_no_flip(const Lod3D* L,uint32_t a,uint32_t b){
+    uint32_t wa=L->wid[a], wb=L->wid[b];
+    const float* pb=L->verts[b].p;
+    LOD_EACH(L,wa,c){
+        uint32_t t=c/3;
+        if(L->dead[t]||lod_tri_has(L,t,wb)) continue;
+        const float* p0=L->verts[L->tri[c]].p;
+        const float* p1=L->verts[L->tri[t*3+(c%3+1)%3]].p;
+        const float* p2=L->verts[L->tri[t*3+(c%3+2)%3]].p;
+        float e1[3]={p1[0]-p0[0],p1[1]-p0[1],p1[2]-p0[2]}, e2[3]={p2[0]-p0[0],p2[1]-p0[1],p2[2]-p0[2]};
+        float f1[3]={p1[0]-pb[0],p1[1]-pb[1],p1[2]-pb[2]}, f2[3]={p2[0]-pb[0],p2[1]-pb[1],p2[2]-pb[2]};
+        float n0[3]={e1[1]*e2[2]-e1[2]*e2[1],e1[2]*e2[0]-e1[0]*e2[2],e1[0]*e2[1]-e1[1]*e2[0]};
+        float n1[3]={f1[1]*f2[2]-f1[2]*f2[1],f1[2]*f2[0]-f1[0]*f2[2],f1[0]*f2[1]-f1[1]*f2[0]};
+        if(n0[0]*n1[0]+n0[1]*n1[1]+n0[2]*n1[2]<=0.f) return false;
+    }
+    return true;
+}
+
+static void lod_collapse(Lod3D* L,uint32_t a,uint32_t b,uint32_t pass){
+    uint32_t wa=L->wid[a], wb=L->wid[b], tail=UINT32_MAX;
+    LOD_EACH(L,wa,c){
+        uint32_t t=c/3;
+        tail=c;
+        if(L->dead[t]) continue;
+        for(int k=0;k<3;k++) L->stamp[L->wid[L->tri[t*3+k]]]=pass;
+        if(lod_tri_has(L,t,wb)){ L->dead[t]=1; L->alive--; }
+        else L->tri[c]=b;
+    }
+    if(tail!=UINT32_MAX){ L->next[tail]=L->head[wb]; L->head[wb]=L->head[wa]; L->head[wa]=UINT32_MAX; }
+    for(int i=0;i<10;i++) L->Q[wb].q[i]+=L->Q[wa].q[i];
+    L->locked[wa]=1;
+}
+
+/* 1 パス。縮退できなければ false */
+static bool lod_pass(Lod3D* L,LodEdge3D* ed,uint32_t target,uint32_t pass){
+    uint32_t ne=0;
+    for(uint32_t t=0;t<L->tcnt;t++){
+        if(L->dead[t]) continue;
+        for(int k=0;k<3;k++){
+            uint32_t a=L->tri[t*3+k], b=L->tri[t*3+(k+1)%3];
+            uint32_t wa=L->wid[a], wb=L->wid[b];
+            if(wa==wb) continue;
+            if(!L->locked[wa]){ ed[ne].a=a; ed[ne].b=b; ed[ne++].cost=quadric_cost(&L->Q[wa],&L->Q[wb],L->verts[b].p); }
+            if(!L->locked[wb]){ ed[ne].a=b; ed[ne].b=a; ed[ne++].cost=quadric_cost(&L->Q[wa],&L->Q[wb],L->verts[a].p); }
+        }
+    }
+    qsort(ed,ne,sizeof(LodEdge3D),lod_edge_cmp);
+    bool any=false;
+    for(uint32_t e=0;e<ne&&L->alive>target;e++){
+        uint32_t a=ed[e].a, b=ed[e].b, wa=L->wid[a], wb=L->wid[b];
+        if(L->locked[wa]||L->stamp[wa]==pass||L->stamp[wb]==pass) continue;
+        if(!lod_no_flip(L,a,b)) continue;
+        lod_collapse(L,a,b,pass);
+        any=true;
+    }
+    return any;
+}
+
+static bool lod_init(Lod3D* L,const Vertex3D* verts,uint32_t vcnt,const uint32_t* idx,uint32_t icnt){
+    memset(L,0,sizeof(*L));
+    L->verts=verts; L->tcnt=L->alive=icnt/3;
+    L->tri =(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+    L->next=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+    L->dead=(uint8_t*)calloc(L->tcnt,1);
+    L->wid =(uint32_t*)malloc((size_t)vcnt*sizeof(uint32_t));
+    if(!L->tri||!L->next||!L->dead||!L->wid) return false;
+    uint32_t nw=lod_weld(verts,vcnt,L->wid);
+    if(!nw) return false;
+    L->locked=(uint8_t*)calloc(nw,1);
+    L->stamp =(uint32_t*)calloc(nw,sizeof(uint32_t));
+    L->Q     =(Quadric3D*)calloc(nw,sizeof(Quadric3D));
+    L->head  =(uint32_t*)malloc((size_t)nw*sizeof(uint32_t));
+    uint32_t* copies=(uint32_t*)calloc(nw,sizeof(uint32_t));
+    LodEdge3D* edges=(LodEdge3D*)malloc((size_t)icnt*sizeof(LodEdge3D));
+    bool ok=L->locked&&L->stamp&&L->Q&&L->head&&copies&&edges;
+    if(ok){
+        memcpy(L->tri,idx,(size_t)icnt*sizeof(uint32_t));
+        memset(L->head,0xFF,(size_t)nw*sizeof(uint32_t));
+        for(uint32_t v=0;v<vcnt;v++) if(++copies[L->wid[v]]>1) L->locked[L->wid[v]]=1;   /* 継ぎ目 */
+        for(uint32_t c=0;c<icnt;c++){ uint32_t w=L->wid[idx[c]]; L->next[c]=L->head[w]; L->head[w]=c; }
+        /* 面の平面を面積で重み付けして頂点に足す */
+        for(uint32_t t=0;t<L->tcnt;t++){
+            const float *p0=verts[idx[t*3]].p, *p1=verts[idx[t*3+1]].p, *p2=verts[idx[t*3+2]].p;
+            double e1[3]={p1[0]-p0[0],p1[1]-p0[1],p1[2]-p0[2]}, e2[3]={p2[0]-p0[0],p2[1]-p0[1],p2[2]-p0[2]};
+            double n[3]={e1[1]*e2[2]-e1[2]*e2[1],e1[2]*e2[0]-e1[0]*e2[2],e1[0]*e2[1]-e1[1]*e2[0]};
+            double l=sqrt(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+            if(l<1e-20) continue;
+            n[0]/=l; n[1]/=l; n[2]/=l;
+            double d=-(n[0]*p0[0]+n[1]*p0[1]+n[2]*p0[2]);
+            for(int k=0;k<3;k++) quadric_plane(&L->Q[L->wid[idx[t*3+k]]],n[0],n[1],n[2],d,l*0.5);
+        }
+        /* 縁 (片側にしか面が無い辺) の端点を固定する: 辺を (小さい位置, 大きい位置) で並べて数える */
+        uint32_t ne=0;
+        for(uint32_t c=0;c<icnt;c++){
+            uint32_t wa=L->wid[idx[c]], wb=L->wid[idx[c-c%3+(c%3+1)%3]];
+            if(wa==wb) continue;
+            edges[ne].a=wa<wb?wa:wb; edges[ne].b=wa<wb?wb:wa; edges[ne++].cost=0.f;
+        }
+        qsort(edges,ne,sizeof(LodEdge3D),lod_pair_cmp);
+        for(uint32_t s=0;s<ne;){
+            uint32_t e=s+1;
+            while(e<ne&&edges[e].a==edges[s].a&&edges[e].b==edges[s].b) e++;
+            if(e-s!=2) L->locked[edges[s].a]=L->locked[edges[s].b]=1;   /* 縁か非多様体 */
+            s=e;
+        }
+    }
+    free(copies); free(edges);
+    return ok;
+}
+static void lod_free(Lod3D* L){
+    free(L->tri); free(L->next); free(L->dead); free(L->wid);
+    free(L->locked); free(L->stamp); free(L->Q); free(L->head);
+}
+
+/* LOD0 (idx) に続けて簡略化した LOD を並べたインデックスを返す。
+ * 作れなければ NULL (m->n_lods=1)。*total に全インデックス数 */
+static uint32_t* build_lods(Mesh3D* m,const Vertex3D* verts,uint32_t vcnt,
+                            const uint32_t* idx,uint32_t icnt,uint32_t* total)
+{
+    if(icnt/3<LOD_MIN_TRIS||icnt%3) return NULL;
+    Lod3D L; memset(&L,0,sizeof(L));
+    LodEdge3D* ed=(LodEdge3D*)malloc((size_t)icnt*2*sizeof(LodEdge3D));
+    uint32_t* out=(uint32_t*)malloc((size_t)icnt*3*sizeof(uint32_t));   /* 各段は前段の 8 割以下 */
+    bool ok=ed&&out&&lod_init(&L,verts,vcnt,idx,icnt);
+    uint32_t n=icnt, prev=icnt/3, pass=0;
+    if(ok){
+        memcpy(out,idx,(size_t)icnt*sizeof(uint32_t));
+        for(int l=1;l<ENG_3D_MAX_LODS;l++){
+            uint32_t target=(icnt/3)>>l;
+            while(L.alive>target&&lod_pass(&L,ed,target,++pass)){}
+            if((float)L.alive>(float)prev*LOD_MIN_GAIN||L.alive==0) break;
+            m->lod[l].first=n;
+            for(uint32_t t=0;t<L.tcnt;t++)
+                if(!L.dead[t]){ memcpy(out+n,L.tri+t*3,3*sizeof(uint32_t)); n+=3; }
+            m->lod[l].count=n-m->lod[l].first;
+            m->n_lods=l+1; prev=L.alive;
+            if(L.alive>target) break;                                  /* これ以上減らせない */
+        }
+    }
+    lod_free(&L); free(ed);
+    if(m->n_lods<2){ free(out); return NULL; }
+    *total=n;
+    return out;
+}
+
+/* ══════════════════════════════════════════════════════
+ * メッシュ内部ユーティリティ
+ * ══════════════════════════════════════════════════════*/
+/* ── 圧縮頂点 (ENG_3D_MESH_PACKED) ─
+ *   位置: バウンディングボックス中心からの snorm16 (w は詰め物)
+ *   法線/接線: 八面体エンコードの snorm16×2, UV: half×2 */
+static uint16_t f32_to_f16(float f){
+    uint32_t x; memcpy(&x,&f,4);
+    uint32_t sign=(x>>16)&0x8000u, m=x&0x7FFFFFu;
+    int e=(int)((x>>23)&0xFF);
+    if(e==0xFF) return (uint16_t)(sign|0x7C00u|(m?0x200u:0u));   /* inf / nan */
+    e=e-127+15;
+    if(e>=31) return (uint16_t)(sign|0x7C00u);
+    if(e<=0){                                                       /* 非正規化数 */
+        if(e<-10) return (uint16_t)sign;
+        m|=0x800000u;
+        uint32_t sh=(uint32_t)(14-e), h=m>>sh;
+        if((m>>(sh-1))&1u) h++;
+        return (uint16_t)(sign|h);
+    }
+    uint32_t h=sign|((uint32_t)e<<10)|(m>>13);
+    if(m&0x1000u) h++;                                              /* 丸め (繰り上がりは指数へ) */
+    return (uint16_t)h;
+}
+static int16_t snorm16(float v){
+    v=CLAMP(v,-1.f,1.f);
+    return (int16_t)lrintf(v*32767.f);
+}
+static void oct_encode(const float n[3],int16_t out[2]){
+    float l1=fabsf(n[0])+fabsf(n[1])+fabsf(n[2]);
+    if(l1<1e-20f){out[0]=out[1]=0;return;}
+    float x=n[0]/l1, y=n[1]/l1;
+    if(n[2]<0.f){
+        float ox=x;
+        x=(1.f-fabsf(y))*(ox>=0.f?1.f:-1.f);
+        y=(1.f-fabsf(ox))*(y>=0.f?1.f:-1.f);
+    }
+    out[0]=snorm16(x); out[1]=snorm16(y);
+}
+/* m->bounds から位置の復元係数を決めて詰める。失敗時 NULL */
+static PackedVertex3D* pack_vertices(Mesh3D* m,const Vertex3D* verts,uint32_t vcnt){
+    PackedVertex3D* pv=(PackedVertex3D*)malloc((size_t)vcnt*sizeof(PackedVertex3D));
+    if(!pv) return NULL;
+    float inv[3];
+    for(int k=0;k<3;k++){
+        float c=(m->bounds.min[k]+m->bounds.max[k])*0.5f;
+        float h=(m->bounds.max[k]-m->bounds.min[k])*0.5f;
+        if(h<1e-20f) h=1.f;
+        m->pos_bias[k]=c; m->pos_scale[k]=h; inv[k]=1.f/h;
+    }
+    for(uint32_t i=0;i<vcnt;i++){
+        const Vertex3D* v=&verts[i]; PackedVertex3D* p=&pv[i];
+        for(int k=0;k<3;k++) p->p[k]=snorm16((v->p[k]-m->pos_bias[k])*inv[k]);
+        p->p[3]=0;
+        oct_encode(v->n,p->n);
+        oct_encode(v->t,p->t);
+        p->uv[0]=f32_to_f16(v->uv[0]); p->uv[1]=f32_to_f16(v->uv[1]);
+    }
+    return pv;
+}
+
+/* ══════════════════════════════════════════════════════
+ * ジオメトリアリーナ (ENG_3D_MESH_ARENA)
+ *   頂点形式ごとに VBO/EBO/VAO を 1 組だけ持ち、メッシュはその中の
+ *   (baseVertex, firstIndex) の区間として置く。区間は空きリスト
+ *   (オフセット順, 隣同士は結合) から先頭一致で取り、足りなければ
+ *   バッファを倍にして glCopyBufferSubData で移す。同じ形式のメッシュは
+ *   VAO を切り替えずに glDrawElementsInstancedBaseVertex で描ける
+ * ══════════════════════════════════════════════════════*/
+#define ARENA_INIT_VERTS   (64u*1024u)
+#define ARENA_INIT_INDICES (256u*1024u)
+
+static uint32_t span_alloc(FreeList3D* f,uint32_t len){
+    for(int i=0;i<f->n;i++){
+        Span3D* s=&f->span[i];
+        if(s->len<len) continue;
+        uint32_t off=s->off;
+        s->off+=len; s->len-=len;
+        if(!s->len){ memmove(s,s+1,(size_t)(f->n-i-1)*sizeof(Span3D)); f->n--; }
+        return off;
+    }
+    return UINT32_MAX;
+}
+static void span_free(FreeList3D* f,uint32_t off,uint32_t len){
+    if(!len) return;
+    int i=0;
+    while(i<f->n&&f->span[i].off<off) i++;
+    bool prev=i>0&&f->span[i-1].off+f->span[i-1].len==off;
+    bool next=i<f->n&&off+len==f->span[i].off;
+    if(prev&&next){
+        f->span[i-1].len+=len+f->span[i].len;
+        memmove(&f->span[i],&f->span[i+1],(size_t)(f->n-i-1)*sizeof(Span3D)); f->n--;
+    }
+    else if(prev) f->span[i-1].len+=len;
+    else if(next){ f->span[i].off=off; f->span[i].len+=len; }
+    else {
+        if(f->n==f->cap){
+            int nc=f->cap?f->cap*2:16;
+            Span3D* ns=(Span3D*)realloc(f->span,(size_t)nc*sizeof(Span3D));
+            if(!ns) return;                         /* 空きを失うだけで壊れはしない */
+            f->span=ns; f->cap=nc;
+        }
+        memmove(&f->span[i+1],&f->span[i],(size_t)(f->n-i)*sizeof(Span3D));
+        f->span[i].off=off; f->span[i].len=len; f->n++;
+    }
+}
+
+/* len 要素の区間を取る。空きが無ければ *buf を広げて *moved=true */
+static uint32_t arena_take(FreeList3D* f,unsigned int* buf,uint32_t len,size_t elem,
+                           uint32_t init,bool* moved)
+{
+    uint32_t off=span_alloc(f,len);
+    if(off!=UINT32_MAX) return off;
+    uint64_t ns=f->size?f->size:init;
+    while(ns<(uint64_t)f->size+len) ns*=2;
+    if(ns>UINT32_MAX) return UINT32_MAX;
+    unsigned int nb=0;
+    glGenBuffers(1,&nb);
+    glBindBuffer(GL_COPY_WRITE_BUFFER,nb);
+    glBufferData(GL_COPY_WRITE_BUFFER,(GLsizeiptr)(ns*elem),NULL,GL_STATIC_DRAW);
+    if(*buf){
+        glBindBuffer(GL_COPY_READ_BUFFER,*buf);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,(GLsizeiptr)((size_t)f->size*elem));
+        glDeleteBuffers(1,buf);
+    }
+    *buf=nb; *moved=true;
+    span_free(f,f->size,(uint32_t)ns-f->size);
+    f->size=(uint32_t)ns;
+    return span_alloc(f,len);
+}
+
+static void vertex_layout(bool packed);
+
+static bool arena_upload(ENG_3D* ctx,Mesh3D* m,const void* vdata,size_t stride,uint32_t vcnt,
+                         const uint32_t* idx,uint32_t icnt)
+{
+    GeoArena3D* a=&ctx->arena[m->packed?1:0];
+    bool moved=!a->vao;
+    if(!a->vao) glGenVertexArrays(1,&a->vao);
+    uint32_t bv=arena_take(&a->verts,&a->vbo,vcnt,stride,ARENA_INIT_VERTS,&moved);
+    uint32_t fi=arena_take(&a->idx,&a->ebo,icnt,sizeof(uint32_t),ARENA_INIT_INDICES,&moved);
+    if(moved){                                      /* バッファが替わったら VAO を張り直す */
+        glBindVertexArray(a->vao);
+        glBindBuffer(GL_ARRAY_BUFFER,a->vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,a->ebo);
+        vertex_layout(m->packed);
+        glBindVertexArray(0);
+    }
+    if(bv==UINT32_MAX||fi==UINT32_MAX){
+        if(bv!=UINT32_MAX) span_free(&a->verts,bv,vcnt);
+        if(fi!=UINT32_MAX) span_free(&a->idx,fi,icnt);
+        return false;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER,a->vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER,(GLintptr)((size_t)bv*stride),(GLsizeiptr)((size_t)vcnt*stride),vdata);
+    glBindBuffer(GL_COPY_WRITE_BUFFER,a->ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER,(GLintptr)((size_t)fi*sizeof(uint32_t)),(GLsizeiptr)((size_t)icnt*sizeof(uint32_t)),idx);
+    m->vao=a->vao; m->vbo=m->ebo=0;
+    m->in_arena=true; m->base_vertex=bv; m->first_index=fi; m->arena_indices=icnt;
+    return true;
+}
+
+static void arena_release(ENG_3D* ctx,const Mesh3D* m){
+    GeoArena3D* a=&ctx->arena[m->packed?1:0];
+    span_free(&a->verts,m->base_vertex,(uint32_t)m->vertex_count);
+    span_free(&a->idx,m->first_index,m->arena_indices);
+}
+
+/* 頂点属性 0..3 と インスタンス属性 4..9 (VAO と VBO をバインドした状態で呼ぶ) */
+static void vertex_layout(bool packed){
+    for(int a=0;a<4;a++) glEnableVertexAttribArray(a);
+    if(packed){
+        GLsizei st=sizeof(PackedVertex3D);
+        /* pos */ glVertexAttribPointer(0,3,GL_SHORT,GL_TRUE,st,(void*)offsetof(PackedVertex3D,p));
+        /* nor */ glVertexAttribPointer(1,2,GL_SHORT,GL_TRUE,st,(void*)offsetof(PackedVertex3D,n));
+        /* uv  */ glVertexAttribPointer(2,2,GL_HALF_FLOAT,GL_FALSE,st,(void*)offsetof(PackedVertex3D,uv));
+        /* tan */ glVertexAttribPointer(3,2,GL_SHORT,GL_TRUE,st,(void*)offsetof(PackedVertex3D,t));
+    } else {
+        /* pos */ glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,p));
+        /* nor */ glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,n));
+        /* uv  */ glVertexAttribPointer(2,2,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,uv));
+        /* tan */ glVertexAttribPointer(3,3,GL_FLOAT,GL_FALSE,sizeof(Vertex3D),(void*)offsetof(Vertex3D,t));
+    }
+    /* インスタンス行列 (4..7)・UV 矩形 (8)・レイヤー (9)・法線行列 (10..12)。参照先は描画時に point_instances で設定 */
+    for(int a=4;a<13;a++){glEnableVertexAttribArray(a);glVertexAttribDivisor(a,1);}
+}
+
+/* compute_bounds の後に呼ぶこと (圧縮頂点は bounds 基準で量子化する)。構築はメッシュの flags に従う。
+ * 最適化済みでなければ ENG_3D_MESH_OPTIMIZE でコピーを並べ替えて送る */
+static void upload_mesh(ENG_3D* ctx, Mesh3D* m, const Vertex3D* verts, uint32_t vcnt,
+                         const uint32_t* idx, uint32_t icnt)
+{
+    Vertex3D* ov=NULL; uint32_t* oi=NULL;
+    if((m->flags&ENG_3D_MESH_OPTIMIZE)&&!m->optimized){
+        ov=(Vertex3D*)malloc((size_t)vcnt*sizeof(Vertex3D));
+        oi=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+        if(ov&&oi){
+            memcpy(ov,verts,(size_t)vcnt*sizeof(Vertex3D));
+            memcpy(oi,idx,(size_t)icnt*sizeof(uint32_t));
+            if(optimize_mesh(m,ov,vcnt,oi,icnt)){ verts=ov; idx=oi; }
+        }
+    }
+    uint32_t total=icnt;
+    uint32_t* li=(m->flags&ENG_3D_MESH_LOD)?build_lods(m,verts,vcnt,idx,icnt,&total):NULL;
+    m->lod[0].first=0; m->lod[0].count=icnt;
+    PackedVertex3D* pv=(m->flags&ENG_3D_MESH_PACKED)?pack_vertices(m,verts,vcnt):NULL;
+    m->packed=(pv!=NULL);
+    const void* vdata=pv?(const void*)pv:(const void*)verts;
+    size_t stride=pv?sizeof(PackedVertex3D):sizeof(Vertex3D);
+    const uint32_t* idata=li?li:idx;
+    if(!(m->flags&ENG_3D_MESH_ARENA)||!arena_upload(ctx,m,vdata,stride,vcnt,idata,total)){
+        glGenVertexArrays(1,&m->vao);
+        glGenBuffers(1,&m->vbo);
+        glGenBuffers(1,&m->ebo);
+        glBindVertexArray(m->vao);
+        glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
+        glBufferData(GL_ARRAY_BUFFER,(GLsizeiptr)((size_t)vcnt*stride),vdata,GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,(GLsizeiptr)(total*sizeof(uint32_t)),idata,GL_STATIC_DRAW);
+        vertex_layout(m->packed);
+        glBindVertexArray(0);
+    }
+    m->vertex_count=vcnt;
+    m->index_count =icnt;
+    free(pv); free(ov); free(oi); free(li);
+}
+
+/* ══════════════════════════════════════════════════════
+ * 接線・AABB
+ *   大きなメッシュは job_range で分ける。接線は三角形の塊ごとに
+ *   触れる頂点の窓 [lo,hi) だけの私有バッファへ足し込み、
+ *   頂点の塊ごとに塊番号順で合算するので結果は実行順に依らない。
+ *   窓の合計が頂点数の TAN_WINDOW_MAX 倍を超える (添字が散らばった)
+ *   メッシュは 1 スレッドで足す
+ * ══════════════════════════════════════════════════════*/
+#define TAN_WINDOW_MAX 2
+
+static void tri_tangent(const Vertex3D* verts,const uint32_t* tri,float t[3]){
+    const Vertex3D *v0=&verts[tri[0]],*v1=&verts[tri[1]],*v2=&verts[tri[2]];
+    float e1[3]={v1->p[0]-v0->p[0],v1->p[1]-v0->p[1],v1->p[2]-v0->p[2]};
+    float e2[3]={v2->p[0]-v0->p[0],v2->p[1]-v0->p[1],v2->p[2]-v0->p[2]};
+    float du1=v1->uv[0]-v0->uv[0], dv1=v1->uv[1]-v0->uv[1];
+    float du2=v2->uv[0]-v0->uv[0], dv2=v2->uv[1]-v0->uv[1];
+    float f=1.f/(du1*dv2-du2*dv1+1e-8f);
+    t[0]=f*(dv2*e1[0]-dv1*e2[0]);
+    t[1]=f*(dv2*e1[1]-dv1*e2[1]);
+    t[2]=f*(dv2*e1[2]-dv1*e2[2]);
+}
+
+static void tan_normalize(float* t){
+    float len=sqrtf(t[0]*t[0]+t[1]*t[1]+t[2]*t[2])+1e-8f;
+    t[0]/=len; t[1]/=len; t[2]/=len;
+}
+
+typedef struct {
+    Vertex3D*       verts;
+    const uint32_t* idx;
+    int             chunks;
+    uint32_t        lo[JOB_MAX_THREADS+1], hi[JOB_MAX_THREADS+1];   /* 塊 c が触れる頂点 */
+    float*          acc[JOB_MAX_THREADS+1];                         /* (hi-lo)×3 */
+} TanJob3D;
+
+static void tan_window(void* arg,uint32_t t0,uint32_t t1,int c){
+    TanJob3D* J=(TanJob3D*)arg;
+    uint32_t lo=UINT32_MAX, hi=0;
+    for(uint32_t i=t0*3;i<t1*3;i++){ uint32_t v=J->idx[i]; if(v<lo) lo=v; if(v>=hi) hi=v+1; }
+    J->lo[c]=lo<hi?lo:0; J->hi[c]=hi;
+}
+
+static void tan_accum(void* arg,uint32_t t0,uint32_t t1,int c){
+    TanJob3D* J=(TanJob3D*)arg;
+    float* acc=J->acc[c]; uint32_t lo=J->lo[c];
+    for(uint32_t t=t0;t<t1;t++){
+        const uint32_t* tri=J->idx+(size_t)t*3;
+        float tg[3]; tri_tangent(J->verts,tri,tg);
+        for(int k=0;k<3;k++){
+            float* a=acc+(size_t)(tri[k]-lo)*3;
+            a[0]+=tg[0]; a[1]+=tg[1]; a[2]+=tg[2];
+        }
+    }
+}
+
+static void tan_reduce(void* arg,uint32_t v0,uint32_t v1,int chunk){
+    TanJob3D* J=(TanJob3D*)arg;
+    for(uint32_t v=v0;v<v1;v++){
+        float* t=J->verts[v].t;
+        t[0]=t[1]=t[2]=0.f;
+        for(int c=0;c<J->chunks;c++){
+            if(v<J->lo[c]||v>=J->hi[c]) continue;
+            const float* a=J->acc[c]+(size_t)(v-J->lo[c])*3;
+            t[0]+=a[0]; t[1]+=a[1]; t[2]+=a[2];
+        }
+        tan_normalize(t);
+    }
+}
+
+static void compute_tangents(JobPool3D* jp, Vertex3D* verts, uint32_t vcnt,
+                               uint32_t* idx, uint32_t icnt)
+{
+    uint32_t tcnt=icnt/3;
+    TanJob3D J; memset(&J,0,sizeof(J));
+    J.verts=verts; J.idx=idx;
+    J.chunks=job_chunks(jp,tcnt,JOB_GRAIN);
+    if(J.chunks>1){
+        job_range(jp,J.chunks,tcnt,tan_window,&J);
+        uint64_t total=0;
+        for(int c=0;c<J.chunks;c++) total+=J.hi[c]-J.lo[c];
+        bool ok=total<=(uint64_t)vcnt*TAN_WINDOW_MAX;
+        for(int c=0;c<J.chunks&&ok;c++)
+            ok=(J.acc[c]=(float*)calloc((size_t)(J.hi[c]-J.lo[c])*3+1,sizeof(float)))!=NULL;
+        if(ok){
+            job_range(jp,J.chunks,tcnt,tan_accum,&J);
+            job_range(jp,job_chunks(jp,vcnt,JOB_GRAIN),vcnt,tan_reduce,&J);
+        }
+        for(int c=0;c<J.chunks;c++) free(J.acc[c]);
+        if(ok) return;
+    }
+    for(uint32_t i=0;i<vcnt;i++){ verts[i].t[0]=verts[i].t[1]=verts[i].t[2]=0.f; }
+    for(uint32_t i=0;i+2<icnt;i+=3){
+        float tg[3]; tri_tangent(verts,idx+i,tg);
+        for(int k=0;k<3;k++){
+            verts[idx[i+k]].t[0]+=tg[0];
+            verts[idx[i+k]].t[1]+=tg[1];
+            verts[idx[i+k]].t[2]+=tg[2];
+        }
+    }
+    for(uint32_t i=0;i<vcnt;i++) tan_normalize(verts[i].t);
+}
+
+/* [b,e) の位置の最小/最大。p[0..2] に続く n[0] ごと 4 成分で読み、4 成分目は捨てる */
+static void bounds_range(const Vertex3D* verts,uint32_t b,uint32_t e,float mn[3],float mx[3]){
+#if defined(__SSE__)||defined(_M_X64)
+    __m128 lo=_mm_set1_ps(FLT_MAX), hi=_mm_set1_ps(-FLT_MAX);
+    for(uint32_t i=b;i<e;i++){
+        __m128 p=_mm_loadu_ps(verts[i].p);
+        lo=_mm_min_ps(lo,p); hi=_mm_max_ps(hi,p);
+    }
+    float l4[4], h4[4]; _mm_storeu_ps(l4,lo); _mm_storeu_ps(h4,hi);
+#elif defined(__ARM_NEON)
+    float32x4_t lo=vdupq_n_f32(FLT_MAX), hi=vdupq_n_f32(-FLT_MAX);
+    for(uint32_t i=b;i<e;i++){
+        float32x4_t p=vld1q_f32(verts[i].p);
+        lo=vminq_f32(lo,p); hi=vmaxq_f32(hi,p);
+    }
+    float l4[4], h4[4]; vst1q_f32(l4,lo); vst1q_f32(h4,hi);
+#else
+    float l4[3]={FLT_MAX,FLT_MAX,FLT_MAX}, h4[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
+    for(uint32_t i=b;i<e;i++) for(int k=0;k<3;k++){
+        if(verts[i].p[k]<l4[k]) l4[k]=verts[i].p[k];
+        if(verts[i].p[k]>h4[k]) h4[k]=verts[i].p[k];
+    }
+#endif
+    for(int k=0;k<3;k++){ mn[k]=l4[k]; mx[k]=h4[k]; }
+}
+
+typedef struct { const Vertex3D* verts; float mn[JOB_MAX_THREADS+1][3], mx[JOB_MAX_THREADS+1][3]; } BoundsJob3D;
+static void bounds_job(void* arg,uint32_t b,uint32_t e,int c){
+    BoundsJob3D* J=(BoundsJob3D*)arg;
+    bounds_range(J->verts,b,e,J->mn[c],J->mx[c]);
+}
+
+static void compute_bounds(JobPool3D* jp, Mesh3D* m, Vertex3D* verts, uint32_t vcnt){
+    if(!vcnt)return;
+    BoundsJob3D J; J.verts=verts;
+    int chunks=job_chunks(jp,vcnt,JOB_GRAIN);
+    job_range(jp,chunks,vcnt,bounds_job,&J);
+    for(int k=0;k<3;k++){ m->bounds.min[k]=J.mn[0][k]; m->bounds.max[k]=J.mx[0][k]; }
+    for(int c=1;c<chunks;c++) for(int k=0;k<3;k++){
+        if(J.mn[c][k]<m->bounds.min[k]) m->bounds.min[k]=J.mn[c][k];
+        if(J.mx[c][k]>m->bounds.max[k]) m->bounds.max[k]=J.mx[c][k];
+    }
+}
+
+
+static void mesh_default(Mesh3D* m,int flags){
+    m->flags=flags;
+    m->color[0]=m->color[1]=m->color[2]=m->color[3]=1.f;
+    m->spec_intensity=0.5f; m->shininess=32.f;
+    m->cast_shadow=true; m->receive_shadow=true;
+    m->packed=false; m->optimized=false; m->acmr_before=m->acmr_after=0.f;
+    m->n_lods=1; m->in_arena=false;
+    for(int k=0;k<3;k++){m->pos_scale[k]=1.f;m->pos_bias[k]=0.f;}
+}
+
+/* ══════════════════════════════════════════════════════
+ * メッシュ生成 プリミティブ
+ * ══════════════════════════════════════════════════════*/
+ENG_3D_MeshID eng3d_mesh_cube(ENG_3D* ctx, float w, float h, float d){
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes); if(!id) return 0;
+    float hx=w*0.5f,hy=h*0.5f,hz=d*0.5f;
+    /* 面ごとに 4 頂点、法線を持つ */
+    Vertex3D verts[24]; uint32_t idx[36]; memset(verts,0,sizeof(verts));
+    /* front */
+    float faces[6][3]={{0,0,1},{0,0,-1},{0,1,0},{0,-1,0},{1,0,0},{-1,0,0}};
+    /* 簡略: 一面ずつ手打ち */
+    int vi=0,ii=0;
+    /* +Z */
+    float nx=0,ny=0,nz=1;
+    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{0,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
+    for(int f=0;f<6;f++) idx[ii+f]=((uint32_t[]){0,1,2,0,2,3}[f])+(uint32_t)(vi-4); ii+=6;
+    /* -Z */
+    nx=0;ny=0;nz=-1;
+    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
+    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{0,1}};vi++;
+    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
+    /* +Y */
+    nx=0;ny=1;nz=0;
+    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{0,0}};vi++;
+    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
+    /* -Y */
+    nx=0;ny=-1;nz=0;
+    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{0,1}};vi++;
+    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
+    /* +X */
+    nx=1;ny=0;nz=0;
+    verts[vi]=(Vertex3D){{ hx,-hy, hz},{nx,ny,nz},{0,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx,-hy,-hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy,-hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{ hx, hy, hz},{nx,ny,nz},{0,1}};vi++;
+    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
+    /* -X */
+    nx=-1;ny=0;nz=0;
+    verts[vi]=(Vertex3D){{-hx,-hy,-hz},{nx,ny,nz},{0,0}};vi++;
+    verts[vi]=(Vertex3D){{-hx,-hy, hz},{nx,ny,nz},{1,0}};vi++;
+    verts[vi]=(Vertex3D){{-hx, hy, hz},{nx,ny,nz},{1,1}};vi++;
+    verts[vi]=(Vertex3D){{-hx, hy,-hz},{nx,ny,nz},{0,1}};vi++;
+    { uint32_t base=(uint32_t)(vi-4); for(int f=0;f<6;f++) idx[ii+f]=base+((uint32_t[]){0,1,2,0,2,3})[f]; ii+=6; }
+
+    (void)faces;
+    compute_tangents(&ctx->jobs,verts,24,idx,36);
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,24);
+    upload_mesh(ctx,m,verts,24,idx,36);
+    return id;
+}
+
+/* 格子状プリミティブ (球・カプセル・トーラス) は行単位で独立なので、
+ * 頂点数が JOB_GRAIN を超えると行をまとめてワーカーに配る */
+typedef struct {
+    Vertex3D* verts; uint32_t* idx;
+    float     r, R, hh;
+    int       cols, rows;       /* 行あたりの区間数 / 区間の行数 (頂点は (cols+1)×(rows+1)) */
+} GridGen3D;
+
+static int grid_chunks(JobPool3D* jp,const GridGen3D* g){
+    return job_chunks(jp,(uint32_t)(g->rows+1),JOB_GRAIN/(uint32_t)(g->cols+1)+1);
+}
+
+/* 行 j と j+1 を結ぶ 2 三角形 × cols */
+static void grid_indices(const GridGen3D* g,int j){
+    uint32_t* o=g->idx+(size_t)j*(size_t)g->cols*6;
+    for(int i=0;i<g->cols;i++){
+        uint32_t a=(uint32_t)(j*(g->cols+1)+i), b=a+(uint32_t)(g->cols+1);
+        *o++=a; *o++=b; *o++=a+1;
+        *o++=a+1; *o++=b; *o++=b+1;
+    }
+}
+
+static void sphere_rows(void* arg,uint32_t j0,uint32_t j1,int chunk){
+    const GridGen3D* g=(const GridGen3D*)arg;
+    for(int j=(int)j0;j<(int)j1;j++){
+        float phi=(float)j/(float)g->rows*(float)M_PI;
+        Vertex3D* v=g->verts+(size_t)j*(size_t)(g->cols+1);
+        for(int i=0;i<=g->cols;i++,v++){
+            float theta=(float)i/(float)g->cols*2.f*(float)M_PI;
+            float nx=sinf(phi)*cosf(theta), ny=cosf(phi), nz=sinf(phi)*sinf(theta);
+            v->p[0]=g->r*nx; v->p[1]=g->r*ny; v->p[2]=g->r*nz;
+            v->n[0]=nx;      v->n[1]=ny;      v->n[2]=nz;
+            v->uv[0]=(float)i/(float)g->cols;
+            v->uv[1]=(float)j/(float)g->rows;
+        }
+        if(j<g->rows) grid_indices(g,j);
+    }
+}
+
+ENG_3D_MeshID eng3d_mesh_sphere(ENG_3D* ctx, float r, int slices, int stacks){
+    if(slices<3) slices=16; if(stacks<2) stacks=8;
+    int vcnt=(slices+1)*(stacks+1);
+    int icnt=slices*stacks*6;
+    Vertex3D* verts=(Vertex3D*)calloc((size_t)vcnt,sizeof(Vertex3D));
+    uint32_t* idx=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+    if(!verts||!idx){free(verts);free(idx);return 0;}
+    GridGen3D g={verts,idx,r,0.f,0.f,slices,stacks};
+    job_range(&ctx->jobs,grid_chunks(&ctx->jobs,&g),(uint32_t)(stacks+1),sphere_rows,&g);
+    compute_tangents(&ctx->jobs,verts,(uint32_t)vcnt,idx,(uint32_t)icnt);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes);
+    if(!id){free(verts);free(idx);return 0;}
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,(uint32_t)vcnt);
+    upload_mesh(ctx,m,verts,(uint32_t)vcnt,idx,(uint32_t)icnt);
+    free(verts); free(idx);
+    return id;
+}
+
+ENG_3D_MeshID eng3d_mesh_plane(ENG_3D* ctx, float w, float d){
+    float hw=w*0.5f, hd=d*0.5f;
+    Vertex3D verts[4]={
+        {{-hw,0, hd},{0,1,0},{0,1}},
+        {{ hw,0, hd},{0,1,0},{1,1}},
+        {{ hw,0,-hd},{0,1,0},{1,0}},
+        {{-hw,0,-hd},{0,1,0},{0,0}}
+    };
+    uint32_t idx[6]={0,1,2,0,2,3};
+    compute_tangents(&ctx->jobs,verts,4,idx,6);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes); if(!id) return 0;
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,4);
+    upload_mesh(ctx,m,verts,4,idx,6);
+    return id;
+}
+
+ENG_3D_MeshID eng3d_mesh_cylinder(ENG_3D* ctx, float r, float h, int segs){
+    if(segs<3) segs=16;
+    int vcnt=(segs+1)*4+2; /* side top+bot caps */
+    int icnt=segs*6 + segs*3*2;
+    Vertex3D* verts=(Vertex3D*)calloc((size_t)vcnt,sizeof(Vertex3D));
+    uint32_t* idx=(uint32_t*)malloc((size_t)icnt*sizeof(uint32_t));
+    float hh=h*0.5f; int vi=0,ii=0;
+    /* side */
+    for(int i=0;i<=segs;i++){
+        float th=(float)i/(float)segs*2.f*(float)M_PI;
+        float cx=cosf(th), cz=sinf(th);
+        verts[vi].p[0]=r*cx; verts[vi].p[1]=-hh; verts[vi].p[2]=r*cz;
+        verts[vi].n[0]=cx; verts[vi].n[2]=cz; verts[vi].uv[0]=(float)i/(float)segs; verts[vi].uv[1]=0; vi++;
+        verts[vi].p[0]=r*cx; verts[vi].p[1]= hh; verts[vi].p[2]=r*cz;
+        verts[vi].n[0]=cx; verts[vi].n[2]=cz; verts[vi].uv[0]=(float)i/(float)segs; verts[vi].uv[1]=1; vi++;
+    }
+    for(int i=0;i<segs;i++){
+        uint32_t b=(uint32_t)(i*2);
+        idx[ii++]=b; idx[ii++]=b+2; idx[ii++]=b+1;
+        idx[ii++]=b+1; idx[ii++]=b+2; idx[ii++]=b+3;
+    }
+    /* top cap center */
+    uint32_t tc=(uint32_t)vi;
+    verts[vi].p[1]=hh; verts[vi].n[1]=1.f; verts[vi].uv[0]=verts[vi].uv[1]=0.5f; vi++;
+    for(int i=0;i<=segs;i++){
+        float th=(float)i/(float)segs*2.f*(float)M_PI;
+        verts[vi].p[0]=r*cosf(th); verts[vi].p[1]=hh; verts[vi].p[2]=r*sinf(th);
+        verts[vi].n[1]=1.f;
+        verts[vi].uv[0]=cosf(th)*0.5f+0.5f; verts[vi].uv[1]=sinf(th)*0.5f+0.5f; vi++;
+    }
+    for(int i=0;i<segs;i++){
+        idx[ii++]=tc; idx[ii++]=tc+1+(uint32_t)i+1; idx[ii++]=tc+1+(uint32_t)i;
+    }
+    /* bot cap */
+    uint32_t bc=(uint32_t)vi;
+    verts[vi].p[1]=-hh; verts[vi].n[1]=-1.f; verts[vi].uv[0]=verts[vi].uv[1]=0.5f; vi++;
+    for(int i=0;i<=segs;i++){
+        float th=(float)i/(float)segs*2.f*(float)M_PI;
+        verts[vi].p[0]=r*cosf(th); verts[vi].p[1]=-hh; verts[vi].p[2]=r*sinf(th);
+        verts[vi].n[1]=-1.f;
+        verts[vi].uv[0]=cosf(th)*0.5f+0.5f; verts[vi].uv[1]=sinf(th)*0.5f+0.5f; vi++;
+    }
+    for(int i=0;i<segs;i++){
+        idx[ii++]=bc; idx[ii++]=bc+1+(uint32_t)i; idx[ii++]=bc+1+(uint32_t)i+1;
+    }
+    compute_tangents(&ctx->jobs,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes);
+    if(!id){free(verts);free(idx);return 0;}
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,(uint32_t)vi);
+    upload_mesh(ctx,m,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    free(verts); free(idx);
+    return id;
+}
+
+/* 下半球 (j<=rows/2) は -hh、上半球は +hh にずらした UV 球 */
+static void capsule_rows(void* arg,uint32_t j0,uint32_t j1,int chunk){
+    const GridGen3D* g=(const GridGen3D*)arg;
+    int hemi=g->rows/2;
+    for(int j=(int)j0;j<(int)j1;j++){
+        float phi;
+        float yoffset=0;
+        if(j<=hemi){
+            phi=(float)j/(float)hemi*(float)M_PI_2;
+            yoffset=-g->hh;
+        } else {
+            phi=(float)M_PI_2+(float)(j-hemi)/(float)hemi*(float)M_PI_2;
+            yoffset= g->hh;
+        }
+        float sp=sinf(phi), cp=cosf(phi);
+        Vertex3D* v=g->verts+(size_t)j*(size_t)(g->cols+1);
+        for(int i=0;i<=g->cols;i++,v++){
+            float th=(float)i/(float)g->cols*2.f*(float)M_PI;
+            float nx=sp*cosf(th), ny=cp, nz=sp*sinf(th);
+            v->p[0]=g->r*nx; v->p[1]=g->r*ny+yoffset; v->p[2]=g->r*nz;
+            v->n[0]=nx; v->n[1]=ny; v->n[2]=nz;
+            v->uv[0]=(float)i/(float)g->cols;
+            v->uv[1]=(float)j/(float)g->rows;
+        }
+        if(j<g->rows) grid_indices(g,j);
+    }
+}
+
+ENG_3D_MeshID eng3d_mesh_capsule(ENG_3D* ctx, float r, float h, int segs){
+    /* カプセル = 2 球端 + 円柱中間 で UV スフィア風に生成 */
+    if(segs<4) segs=16;
+    int hemi=segs/2, tot_stacks=hemi*2;
+    int vi=(segs+1)*(tot_stacks+1);
+    int ii=segs*tot_stacks*6;
+    Vertex3D* verts=(Vertex3D*)calloc((size_t)vi,sizeof(Vertex3D));
+    uint32_t* idx  =(uint32_t*)malloc((size_t)ii*sizeof(uint32_t));
+    if(!verts||!idx){free(verts);free(idx);return 0;}
+    GridGen3D g={verts,idx,r,0.f,h*0.5f,segs,tot_stacks};
+    job_range(&ctx->jobs,grid_chunks(&ctx->jobs,&g),(uint32_t)(tot_stacks+1),capsule_rows,&g);
+    compute_tangents(&ctx->jobs,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes);
+    if(!id){free(verts);free(idx);return 0;}
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,(uint32_t)vi);
+    upload_mesh(ctx,m,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    free(verts); free(idx);
+    return id;
+}
+
+/* 行 = 大円の分割 i、列 = 管の分割 j */
+static void torus_rows(void* arg,uint32_t i0,uint32_t i1,int chunk){
+    const GridGen3D* g=(const GridGen3D*)arg;
+    for(int i=(int)i0;i<(int)i1;i++){
+        float u=(float)i/(float)g->rows*2.f*(float)M_PI;
+        Vertex3D* vt=g->verts+(size_t)i*(size_t)(g->cols+1);
+        for(int j=0;j<=g->cols;j++,vt++){
+            float v=(float)j/(float)g->cols*2.f*(float)M_PI;
+            float cx=(g->R+g->r*cosf(v))*cosf(u);
+            float cy=g->r*sinf(v);
+            float cz=(g->R+g->r*cosf(v))*sinf(u);
+            float nx=cosf(v)*cosf(u), ny=sinf(v), nz=cosf(v)*sinf(u);
+            vt->p[0]=cx; vt->p[1]=cy; vt->p[2]=cz;
+            vt->n[0]=nx; vt->n[1]=ny; vt->n[2]=nz;
+            vt->uv[0]=(float)i/(float)g->rows;
+            vt->uv[1]=(float)j/(float)g->cols;
+        }
+        if(i<g->rows) grid_indices(g,i);
+    }
+}
+
+ENG_3D_MeshID eng3d_mesh_torus(ENG_3D* ctx, float R, float r, int segsR, int segsr){
+    if(segsR<4) segsR=32; if(segsr<4) segsr=16;
+    int vi=(segsR+1)*(segsr+1);
+    int ii=segsR*segsr*6;
+    Vertex3D* verts=(Vertex3D*)calloc((size_t)vi,sizeof(Vertex3D));
+    uint32_t* idx  =(uint32_t*)malloc((size_t)ii*sizeof(uint32_t));
+    if(!verts||!idx){free(verts);free(idx);return 0;}
+    GridGen3D g={verts,idx,r,R,0.f,segsr,segsR};
+    job_range(&ctx->jobs,grid_chunks(&ctx->jobs,&g),(uint32_t)(segsR+1),torus_rows,&g);
+    compute_tangents(&ctx->jobs,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes);
+    if(!id){free(verts);free(idx);return 0;}
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,ctx->mesh_flags);
+    compute_bounds(&ctx->jobs,m,verts,(uint32_t)vi);
+    upload_mesh(ctx,m,verts,(uint32_t)vi,idx,(uint32_t)ii);
+    free(verts); free(idx);
+    return id;
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: 読み取り専用ファイルマップ
+ * ══════════════════════════════════════════════════════*/
+typedef struct {
+    const char* data;
+    size_t      size;
+#ifdef _WIN32
+    HANDLE      file, map;
+#endif
+} MappedFile3D;
+
+static bool map_file(const char* path,MappedFile3D* mf){
+    memset(mf,0,sizeof(*mf));
+#ifdef _WIN32
+    mf->file=CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+    if(mf->file==INVALID_HANDLE_VALUE){mf->file=NULL;return false;}
+    LARGE_INTEGER sz;
+    if(!GetFileSizeEx(mf->file,&sz)){CloseHandle(mf->file);mf->file=NULL;return false;}
+    mf->size=(size_t)sz.QuadPart;
+    if(mf->size==0) return true;
+    mf->map=CreateFileMappingA(mf->file,NULL,PAGE_READONLY,0,0,NULL);
+    if(mf->map) mf->data=(const char*)MapViewOfFile(mf->map,FILE_MAP_READ,0,0,0);
+    if(!mf->data){
+        if(mf->map) CloseHandle(mf->map);
+        CloseHandle(mf->file); memset(mf,0,sizeof(*mf)); return false;
+    }
+#else
+    int fd=open(path,O_RDONLY);
+    if(fd<0) return false;
+    struct stat st;
+    if(fstat(fd,&st)!=0){close(fd);return false;}
+    mf->size=(size_t)st.st_size;
+    if(mf->size>0){
+        void* p=mmap(NULL,mf->size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(p==MAP_FAILED){close(fd);mf->size=0;return false;}
+        madvise(p,mf->size,MADV_SEQUENTIAL);
+        mf->data=(const char*)p;
+    }
+    close(fd);   /* マップは fd を閉じても残る */
+#endif
+    return true;
+}
+static void unmap_file(MappedFile3D* mf){
+#ifdef _WIN32
+    if(mf->data) UnmapViewOfFile(mf->data);
+    if(mf->map)  CloseHandle(mf->map);
+    if(mf->file) CloseHandle(mf->file);
+#else
+    if(mf->data) munmap((void*)mf->data,mf->size);
+#endif
+    memset(mf,0,sizeof(*mf));
+}
+
+/* 足りなければ倍々で伸ばす (elem バイト × need 個) */
+static bool grow_buf(void** p,size_t* cap,size_t need,size_t elem){
+    if(need<=*cap) return true;
+    size_t nc=*cap?*cap:1024;
+    while(nc<need) nc*=2;
+    void* np=realloc(*p,nc*elem);
+    if(!np) return false;
+    *p=np; *cap=nc;
+    return true;
+}
+
+/* キャッシュを書く一時ファイル名 "<path>.<pid>-<thread>.tmp" (free は呼び出し側)。
+ * 同じパスを別スレッド・別プロセスが同時に書いても混ざらない */
+static char* cache_tmp_path(const char* path){
+#ifdef _WIN32
+    unsigned long pid=(unsigned long)GetCurrentProcessId();
+#else
+    unsigned long pid=(unsigned long)getpid();
+#endif
+    size_t n=strlen(path)+48;
+    char* tmp=(char*)malloc(n);
+    if(tmp) snprintf(tmp,n,"%s.%lu-%lu.tmp",path,pid,(unsigned long)SDL_ThreadID());
+    return tmp;
+}
+
+/* ══════════════════════════════════════════════════════
+ * バイナリメッシュ (.e3dm)
+ *   [E3dmHeader 64B][Vertex3D × vertex_count][uint32 × index_count]
+ *   頂点/インデックスは GPU に渡す並びそのまま (リトルエンディアン)。
+ *   マップしたポインタをそのまま glBufferData に渡すのでコピーしない。
+ *   OBJ 読込時は "<path>.e3dm" にキャッシュを書き、次回はソースの
+ *   サイズと更新時刻が一致すればそちらを読む
+ * ══════════════════════════════════════════════════════*/
+#define E3DM_MAGIC   0x4D443345u   /* "E3DM" */
+#define E3DM_VERSION 3u
+#define E3DM_LAYOUT_PNUT 0x0Fu     /* pos | normal | uv | tangent (float) */
+#define E3DM_FLAG_OPTIMIZED 0x01u  /* 頂点キャッシュ最適化済み (acmr_* が有効) */
+
+typedef struct {
+    uint32_t magic, version;
+    uint8_t  layout, flags;        /* 頂点属性ビットと E3DM_FLAG_* */
+    uint16_t stride;               /* 1 頂点のバイト数 */
+    uint16_t acmr_before, acmr_after;   /* 最適化前後の ACMR×1000 */
+    uint32_t vertex_count, index_count;
+    uint64_t src_size;             /* キャッシュ元 (無ければ 0) */
+    int64_t  src_mtime;
+    float    bmin[3], bmax[3];
+} E3dmHeader;
+_Static_assert(sizeof(E3dmHeader)==64,"E3dmHeader は 64 バイト (頂点ブロックの整列)");
+
+/* 三角形単位で、全インデックスが頂点数未満か (壊れたファイルで範囲外を読まない) */
+static bool e3dm_indices_ok(const uint32_t* idx,uint32_t icnt,uint32_t vcnt){
+    if(vcnt==0||icnt%3) return false;
+    uint32_t hi=0;
+    for(uint32_t i=0;i<icnt;i++) if(idx[i]>hi) hi=idx[i];
+    return hi<vcnt;
+}
+
+/* src が非 NULL ならキャッシュとしてソースと一致するか確かめる。
+ * 最適化を求めるメッシュには未最適化のキャッシュを使わない (焼き直させる) */
+static ENG_3D_MeshID load_e3dm(ENG_3D* ctx,const char* path,const struct stat* src,int flags){
+    MappedFile3D mf;
+    if(!map_file(path,&mf)) return 0;
+    const E3dmHeader* h=(const E3dmHeader*)mf.data;
+    bool ok=mf.size>=sizeof(E3dmHeader)&&h->magic==E3DM_MAGIC&&h->version==E3DM_VERSION
+          &&h->layout==E3DM_LAYOUT_PNUT&&h->stride==sizeof(Vertex3D)&&h->index_count>0
+          &&mf.size>=sizeof(E3dmHeader)+(uint64_t)h->vertex_count*sizeof(Vertex3D)
+                                       +(uint64_t)h->index_count*sizeof(uint32_t);
+    if(ok&&src) ok=h->src_size==(uint64_t)src->st_size&&h->src_mtime==(int64_t)src->st_mtime
+                 &&(!(flags&ENG_3D_MESH_OPTIMIZE)||(h->flags&E3DM_FLAG_OPTIMIZED));
+    const Vertex3D* verts=ok?(const Vertex3D*)(mf.data+sizeof(E3dmHeader)):NULL;
+    const uint32_t* idx  =ok?(const uint32_t*)(verts+h->vertex_count):NULL;
+    if(ok) ok=e3dm_indices_ok(idx,h->index_count,h->vertex_count);   /* 駄目なら呼び出し側が OBJ を読む */
+    ENG_3D_MeshID id=ok?handle_alloc(&ctx->meshes):0;
+    if(!id){ unmap_file(&mf); return 0; }
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,flags);
+    memcpy(m->bounds.min,h->bmin,sizeof(h->bmin));
+    memcpy(m->bounds.max,h->bmax,sizeof(h->bmax));
+    if(h->flags&E3DM_FLAG_OPTIMIZED){
+        m->optimized=true;
+        m->acmr_before=h->acmr_before/1000.f; m->acmr_after=h->acmr_after/1000.f;
+    }
+    upload_mesh(ctx,m,verts,h->vertex_count,idx,h->index_count);
+    unmap_file(&mf);
+    return id;
+}
+
+ENG_3D_MeshID eng3d_mesh_load_bin(ENG_3D* ctx,const char* path){
+    ENG_3D_MeshID id=load_e3dm(ctx,path,NULL,ctx->mesh_flags);
+    if(!id) fprintf(stderr,"[3D] e3dm: %s\n",path);
+    return id;
+}
+
+/* 一時ファイルに書いてから置き換える (途中で落ちても壊れたキャッシュを残さない) */
+static bool save_e3dm(const char* path,const Mesh3D* m,const Vertex3D* verts,uint32_t vcnt,
+                      const uint32_t* idx,uint32_t icnt,const struct stat* src)
+{
+    E3dmHeader h; memset(&h,0,sizeof(h));
+    h.magic=E3DM_MAGIC; h.version=E3DM_VERSION;
+    h.layout=E3DM_LAYOUT_PNUT; h.stride=sizeof(Vertex3D);
+    if(m->optimized){
+        h.flags|=E3DM_FLAG_OPTIMIZED;
+        h.acmr_before=(uint16_t)lrintf(m->acmr_before*1000.f);
+        h.acmr_after =(uint16_t)lrintf(m->acmr_after*1000.f);
+    }
+    h.vertex_count=vcnt; h.index_count=icnt;
+    if(src){ h.src_size=(uint64_t)src->st_size; h.src_mtime=(int64_t)src->st_mtime; }
+    memcpy(h.bmin,m->bounds.min,sizeof(h.bmin));
+    memcpy(h.bmax,m->bounds.max,sizeof(h.bmax));
+    char* tmp=cache_tmp_path(path); if(!tmp) return false;
+    FILE* fp=fopen(tmp,"wb");
+    bool ok=fp!=NULL;
+    if(ok){
+        ok=fwrite(&h,sizeof(h),1,fp)==1
+         &&fwrite(verts,sizeof(Vertex3D),vcnt,fp)==vcnt
+         &&fwrite(idx,sizeof(uint32_t),icnt,fp)==icnt;
+        ok=(fclose(fp)==0)&&ok;
+        if(ok){
+#ifdef _WIN32
+            remove(path);                           /* Windows の rename は上書きしない */
+#endif
+            ok=rename(tmp,path)==0;                 /* POSIX はこれで不可分に置き換わる */
+        }
+        if(!ok) remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+
+void eng3d_mesh_obj_cache(ENG_3D* ctx,bool on){ctx->obj_cache_off=!on;}
+void eng3d_mesh_build_flags(ENG_3D* ctx,int flags){ctx->mesh_flags=flags;}
+
+/* ══════════════════════════════════════════════════════
+ * OBJ ローダー
+ *   ファイルをマップして 1 パスで読む。数値は手書きの高速パスで解析し、
+ *   (v/vt/vn) の組をハッシュして同じ頂点はインデックスで共有する。
+ *   対応: v / vt / vn / f (3 角形以上は扇形分割, 負のインデックス可)
+ * ══════════════════════════════════════════════════════*/
+static const double OBJ_P10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                               1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+static const char* obj_ws(const char* s,const char* e){
+    while(s<e&&(*s==' '||*s=='\t'||*s=='\r')) s++;
+    return s;
+}
+static const char* obj_int(const char* s,const char* e,int* out){
+    bool neg=false;
+    if(s<e&&(*s=='-'||*s=='+')){neg=(*s=='-');s++;}
+    int v=0;
+    while(s<e&&(unsigned)(*s-'0')<10u){v=v*10+(*s-'0');s++;}
+    *out=neg?-v:v;
+    return s;
+}
+/* [+-]digits[.digits][(e|E)[+-]digits]。有効 19 桁まで整数で積み、10 の冪で 1 回だけ割る */
+static const char* obj_float(const char* s,const char* e,float* out){
+    s=obj_ws(s,e);
+    bool neg=false;
+    if(s<e&&(*s=='-'||*s=='+')){neg=(*s=='-');s++;}
+    uint64_t mant=0; int ex=0, nd=0;
+    for(;s<e&&(unsigned)(*s-'0')<10u;s++){
+        if(nd<19){mant=mant*10+(uint64_t)(*s-'0');if(mant)nd++;}
+        else ex++;
+    }
+    if(s<e&&*s=='.'){
+        for(s++;s<e&&(unsigned)(*s-'0')<10u;s++){
+            if(nd<19){mant=mant*10+(uint64_t)(*s-'0');if(mant)nd++;ex--;}
+        }
+    }
+    if(s<e&&(*s=='e'||*s=='E')){int x;s=obj_int(s+1,e,&x);ex+=x;}
+    double v=(double)mant;
+    if(ex>0)      v*=(ex<=22)?OBJ_P10[ex]:pow(10.0,ex);
+    else if(ex<0) v/=(ex>=-22)?OBJ_P10[-ex]:pow(10.0,-ex);
+    *out=(float)(neg?-v:v);
+    return s;
+}
+
+/* (v/vt/vn) → 頂点番号 のオープンアドレス法ハッシュ */
+typedef struct { int p,t,n; uint32_t v; } ObjKey3D;
+typedef struct { ObjKey3D* slot; size_t cap, count; } ObjMap3D;
+#define OBJ_EMPTY 0xFFFFFFFFu
+
+static size_t obj_hash(int p,int t,int n,size_t mask){
+    uint32_t h=(uint32_t)p*0x9E3779B1u^(uint32_t)t*0x85EBCA77u^(uint32_t)n*0xC2B2AE3Du;
+    h^=h>>15; h*=0x2C1B3C6Du; h^=h>>12;
+    return (size_t)h&mask;
+}
+static bool obj_map_grow(ObjMap3D* m){
+    size_t nc=m->cap?m->cap*2:4096;
+    ObjKey3D* ns=(ObjKey3D*)malloc(nc*sizeof(ObjKey3D));
+    if(!ns) return false;
+    for(size_t i=0;i<nc;i++) ns[i].v=OBJ_EMPTY;
+    for(size_t i=0;i<m->cap;i++){
+        ObjKey3D* k=&m->slot[i]; if(k->v==OBJ_EMPTY) continue;
+        size_t h=obj_hash(k->p,k->t,k->n,nc-1);
+        while(ns[h].v!=OBJ_EMPTY) h=(h+1)&(nc-1);
+        ns[h]=*k;
+    }
+    free(m->slot); m->slot=ns; m->cap=nc;
+    return true;
+}
+
+typedef struct {
+    float*    pos; size_t np, cap_p;   /* xyz */
+    float*    nor; size_t nn, cap_n;   /* xyz */
+    float*    uv;  size_t nu, cap_u;   /* uv  */
+    Vertex3D* verts; size_t nv, cap_v;
+    uint32_t* idx;   size_t ni, cap_i;
+    ObjMap3D  map;
+} ObjBuild3D;
+
+static void obj_build_free(ObjBuild3D* b){
+    free(b->pos); free(b->nor); free(b->uv); free(b->verts); free(b->idx); free(b->map.slot);
+}
+
+/* 1-origin / 負 (末尾からの相対) を 0-origin に。範囲外は -1 */
+static int obj_resolve(int i,size_t n){
+    if(i>0) return ((size_t)i<=n)?i-1:-1;
+    if(i<0) return ((size_t)(-i)<=n)?(int)n+i:-1;
+    return -1;
+}
+
+/* 頂点を引く (無ければ追加)。失敗時 OBJ_EMPTY */
+static uint32_t obj_vertex(ObjBuild3D* b,int p,int t,int n){
+    if(b->map.count*2>=b->map.cap&&!obj_map_grow(&b->map)) return OBJ_EMPTY;
+    size_t mask=b->map.cap-1, h=obj_hash(p,t,n,mask);
+    for(;;h=(h+1)&mask){
+        ObjKey3D* k=&b->map.slot[h];
+        if(k->v==OBJ_EMPTY) break;
+        if(k->p==p&&k->t==t&&k->n==n) return k->v;
+    }
+    if(!grow_buf((void**)&b->verts,&b->cap_v,b->nv+1,sizeof(Vertex3D))) return OBJ_EMPTY;
+    Vertex3D* v=&b->verts[b->nv]; memset(v,0,sizeof(*v));
+    memcpy(v->p,&b->pos[(size_t)p*3],3*sizeof(float));
+    if(n>=0) memcpy(v->n,&b->nor[(size_t)n*3],3*sizeof(float));
+    if(t>=0) memcpy(v->uv,&b->uv[(size_t)t*2],2*sizeof(float));
+    ObjKey3D* k=&b->map.slot[h];
+    k->p=p; k->t=t; k->n=n; k->v=(uint32_t)b->nv;
+    b->map.count++;
+    return (uint32_t)b->nv++;
+}
+
+/* "f" 行の残り [s,e) を扇形分割して idx に積む */
+static bool obj_face(ObjBuild3D* b,const char* s,const char* e){
+    uint32_t first=OBJ_EMPTY, prev=OBJ_EMPTY;
+    int corner=0;
+    for(;;){
+        s=obj_ws(s,e);
+        if(s>=e||*s=='#') break;
+        int pi=0,ti=0,ni=0;
+        s=obj_int(s,e,&pi);
+        if(s<e&&*s=='/'){
+            s++;
+            if(s<e&&*s!='/') s=obj_int(s,e,&ti);
+            if(s<e&&*s=='/') s=obj_int(s+1,e,&ni);
+        }
+        while(s<e&&*s!=' '&&*s!='\t'&&*s!='\r') s++;   /* 不明な書式は読み飛ばす */
+        int p=obj_resolve(pi,b->np);
+        if(p<0) return true;                           /* 壊れた面は捨てる */
+        int t=obj_resolve(ti,b->nu), n=obj_resolve(ni,b->nn);
+        uint32_t v=obj_vertex(b,p,t,n);
+        if(v==OBJ_EMPTY) return false;
+        if(corner>=2){
+            if(!grow_buf((void**)&b->idx,&b->cap_i,b->ni+3,sizeof(uint32_t))) return false;
+            b->idx[b->ni++]=first; b->idx[b->ni++]=prev; b->idx[b->ni++]=v;
+        }
+        if(corner==0) first=v;
+        prev=v; corner++;
+    }
+    return true;
+}
+
+/* v/vn/vt 行: 成分 k 個を arr に積む */
+static bool obj_attr(float** arr,size_t* n,size_t* cap,int k,const char* s,const char* e){
+    if(!grow_buf((void**)arr,cap,*n+1,(size_t)k*sizeof(float))) return false;
+    float* d=*arr+*n*(size_t)k;
+    for(int i=0;i<k;i++) s=obj_float(s,e,&d[i]);
+    (*n)++;
+    return true;
+}
+
+ENG_3D_MeshID eng3d_mesh_load_obj(ENG_3D* ctx, const char* path){
+    return eng3d_mesh_load_obj_flags(ctx,path,ctx->mesh_flags);
+}
+ENG_3D_MeshID eng3d_mesh_load_obj_flags(ENG_3D* ctx, const char* path, int flags){
+    /* キャッシュ (.e3dm) がソースと一致すればパースしない */
+    char* cache=NULL;
+    struct stat src;
+    if(!ctx->obj_cache_off&&stat(path,&src)==0){
+        size_t n=strlen(path);
+        cache=(char*)malloc(n+6);
+        if(cache){
+            memcpy(cache,path,n); memcpy(cache+n,".e3dm",6);
+            ENG_3D_MeshID id=load_e3dm(ctx,cache,&src,flags);
+            if(id){ free(cache); return id; }
+        }
+    }
+    MappedFile3D mf;
+    if(!map_file(path,&mf)){ fprintf(stderr,"[3D] OBJ: %s\n",path); free(cache); return 0; }
+    ObjBuild3D b; memset(&b,0,sizeof(b));
+    const char *s=mf.data, *end=mf.data+mf.size;
+    bool ok=true;
+    while(ok&&s<end){
+        const char* eol=(const char*)memchr(s,'\n',(size_t)(end-s));
+        if(!eol) eol=end;
+        s=obj_ws(s,eol);
+        if(eol-s>=2){
+            if(s[0]=='v'&&s[1]==' ')      ok=obj_attr(&b.pos,&b.np,&b.cap_p,3,s+2,eol);
+            else if(s[0]=='v'&&s[1]=='n') ok=obj_attr(&b.nor,&b.nn,&b.cap_n,3,s+2,eol);
+            else if(s[0]=='v'&&s[1]=='t') ok=obj_attr(&b.uv, &b.nu,&b.cap_u,2,s+2,eol);
+            else if(s[0]=='f'&&s[1]==' ') ok=obj_face(&b,s+2,eol);
+        }
+        s=eol+1;
+    }
+    unmap_file(&mf);
+    if(!ok||b.ni==0){
+        fprintf(stderr,"[3D] OBJ: %s (%s)\n",path,ok?"面がありません":"メモリ不足");
+        obj_build_free(&b); free(cache); return 0;
+    }
+    compute_tangents(&ctx->jobs,b.verts,(uint32_t)b.nv,b.idx,(uint32_t)b.ni);
+    ENG_3D_MeshID id=handle_alloc(&ctx->meshes);
+    if(!id){ obj_build_free(&b); free(cache); return 0; }
+    Mesh3D* m=mesh_get(ctx,id); mesh_default(m,flags);
+    compute_bounds(&ctx->jobs,m,b.verts,(uint32_t)b.nv);
+    if(m->flags&ENG_3D_MESH_OPTIMIZE)                                /* キャッシュにも焼き込む */
+        optimize_mesh(m,b.verts,(uint32_t)b.nv,b.idx,(uint32_t)b.ni);
+    upload_mesh(ctx,m,b.verts,(uint32_t)b.nv,b.idx,(uint32_t)b.ni);
+    if(cache) save_e3dm(cache,m,b.verts,(uint32_t)b.nv,b.idx,(uint32_t)b.ni,&src);   /* 書けなくても続行 */
+    obj_build_free(&b); free(cache);
+    return id;
+}
+
+void eng3d_mesh_destroy(ENG_3D* ctx, ENG_3D_MeshID id){
+    Mesh3D* m=mesh_get(ctx,id);
+    if(!m) return;
+    if(m->in_arena) arena_release(ctx,m);
+    else {
+        glDeleteVertexArrays(1,&m->vao);
+        glDeleteBuffers(1,&m->vbo);
+        glDeleteBuffers(1,&m->ebo);
+    }
+    handle_free(&ctx->meshes,id);
+}
+
+int          eng3d_mesh_vertex_count(ENG_3D* ctx,ENG_3D_MeshID id){ const Mesh3D* m=mesh_get(ctx,id); return m?m->vertex_count:0; }
+ENG_3D_AABB  eng3d_mesh_bounds     (ENG_3D* ctx,ENG_3D_MeshID id){
+    const Mesh3D* m=mesh_get(ctx,id);
+    if(m) return m->bounds;
+    ENG_3D_AABB a; memset(&a,0,sizeof(a)); return a;
+}
+int eng3d_mesh_lod_info(ENG_3D* ctx,ENG_3D_MeshID id,int tris[ENG_3D_MAX_LODS]){
+    const Mesh3D* m=mesh_get(ctx,id);
+    if(!m) return 0;
+    for(int l=0;tris&&l<ENG_3D_MAX_LODS;l++) tris[l]=l<m->n_lods?(int)(m->lod[l].count/3):0;
+    return m->n_lods;
+}
+bool eng3d_mesh_acmr(ENG_3D* ctx,ENG_3D_MeshID id,float* before,float* after){
+    const Mesh3D* m=mesh_get(ctx,id);
+    bool ok=m&&m->optimized;
+    if(before) *before=ok?m->acmr_before:0.f;
+    if(after)  *after =ok?m->acmr_after:0.f;
+    return ok;
+}
+
+/* ══════════════════════════════════════════════════════
+ * 圧縮テクスチャ (DDS / KTX2, BC1/BC3/BC5/BC7)
+ *   コンテナのミップチェーンをそのまま glCompressedTexImage2D へ渡す。
+ *   拡張が無い BC は CPU で RGBA8 に展開する (BC5 = RGTC は 3.0 で必須)。
+ *   行の並びは変えない: GL の下原点で書き出したものを前提とする
+ *   (texconv -vflip / toktx --lower_left_maps_to_s0t0)
+ * ══════════════════════════════════════════════════════*/
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#  define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#  define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#  define GL_COMPRESSED_RGBA_BPTC_UNORM    0x8E8C
+#endif
+
+enum { TEXFMT_RGBA8, TEXFMT_BC1, TEXFMT_BC3, TEXFMT_BC5, TEXFMT_BC7 };
+#define TEX_MAX_LEVELS 16
+typedef struct {
+    int            fmt, w, h, levels;   /* TEXFMT_* */
+    const uint8_t* level[TEX_MAX_LEVELS];
+    size_t         size[TEX_MAX_LEVELS];
+} TexImage3D;
+/* tex_read の結果: img.levels>0 ならミップチェーン、そうでなければ非圧縮の pixels */
+typedef struct {
+    TexImage3D     img;
+    MappedFile3D   mf;                  /* DDS/KTX2 はマップしたまま img が指す */
+    uint8_t*       blob;                /* 変換した BC チェーン */
+    unsigned char* pixels;              /* stb_image (上下反転済み) */
+    int            w, h, ch;
+} TexSrc3D;
+/* プール配列のレイヤーへの転送 (非同期ではミップ段ごとにフレームをまたぐ) */
+typedef struct {
+    bool     open;                      /* レイヤーを押さえている */
+    bool     native;                    /* 圧縮のまま送る */
+    int      pool, layer, level, levels;
+    uint8_t *mip, *tmp;                 /* ミップチェーンが無い時の縮小用 */
+} PoolPut3D;
+struct TexLoad3D {
+    char*          path;
+    bool           compress;            /* 投入時の tex_compress */
+    TexSrc3D       src;                 /* ワーカーが書き、DECODED 以降はメインスレッドのもの */
+    SDL_atomic_t   state;               /* TEXLOAD_* */
+    int            row;                 /* 転送済みの行数 (非圧縮) */
+    int            level;               /* 転送済みのミップ段 (DDS/KTX2/変換済み) */
+    PoolPut3D      put;                 /* プール行き */
+    int64_t        bytes;               /* 転送済みの VRAM 見積り */
+    unsigned int   tex;                 /* 転送先 (完了でスロットと差し替え) */
+    ENG_3D_TexID   id;                  /* 0 = 読込中に破棄された */
+    bool           pool;                /* 投入時の tex_pooling */
+};
+
+static unsigned tex_query_caps(void){
+    unsigned caps=1u<<TEXFMT_RGBA8|1u<<TEXFMT_BC5;
+    GLint n=0; glGetIntegerv(GL_NUM_EXTENSIONS,&n);
+    for(GLint i=0;i<n;i++){
+        const char* e=(const char*)glGetStringi(GL_EXTENSIONS,(GLuint)i);
+        if(!e) continue;
+        if(!strcmp(e,"GL_EXT_texture_compression_s3tc"))       caps|=1u<<TEXFMT_BC1|1u<<TEXFMT_BC3;
+        else if(!strcmp(e,"GL_ARB_texture_compression_bptc")) caps|=1u<<TEXFMT_BC7;
+    }
+    return caps;
+}
+static GLenum tex_gl_format(int fmt){
+    switch(fmt){
+    case TEXFMT_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case TEXFMT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TEXFMT_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TEXFMT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default:         return GL_RGBA8;
+    }
+}
+static size_t tex_level_bytes(int fmt,int w,int h){
+    if(fmt==TEXFMT_RGBA8) return (size_t)w*(size_t)h*4;
+    return (size_t)((w+3)/4)*(size_t)((h+3)/4)*(fmt==TEXFMT_BC1?8u:16u);
+}
+static uint32_t rd32(const uint8_t* p){ uint32_t v; memcpy(&v,p,4); return v; }
+static uint64_t rd64(const uint8_t* p){ uint64_t v; memcpy(&v,p,8); return v; }
+
+/* ── ブロック展開 (4×4 → RGBA8 ×16) ─*/
+static void bc_rgb565(uint16_t c,uint8_t o[4]){
+    int r=c>>11&31, g=c>>5&63, b=c&31;
+    o[0]=(uint8_t)(r<<3|r>>2); o[1]=(uint8_t)(g<<2|g>>4); o[2]=(uint8_t)(b<<3|b>>2); o[3]=255;
+}
+/* four=true は BC3 の色ブロック (c0<=c1 でも 4 色) */
+static void bc1_block(const uint8_t* b,uint8_t out[64],bool four){
+    uint16_t c0=(uint16_t)(b[0]|b[1]<<8), c1=(uint16_t)(b[2]|b[3]<<8);
+    uint8_t pal[4][4];
+    bc_rgb565(c0,pal[0]); bc_rgb565(c1,pal[1]);
+    for(int k=0;k<3;k++){
+        if(four||c0>c1){
+            pal[2][k]=(uint8_t)((2*pal[0][k]+pal[1][k])/3);
+            pal[3][k]=(uint8_t)((pal[0][k]+2*pal[1][k])/3);
+        } else {
+            pal[2][k]=(uint8_t)((pal[0][k]+pal[1][k])/2);
+            pal[3][k]=0;
+        }
+    }
+    pal[2][3]=255; pal[3][3]=(four||c0>c1)?255:0;
+    uint32_t idx=rd32(b+4);
+    for(int i=0;i<16;i++) memcpy(out+i*4,pal[idx>>(2*i)&3],4);
+}
+/* BC3 のアルファ / BC5 の 1 チャンネル。stride 4 で out[ch] に書く */
+static void bc_alpha_block(const uint8_t* b,uint8_t* out){
+    int a0=b[0], a1=b[1], pal[8]={a0,a1};
+    if(a0>a1) for(int i=1;i<7;i++) pal[i+1]=((7-i)*a0+i*a1)/7;
+    else { for(int i=1;i<5;i++) pal[i+1]=((5-i)*a0+i*a1)/5; pal[6]=0; pal[7]=255; }
+    uint64_t idx=rd64(b)>>16;
+    for(int i=0;i<16;i++) out[i*4]=(uint8_t)pal[idx>>(3*i)&7];
+}
+
+/* BC7 の分割表 (2 分割は 1 ビット/画素, 3 分割は 2 ビット/画素) とアンカー位置 */
+static const uint16_t bc7_part2[64]={
+    0xCCCC,0x8888,0xEEEE,0xECC8,0xC880,0xFEEC,0xFEC8,0xEC80,0xC800,0xFFEC,0xFE80,0xE800,0xFFE8,0xFF00,0xFFF0,0xF000,
+    0xF710,0x008E,0x7100,0x08CE,0x008C,0x7310,0x3100,0x8CCE,0x088C,0x3110,0x6666,0x366C,0x17E8,0x0FF0,0x718E,0x399C,
+    0xAAAA,0xF0F0,0x5A5A,0x33CC,0x3C3C,0x55AA,0x9696,0xA55A,0x73CE,0x13C8,0x324C,0x3BDC,0x6996,0xC33C,0x9966,0x0660,
+    0x0272,0x04E4,0x4E40,0x2720,0xC936,0x936C,0x39C6,0x639C,0x9336,0x9CC6,0x817E,0xE718,0xCCF0,0x0FCC,0x7744,0xEE22};
+static const uint32_t bc7_part3[64]={
+    0xAA685050,0x6A5A5040,0x5A5A4200,0x5450A0A8,0xA5A50000,0xA0A05050,0x5555A0A0,0x5A5A5050,
+    0xAA550000,0xAA555500,0xAAAA5500,0x90909090,0x94949494,0xA4A4A4A4,0xA9A59450,0x2A0A4250,
+    0xA5945040,0x0A425054,0xA5A5A500,0x55A0A0A0,0xA8A85454,0x6A6A4040,0xA4A45000,0x1A1A0500,
+    0x0050A4A4,0xAAA59090,0x14696914,0x69691400,0xA08585A0,0xAA821414,0x50A4A450,0x6A5A0200,
+    0xA9A58000,0x5090A0A8,0xA8A09050,0x24242424,0x00AA5500,0x24924924,0x24499224,0x50A50A50,
+    0x500AA550,0xAAAA4444,0x66660000,0xA5A0A5A0,0x50A050A0,0x69286928,0x44AAAA44,0x66666600,
+    0xAA444444,0x54A854A8,0x95809580,0x96969600,0xA85454A8,0x80959580,0xAA141414,0x96960000,
+    0xAAAA1414,0xA05050A0,0xA0A5A5A0,0x96000000,0x40804080,0xA9A8A9A8,0xAAAAAA44,0x2A4A5254};
+static const uint8_t bc7_anchor2[64]={
+    15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15, 2, 8, 2, 2, 8, 8,15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15,15, 6, 8, 2, 8,15,15, 2, 8, 2, 2, 2,15,15, 6, 6, 2, 6, 8,15,15, 2, 2,15,15,15,15,15, 2, 2,15};
+static const uint8_t bc7_anchor3[64][2]={
+    {3,15},{3,8},{15,8},{15,3},{8,15},{3,15},{15,3},{15,8},{8,15},{8,15},{6,15},{6,15},{6,15},{5,15},{3,15},{3,8},
+    {3,15},{3,8},{8,15},{15,3},{3,15},{3,8},{6,15},{10,8},{5,3},{8,15},{8,6},{6,10},{8,15},{5,15},{15,10},{15,8},
+    {8,15},{15,3},{3,15},{5,10},{6,10},{10,8},{8,9},{15,10},{15,6},{3,15},{15,8},{5,15},{15,3},{15,6},{15,6},{15,8},
+    {3,15},{15,3},{5,15},{5,15},{5,15},{8,15},{5,15},{10,15},{5,15},{10,15},{8,15},{13,15},{15,3},{12,15},{3,15},{3,8}};
+static const struct { uint8_t ns, pb, rb, isb, cb, ab, epb, spb, ib, ib2; } bc7_mode[8]={
+    {3,4,0,0,4,0,1,0,3,0},{2,6,0,0,6,0,0,1,3,0},{3,6,0,0,5,0,0,0,2,0},{2,6,0,0,7,0,1,0,2,0},
+    {1,0,2,1,5,6,0,0,2,3},{1,0,2,0,7,8,0,0,2,2},{1,0,0,0,7,7,1,0,4,0},{2,6,0,0,5,5,1,0,2,0}};
+static const uint8_t bc7_w2[4]={0,21,43,64}, bc7_w3[8]={0,9,18,27,37,46,55,64},
+                     bc7_w4[16]={0,4,9,13,17,21,26,30,34,38,43,47,51,55,60,64};
+
+static uint32_t bc7_bits(const uint8_t* b,int* pos,int n){
+    uint32_t v=0;
+    for(int i=0;i<n;i++,(*pos)++) v|=(uint32_t)(b[*pos>>3]>>(*pos&7)&1)<<i;
+    return v;
+}
+static int bc7_interp(int e0,int e1,int idx,int bits){
+    int w=bits==2?bc7_w2[idx]:bits==3?bc7_w3[idx]:bc7_w4[idx];
+    return ((64-w)*e0+w*e1+32)>>6;
+}
+static void bc7_block(const uint8_t* b,uint8_t out[64]){
+    int mode=0;
+    while(mode<8&&!(b[0]>>mode&1)) mode++;
+    if(mode==8){ memset(out,0,64); return; }       /* 予約モードは透明な黒 */
+    int pos=mode+1, ns=bc7_mode[mode].ns, cb=bc7_mode[mode].cb, ab=bc7_mode[mode].ab;
+    int part=(int)bc7_bits(b,&pos,bc7_mode[mode].pb);
+    int rot =(int)bc7_bits(b,&pos,bc7_mode[mode].rb);
+    int isb =(int)bc7_bits(b,&pos,bc7_mode[mode].isb);
+    int ep[3][2][4];                                /* 分割, 端点, RGBA */
+    for(int c=0;c<4;c++){
+        int nb=c<3?cb:ab;
+        for(int s=0;s<ns;s++) for(int e=0;e<2;e++) ep[s][e][c]=(int)bc7_bits(b,&pos,nb);
+    }
+    int pb=bc7_mode[mode].epb||bc7_mode[mode].spb;
+    if(pb){
+        int p[3][2];
+        for(int s=0;s<ns;s++){
+            if(bc7_mode[mode].epb){ p[s][0]=(int)bc7_bits(b,&pos,1); p[s][1]=(int)bc7_bits(b,&pos,1); }
+            else p[s][0]=p[s][1]=(int)bc7_bits(b,&pos,1);
+        }
+        for(int s=0;s<ns;s++) for(int e=0;e<2;e++) for(int c=0;c<4;c++) ep[s][e][c]=ep[s][e][c]<<1|p[s][e];
+    }
+    for(int s=0;s<ns;s++) for(int e=0;e<2;e++) for(int c=0;c<4;c++){
+        int nb=(c<3?cb:ab)+pb;
+        ep[s][e][c]=c==3&&!ab?255:(ep[s][e][c]<<(8-nb))|(ep[s][e][c]>>(2*nb-8));
+    }
+    int sub[16], idx[16], idx2[16];
+    for(int i=0;i<16;i++)
+        sub[i]=ns==2?(bc7_part2[part]>>i&1):ns==3?(int)(bc7_part3[part]>>(2*i)&3):0;
+    int ib=bc7_mode[mode].ib, ib2=bc7_mode[mode].ib2;
+    for(int i=0;i<16;i++){
+        bool anchor=i==0||(ns==2&&i==bc7_anchor2[part])||(ns==3&&(i==bc7_anchor3[part][0]||i==bc7_anchor3[part][1]));
+        idx[i]=(int)bc7_bits(b,&pos,anchor?ib-1:ib);
+    }
+    for(int i=0;ib2&&i<16;i++) idx2[i]=(int)bc7_bits(b,&pos,i==0?ib2-1:ib2);
+    for(int i=0;i<16;i++){
+        int s=sub[i], ci=idx[i], cbits=ib, ai=idx[i], abits=ib;
+        if(ib2){
+            if(isb){ ci=idx2[i]; cbits=ib2; }
+            else   { ai=idx2[i]; abits=ib2; }
+        }
+        uint8_t* o=out+i*4;
+        for(int c=0;c<3;c++) o[c]=(uint8_t)bc7_interp(ep[s][0][c],ep[s][1][c],ci,cbits);
+        o[3]=(uint8_t)bc7_interp(ep[s][0][3],ep[s][1][3],ai,abits);
+        if(rot){ uint8_t t=o[3]; o[3]=o[rot-1]; o[rot-1]=t; }
+    }
+}
+
+/* 拡張の無い BC を RGBA8 に展開する */
+static uint8_t* tex_decode_rgba(int fmt,const uint8_t* src,int w,int h){
+    uint8_t* dst=(uint8_t*)malloc((size_t)w*(size_t)h*4);
+    if(!dst) return NULL;
+    uint8_t blk[64];
+    size_t bsz=fmt==TEXFMT_BC1?8:16;
+    for(int by=0;by<h;by+=4) for(int bx=0;bx<w;bx+=4,src+=bsz){
+        switch(fmt){
+        case TEXFMT_BC1: bc1_block(src,blk,false); break;
+        case TEXFMT_BC3: bc1_block(src+8,blk,true); bc_alpha_block(src,blk+3); break;
+        case TEXFMT_BC5:
+            bc_alpha_block(src,blk); bc_alpha_block(src+8,blk+1);
+            for(int i=0;i<16;i++){ blk[i*4+2]=0; blk[i*4+3]=255; }
+            break;
+        default: bc7_block(src,blk); break;
+        }
+        for(int y=0;y<4&&by+y<h;y++) for(int x=0;x<4&&bx+x<w;x++)
+            memcpy(dst+(((size_t)(by+y)*(size_t)w)+(size_t)(bx+x))*4,blk+(y*4+x)*4,4);
+    }
+    return dst;
+}
+
+/* ── BC1 / BC3 エンコード (変換キャッシュ用) ─
+ *   色は主成分軸上の最小/最大を端点にする簡易フィット。
+ *   アルファは最小/最大の 8 段 */
+static uint16_t bc_pack565(const float c[3]){
+    int r=(int)lrintf(CLAMP(c[0],0.f,255.f)*31.f/255.f);
+    int g=(int)lrintf(CLAMP(c[1],0.f,255.f)*63.f/255.f);
+    int b=(int)lrintf(CLAMP(c[2],0.f,255.f)*31.f/255.f);
+    return (uint16_t)(r<<11|g<<5|b);
+}
+static void bc1_encode(const uint8_t px[64],uint8_t out[8]){
+    float mean[3]={0,0,0}, cov[6]={0,0,0,0,0,0};
+    for(int i=0;i<16;i++) for(int k=0;k<3;k++) mean[k]+=px[i*4+k]/16.f;
+    for(int i=0;i<16;i++){
+        float d[3]={px[i*4]-mean[0],px[i*4+1]-mean[1],px[i*4+2]-mean[2]};
+        cov[0]+=d[0]*d[0]; cov[1]+=d[0]*d[1]; cov[2]+=d[0]*d[2];
+        cov[3]+=d[1]*d[1]; cov[4]+=d[1]*d[2]; cov[5]+=d[2]*d[2];
+    }
+    float ax[3]={1.f,1.f,1.f};                       /* べき乗法で主軸 */
+    for(int it=0;it<6;it++){
+        float nx=cov[0]*ax[0]+cov[1]*ax[1]+cov[2]*ax[2];
+        float ny=cov[1]*ax[0]+cov[3]*ax[1]+cov[4]*ax[2];
+        float nz=cov[2]*ax[0]+cov[4]*ax[1]+cov[5]*ax[2];
+        float m=fmaxf(fabsf(nx),fmaxf(fabsf(ny),fabsf(nz)));
+        if(m<1e-6f) break;
+        ax[0]=nx/m; ax[1]=ny/m; ax[2]=nz/m;
+    }
+    float lo=1e30f, hi=-1e30f;
+    for(int i=0;i<16;i++){
+        float t=(px[i*4]-mean[0])*ax[0]+(px[i*4+1]-mean[1])*ax[1]+(px[i*4+2]-mean[2])*ax[2];
+        lo=fminf(lo,t); hi=fmaxf(hi,t);
+    }
+    float n2=ax[0]*ax[0]+ax[1]*ax[1]+ax[2]*ax[2], e0[3], e1[3];
+    for(int k=0;k<3;k++){ e0[k]=mean[k]+ax[k]*hi/n2; e1[k]=mean[k]+ax[k]*lo/n2; }
+    uint16_t c0=bc_pack565(e0), c1=bc_pack565(e1);
+    if(c0<c1){ uint16_t t=c0; c0=c1; c1=t; }
+    uint32_t idx=0;
+    if(c0!=c1){
+        uint8_t pal[64]; uint8_t blk[8]={(uint8_t)c0,(uint8_t)(c0>>8),(uint8_t)c1,(uint8_t)(c1>>8),0xE4,0,0,0};
+        bc1_block(blk,pal,true);                     /* 画素 0..3 = インデックス 0..3 の色 */
+        for(int i=0;i<16;i++){
+            int best=0, bd=INT_MAX;
+            for(int j=0;j<4;j++){
+                int dr=px[i*4]-pal[j*4], dg=px[i*4+1]-pal[j*4+1], db=px[i*4+2]-pal[j*4+2];
+                int d=dr*dr+dg*dg+db*db;
+                if(d<bd){ bd=d; best=j; }
+            }
+            idx|=(uint32_t)best<<(2*i);
+        }
+    }
+    out[0]=(uint8_t)c0; out[1]=(uint8_t)(c0>>8); out[2]=(uint8_t)c1; out[3]=(uint8_t)(c1>>8);
+    memcpy(out+4,&idx,4);
+}
+static void bc_alpha_encode(const uint8_t px[64],uint8_t out[8]){
+    int lo=255, hi=0;
+    for(int i=0;i<16;i++){ lo=px[i*4+3]<lo?px[i*4+3]:lo; hi=px[i*4+3]>hi?px[i*4+3]:hi; }
+    uint64_t bits=0;
+    if(hi>lo) for(int i=0;i<16;i++){
+        int t=((px[i*4+3]-lo)*14+(hi-lo))/(2*(hi-lo));   /* 0=lo .. 7=hi (四捨五入) */
+        uint64_t k=t==7?0:t==0?1:(uint64_t)(8-t);
+        bits|=k<<(3*i);
+    }
+    out[0]=(uint8_t)hi; out[1]=(uint8_t)lo;
+    for(int i=0;i<6;i++) out[2+i]=(uint8_t)(bits>>(8*i));
+}
+
+/* 2×2 の平均で半分に (奇数端は最後の列/行を重ねる) */
+static void mip_down(const uint8_t* src,int w,int h,uint8_t* dst,int nw,int nh){
+    for(int y=0;y<nh;y++) for(int x=0;x<nw;x++){
+        int x0=x*2, y0=y*2, x1=x0+1<w?x0+1:x0, y1=y0+1<h?y0+1:y0;
+        for(int c=0;c<4;c++){
+            int s=src[((size_t)y0*w+x0)*4+c]+src[((size_t)y0*w+x1)*4+c]
+                 +src[((size_t)y1*w+x0)*4+c]+src[((size_t)y1*w+x1)*4+c];
+            dst[((size_t)y*nw+x)*4+c]=(uint8_t)((s+2)>>2);
+        }
+    }
+}
+
+static int tex_full_levels(int w,int h){
+    int levels=1;
+    while(levels<TEX_MAX_LEVELS&&((w>>levels)>0||(h>>levels)>0)) levels++;
+    return levels;
+}
+
+/* RGBA8 (GL の行順) から BC1 か BC3 のミップチェーンを作る。img は戻り値を指す */
+static uint8_t* tex_transcode(const uint8_t* rgba,int w,int h,TexImage3D* img){
+    bool alpha=false;
+    for(size_t i=0;i<(size_t)w*(size_t)h&&!alpha;i++) alpha=rgba[i*4+3]!=255;
+    int fmt=alpha?TEXFMT_BC3:TEXFMT_BC1, levels=tex_full_levels(w,h);
+    size_t total=0;
+    for(int l=0;l<levels;l++){
+        int lw=w>>l?w>>l:1, lh=h>>l?h>>l:1;
+        total+=tex_level_bytes(fmt,lw,lh);
+    }
+    uint8_t* blob=(uint8_t*)malloc(total);
+    uint8_t* mip=(uint8_t*)malloc((size_t)w*(size_t)h*4);
+    uint8_t* tmp=(uint8_t*)malloc((size_t)(w/2+1)*(size_t)(h/2+1)*4);
+    if(!blob||!mip||!tmp){ free(blob); free(mip); free(tmp); return NULL; }
+    memcpy(mip,rgba,(size_t)w*(size_t)h*4);
+    img->fmt=fmt; img->w=w; img->h=h; img->levels=levels;
+    uint8_t* dst=blob;
+    for(int l=0,lw=w,lh=h;l<levels;l++){
+        img->level[l]=dst; img->size[l]=tex_level_bytes(fmt,lw,lh);
+        for(int by=0;by<lh;by+=4) for(int bx=0;bx<lw;bx+=4){
+            uint8_t blk[64];
+            for(int y=0;y<4;y++) for(int x=0;x<4;x++){           /* 端はクランプ */
+                int sx=bx+x<lw?bx+x:lw-1, sy=by+y<lh?by+y:lh-1;
+                memcpy(blk+(y*4+x)*4,mip+((size_t)sy*lw+sx)*4,4);
+            }
+            if(alpha){ bc_alpha_encode(blk,dst); dst+=8; }
+            bc1_encode(blk,dst); dst+=8;
+        }
+        if(l+1<levels){
+            int nw=lw>1?lw/2:1, nh=lh>1?lh/2:1;
+            mip_down(mip,lw,lh,tmp,nw,nh);
+            memcpy(mip,tmp,(size_t)nw*(size_t)nh*4);
+            lw=nw; lh=nh;
+        }
+    }
+    free(mip); free(tmp);
+    return blob;
+}
+
+/* ── コンテナ ─*/
+#define DDS_MAGIC      0x20534444u   /* "DDS " */
+#define DDS_FOURCC(a,b,c,d) ((uint32_t)(a)|(uint32_t)(b)<<8|(uint32_t)(c)<<16|(uint32_t)(d)<<24)
+#define DDS_CACHE_TAG  0x54443345u   /* "E3DT": reserved1 に載せる変換キャッシュの印 */
+typedef struct {
+    uint32_t magic, size, flags, height, width, pitch, depth, mips;
+    uint32_t reserved1[11];          /* [0]=E3DT [1..2]=元サイズ [3..4]=元更新時刻 */
+    uint32_t pf_size, pf_flags, fourcc, bits, rmask, gmask, bmask, amask;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+} DdsHeader3D;
+_Static_assert(sizeof(DdsHeader3D)==128,"DDS ヘッダは 128 バイト");
+
+/* 各レベルがデータ内に収まるか確かめながら img を埋める */
+static bool tex_fill_levels(TexImage3D* img,const uint8_t* base,size_t n,size_t off,int levels){
+    if(img->w<=0||img->h<=0||img->w>16384||img->h>16384) return false;
+    if(levels<1) levels=1;
+    if(levels>TEX_MAX_LEVELS) levels=TEX_MAX_LEVELS;
+    img->levels=0;
+    for(int l=0;l<levels;l++){
+        int lw=img->w>>l?img->w>>l:1, lh=img->h>>l?img->h>>l:1;
+        size_t sz=tex_level_bytes(img->fmt,lw,lh);
+        if(off>n||sz>n-off) break;
+        img->level[l]=base+off; img->size[l]=sz; img->levels++;
+        off+=sz;
+        if(lw==1&&lh==1) break;
+    }
+    return img->levels>0;
+}
+
+static bool parse_dds(const uint8_t* p,size_t n,TexImage3D* img){
+    if(n<sizeof(DdsHeader3D)) return false;
+    DdsHeader3D h; memcpy(&h,p,sizeof(h));
+    if(h.magic!=DDS_MAGIC||h.size!=124||h.depth>1) return false;
+    size_t off=sizeof(h);
+    img->fmt=-1;
+    if(h.pf_flags&0x4u){                             /* DDPF_FOURCC */
+        uint32_t f=h.fourcc;
+        if(f==DDS_FOURCC('D','X','T','1')) img->fmt=TEXFMT_BC1;
+        else if(f==DDS_FOURCC('D','X','T','5')) img->fmt=TEXFMT_BC3;
+        else if(f==DDS_FOURCC('A','T','I','2')||f==DDS_FOURCC('B','C','5','U')) img->fmt=TEXFMT_BC5;
+        else if(f==DDS_FOURCC('D','X','1','0')&&n>=off+20){
+            uint32_t dxgi=rd32(p+off), dim=rd32(p+off+8), arr=rd32(p+off+12);
+            off+=20;
+            if(dim!=3||arr>1) return false;          /* 2D の 1 枚だけ */
+            if(dxgi==71||dxgi==72) img->fmt=TEXFMT_BC1;
+            else if(dxgi==77||dxgi==78) img->fmt=TEXFMT_BC3;
+            else if(dxgi==83) img->fmt=TEXFMT_BC5;
+            else if(dxgi==98||dxgi==99) img->fmt=TEXFMT_BC7;
+            else if(dxgi==28||dxgi==29) img->fmt=TEXFMT_RGBA8;
+        }
+    } else if((h.pf_flags&0x40u)&&h.bits==32&&h.rmask==0xFFu&&h.gmask==0xFF00u
+              &&h.bmask==0xFF0000u&&h.amask==0xFF000000u)
+        img->fmt=TEXFMT_RGBA8;
+    if(img->fmt<0) return false;
+    if(h.caps2&0x200u) return false;                 /* キューブマップは非対応 */
+    img->w=(int)h.width; img->h=(int)h.height;
+    return tex_fill_levels(img,p,n,off,(h.flags&0x20000u)?(int)h.mips:1);
+}
+
+/* sRGB の指定は UNORM として扱う (PNG の読込と同じ) */
+static bool parse_ktx2(const uint8_t* p,size_t n,TexImage3D* img){
+    static const uint8_t id[12]={0xAB,'K','T','X',' ','2','0',0xBB,'\r','\n',0x1A,'\n'};
+    if(n<80||memcmp(p,id,12)) return false;
+    uint32_t vk=rd32(p+12), w=rd32(p+20), h=rd32(p+24), depth=rd32(p+28);
+    uint32_t layers=rd32(p+32), faces=rd32(p+36), levels=rd32(p+40), scheme=rd32(p+44);
+    if(depth>1||layers>1||faces!=1||scheme!=0) return false;   /* Basis / zstd も非対応 */
+    switch(vk){
+    case 37: case 43:   img->fmt=TEXFMT_RGBA8; break;   /* R8G8B8A8_UNORM / SRGB */
+    case 133: case 134: img->fmt=TEXFMT_BC1; break;     /* BC1_RGBA */
+    case 137: case 138: img->fmt=TEXFMT_BC3; break;
+    case 141:           img->fmt=TEXFMT_BC5; break;
+    case 145: case 146: img->fmt=TEXFMT_BC7; break;
+    default: return false;
+    }
+    img->w=(int)w; img->h=(int)h;
+    if(levels==0) levels=1;
+    if(w==0||h==0||w>16384||h>16384||levels>TEX_MAX_LEVELS||n<80+(size_t)levels*24) return false;
+    /* レベルの並びは index の位置で決まる (ファイル内は小さい順に置かれる) */
+    img->levels=0;
+    for(uint32_t l=0;l<levels;l++){
+        uint64_t off=rd64(p+80+l*24), len=rd64(p+80+l*24+8);
+        int lw=(int)(w>>l?w>>l:1), lh=(int)(h>>l?h>>l:1);
+        if(len!=tex_level_bytes(img->fmt,lw,lh)||off>n||len>n-off) break;
+        img->level[l]=p+off; img->size[l]=(size_t)len; img->levels++;
+    }
+    return img->levels>0;
+}
+
+static bool parse_tex_container(const uint8_t* p,size_t n,TexImage3D* img){
+    memset(img,0,sizeof(*img));
+    return parse_dds(p,n,img)||parse_ktx2(p,n,img);
+}
+
+/* 変換キャッシュを DDS (DXT1/DXT5, GL の行順) で書く。save_e3dm と同じく一時ファイル経由 */
+static bool save_tex_cache(const char* path,const TexImage3D* img,const struct stat* src){
+    DdsHeader3D h; memset(&h,0,sizeof(h));
+    h.magic=DDS_MAGIC; h.size=124;
+    h.flags=0x1u|0x2u|0x4u|0x1000u|0x20000u|0x80000u;   /* CAPS|HEIGHT|WIDTH|PIXELFORMAT|MIPMAPCOUNT|LINEARSIZE */
+    h.width=(uint32_t)img->w; h.height=(uint32_t)img->h;
+    h.pitch=(uint32_t)img->size[0]; h.mips=(uint32_t)img->levels;
+    h.reserved1[0]=DDS_CACHE_TAG;
+    h.reserved1[1]=(uint32_t)((uint64_t)src->st_size); h.reserved1[2]=(uint32_t)((uint64_t)src->st_size>>32);
+    h.reserved1[3]=(uint32_t)((uint64_t)src->st_mtime); h.reserved1[4]=(uint32_t)((uint64_t)src->st_mtime>>32);
+    h.pf_size=32; h.pf_flags=0x4u;
+    h.fourcc=img->fmt==TEXFMT_BC3?DDS_FOURCC('D','X','T','5'):DDS_FOURCC('D','X','T','1');
+    h.caps=0x1000u|0x8u|0x400000u;                  /* TEXTURE|COMPLEX|MIPMAP */
+    char* tmp=cache_tmp_path(path); if(!tmp) return false;
+    FILE* fp=fopen(tmp,"wb");
+    bool ok=fp!=NULL;
+    if(ok){
+        ok=fwrite(&h,sizeof(h),1,fp)==1;
+        for(int l=0;ok&&l<img->levels;l++) ok=fwrite(img->level[l],1,img->size[l],fp)==img->size[l];
+        ok=(fclose(fp)==0)&&ok;
+        if(ok){
+#ifdef _WIN32
+            remove(path);                           /* save_e3dm と同じ */
+#endif
+            ok=rename(tmp,path)==0;
+        }
+        if(!ok) remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+static bool tex_cache_valid(const uint8_t* p,size_t n,const struct stat* src){
+    if(n<sizeof(DdsHeader3D)) return false;
+    const DdsHeader3D* h=(const DdsHeader3D*)p;
+    uint64_t size=(uint64_t)h->reserved1[1]|(uint64_t)h->reserved1[2]<<32;
+    uint64_t mt  =(uint64_t)h->reserved1[3]|(uint64_t)h->reserved1[4]<<32;
+    return h->magic==DDS_MAGIC&&h->reserved1[0]==DDS_CACHE_TAG
+         &&size==(uint64_t)src->st_size&&mt==(uint64_t)src->st_mtime;
+}
+
+/* パスからテクスチャの元データを作る。GL は使わないのでワーカーから呼べる。
+ *   DDS/KTX2 → マップしたまま img に / compress なら "<path>.dds" キャッシュ →
+ *   無ければ stb_image で読み、compress なら BC1/BC3 に変換してキャッシュを書く */
+static void flip_rows(unsigned char* px,int w,int h,int ch);
+static bool tex_read(const char* path,bool compress,TexSrc3D* s){
+    memset(s,0,sizeof(*s));
+    if(map_file(path,&s->mf)){
+        if(parse_tex_container((const uint8_t*)s->mf.data,s->mf.size,&s->img)) return true;
+        unmap_file(&s->mf);
+    }
+    struct stat src;
+    char* cache=NULL;
+    if(compress&&stat(path,&src)==0){
+        size_t n=strlen(path);
+        cache=(char*)malloc(n+5);
+        if(cache){
+            memcpy(cache,path,n); memcpy(cache+n,".dds",5);
+            if(map_file(cache,&s->mf)){
+                const uint8_t* p=(const uint8_t*)s->mf.data;
+                if(tex_cache_valid(p,s->mf.size,&src)&&parse_tex_container(p,s->mf.size,&s->img)){ free(cache); return true; }
+                unmap_file(&s->mf);
+            }
+        }
+    }
+    s->pixels=stbi_load(path,&s->w,&s->h,&s->ch,cache?4:0);
+    if(!s->pixels){ free(cache); return false; }
+    if(cache){ s->ch=4; flip_rows(s->pixels,s->w,s->h,4); }
+    else flip_rows(s->pixels,s->w,s->h,s->ch);
+    if(cache){
+        s->blob=tex_transcode(s->pixels,s->w,s->h,&s->img);
+        if(s->blob){
+            save_tex_cache(cache,&s->img,&src);     /* 書けなくても続行 */
+            stbi_image_free(s->pixels); s->pixels=NULL;
+        }
+    }
+    free(cache);
+    return true;
+}
+static void tex_src_free(TexSrc3D* s){
+    unmap_file(&s->mf);
+    free(s->blob);
+    stbi_image_free(s->pixels);
+    memset(s,0,sizeof(*s));
+}
+
+/* img の l 段目をバインド中の GL_TEXTURE_2D へ。拡張の無い BC は展開して RGBA8 で送る。
+ * VRAM 上のバイト数を返す */
+static size_t tex_upload_level(ENG_3D* ctx,const TexImage3D* img,int l){
+    bool native=(ctx->tex_caps>>img->fmt)&1u;
+    int lw=img->w>>l?img->w>>l:1, lh=img->h>>l?img->h>>l:1;
+    size_t n;
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    if(img->fmt==TEXFMT_RGBA8||!native){
+        uint8_t* px=img->fmt==TEXFMT_RGBA8?NULL:tex_decode_rgba(img->fmt,img->level[l],lw,lh);
+        glTexImage2D(GL_TEXTURE_2D,l,GL_RGBA8,lw,lh,0,GL_RGBA,GL_UNSIGNED_BYTE,px?px:img->level[l]);
+        free(px);
+        n=(size_t)lw*(size_t)lh*4;
+    } else {
+        glCompressedTexImage2D(GL_TEXTURE_2D,l,tex_gl_format(img->fmt),lw,lh,0,(GLsizei)img->size[l],img->level[l]);
+        n=img->size[l];
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    return n;
+}
+/* 全段を送り終えた (バインド中の) テクスチャのパラメータ */
+static void tex_params_levels(const TexImage3D* img){
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,img->levels-1);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,img->levels>1?GL_LINEAR_MIPMAP_LINEAR:GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+}
+/* img を新しい GL テクスチャへ (全段) */
+static unsigned int tex_upload_image(ENG_3D* ctx,const TexImage3D* img,int64_t* bytes){
+    unsigned int t; glGenTextures(1,&t);
+    glBindTexture(GL_TEXTURE_2D,t);
+    *bytes=0;
+    for(int l=0;l<img->levels;l++) *bytes+=(int64_t)tex_upload_level(ctx,img,l);
+    tex_params_levels(img);
+    return t;
+}
+
+/* ══════════════════════════════════════════════════════
+ * テクスチャプール (GL_TEXTURE_2D_ARRAY)
+ *   eng3d_tex_pool で有効にすると、以降の読込は (形式, 幅, 高さ, ミップ数) の
+ *   同じ配列のレイヤーへ入り、TEX_ATLAS_ENTRY 以下で 2 冪でない小物は
+ *   RGBA8 のアトラス配列へ棚詰めされる。レイヤーと UV 矩形は
+ *   インスタンス属性で渡すので、同じプールのテクスチャ同士は
+ *   バッチもインスタンシングも切らない。
+ *   アトラスの繰り返しはシェーダーの fract で行い、周囲は TEX_ATLAS_PAD 幅で
+ *   端を複製する (継ぎ目は REPEAT ではなくクランプ相当になる)。
+ *   GL 3.3 には glCopyImageSubData が無いので、満杯時は倍の配列を作り
+ *   RGBA8 は FBO 経由の glCopyTexSubImage3D、BC は読み戻しで移す
+ * ══════════════════════════════════════════════════════*/
+static uint8_t* rgba_expand(const unsigned char* px,int w,int h,int ch){
+    size_t n=(size_t)w*(size_t)h;
+    uint8_t* o=(uint8_t*)malloc(n*4);
+    if(!o) return NULL;
+    for(size_t i=0;i<n;i++){                       /* GL_RED/RG/RGB と同じ補い方 */
+        const unsigned char* s=px+i*(size_t)ch;
+        uint8_t* d=o+i*4;
+        d[0]=s[0]; d[1]=ch>1?s[1]:0; d[2]=ch>2?s[2]:0; d[3]=ch>3?s[3]:255;
+    }
+    return o;
+}
+
+static void pool_alloc_level(const TexPool3D* p,int l,int layers){
+    int lw=p->w>>l?p->w>>l:1, lh=p->h>>l?p->h>>l:1;
+    if(p->fmt==TEXFMT_RGBA8)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY,l,GL_RGBA8,lw,lh,layers,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+    else
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY,l,tex_gl_format(p->fmt),lw,lh,layers,0,
+                               (GLsizei)(tex_level_bytes(p->fmt,lw,lh)*(size_t)layers),NULL);
+}
+
+/* 旧配列 p->tex の全レイヤーを dst (GL_TEXTURE_2D_ARRAY にバインド済み) へ移す */
+static bool pool_copy(const TexPool3D* p,unsigned int dst){
+    if(p->fmt==TEXFMT_RGBA8){
+        GLint prev=0; glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING,&prev);
+        unsigned int fbo; glGenFramebuffers(1,&fbo);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo);
+        for(int l=0;l<p->levels;l++){
+            int lw=p->w>>l?p->w>>l:1, lh=p->h>>l?p->h>>l:1;
+            for(int k=0;k<p->cap;k++){
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,p->tex,l,k);
+                glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY,l,0,0,k,0,0,lw,lh);
+            }
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER,(GLuint)prev);
+        glDeleteFramebuffers(1,&fbo);
+        return true;
+    }
+    for(int l=0;l<p->levels;l++){
+        int lw=p->w>>l?p->w>>l:1, lh=p->h>>l?p->h>>l:1;
+        size_t n=tex_level_bytes(p->fmt,lw,lh)*(size_t)p->cap;
+        uint8_t* buf=(uint8_t*)malloc(n);
+        if(!buf) return false;
+        glBindTexture(GL_TEXTURE_2D_ARRAY,p->tex);
+        glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY,l,buf);
+        glBindTexture(GL_TEXTURE_2D_ARRAY,dst);
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,l,0,0,0,lw,lh,p->cap,tex_gl_format(p->fmt),(GLsizei)n,buf);
+        free(buf);
+    }
+    return true;
+}
+
+/* レイヤーが need 枚以上になるよう配列を作り直す (倍々, 上限 TEX_POOL_LAYERS) */
+static bool pool_reserve(TexPool3D* p,int need){
+    if(need<=p->cap) return true;
+    int cap=p->cap?p->cap*2:p->atlas?1:4;
+    while(cap<need) cap*=2;
+    if(cap>TEX_POOL_LAYERS) cap=TEX_POOL_LAYERS;
+    if(need>cap) return false;
+    uint16_t* live=(uint16_t*)realloc(p->live,(size_t)cap*sizeof(uint16_t));
+    if(!live) return false;
+    memset(live+p->cap,0,(size_t)(cap-p->cap)*sizeof(uint16_t));
+    p->live=live;
+    unsigned int t; glGenTextures(1,&t);
+    glBindTexture(GL_TEXTURE_2D_ARRAY,t);
+    for(int l=0;l<p->levels;l++) pool_alloc_level(p,l,cap);
+    GLint wrap=p->atlas?GL_CLAMP_TO_EDGE:GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAX_LEVEL,p->levels-1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,p->levels>1?GL_LINEAR_MIPMAP_LINEAR:GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    if(p->tex&&!pool_copy(p,t)){ glDeleteTextures(1,&t); return false; }
+    if(p->tex) glDeleteTextures(1,&p->tex);
+    p->tex=t; p->cap=cap;
+    return true;
+}
+
+/* 条件に合うプール。無ければ空きに作る (-1=空き無し) */
+static int pool_get(ENG_3D* ctx,bool atlas,int fmt,int w,int h,int levels){
+    int fr=-1;
+    for(int i=0;i<TEX_POOL_MAX;i++){
+        const TexPool3D* p=&ctx->pools[i];
+        if(!p->used){ if(fr<0) fr=i; continue; }
+        if(p->atlas==atlas&&p->fmt==fmt&&p->w==w&&p->h==h&&p->levels==levels) return i;
+    }
+    if(fr>=0){
+        TexPool3D* p=&ctx->pools[fr];
+        memset(p,0,sizeof(*p));
+        p->used=true; p->atlas=atlas; p->fmt=fmt; p->w=w; p->h=h; p->levels=levels;
+    }
+    return fr;
+}
+
+/* p->tex を GL_TEXTURE_2D_ARRAY にバインドした状態で呼ぶ */
+static void pool_put(ENG_3D* ctx,const TexPool3D* p,int layer,int l,int x,int y,int w,int h,
+    const uint8_t* data,size_t size)
+{
+    if(p->fmt==TEXFMT_RGBA8)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY,l,x,y,layer,w,h,1,GL_RGBA,GL_UNSIGNED_BYTE,data);
+    else
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,l,x,y,layer,w,h,1,tex_gl_format(p->fmt),(GLsizei)size,data);
+    ctx->stats.upload_bytes+=(int64_t)size;
+}
+
+/* 同じ形の配列の空きレイヤーを押さえる。ミップチェーンが無ければ pixels から作る */
+static bool pool_array_begin(ENG_3D* ctx,const TexSrc3D* s,int w,int h,PoolPut3D* u){
+    const TexImage3D* img=&s->img;
+    memset(u,0,sizeof(*u));
+    u->native=img->levels&&img->fmt!=TEXFMT_RGBA8&&((ctx->tex_caps>>img->fmt)&1u);
+    u->levels=img->levels?img->levels:tex_full_levels(w,h);
+    int pi=pool_get(ctx,false,u->native?img->fmt:TEXFMT_RGBA8,w,h,u->levels);
+    if(pi<0) return false;
+    TexPool3D* p=&ctx->pools[pi];
+    int layer=0;
+    while(layer<p->cap&&p->live[layer]) layer++;
+    if(!pool_reserve(p,layer+1)) return false;
+    if(!img->levels){
+        u->mip=rgba_expand(s->pixels,w,h,s->ch);
+        u->tmp=(uint8_t*)malloc((size_t)(w/2+1)*(size_t)(h/2+1)*4);
+        if(!u->mip||!u->tmp){ free(u->mip); free(u->tmp); return false; }
+    }
+    p->live[layer]=1;                           /* 転送中も他の読込に取られない */
+    u->pool=pi; u->layer=layer; u->open=true;
+    return true;
+}
+
+/* 次のミップ段を 1 つ送り、VRAM 上のバイト数を返す */
+static size_t pool_array_level(ENG_3D* ctx,const TexSrc3D* s,PoolPut3D* u){
+    const TexImage3D* img=&s->img;
+    const TexPool3D* p=&ctx->pools[u->pool];
+    int l=u->level++;
+    int lw=p->w>>l?p->w>>l:1, lh=p->h>>l?p->h>>l:1;
+    size_t n=u->native?img->size[l]:(size_t)lw*(size_t)lh*4;
+    glBindTexture(GL_TEXTURE_2D_ARRAY,p->tex);  /* 段の間に配列が作り直されうる */
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    if(u->mip){
+        pool_put(ctx,p,u->layer,l,0,0,lw,lh,u->mip,n);
+        if(l+1<u->levels){
+            int nw=lw>1?lw/2:1, nh=lh>1?lh/2:1;
+            mip_down(u->mip,lw,lh,u->tmp,nw,nh);
+            memcpy(u->mip,u->tmp,(size_t)nw*(size_t)nh*4);
+        }
+    } else {
+        uint8_t* px=u->native||img->fmt==TEXFMT_RGBA8?NULL:tex_decode_rgba(img->fmt,img->level[l],lw,lh);
+        pool_put(ctx,p,u->layer,l,0,0,lw,lh,px?px:img->level[l],n);
+        free(px);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    return n;
+}
+
+/* 全段を送ったら t に結び付ける。t が NULL (途中で破棄) ならレイヤーを返す */
+static void pool_array_end(ENG_3D* ctx,Tex3D* t,PoolPut3D* u){
+    TexPool3D* p=&ctx->pools[u->pool];
+    free(u->mip); free(u->tmp);
+    u->mip=u->tmp=NULL; u->open=false;
+    if(!t){ if(p->live&&u->layer<p->cap) p->live[u->layer]=0; return; }
+    t->pool=(uint8_t)(u->pool+1); t->layer=(uint16_t)u->layer;
+    float* r=t->rect; r[0]=r[1]=1.f; r[2]=r[3]=0.f;
+}
+
+static bool pool_add_array(ENG_3D* ctx,Tex3D* t,const TexSrc3D* s,int w,int h,int64_t* bytes){
+    PoolPut3D u;
+    if(!pool_array_begin(ctx,s,w,h,&u)) return false;
+    *bytes=0;
+    while(u.level<u.levels) *bytes+=(int64_t)pool_array_level(ctx,s,&u);
+    pool_array_end(ctx,t,&u);
+    return true;
+}
+
+/* 棚詰め: 高さの近い (4/3 倍以内) 棚の右へ。無ければ余白のある最初の層に棚を足す */
+static bool atlas_place(TexPool3D* p,int pw,int ph,int* layer,int* x,int* y){
+    Shelf3D* best=NULL;
+    for(int i=0;i<p->n_shelves;i++){
+        Shelf3D* s=&p->shelves[i];
+        if(s->h>=ph&&s->h*3<=ph*4&&s->x+pw<=TEX_ATLAS_SIZE&&(!best||s->h<best->h)) best=s;
+    }
+    if(!best){
+        int l=0, top=0;
+        for(;;l++){
+            if(l>=p->cap&&!pool_reserve(p,l+1)) return false;
+            top=0;
+            for(int i=0;i<p->n_shelves;i++){
+                const Shelf3D* s=&p->shelves[i];
+                if(s->layer==l&&s->y+s->h>top) top=s->y+s->h;
+            }
+            if(top+ph<=TEX_ATLAS_SIZE) break;
+        }
+        if(!grow_buf((void**)&p->shelves,&p->cap_shelves,(size_t)p->n_shelves+1,sizeof(Shelf3D))) return false;
+        best=&p->shelves[p->n_shelves++];
+        best->layer=(uint16_t)l; best->x=0; best->y=(uint16_t)top; best->h=(uint16_t)ph;
+    }
+    *layer=best->layer; *x=best->x; *y=best->y;
+    best->x=(uint16_t)(best->x+pw);
+    return true;
+}
+
+/* rgba (w×h) をアトラスへ。縁と 4 の倍数への切り上げ分は端の複製で埋める */
+static bool pool_add_atlas(ENG_3D* ctx,Tex3D* t,const uint8_t* rgba,int w,int h,int64_t* bytes){
+    int pi=pool_get(ctx,true,TEXFMT_RGBA8,TEX_ATLAS_SIZE,TEX_ATLAS_SIZE,TEX_ATLAS_LEVELS);
+    if(pi<0) return false;
+    TexPool3D* p=&ctx->pools[pi];
+    int pw=(w+2*TEX_ATLAS_PAD+3)&~3, ph=(h+2*TEX_ATLAS_PAD+3)&~3;   /* ミップ 2 段目も整数位置 */
+    uint8_t* blk=(uint8_t*)malloc((size_t)pw*(size_t)ph*4);
+    uint8_t* tmp=(uint8_t*)malloc((size_t)pw*(size_t)ph);
+    int layer,x,y;
+    if(!blk||!tmp||!atlas_place(p,pw,ph,&layer,&x,&y)){ free(blk); free(tmp); return false; }
+    for(int by=0;by<ph;by++) for(int bx=0;bx<pw;bx++){
+        int sx=CLAMP(bx-TEX_ATLAS_PAD,0,w-1), sy=CLAMP(by-TEX_ATLAS_PAD,0,h-1);
+        memcpy(blk+((size_t)by*pw+bx)*4,rgba+((size_t)sy*w+sx)*4,4);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY,p->tex);
+    for(int l=0,lw=pw,lh=ph;l<TEX_ATLAS_LEVELS;l++){
+        pool_put(ctx,p,layer,l,x>>l,y>>l,lw,lh,blk,(size_t)lw*(size_t)lh*4);
+        if(l+1<TEX_ATLAS_LEVELS){
+            mip_down(blk,lw,lh,tmp,lw/2,lh/2);
+            lw/=2; lh/=2;
+            memcpy(blk,tmp,(size_t)lw*(size_t)lh*4);
+        }
+    }
+    free(blk); free(tmp);
+    p->live[layer]++;
+    *bytes=(int64_t)pw*ph*4*4/3;
+    t->pool=(uint8_t)(pi+1); t->layer=(uint16_t)layer;
+    float* r=t->rect;
+    r[0]=(float)w/TEX_ATLAS_SIZE;               r[1]=(float)h/TEX_ATLAS_SIZE;
+    r[2]=(float)(x+TEX_ATLAS_PAD)/TEX_ATLAS_SIZE; r[3]=(float)(y+TEX_ATLAS_PAD)/TEX_ATLAS_SIZE;
+    return true;
+}
+
+/* 配列行き (大きいか 2 冪) か、アトラス行きか */
+static bool pool_is_array(int w,int h){
+    return w>TEX_ATLAS_ENTRY||h>TEX_ATLAS_ENTRY||(!(w&(w-1))&&!(h&(h-1)));
+}
+
+/* s をプールへ。入らなければ false (呼び出し側で単独のテクスチャにする) */
+static bool pool_add(ENG_3D* ctx,Tex3D* t,const TexSrc3D* s,int64_t* bytes){
+    const TexImage3D* img=&s->img;
+    int w=img->levels?img->w:s->w, h=img->levels?img->h:s->h;
+    if(w<=0||h<=0) return false;
+    if(pool_is_array(w,h)) return pool_add_array(ctx,t,s,w,h,bytes);
+    uint8_t* px=NULL;
+    const uint8_t* src;
+    if(!img->levels)                  src=px=rgba_expand(s->pixels,w,h,s->ch);
+    else if(img->fmt==TEXFMT_RGBA8)   src=img->level[0];
+    else                              src=px=tex_decode_rgba(img->fmt,img->level[0],w,h);
+    bool ok=src&&pool_add_atlas(ctx,t,src,w,h,bytes);
+    free(px);
+    return ok;
+}
+
+static void pool_release(ENG_3D* ctx,Tex3D* t){
+    if(!t->pool) return;
+    TexPool3D* p=&ctx->pools[t->pool-1];
+    int layer=t->layer;
+    if(p->live[layer]&&--p->live[layer]==0&&p->atlas){   /* 空になった層は棚ごと使い直す */
+        int n=0;
+        for(int i=0;i<p->n_shelves;i++) if(p->shelves[i].layer!=layer) p->shelves[n++]=p->shelves[i];
+        p->n_shelves=n;
+    }
+    t->pool=0;
+}
+
+static void pools_destroy(ENG_3D* ctx){
+    for(int i=0;i<TEX_POOL_MAX;i++){
+        TexPool3D* p=&ctx->pools[i];
+        if(p->tex) glDeleteTextures(1,&p->tex);
+        free(p->live); free(p->shelves);
+        memset(p,0,sizeof(*p));
+    }
 }
 
 /* ══════════════════════════════════════════════════════
  * テクスチャ
+ *   stb_image の上下反転は全体設定でスレッド安全でないので使わず、
+ *   読んだ後に flip_rows で反転する
  * ══════════════════════════════════════════════════════*/
+static GLenum tex_format(int ch){
+    return ch==4?GL_RGBA:ch==3?GL_RGB:ch==2?GL_RG:GL_RED;
+}
+static void flip_rows(unsigned char* px,int w,int h,int ch){
+    size_t row=(size_t)w*(size_t)ch;
+    unsigned char tmp[1024];
+    for(int y=0;y<h/2;y++){
+        unsigned char *a=px+(size_t)y*row, *b=px+(size_t)(h-1-y)*row;
+        for(size_t o=0;o<row;o+=sizeof(tmp)){
+            size_t n=row-o<sizeof(tmp)?row-o:sizeof(tmp);
+            memcpy(tmp,a+o,n); memcpy(a+o,b+o,n); memcpy(b+o,tmp,n);
+        }
+    }
+}
+static void tex_params_mip(void){
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+}
+/* 非圧縮 + 実行時ミップの VRAM 見積り (RGB も 4 バイトで持たれる前提, ミップで 4/3) */
+static int64_t tex_bytes_mip(int w,int h,int ch){
+    return (int64_t)w*h*(ch==3?4:ch)*4/3;
+}
 ENG_3D_TexID eng3d_tex_load(ENG_3D* ctx, const char* path){
-    for(int i=0;i<ENG_3D_MAX_TEXTURES;i++) if(!ctx->tex_used[i]){
-        stbi_set_flip_vertically_on_load(1);
-        int w,h,ch; unsigned char* data=stbi_load(path,&w,&h,&ch,0);
-        if(!data){ fprintf(stderr,"[3D] tex: %s\n",path); return 0; }
-        GLenum fmt=(ch==4)?GL_RGBA:(ch==3)?GL_RGB:GL_RED;
-        glGenTextures(1,&ctx->textures[i]);
-        glBindTexture(GL_TEXTURE_2D,ctx->textures[i]);
-        glTexImage2D(GL_TEXTURE_2D,0,(GLint)fmt,w,h,0,fmt,GL_UNSIGNED_BYTE,data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-        stbi_image_free(data);
-        ctx->tex_used[i]=true;
-        return i+1;
+    TexSrc3D s;
+    if(!tex_read(path,ctx->tex_compress,&s)){ fprintf(stderr,"[3D] tex: %s\n",path); return 0; }
+    ENG_3D_TexID id=handle_alloc(&ctx->textures);
+    Tex3D* t=tex_get(ctx,id);
+    if(!t){ tex_src_free(&s); return 0; }
+    if(ctx->tex_pooling&&pool_add(ctx,t,&s,&t->bytes)) t->gl=0;
+    else if(s.img.levels) t->gl=tex_upload_image(ctx,&s.img,&t->bytes);
+    else {
+        GLenum fmt=tex_format(s.ch);
+        glGenTextures(1,&t->gl);
+        glBindTexture(GL_TEXTURE_2D,t->gl);
+        glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+        glTexImage2D(GL_TEXTURE_2D,0,(GLint)fmt,s.w,s.h,0,fmt,GL_UNSIGNED_BYTE,s.pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+        tex_params_mip();
+        t->bytes=tex_bytes_mip(s.w,s.h,s.ch);
+    }
+    tex_src_free(&s);
+    t->state=ENG_3D_TEX_READY;
+    return id;
+}
+
+/* ── 非同期読込 ─
+ *   ワーカーが tex_read し、メインスレッドが eng3d_begin で転送する。
+ *   1 フレーム tex_budget バイトまで (1 件につき最低 1 単位は送る)。
+ *   非圧縮は PBO リング経由で行単位に、DDS/KTX2/変換済みとプール配列行きは
+ *   ミップ段単位に送る (アトラス行きは小さいので 1 回で)。
+ *   転送が終わるまではスロットに 1×1 の白を置き、完了で本体と差し替える */
+static void tex_decode_job(void* arg){
+    TexLoad3D* d=(TexLoad3D*)arg;
+    bool ok=tex_read(d->path,d->compress,&d->src);
+    SDL_AtomicSet(&d->state,ok?TEXLOAD_DECODED:TEXLOAD_FAILED);
+}
+
+ENG_3D_TexID eng3d_tex_load_async(ENG_3D* ctx, const char* path){
+    if(!path) return 0;
+    TexLoad3D* d=(TexLoad3D*)calloc(1,sizeof(TexLoad3D));
+    size_t n=strlen(path)+1;
+    if(d) d->path=(char*)malloc(n);
+    if(!d||!d->path||!grow_buf((void**)&ctx->tex_loads,&ctx->cap_tex_loads,ctx->n_tex_loads+1,sizeof(TexLoad3D*))
+       ||!(d->id=handle_alloc(&ctx->textures))){
+        if(d) free(d->path);
+        free(d); return 0;
+    }
+    memcpy(d->path,path,n);
+    d->compress=ctx->tex_compress; d->pool=ctx->tex_pooling;
+    SDL_AtomicSet(&d->state,TEXLOAD_QUEUED);
+    static const unsigned char white[4]={255,255,255,255};
+    Tex3D* t=tex_get(ctx,d->id);
+    glGenTextures(1,&t->gl);
+    glBindTexture(GL_TEXTURE_2D,t->gl);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,1,1,0,GL_RGBA,GL_UNSIGNED_BYTE,white);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    t->state=ENG_3D_TEX_LOADING; t->progress=0.f;
+    t->bytes=4;
+    ctx->tex_loads[ctx->n_tex_loads++]=d;
+    ENG_3D_TexID id=d->id;                      /* d はジョブが先に読み終えうる */
+    job_submit(&ctx->jobs,NULL,tex_decode_job,d);
+    return id;
+}
+
+/* d の残りの行を予算 *budget の範囲で送る (最低 1 回は送る)。送り終えたら true */
+static bool tex_stream_rows(ENG_3D* ctx,TexLoad3D* d,size_t* budget){
+    const TexSrc3D* s=&d->src;
+    GLenum fmt=tex_format(s->ch);
+    size_t row=(size_t)s->w*(size_t)s->ch;
+    if(!d->tex){
+        glGenTextures(1,&d->tex);
+        glBindTexture(GL_TEXTURE_2D,d->tex);
+        glTexImage2D(GL_TEXTURE_2D,0,(GLint)fmt,s->w,s->h,0,fmt,GL_UNSIGNED_BYTE,NULL);
+    }
+    if(!ctx->pbo[0]) glGenBuffers(TEX_PBO_RING,ctx->pbo);
+    glBindTexture(GL_TEXTURE_2D,d->tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    while(d->row<s->h&&*budget>0){
+        size_t rows=(size_t)(s->h-d->row);
+        size_t fit=(*budget<TEX_PBO_BYTES?*budget:TEX_PBO_BYTES)/row;
+        if(fit==0) fit=1;                            /* 1 行が予算/PBO より大きい */
+        if(rows>fit) rows=fit;
+        size_t bytes=rows*row;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER,ctx->pbo[ctx->pbo_next]);
+        ctx->pbo_next=(ctx->pbo_next+1)%TEX_PBO_RING;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER,(GLsizeiptr)bytes,NULL,GL_STREAM_DRAW);   /* orphan */
+        void* dst=glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,(GLsizeiptr)bytes,
+                                   GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(dst){
+            memcpy(dst,s->pixels+(size_t)d->row*row,bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D,0,0,d->row,s->w,(GLsizei)rows,fmt,GL_UNSIGNED_BYTE,(void*)0);
+        } else {                                     /* マップできなければ直接 */
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+            glTexSubImage2D(GL_TEXTURE_2D,0,0,d->row,s->w,(GLsizei)rows,fmt,GL_UNSIGNED_BYTE,
+                            s->pixels+(size_t)d->row*row);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+        d->row+=(int)rows;
+        *budget=*budget>bytes?*budget-bytes:0;
+        ctx->stats.upload_bytes+=(int64_t)bytes;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    if(d->row<s->h) return false;
+    tex_params_mip();
+    return true;
+}
+
+/* DDS/KTX2/変換済み: 残りのミップ段を予算の範囲で送る (最低 1 段)。送り終えたら true */
+static bool tex_stream_levels(ENG_3D* ctx,TexLoad3D* d,size_t* budget){
+    const TexImage3D* img=&d->src.img;
+    if(!d->tex) glGenTextures(1,&d->tex);
+    glBindTexture(GL_TEXTURE_2D,d->tex);
+    while(d->level<img->levels&&*budget>0){
+        size_t n=tex_upload_level(ctx,img,d->level++);
+        d->bytes+=(int64_t)n;
+        *budget=*budget>n?*budget-n:0;
+        ctx->stats.upload_bytes+=(int64_t)n;
+    }
+    if(d->level<img->levels) return false;
+    tex_params_levels(img);
+    return true;
+}
+
+/* プール行き: 配列はミップ段ごとに予算の範囲で、アトラスは 1 回で送る。送り終えたら true。
+ * プールに入らなければ d->pool を落とす (単独のテクスチャとして送り直す) */
+static bool tex_stream_pool(ENG_3D* ctx,TexLoad3D* d,Tex3D* t,size_t* budget){
+    const TexSrc3D* s=&d->src;
+    int w=s->img.levels?s->img.w:s->w, h=s->img.levels?s->img.h:s->h;
+    if(!d->put.open){
+        if(!pool_is_array(w,h)){
+            if(!pool_add(ctx,t,s,&d->bytes)){ d->pool=false; return false; }
+            *budget=*budget>(size_t)d->bytes?*budget-(size_t)d->bytes:0;
+            return true;
+        }
+        if(!pool_array_begin(ctx,s,w,h,&d->put)){ d->pool=false; return false; }
+    }
+    while(d->put.level<d->put.levels&&*budget>0){
+        size_t n=pool_array_level(ctx,s,&d->put);
+        d->bytes+=(int64_t)n;
+        *budget=*budget>n?*budget-n:0;
+    }
+    if(d->put.level<d->put.levels) return false;
+    pool_array_end(ctx,t,&d->put);
+    return true;
+}
+
+/* eng3d_begin から。デコード済みのものを予算内で転送し、終わったものを片付ける */
+static void tex_stream(ENG_3D* ctx){
+    size_t budget=(size_t)ctx->tex_budget;
+    for(int k=0;k<ctx->n_tex_loads;){
+        TexLoad3D* d=ctx->tex_loads[k];
+        int st=SDL_AtomicGet(&d->state);
+        bool done=false;
+        if(st==TEXLOAD_QUEUED){ k++; continue; }
+        Tex3D* t=tex_get(ctx,d->id);
+        const TexSrc3D* s=&d->src;
+        if(!t) done=true;                            /* 途中で破棄された */
+        else if(st==TEXLOAD_FAILED){
+            fprintf(stderr,"[3D] tex: %s\n",d->path);
+            t->state=ENG_3D_TEX_FAILED;
+            done=true;
+        }
+        else if(budget>0){
+            if(d->pool&&tex_stream_pool(ctx,d,t,&budget)){
+                glDeleteTextures(1,&t->gl);                  /* プレースホルダ */
+                t->gl=0;
+                t->state=ENG_3D_TEX_READY;
+                t->bytes=d->bytes;
+                done=true;
+            }
+            else if(d->pool){}                               /* 続きは次のフレーム */
+            else if(s->img.levels) done=tex_stream_levels(ctx,d,&budget);
+            else if(tex_stream_rows(ctx,d,&budget)){
+                d->bytes=tex_bytes_mip(s->w,s->h,s->ch);
+                done=true;
+            }
+        }
+        if(done&&d->tex&&t){
+            glDeleteTextures(1,&t->gl);                      /* プレースホルダ */
+            t->gl=d->tex; d->tex=0;
+            t->state=ENG_3D_TEX_READY;
+            t->bytes=d->bytes;
+        }
+        if(t) t->progress=done?1.f:d->put.open?(float)d->put.level/(float)d->put.levels
+                         :s->img.levels?(float)d->level/(float)s->img.levels
+                         :s->h?(float)d->row/(float)s->h:0.f;
+        if(!done){ k++; continue; }
+        if(d->put.open) pool_array_end(ctx,NULL,&d->put);   /* 途中で破棄された */
+        if(d->tex) glDeleteTextures(1,&d->tex);
+        tex_src_free(&d->src); free(d->path); free(d);
+        ctx->tex_loads[k]=ctx->tex_loads[--ctx->n_tex_loads];
     }
-    return 0;
+}
+
+void eng3d_tex_upload_budget(ENG_3D* ctx,int bytes_per_frame){
+    ctx->tex_budget=bytes_per_frame>0?bytes_per_frame:1;
+}
+void eng3d_tex_compress(ENG_3D* ctx,bool on){ ctx->tex_compress=on; }
+void eng3d_tex_pool(ENG_3D* ctx,bool on){ ctx->tex_pooling=on; }
+ENG_3D_TexStatus eng3d_tex_status(ENG_3D* ctx,ENG_3D_TexID id,float* progress){
+    const Tex3D* t=tex_get(ctx,id);
+    if(progress) *progress=t?t->progress:0.f;
+    return t?(ENG_3D_TexStatus)t->state:ENG_3D_TEX_NONE;
+}
+int eng3d_tex_pending(ENG_3D* ctx){ return ctx->n_tex_loads; }
+int64_t eng3d_tex_memory(ENG_3D* ctx,ENG_3D_TexID id){
+    if(id){ const Tex3D* t=tex_get(ctx,id); return t?t->bytes:0; }
+    int64_t sum=0;
+    for(uint32_t s=0;handle_next(&ctx->textures,&s);s++) sum+=((const Tex3D*)handle_at(&ctx->textures,s))->bytes;
+    return sum;
 }
 
 void eng3d_tex_destroy(ENG_3D* ctx, ENG_3D_TexID id){
-    if(id<1||id>ENG_3D_MAX_TEXTURES||!ctx->tex_used[id-1]) return;
-    glDeleteTextures(1,&ctx->textures[id-1]);
-    ctx->tex_used[id-1]=false;
-    ctx->textures[id-1]=0;
+    Tex3D* t=tex_get(ctx,id);
+    if(!t) return;
+    for(int k=0;k<ctx->n_tex_loads;k++)
+        if(ctx->tex_loads[k]->id==id) ctx->tex_loads[k]->id=0;   /* 完了時に捨てる */
+    pool_release(ctx,t);
+    glDeleteTextures(1,&t->gl);
+    handle_free(&ctx->textures,id);
 }
 
 /* ══════════════════════════════════════════════════════
  * マテリアルセッター
  * ══════════════════════════════════════════════════════*/
-#define MESH_OK(ctx,id) ((id)>=1&&(id)<=ENG_3D_MAX_MESHES&&(ctx)->meshes[(id)-1].used)
-void eng3d_mesh_color      (ENG_3D* ctx,ENG_3D_MeshID id,float r,float g,float b,float a){if(!MESH_OK(ctx,id))return;float*c=ctx->meshes[id-1].color;c[0]=r;c[1]=g;c[2]=b;c[3]=a;}
-void eng3d_mesh_texture    (ENG_3D* ctx,ENG_3D_MeshID id,ENG_3D_TexID t){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].tex_id=t;}
-void eng3d_mesh_normal_map (ENG_3D* ctx,ENG_3D_MeshID id,ENG_3D_TexID t){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].normal_map_id=t;}
-void eng3d_mesh_specular   (ENG_3D* ctx,ENG_3D_MeshID id,float in,float sh){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].spec_intensity=in;ctx->meshes[id-1].shininess=sh;}
-void eng3d_mesh_emissive   (ENG_3D* ctx,ENG_3D_MeshID id,float r,float g,float b,float in){if(!MESH_OK(ctx,id))return;float*e=ctx->meshes[id-1].emissive;e[0]=r;e[1]=g;e[2]=b;ctx->meshes[id-1].emissive_int=in;}
-void eng3d_mesh_wireframe  (ENG_3D* ctx,ENG_3D_MeshID id,bool on){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].wireframe=on;}
-void eng3d_mesh_cast_shadow(ENG_3D* ctx,ENG_3D_MeshID id,bool on){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].cast_shadow=on;}
-void eng3d_mesh_receive_shadow(ENG_3D* ctx,ENG_3D_MeshID id,bool on){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].receive_shadow=on;}
-void eng3d_mesh_transparent(ENG_3D* ctx,ENG_3D_MeshID id,bool on){if(!MESH_OK(ctx,id))return;ctx->meshes[id-1].transparent=on;}
+void eng3d_mesh_color      (ENG_3D* ctx,ENG_3D_MeshID id,float r,float g,float b,float a){Mesh3D*m=mesh_get(ctx,id);if(!m)return;float*c=m->color;c[0]=r;c[1]=g;c[2]=b;c[3]=a;}
+void eng3d_mesh_texture    (ENG_3D* ctx,ENG_3D_MeshID id,ENG_3D_TexID t){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->tex_id=t;}
+void eng3d_mesh_normal_map (ENG_3D* ctx,ENG_3D_MeshID id,ENG_3D_TexID t){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->normal_map_id=t;}
+void eng3d_mesh_specular   (ENG_3D* ctx,ENG_3D_MeshID id,float in,float sh){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->spec_intensity=in;m->shininess=sh;}
+void eng3d_mesh_emissive   (ENG_3D* ctx,ENG_3D_MeshID id,float r,float g,float b,float in){Mesh3D*m=mesh_get(ctx,id);if(!m)return;float*e=m->emissive;e[0]=r;e[1]=g;e[2]=b;m->emissive_int=in;}
+void eng3d_mesh_wireframe  (ENG_3D* ctx,ENG_3D_MeshID id,bool on){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->wireframe=on;}
+void eng3d_mesh_cast_shadow(ENG_3D* ctx,ENG_3D_MeshID id,bool on){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->cast_shadow=on;}
+void eng3d_mesh_receive_shadow(ENG_3D* ctx,ENG_3D_MeshID id,bool on){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->receive_shadow=on;}
+void eng3d_mesh_transparent(ENG_3D* ctx,ENG_3D_MeshID id,bool on){Mesh3D*m=mesh_get(ctx,id);if(!m)return;m->transparent=on;}
 
 /* ══════════════════════════════════════════════════════
  * FBO / ブルーム / シャドウセットアップ
@@ -1093,19 +3908,25 @@ static void setup_bloom_fbo(ENG_3D* ctx) {
     glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
+/* デプス配列テクスチャ (レイヤー = カスケード) */
+static void alloc_shadow_layers(ENG_3D* ctx) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY,ctx->shadow_depth_tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_DEPTH_COMPONENT24,SHADOW_MAP_W,SHADOW_MAP_H,
+                 ctx->shadow_cascades,0,GL_DEPTH_COMPONENT,GL_FLOAT,NULL);
+}
+
 static void setup_shadow_fbo(ENG_3D* ctx) {
     glGenFramebuffers(1,&ctx->shadow_fbo);
     glGenTextures(1,&ctx->shadow_depth_tex);
-    glBindTexture(GL_TEXTURE_2D,ctx->shadow_depth_tex);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT,SHADOW_MAP_W,SHADOW_MAP_H,0,GL_DEPTH_COMPONENT,GL_FLOAT,NULL);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_BORDER);
+    alloc_shadow_layers(ctx);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_BORDER);
     float border[]={1,1,1,1};
-    glTexParameterfv(GL_TEXTURE_2D,GL_TEXTURE_BORDER_COLOR,border);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_BORDER_COLOR,border);
     glBindFramebuffer(GL_FRAMEBUFFER,ctx->shadow_fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_TEXTURE_2D,ctx->shadow_depth_tex,0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,ctx->shadow_depth_tex,0,0);
     glDrawBuffer(GL_NONE); glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
@@ -1118,6 +3939,23 @@ static float skybox_verts[] = {
     -1,1,-1,1,1,-1,1,1,1,1,1,1,-1,1,1,-1,1,-1,
     -1,-1,-1,-1,-1,1,1,-1,-1,1,-1,-1,-1,-1,1,1,-1,1};
 
+/* ヘッドレス用の描画先 (RGBA8 + depth24) */
+static void setup_target_fbo(ENG_3D* ctx) {
+    glGenFramebuffers(1,&ctx->target_fbo);
+    glGenRenderbuffers(1,&ctx->target_color_rbo);
+    glGenRenderbuffers(1,&ctx->target_depth_rbo);
+    glBindFramebuffer(GL_FRAMEBUFFER,ctx->target_fbo);
+    glBindRenderbuffer(GL_RENDERBUFFER,ctx->target_color_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,ctx->w,ctx->h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,ctx->target_color_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER,ctx->target_depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT24,ctx->w,ctx->h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,ctx->target_depth_rbo);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr,"[3D] headless FBO incomplete\n");
+    glBindFramebuffer(GL_FRAMEBUFFER,ctx->target_fbo);
+}
+
 static void setup_skybox_vao(ENG_3D* ctx) {
     glGenVertexArrays(1,&ctx->skybox_vao);
     glGenBuffers(1,&ctx->skybox_vbo);
@@ -1150,7 +3988,8 @@ static void emitter_init_vbo(Emitter3D* e) {
 /* ══════════════════════════════════════════════════════
  * ライフサイクル
  * ══════════════════════════════════════════════════════*/
-ENG_3D* eng3d_create(const char* title,int w,int h){
+/* SDL ウィンドウ + GL 3.3 Core コンテキスト */
+static SDL_Window* sdl_gl_window(const char* title,int w,int h,uint32_t flags,SDL_GLContext* out){
     if(SDL_WasInit(SDL_INIT_VIDEO)==0) SDL_Init(SDL_INIT_VIDEO|SDL_INIT_EVENTS);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION,3);
@@ -1158,29 +3997,35 @@ ENG_3D* eng3d_create(const char* title,int w,int h){
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE,24);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER,1);
     SDL_Window* win=SDL_CreateWindow(title,SDL_WINDOWPOS_CENTERED,SDL_WINDOWPOS_CENTERED,
-        w,h,SDL_WINDOW_OPENGL|SDL_WINDOW_RESIZABLE);
+        w,h,SDL_WINDOW_OPENGL|flags);
     if(!win){fprintf(stderr,"[3D] SDL_CreateWindow: %s\n",SDL_GetError());return NULL;}
     SDL_GLContext gl=SDL_GL_CreateContext(win);
     if(!gl){fprintf(stderr,"[3D] GL: %s\n",SDL_GetError());SDL_DestroyWindow(win);return NULL;}
 #ifdef _WIN32
-    win_gl_load();
-#endif
-    SDL_GL_SetSwapInterval(1);
-    ENG_3D* ctx=(ENG_3D*)calloc(1,sizeof(ENG_3D));
-    ctx->window=win; ctx->gl_ctx=gl; ctx->w=w; ctx->h=h;
+    win_gl_load();
+#endif
+    *out=gl;
+    return win;
+}
+
+/* GL コンテキストが current になった後の共通初期化 */
+static ENG_3D* ctx_init(ENG_3D* ctx){
     ctx->cam_pos[0]=0; ctx->cam_pos[1]=3; ctx->cam_pos[2]=5;
     ctx->fov=60.f; ctx->near_z=0.1f; ctx->far_z=500.f;
     ctx->ambient[0]=ctx->ambient[1]=ctx->ambient[2]=0.2f;
     ctx->dir_dir[0]=0.5f; ctx->dir_dir[1]=-1.f; ctx->dir_dir[2]=0.3f;
     ctx->dir_col[0]=ctx->dir_col[1]=ctx->dir_col[2]=0.8f;
-    ctx->shadow_bias=0.005f; ctx->shadow_ortho=20.f;
+    ctx->shadow_bias=0.005f; ctx->shadow_dist=60.f; ctx->shadow_cascades=3;
+    ctx->cull_on=true;
+    ctx->lod_screen[0]=0.3f; ctx->lod_screen[1]=0.15f; ctx->lod_screen[2]=0.07f; ctx->lod_hyst=0.1f;
+    ctx->tex_budget=4*1024*1024;
+    ctx->tex_caps=tex_query_caps();
     ctx->bloom_threshold=1.f; ctx->bloom_intensity=0.5f;
     ctx->fog_color[0]=ctx->fog_color[1]=ctx->fog_color[2]=0.5f;
     ctx->fog_start=50.f; ctx->fog_end=200.f; ctx->fog_density=0.01f;
-    for(int i=0;i<ENG_3D_MAX_NODES;i++){
-        ctx->nodes[i].lscale[0]=ctx->nodes[i].lscale[1]=ctx->nodes[i].lscale[2]=1.f;
-        ctx->nodes[i].parent=-1;
-    }
+    handle_init(&ctx->meshes,sizeof(Mesh3D));   handle_init(&ctx->textures,sizeof(Tex3D));
+    handle_init(&ctx->emitters,sizeof(Emitter3D));
+    handle_init(&ctx->nodes,sizeof(SceneNode)); handle_init(&ctx->anims,sizeof(Anim3D));
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE); glCullFace(GL_BACK);
     glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
@@ -1190,6 +4035,21 @@ ENG_3D* eng3d_create(const char* title,int w,int h){
     ctx->shader_blur    =build_program2(VERT_QUAD,   FRAG_BLUR);
     ctx->shader_combine =build_program2(VERT_QUAD,   FRAG_COMBINE);
     ctx->shader_particle=build_program2(VERT_PARTICLE,FRAG_PARTICLE);
+    /* サンプラーのユニット割り当ては固定なのでリンク直後に一度だけ設定 */
+    glUseProgram(ctx->shader_main.id);
+    U1I(ctx,&ctx->shader_main,U_ALBEDO,0); U1I(ctx,&ctx->shader_main,U_NORMAL_MAP,1); U1I(ctx,&ctx->shader_main,U_SHADOW_MAP,2);
+    U1I(ctx,&ctx->shader_main,U_ALBEDO_ARR,3); U1I(ctx,&ctx->shader_main,U_NORMAL_ARR,4);
+    glUseProgram(ctx->shader_skybox.id);   U1I(ctx,&ctx->shader_skybox,U_SKYBOX,0);
+    glUseProgram(ctx->shader_blur.id);     U1I(ctx,&ctx->shader_blur,U_IMAGE,0);
+    glUseProgram(ctx->shader_combine.id);  U1I(ctx,&ctx->shader_combine,U_SCENE,0); U1I(ctx,&ctx->shader_combine,U_BLOOM,1);
+    glUseProgram(ctx->shader_particle.id); U1I(ctx,&ctx->shader_particle,U_TEX,0);
+    glUseProgram(0);
+    glGenBuffers(1,&ctx->frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER,ctx->frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER,sizeof(FrameUBO),NULL,GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER,FRAME_UBO_BINDING,ctx->frame_ubo);
+    glGenBuffers(1,&ctx->inst_vbo);
+    for(int i=0;i<GPU_TIMER_FRAMES;i++) glGenQueries(GPU_TIMER_SLOTS,ctx->gpu_frames[i].q);
     setup_quad(ctx);
     setup_bloom_fbo(ctx);
     setup_shadow_fbo(ctx);
@@ -1200,14 +4060,112 @@ ENG_3D* eng3d_create(const char* title,int w,int h){
     return ctx;
 }
 
+ENG_3D* eng3d_create(const char* title,int w,int h){
+    SDL_GLContext gl=NULL;
+    SDL_Window* win=sdl_gl_window(title,w,h,SDL_WINDOW_RESIZABLE,&gl);
+    if(!win) return NULL;
+    SDL_GL_SetSwapInterval(1);
+    ENG_3D* ctx=(ENG_3D*)calloc(1,sizeof(ENG_3D));
+    ctx->window=win; ctx->gl_ctx=gl; ctx->w=w; ctx->h=h;
+    return ctx_init(ctx);
+}
+
+/* ══════════════════════════════════════════════════════
+ * ヘッドレス
+ *   EGL surfaceless (Mesa llvmpipe 可) でディスプレイ無しにコンテキストを作り、
+ *   target_fbo に描く。EGL が無いビルドでは非表示 SDL ウィンドウで代用する
+ * ══════════════════════════════════════════════════════*/
+#ifdef ENG3D_HAVE_EGL
+static bool egl_create_context(ENG_3D* ctx){
+    EGLDisplay dpy=EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display=
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(get_platform_display) dpy=get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,EGL_DEFAULT_DISPLAY,NULL);
+    if(dpy==EGL_NO_DISPLAY) dpy=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(dpy==EGL_NO_DISPLAY||!eglInitialize(dpy,NULL,NULL)) return false;
+    static const EGLint cfg_attr[]={EGL_RENDERABLE_TYPE,EGL_OPENGL_BIT,EGL_NONE};
+    static const EGLint ctx_attr[]={
+        EGL_CONTEXT_MAJOR_VERSION_KHR,3,EGL_CONTEXT_MINOR_VERSION_KHR,3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE};
+    EGLConfig  cfg; EGLint n=0;
+    EGLContext ec=EGL_NO_CONTEXT;
+    if(eglBindAPI(EGL_OPENGL_API)&&eglChooseConfig(dpy,cfg_attr,&cfg,1,&n)&&n>0)
+        ec=eglCreateContext(dpy,cfg,EGL_NO_CONTEXT,ctx_attr);
+    if(ec==EGL_NO_CONTEXT||!eglMakeCurrent(dpy,EGL_NO_SURFACE,EGL_NO_SURFACE,ec)){
+        if(ec!=EGL_NO_CONTEXT) eglDestroyContext(dpy,ec);
+        eglTerminate(dpy);
+        return false;
+    }
+    ctx->egl_dpy=dpy; ctx->egl_ctx=ec;
+    return true;
+}
+#endif
+
+ENG_3D* eng3d_create_headless(int w,int h){
+    if(w<=0||h<=0) return NULL;
+    ENG_3D* ctx=(ENG_3D*)calloc(1,sizeof(ENG_3D));
+    ctx->w=w; ctx->h=h; ctx->headless=true;
+    bool ok=false;
+#ifdef ENG3D_HAVE_EGL
+    ok=egl_create_context(ctx);
+#endif
+    if(!ok){
+        ctx->window=sdl_gl_window("eng3d",w,h,SDL_WINDOW_HIDDEN,&ctx->gl_ctx);
+        ok=ctx->window!=NULL;
+    }
+    if(!ok){fprintf(stderr,"[3D] headless: GL コンテキストを作成できません\n");free(ctx);return NULL;}
+    ctx_init(ctx);
+    setup_target_fbo(ctx);
+    return ctx;
+}
+
+bool eng3d_read_pixels(ENG_3D* ctx,uint8_t* rgba){
+    if(!ctx||!rgba) return false;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,ctx->target_fbo);
+    glReadBuffer(ctx->target_fbo?GL_COLOR_ATTACHMENT0:GL_FRONT);
+    glPixelStorei(GL_PACK_ALIGNMENT,1);
+    glReadPixels(0,0,ctx->w,ctx->h,GL_RGBA,GL_UNSIGNED_BYTE,rgba);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,0);
+    /* GL は下の行から返すので上下反転 */
+    size_t row=(size_t)ctx->w*4;
+    uint8_t* tmp=(uint8_t*)malloc(row);
+    if(!tmp) return false;
+    for(int y=0;y<ctx->h/2;y++){
+        uint8_t* a=rgba+(size_t)y*row; uint8_t* b=rgba+(size_t)(ctx->h-1-y)*row;
+        memcpy(tmp,a,row); memcpy(a,b,row); memcpy(b,tmp,row);
+    }
+    free(tmp);
+    return true;
+}
+
+static void scene_free(SceneGraph3D* g);
+
 void eng3d_destroy(ENG_3D* ctx){
     if(!ctx) return;
-    for(int i=0;i<ENG_3D_MAX_MESHES;i++) if(ctx->meshes[i].used) eng3d_mesh_destroy(ctx,i+1);
-    for(int i=0;i<ENG_3D_MAX_TEXTURES;i++) if(ctx->tex_used[i]) eng3d_tex_destroy(ctx,i+1);
-    for(int i=0;i<ENG_3D_MAX_EMITTERS;i++) if(ctx->emitters[i].used) eng3d_emitter_destroy(ctx,i+1);
-    glDeleteProgram(ctx->shader_main); glDeleteProgram(ctx->shader_shadow);
-    glDeleteProgram(ctx->shader_skybox); glDeleteProgram(ctx->shader_blur);
-    glDeleteProgram(ctx->shader_combine); glDeleteProgram(ctx->shader_particle);
+    for(uint32_t s=0;handle_next(&ctx->meshes,&s);s++) eng3d_mesh_destroy(ctx,handle_id(&ctx->meshes,s));
+    for(uint32_t s=0;handle_next(&ctx->textures,&s);s++) eng3d_tex_destroy(ctx,handle_id(&ctx->textures,s));
+    pools_destroy(ctx);
+    for(uint32_t s=0;handle_next(&ctx->emitters,&s);s++) eng3d_emitter_destroy(ctx,handle_id(&ctx->emitters,s));
+    job_stop(&ctx->jobs);                       /* 残りのデコードを終わらせてから */
+    tex_stream(ctx);                            /* 全て orphan なので解放だけ */
+    handle_destroy(&ctx->meshes); handle_destroy(&ctx->textures); handle_destroy(&ctx->emitters);
+    handle_destroy(&ctx->nodes);  handle_destroy(&ctx->anims);
+    scene_free(&ctx->scene);
+    free(ctx->tex_loads);
+    if(ctx->pbo[0]) glDeleteBuffers(TEX_PBO_RING,ctx->pbo);
+    glDeleteProgram(ctx->shader_main.id); glDeleteProgram(ctx->shader_shadow.id);
+    glDeleteProgram(ctx->shader_skybox.id); glDeleteProgram(ctx->shader_blur.id);
+    glDeleteProgram(ctx->shader_combine.id); glDeleteProgram(ctx->shader_particle.id);
+    glDeleteBuffers(1,&ctx->frame_ubo);
+    glDeleteBuffers(1,&ctx->inst_vbo);
+    for(int i=0;i<2;i++){
+        GeoArena3D* a=&ctx->arena[i];
+        if(!a->vao) continue;
+        glDeleteVertexArrays(1,&a->vao); glDeleteBuffers(1,&a->vbo); glDeleteBuffers(1,&a->ebo);
+        free(a->verts.span); free(a->idx.span);
+    }
+    for(int i=0;i<GPU_TIMER_FRAMES;i++) glDeleteQueries(GPU_TIMER_SLOTS,ctx->gpu_frames[i].q);
     glDeleteFramebuffers(1,&ctx->bloom_fbo); glDeleteFramebuffers(1,&ctx->bloom_fbo2);
     glDeleteFramebuffers(1,&ctx->shadow_fbo);
     glDeleteTextures(1,&ctx->bloom_color_tex); glDeleteTextures(1,&ctx->bloom_color_tex2);
@@ -1216,6 +4174,21 @@ void eng3d_destroy(ENG_3D* ctx){
     glDeleteVertexArrays(1,&ctx->quad_vao); glDeleteBuffers(1,&ctx->quad_vbo);
     glDeleteVertexArrays(1,&ctx->skybox_vao); glDeleteBuffers(1,&ctx->skybox_vbo);
     if(ctx->skybox_on) glDeleteTextures(1,&ctx->skybox_cubemap);
+    if(ctx->target_fbo){
+        glDeleteFramebuffers(1,&ctx->target_fbo);
+        glDeleteRenderbuffers(1,&ctx->target_color_rbo); glDeleteRenderbuffers(1,&ctx->target_depth_rbo);
+    }
+    free(ctx->draws); free(ctx->sort_buf); free(ctx->inst_data);
+    free(ctx->ops); free(ctx->fx_data);
+#ifdef ENG3D_HAVE_EGL
+    if(ctx->egl_ctx){
+        eglMakeCurrent(ctx->egl_dpy,EGL_NO_SURFACE,EGL_NO_SURFACE,EGL_NO_CONTEXT);
+        eglDestroyContext(ctx->egl_dpy,ctx->egl_ctx);
+        eglTerminate(ctx->egl_dpy);
+        free(ctx);
+        return;
+    }
+#endif
     SDL_GL_DeleteContext(ctx->gl_ctx); SDL_DestroyWindow(ctx->window);
     free(ctx);
 }
@@ -1230,6 +4203,7 @@ bool eng3d_update(ENG_3D* ctx){
     memcpy(ctx->prev_keys,ctx->keys,sizeof(ctx->prev_keys));
     ctx->prev_mouse_btn=ctx->mouse_btn;
     ctx->mdx=ctx->mdy=ctx->scroll=0;
+    if(ctx->headless) return !ctx->quit;   /* 入力もウィンドウイベントも無い */
     SDL_Event e;
     while(SDL_PollEvent(&e)){
         if(e.type==SDL_QUIT) ctx->quit=true;
@@ -1297,7 +4271,13 @@ void eng3d_spot_light(ENG_3D* ctx,int slot,
 void eng3d_spot_light_off(ENG_3D* ctx,int slot){if(slot>=0&&slot<ENG_3D_MAX_SPOTS)ctx->sp_lights[slot].active=false;}
 void eng3d_shadow_enable(ENG_3D* ctx,bool on){ctx->shadow_on=on;}
 void eng3d_shadow_bias  (ENG_3D* ctx,float b){ctx->shadow_bias=b;}
-void eng3d_shadow_size  (ENG_3D* ctx,float s){ctx->shadow_ortho=s;}
+void eng3d_shadow_size  (ENG_3D* ctx,float s){ctx->shadow_dist=s;}
+void eng3d_shadow_cascades(ENG_3D* ctx,int n){
+    n=CLAMP(n,1,ENG_3D_MAX_CASCADES);
+    if(n==ctx->shadow_cascades) return;
+    ctx->shadow_cascades=n;
+    alloc_shadow_layers(ctx);
+}
 void eng3d_fog_enable   (ENG_3D* ctx,bool on){ctx->fog_on=on;}
 void eng3d_fog(ENG_3D* ctx,float r,float g,float b,int mode,float st,float en,float den){
     ctx->fog_color[0]=r;ctx->fog_color[1]=g;ctx->fog_color[2]=b;
@@ -1307,9 +4287,27 @@ void eng3d_bloom_enable   (ENG_3D* ctx,bool on){ctx->bloom_on=on;}
 void eng3d_bloom_threshold(ENG_3D* ctx,float t){ctx->bloom_threshold=t;}
 void eng3d_bloom_intensity(ENG_3D* ctx,float v){ctx->bloom_intensity=v;}
 
+static void gpu_timer_begin(ENG_3D* ctx,int pass);
+static void gpu_timer_end(ENG_3D* ctx);
+static void particles_exec(ENG_3D* ctx,const FrameOp3D* op);
+
+/* ここまでの描画の後に実行する区切りを積む */
+static FrameOp3D* frame_op(ENG_3D* ctx,int type){
+    if(!grow_buf((void**)&ctx->ops,&ctx->cap_ops,ctx->n_ops+1,sizeof(FrameOp3D))) return NULL;
+    FrameOp3D* op=&ctx->ops[ctx->n_ops++];
+    memset(op,0,sizeof(*op));
+    op->type=type; op->end=ctx->n_draws;
+    return op;
+}
+
 /* ══════════════════════════════════════════════════════
  * スカイボックス
  * ══════════════════════════════════════════════════════*/
+typedef struct { const char* path; unsigned char* data; int w, h; } SkyFace3D;
+static void sky_decode_job(void* arg){
+    SkyFace3D* f=(SkyFace3D*)arg; int ch;
+    f->data=stbi_load(f->path,&f->w,&f->h,&ch,3);     /* キューブマップは反転しない */
+}
 bool eng3d_skybox_load(ENG_3D* ctx,
     const char* px,const char* nx,
     const char* py,const char* ny,
@@ -1318,15 +4316,18 @@ bool eng3d_skybox_load(ENG_3D* ctx,
     if(ctx->skybox_on) glDeleteTextures(1,&ctx->skybox_cubemap);
     glGenTextures(1,&ctx->skybox_cubemap);
     glBindTexture(GL_TEXTURE_CUBE_MAP,ctx->skybox_cubemap);
+    /* 6 面をジョブプールで並列にデコードしてから順に転送 */
     const char* faces[6]={px,nx,py,ny,pz,nz};
-    stbi_set_flip_vertically_on_load(0);
+    SkyFace3D f[6]; SDL_atomic_t pending; SDL_AtomicSet(&pending,6);
+    for(int i=0;i<6;i++){ f[i].path=faces[i]; f[i].data=NULL; job_submit(&ctx->jobs,&pending,sky_decode_job,&f[i]); }
+    job_wait(&ctx->jobs,&pending);
+    bool ok=true;
     for(int i=0;i<6;i++){
-        int w,h,ch; unsigned char* data=stbi_load(faces[i],&w,&h,&ch,3);
-        if(!data){fprintf(stderr,"[3D] skybox: %s\n",faces[i]);return false;}
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i,0,GL_RGB,w,h,0,GL_RGB,GL_UNSIGNED_BYTE,data);
-        stbi_image_free(data);
+        if(!f[i].data){fprintf(stderr,"[3D] skybox: %s\n",faces[i]);ok=false;continue;}
+        if(ok) glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i,0,GL_RGB,f[i].w,f[i].h,0,GL_RGB,GL_UNSIGNED_BYTE,f[i].data);
     }
-    stbi_set_flip_vertically_on_load(1);
+    for(int i=0;i<6;i++) stbi_image_free(f[i].data);
+    if(!ok){ glDeleteTextures(1,&ctx->skybox_cubemap); ctx->skybox_on=false; return false; }
     glTexParameteri(GL_TEXTURE_CUBE_MAP,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
@@ -1335,20 +4336,20 @@ bool eng3d_skybox_load(ENG_3D* ctx,
     ctx->skybox_on=true; return true;
 }
 void eng3d_skybox_draw(ENG_3D* ctx){
+    if(ctx->skybox_on) frame_op(ctx,FRAME_OP_SKYBOX);   /* 実際の描画は eng3d_end */
+}
+static void skybox_exec(ENG_3D* ctx){
     if(!ctx->skybox_on)return;
+    gpu_timer_begin(ctx,GPU_PASS_MAIN);
     glDepthFunc(GL_LEQUAL);
-    glUseProgram(ctx->shader_skybox);
-    mat4 view_no_trans; m4_copy(view_no_trans,ctx->mat_view);
-    view_no_trans[12]=view_no_trans[13]=view_no_trans[14]=0;
-    UM4(ctx->shader_skybox,"uView",view_no_trans);
-    UM4(ctx->shader_skybox,"uProj",ctx->mat_proj);
+    ST_PROG(ctx,ctx->shader_skybox.id);   /* ビュー/射影は Frame UBO から */
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP,ctx->skybox_cubemap);
-    U1I(ctx->shader_skybox,"uSkybox",0);
-    glBindVertexArray(ctx->skybox_vao);
-    glDrawArrays(GL_TRIANGLES,0,36);
+    ST_TEX(ctx,GL_TEXTURE_CUBE_MAP,ctx->skybox_cubemap);
+    ST_VAO(ctx,ctx->skybox_vao);
+    glDrawArrays(GL_TRIANGLES,0,36); stat_draw(ctx,12,1);
     glBindVertexArray(0);
     glDepthFunc(GL_LESS);
+    gpu_timer_end(ctx);
 }
 void eng3d_skybox_unload(ENG_3D* ctx){
     if(!ctx->skybox_on)return;
@@ -1357,100 +4358,458 @@ void eng3d_skybox_unload(ENG_3D* ctx){
 }
 
 /* ══════════════════════════════════════════════════════
- * 内部: uniform 一括設定
+ * 内部: フレーム共通 UBO
+ *   カメラ/ライト/フォグ/シャドウを std140 で詰め、
+ *   前回転送した内容と異なる時だけ glBufferSubData する
  * ══════════════════════════════════════════════════════*/
-static void set_lighting_uniforms(ENG_3D* ctx,unsigned int prog){
-    U3F(prog,"uAmbient",ctx->ambient);
-    U3F(prog,"uDirDir",ctx->dir_dir);
-    U3F(prog,"uDirCol",ctx->dir_col);
-    U3F(prog,"uCamPos",ctx->cam_pos);
-    float pt_pos[ENG_3D_MAX_LIGHTS*3]={0},pt_col[ENG_3D_MAX_LIGHTS*3]={0},pt_rad[ENG_3D_MAX_LIGHTS]={0};
+static void update_frame_ubo(ENG_3D* ctx){
+    FrameUBO f; memset(&f,0,sizeof(f));
+    memcpy(f.view,ctx->mat_view,64);
+    memcpy(f.proj,ctx->mat_proj,64);
+    memcpy(f.light_space,ctx->mat_light_space,sizeof(f.light_space));
+    memcpy(f.cascade_splits,ctx->cascade_splits,sizeof(f.cascade_splits));
+    memcpy(f.cam_pos,ctx->cam_pos,12);
+    memcpy(f.ambient,ctx->ambient,12);
+    memcpy(f.dir_dir,ctx->dir_dir,12);
+    memcpy(f.dir_col,ctx->dir_col,12);
     int npt=0;
     for(int i=0;i<ENG_3D_MAX_LIGHTS;i++) if(ctx->pt_lights[i].active){
-        pt_pos[npt*3]=ctx->pt_lights[i].x;pt_pos[npt*3+1]=ctx->pt_lights[i].y;pt_pos[npt*3+2]=ctx->pt_lights[i].z;
-        pt_col[npt*3]=ctx->pt_lights[i].r;pt_col[npt*3+1]=ctx->pt_lights[i].g;pt_col[npt*3+2]=ctx->pt_lights[i].b;
-        pt_rad[npt]=ctx->pt_lights[i].radius; npt++;
-    }
-    glUniform3fv(UL(prog,"uPtPos"),ENG_3D_MAX_LIGHTS,pt_pos);
-    glUniform3fv(UL(prog,"uPtCol"),ENG_3D_MAX_LIGHTS,pt_col);
-    glUniform1fv(UL(prog,"uPtRad"),ENG_3D_MAX_LIGHTS,pt_rad);
-    U1I(prog,"uPtCount",npt);
-    float sp_pos[ENG_3D_MAX_SPOTS*3]={0},sp_dir[ENG_3D_MAX_SPOTS*3]={0},sp_col[ENG_3D_MAX_SPOTS*3]={0};
-    float sp_rad[ENG_3D_MAX_SPOTS]={0},sp_cut[ENG_3D_MAX_SPOTS]={0},sp_out[ENG_3D_MAX_SPOTS]={0};
+        PointLight3D* l=&ctx->pt_lights[i];
+        f.pt_pos[npt][0]=l->x; f.pt_pos[npt][1]=l->y; f.pt_pos[npt][2]=l->z; f.pt_pos[npt][3]=l->radius;
+        f.pt_col[npt][0]=l->r; f.pt_col[npt][1]=l->g; f.pt_col[npt][2]=l->b;
+        npt++;
+    }
     int nsp=0;
     for(int i=0;i<ENG_3D_MAX_SPOTS;i++) if(ctx->sp_lights[i].active){
-        sp_pos[nsp*3]=ctx->sp_lights[i].x;sp_pos[nsp*3+1]=ctx->sp_lights[i].y;sp_pos[nsp*3+2]=ctx->sp_lights[i].z;
-        sp_dir[nsp*3]=ctx->sp_lights[i].dx;sp_dir[nsp*3+1]=ctx->sp_lights[i].dy;sp_dir[nsp*3+2]=ctx->sp_lights[i].dz;
-        sp_col[nsp*3]=ctx->sp_lights[i].r;sp_col[nsp*3+1]=ctx->sp_lights[i].g;sp_col[nsp*3+2]=ctx->sp_lights[i].b;
-        sp_rad[nsp]=ctx->sp_lights[i].radius;
-        sp_cut[nsp]=ctx->sp_lights[i].cutoff_cos;
-        sp_out[nsp]=ctx->sp_lights[i].outer_cos;
+        SpotLight3D* l=&ctx->sp_lights[i];
+        f.sp_pos[nsp][0]=l->x;  f.sp_pos[nsp][1]=l->y;  f.sp_pos[nsp][2]=l->z;  f.sp_pos[nsp][3]=l->radius;
+        f.sp_dir[nsp][0]=l->dx; f.sp_dir[nsp][1]=l->dy; f.sp_dir[nsp][2]=l->dz; f.sp_dir[nsp][3]=l->cutoff_cos;
+        f.sp_col[nsp][0]=l->r;  f.sp_col[nsp][1]=l->g;  f.sp_col[nsp][2]=l->b;  f.sp_col[nsp][3]=l->outer_cos;
         nsp++;
     }
-    glUniform3fv(UL(prog,"uSpPos"),ENG_3D_MAX_SPOTS,sp_pos);
-    glUniform3fv(UL(prog,"uSpDir"),ENG_3D_MAX_SPOTS,sp_dir);
-    glUniform3fv(UL(prog,"uSpCol"),ENG_3D_MAX_SPOTS,sp_col);
-    glUniform1fv(UL(prog,"uSpRad"),ENG_3D_MAX_SPOTS,sp_rad);
-    glUniform1fv(UL(prog,"uSpCut"),ENG_3D_MAX_SPOTS,sp_cut);
-    glUniform1fv(UL(prog,"uSpOut"),ENG_3D_MAX_SPOTS,sp_out);
-    U1I(prog,"uSpCount",nsp);
-    int fm=ctx->fog_on?ctx->fog_mode:-1;
-    U1I(prog,"uFogMode",fm);
-    U3F(prog,"uFogColor",ctx->fog_color);
-    U1F(prog,"uFogStart",ctx->fog_start);
-    U1F(prog,"uFogEnd",ctx->fog_end);
-    U1F(prog,"uFogDensity",ctx->fog_density);
+    memcpy(f.fog_color,ctx->fog_color,12); f.fog_color[3]=ctx->fog_density;
+    f.fog_range[0]=ctx->fog_start; f.fog_range[1]=ctx->fog_end; f.fog_range[2]=ctx->shadow_bias;
+    f.counts[0]=npt; f.counts[1]=nsp; f.counts[2]=ctx->fog_on?ctx->fog_mode:-1;
+    f.counts[3]=ctx->shadow_cascades;
+    if(ctx->frame_valid&&memcmp(&f,&ctx->frame_data,sizeof(f))==0) return;
+    glBindBuffer(GL_UNIFORM_BUFFER,ctx->frame_ubo);
+    ST_SUBDATA(ctx,GL_UNIFORM_BUFFER,0,sizeof(f),&f);
+    ctx->stats.uniform_uploads++;
+    ctx->frame_data=f; ctx->frame_valid=true;
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: 描画キーとソート
+ *   64bit キー (上位ほど優先):
+ *     不透明: [63:62]=0 | テクスチャ 8 | 法線マップ 8 | ワイヤ 1 | メッシュ 9 | LOD 2 | 深度 24 (手前→奥)
+ *     半透明: [63:62]=1 | 反転深度 24 (奥→手前) | メッシュ 9 | LOD 2
+ *     影のみ: [63:62]=2 | メッシュ 9 | LOD 2   (画面外のシャドウキャスター)
+ *   メッシュ用プログラムは shader_main 1 本なのでプログラムのビットは持たない
+ * ══════════════════════════════════════════════════════*/
+#define KEY_PASS_SHIFT  62
+#define KEY_PASS_OPAQUE 0ull
+#define KEY_PASS_BLEND  1ull
+#define KEY_PASS_SHADOW 2ull
+#define KEY_PASS(k)     ((k)>>KEY_PASS_SHIFT)
+#define KEY_DEPTH_MAX   0xFFFFFFu
+
+/* バインドする実体: 単独は ID、プールは TEXKEY_POOL|プール番号 (0=なし)。
+ * 同じ値の描画はテクスチャを替えずに続けて描ける */
+#define TEXKEY_POOL 0x80000000u
+static uint32_t tex_bind_key(ENG_3D* ctx,ENG_3D_TexID t){
+    const Tex3D* x=tex_get(ctx,t);
+    return !x?0u:x->pool?TEXKEY_POOL|x->pool:(uint32_t)t;
+}
+/* ソートキーのテクスチャ欄は 8bit。畳み込みで衝突しても区間分けは
+ * tex_bind_key の比較で行うので、並びが少し崩れるだけ */
+static uint64_t tex_sort_bits(uint32_t k){
+    return k?1u+(k^k>>HANDLE_SLOT_BITS^k>>24)%255u:0u;
+}
+static ENG_3D_TexID draw_albedo(ENG_3D* ctx,const DrawCmd3D* d){
+    const Mesh3D* m=d->tex?NULL:mesh_get(ctx,d->mesh);
+    return d->tex?d->tex:m?m->tex_id:0;
+}
+
+static uint64_t draw_sort_key(ENG_3D* ctx,ENG_3D_MeshID id,const Mesh3D* m,ENG_3D_TexID tex,
+    const mat4 model,int lod,bool shadow_only)
+{
+    uint64_t mesh=(uint64_t)id&0x1FF, l=(uint64_t)lod&3;
+    if(shadow_only) return (KEY_PASS_SHADOW<<KEY_PASS_SHIFT)|(mesh<<53)|(l<<51);
+    /* バウンディングボックス中心のビュー空間深度を near..far で 24bit に量子化 */
+    float cx=(m->bounds.min[0]+m->bounds.max[0])*0.5f;
+    float cy=(m->bounds.min[1]+m->bounds.max[1])*0.5f;
+    float cz=(m->bounds.min[2]+m->bounds.max[2])*0.5f;
+    float wx=model[0]*cx+model[4]*cy+model[8] *cz+model[12];
+    float wy=model[1]*cx+model[5]*cy+model[9] *cz+model[13];
+    float wz=model[2]*cx+model[6]*cy+model[10]*cz+model[14];
+    const float* v=ctx->mat_view;
+    float dist=-(v[2]*wx+v[6]*wy+v[10]*wz+v[14]);
+    float t=(dist-ctx->near_z)/(ctx->far_z-ctx->near_z);
+    t=CLAMP(t,0.f,1.f);
+    uint64_t depth=(uint64_t)(t*(float)KEY_DEPTH_MAX);
+    if(m->transparent)
+        return (KEY_PASS_BLEND<<KEY_PASS_SHIFT)|((KEY_DEPTH_MAX-depth)<<38)|(mesh<<29)|(l<<27);
+    return (tex_sort_bits(tex_bind_key(ctx,tex))<<54)|(tex_sort_bits(tex_bind_key(ctx,m->normal_map_id))<<46)
+          |((uint64_t)(m->wireframe?1:0)<<45)|(mesh<<36)|(l<<34)|(depth<<10);
+}
+
+/* LSD 基数ソート (8bit × 8 パス)。全要素で同じ値のバイトはパスごと省略する。
+ * 結果が入っている方のバッファを返す */
+static DrawSort3D* radix_sort_draws(DrawSort3D* a,DrawSort3D* tmp,int n){
+    uint32_t hist[8][256];
+    memset(hist,0,sizeof(hist));
+    for(int i=0;i<n;i++){
+        uint64_t k=a[i].key;
+        for(int b=0;b<8;b++) hist[b][(k>>(b*8))&0xFF]++;
+    }
+    for(int b=0;b<8;b++){
+        uint32_t* h=hist[b];
+        int sh=b*8;
+        if(h[(a[0].key>>sh)&0xFF]==(uint32_t)n) continue;
+        uint32_t sum=0;
+        for(int j=0;j<256;j++){uint32_t c=h[j];h[j]=sum;sum+=c;}
+        for(int i=0;i<n;i++) tmp[h[(a[i].key>>sh)&0xFF]++]=a[i];
+        DrawSort3D* t=a;a=tmp;tmp=t;
+    }
+    return a;
+}
+
+static const DrawSort3D* sort_draws(ENG_3D* ctx){
+    int n=ctx->n_draws;
+    if(n>ctx->cap_sort){
+        DrawSort3D* ns=(DrawSort3D*)realloc(ctx->sort_buf,(size_t)ctx->cap_draws*2*sizeof(DrawSort3D));
+        if(!ns) return NULL;
+        ctx->sort_buf=ns; ctx->cap_sort=ctx->cap_draws;
+    }
+    DrawSort3D *a=ctx->sort_buf, *tmp=a+ctx->cap_sort;
+    for(int i=0;i<n;i++){a[i].key=ctx->draws[i].key;a[i].idx=(uint32_t)i;}
+    /* 区切りをまたいでは並べ替えない (スカイボックス等との前後を保つ) */
+    int s=0;
+    for(size_t k=0;k<=ctx->n_ops;k++){
+        int e=k<ctx->n_ops?ctx->ops[k].end:n;
+        if(e>s){
+            DrawSort3D* r=radix_sort_draws(a+s,tmp+s,e-s);
+            if(r!=a+s) memcpy(a+s,r,(size_t)(e-s)*sizeof(DrawSort3D));
+        }
+        s=e;
+    }
+    return a;
 }
 
 /* ══════════════════════════════════════════════════════
  * 内部: メッシュ描画
+ *   ソート済みキューを流しながら、直前と同じ状態の設定は省く
  * ══════════════════════════════════════════════════════*/
-static void draw_mesh_internal(ENG_3D* ctx,unsigned int prog,
-    ENG_3D_MeshID mesh_id,
-    float px,float py,float pz,
-    float rx,float ry,float rz,
-    float sx,float sy,float sz)
+typedef struct {
+    int          mesh;
+    unsigned int vao, tex, nm, tex_arr, nm_arr;
+    uint32_t     albedo;        /* tex_bind_key (UINT32_MAX=未設定) */
+    bool         wire, blend;
+} PassState3D;
+
+static void bind_mesh_material(ENG_3D* ctx,const Program3D* prog,
+    const Mesh3D* m,PassState3D* st)
 {
-    if(mesh_id<1||mesh_id>ENG_3D_MAX_MESHES||!ctx->meshes[mesh_id-1].used)return;
-    Mesh3D* m=&ctx->meshes[mesh_id-1];
-    mat4 model,mvp,tmp;
-    m4_trs(model,px,py,pz,rx,ry,rz,sx,sy,sz);
-    m4_mul(tmp,ctx->mat_view,model); m4_mul(mvp,ctx->mat_proj,tmp);
-    float nm[9]; m4_normal(nm,model);
-    UM4(prog,"uMVP",mvp); UM4(prog,"uModel",model);
-    if(UL(prog,"uNM")>=0) UM3(prog,"uNM",nm);
-    UM4(prog,"uLightSpace",ctx->mat_light_space);
-    U4F(prog,"uColor",m->color);
-    U3F(prog,"uEmissive",m->emissive);
-    U1F(prog,"uEmissiveInt",m->emissive_int);
-    U1F(prog,"uSpecInt",m->spec_intensity);
-    U1F(prog,"uShininess",m->shininess);
-    int hasTex=0;
-    if(m->tex_id>=1&&m->tex_id<=ENG_3D_MAX_TEXTURES&&ctx->tex_used[m->tex_id-1]){
-        glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,ctx->textures[m->tex_id-1]);
-        U1I(prog,"uAlbedo",0); hasTex=1;
-    }
-    U1I(prog,"uHasTex",hasTex);
-    int hasNM=0;
-    if(m->normal_map_id>=1&&m->normal_map_id<=ENG_3D_MAX_TEXTURES&&ctx->tex_used[m->normal_map_id-1]){
-        glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,ctx->textures[m->normal_map_id-1]);
-        U1I(prog,"uNormalMap",1); hasNM=1;
-    }
-    U1I(prog,"uHasNM",hasNM);
-    int hasShadow=ctx->shadow_on&&m->receive_shadow?1:0;
-    if(hasShadow){
-        glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D,ctx->shadow_depth_tex);
-        U1I(prog,"uShadowMap",2);
-    }
-    U1I(prog,"uHasShadow",hasShadow);
-    U1F(prog,"uShadowBias",ctx->shadow_bias);
-    if(m->wireframe) glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
-    if(m->transparent){glEnable(GL_BLEND);glDepthMask(GL_FALSE);}
-    glBindVertexArray(m->vao);
-    glDrawElements(GL_TRIANGLES,(GLsizei)m->index_count,GL_UNSIGNED_INT,0);
+    U4F(ctx,prog,U_COLOR,m->color);
+    U3F(ctx,prog,U_EMISSIVE,m->emissive);
+    U1F(ctx,prog,U_EMISSIVE_INT,m->emissive_int);
+    U1F(ctx,prog,U_SPEC_INT,m->spec_intensity);
+    U1F(ctx,prog,U_SHININESS,m->shininess);
+    const Tex3D* n=tex_get(ctx,m->normal_map_id);
+    if(n&&n->pool){
+        unsigned int nm=ctx->pools[n->pool-1].tex;
+        if(nm!=st->nm_arr){glActiveTexture(GL_TEXTURE4);ST_TEX(ctx,GL_TEXTURE_2D_ARRAY,nm);st->nm_arr=nm;}
+        U4F(ctx,prog,U_NM_RECT,n->rect);
+        U1F(ctx,prog,U_NM_LAYER,(float)n->layer);
+        U1I(ctx,prog,U_HAS_NM,2);
+    } else {
+        if(n&&n->gl!=st->nm){glActiveTexture(GL_TEXTURE1);ST_TEX(ctx,GL_TEXTURE_2D,n->gl);st->nm=n->gl;}
+        U1I(ctx,prog,U_HAS_NM,n?1:0);
+    }
+    U1I(ctx,prog,U_HAS_SHADOW,ctx->shadow_on&&m->receive_shadow?1:0);
+    U3F(ctx,prog,U_POS_SCALE,m->pos_scale);
+    U3F(ctx,prog,U_POS_BIAS,m->pos_bias);
+    U1I(ctx,prog,U_PACKED,m->packed?1:0);
+    if(m->wireframe!=st->wire){
+        glPolygonMode(GL_FRONT_AND_BACK,m->wireframe?GL_LINE:GL_FILL);
+        st->wire=m->wireframe;
+    }
+    if(m->transparent&&!st->blend){glDepthMask(GL_FALSE);st->blend=true;}
+    if(m->vao!=st->vao){ST_VAO(ctx,m->vao);st->vao=m->vao;}
+}
+
+/* アルベドは描画毎に差し替えられるので区間毎に。プール同士なら配列は替わらない */
+static void bind_albedo(ENG_3D* ctx,const Program3D* prog,ENG_3D_TexID t,PassState3D* st){
+    uint32_t k=tex_bind_key(ctx,t);
+    if(k==st->albedo) return;
+    st->albedo=k;
+    if(k&TEXKEY_POOL){
+        unsigned int arr=ctx->pools[(k&~TEXKEY_POOL)-1].tex;
+        if(arr!=st->tex_arr){glActiveTexture(GL_TEXTURE3);ST_TEX(ctx,GL_TEXTURE_2D_ARRAY,arr);st->tex_arr=arr;}
+    } else if(k){
+        unsigned int tex=tex_get(ctx,(ENG_3D_TexID)k)->gl;
+        if(tex!=st->tex){glActiveTexture(GL_TEXTURE0);ST_TEX(ctx,GL_TEXTURE_2D,tex);st->tex=tex;}
+    }
+    U1I(ctx,prog,U_HAS_TEX,k&TEXKEY_POOL?2:k?1:0);
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: インスタンシング
+ *   ソート済みキューの行列とアルベドの UV 矩形・レイヤーを
+ *   フラッシュ毎に 1 回だけ inst_vbo へ転送し、
+ *   同じメッシュ・同じバインドが続く区間を 1 回の
+ *   glDrawElementsInstanced で描く。GL 3.3 には baseInstance が無いので
+ *   区間の先頭へは属性ポインタのオフセットで合わせる
+ * ══════════════════════════════════════════════════════*/
+#define INST_FLOATS 30              /* 行列 16 + UV 矩形 4 + レイヤー 1 + 法線行列 9 */
+#define INST_STRIDE (INST_FLOATS*4)
+static bool upload_instances(ENG_3D* ctx,const DrawSort3D* order){
+    int n=ctx->n_draws;
+    if(n>ctx->cap_inst){
+        float* ni=(float*)realloc(ctx->inst_data,(size_t)ctx->cap_draws*INST_STRIDE);
+        if(!ni) return false;
+        ctx->inst_data=ni; ctx->cap_inst=ctx->cap_draws;
+    }
+    for(int i=0;i<n;i++){
+        const DrawCmd3D* d=&ctx->draws[order[i].idx];
+        float* o=ctx->inst_data+(size_t)i*INST_FLOATS;
+        memcpy(o,d->model,64);
+        const Tex3D* t=tex_get(ctx,draw_albedo(ctx,d));
+        if(t&&t->pool){ memcpy(o+16,t->rect,16); o[20]=(float)t->layer; }
+        else { o[16]=o[17]=1.f; o[18]=o[19]=o[20]=0.f; }
+        m4_normal(o+21,d->model);                   /* 頂点ごとに逆行列を取らせない */
+    }
+    glBindBuffer(GL_ARRAY_BUFFER,ctx->inst_vbo);
+    glBufferData(GL_ARRAY_BUFFER,(GLsizeiptr)ctx->cap_inst*INST_STRIDE,NULL,GL_STREAM_DRAW);   /* orphan */
+    ST_SUBDATA(ctx,GL_ARRAY_BUFFER,0,(GLsizeiptr)n*INST_STRIDE,ctx->inst_data);
+    return true;
+}
+
+/* VAO をバインドした状態で呼ぶ。first 番目のインスタンスから読ませる */
+static void point_instances(ENG_3D* ctx,int first){
+    size_t base=(size_t)first*INST_STRIDE;
+    glBindBuffer(GL_ARRAY_BUFFER,ctx->inst_vbo);
+    for(int c=0;c<4;c++)
+        glVertexAttribPointer(4+c,4,GL_FLOAT,GL_FALSE,INST_STRIDE,(void*)(base+(size_t)c*16));
+    glVertexAttribPointer(8,4,GL_FLOAT,GL_FALSE,INST_STRIDE,(void*)(base+64));
+    glVertexAttribPointer(9,1,GL_FLOAT,GL_FALSE,INST_STRIDE,(void*)(base+80));
+    for(int c=0;c<3;c++)
+        glVertexAttribPointer(10+c,3,GL_FLOAT,GL_FALSE,INST_STRIDE,(void*)(base+84+(size_t)c*12));
+}
+
+/* order[i] から同じパス・同じメッシュ・同じ LOD・同じアルベドのバインドが続く区間の終端 (排他, n まで)。
+ * by_cascade ならカスケードのビットが同じものだけを続ける (シャドウパス用) */
+static int next_run(ENG_3D* ctx,const DrawSort3D* order,int i,int n,bool by_cascade){
+    const DrawCmd3D* d=&ctx->draws[order[i].idx];
+    uint64_t pass=KEY_PASS(order[i].key);
+    uint32_t tex=tex_bind_key(ctx,draw_albedo(ctx,d));
+    int j=i+1;
+    while(j<n){
+        const DrawCmd3D* e=&ctx->draws[order[j].idx];
+        if(e->mesh!=d->mesh||e->lod!=d->lod||KEY_PASS(order[j].key)!=pass) break;
+        if(by_cascade&&e->cascades!=d->cascades) break;
+        if(e->tex!=d->tex&&tex_bind_key(ctx,draw_albedo(ctx,e))!=tex) break;
+        j++;
+    }
+    return j;
+}
+
+/* 区間 [i,j) を描く (VAO とマテリアルは設定済み) */
+static void draw_run(ENG_3D* ctx,const Mesh3D* m,const DrawSort3D* order,int i,int j){
+    int l=ctx->draws[order[i].idx].lod;
+    if(l>=m->n_lods) l=m->n_lods-1;
+    point_instances(ctx,i);
+    const void* first=(void*)(((size_t)m->first_index+m->lod[l].first)*sizeof(uint32_t));
+    if(m->in_arena)
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES,(GLsizei)m->lod[l].count,GL_UNSIGNED_INT,
+                                          first,j-i,(GLint)m->base_vertex);
+    else
+        glDrawElementsInstanced(GL_TRIANGLES,(GLsizei)m->lod[l].count,GL_UNSIGNED_INT,first,j-i);
+    stat_draw(ctx,m->lod[l].count/3,j-i);
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: GPU タイマー
+ *   パス区間を GL_TIME_ELAPSED で囲み、GPU_TIMER_FRAMES 前の
+ *   同じリング位置を再利用する直前に結果を読む。間に合っていなければ
+ *   その回は捨てる (前回値のまま) ので、CPU が GPU を待つことはない
+ * ══════════════════════════════════════════════════════*/
+static void gpu_timer_begin(ENG_3D* ctx,int pass){
+    GpuFrame3D* f=&ctx->gpu_frames[ctx->gpu_frame];
+    if(ctx->gpu_open||f->n>=GPU_TIMER_SLOTS) return;
+    f->pass[f->n]=(uint8_t)pass;
+    glBeginQuery(GL_TIME_ELAPSED,f->q[f->n]);
+    ctx->gpu_open=true;
+}
+static void gpu_timer_end(ENG_3D* ctx){
+    if(!ctx->gpu_open) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    ctx->gpu_frames[ctx->gpu_frame].n++;
+    ctx->gpu_open=false;
+}
+/* eng3d_begin から。リングを進め、再利用するフレームの結果を回収する */
+static void gpu_timer_frame(ENG_3D* ctx){
+    gpu_timer_end(ctx);
+    ctx->gpu_frame=(ctx->gpu_frame+1)%GPU_TIMER_FRAMES;
+    GpuFrame3D* f=&ctx->gpu_frames[ctx->gpu_frame];
+    if(f->n>0){
+        GLint ready=0;   /* 結果は発行順に揃うので最後の 1 個を見れば足りる */
+        glGetQueryObjectiv(f->q[f->n-1],GL_QUERY_RESULT_AVAILABLE,&ready);
+        if(ready){
+            double ns[GPU_PASS_COUNT]={0};
+            for(int i=0;i<f->n;i++){
+                GLuint64 t=0; glGetQueryObjectui64v(f->q[i],GL_QUERY_RESULT,&t);
+                ns[f->pass[i]]+=(double)t;
+            }
+            ENG_3D_GpuStats* s=&ctx->gpu_stats;
+            s->shadow_ms  =(float)(ns[GPU_PASS_SHADOW]*1e-6);
+            s->main_ms    =(float)(ns[GPU_PASS_MAIN]*1e-6);
+            s->particle_ms=(float)(ns[GPU_PASS_PARTICLE]*1e-6);
+            s->post_ms    =(float)(ns[GPU_PASS_POST]*1e-6);
+            s->total_ms   =s->shadow_ms+s->main_ms+s->particle_ms+s->post_ms;
+            s->latency    =GPU_TIMER_FRAMES;
+            s->valid      =true;
+        }
+    }
+    f->n=0;
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: 描画キューのフラッシュ
+ *   eng3d_end で 1 回だけ。フレーム全体のキャスターでシャドウマップを
+ *   描いてから、区切り (スカイボックス・パーティクル) ごとに
+ *   メインパスと区切りの描画を記録順に流す
+ * ══════════════════════════════════════════════════════*/
+static void bind_main_target(ENG_3D* ctx){
+    if(ctx->bloom_on) glBindFramebuffer(GL_FRAMEBUFFER,ctx->bloom_fbo);
+    else              glBindFramebuffer(GL_FRAMEBUFFER,ctx->target_fbo);
+    glViewport(0,0,ctx->w,ctx->h);
+}
+
+static void shadow_pass(ENG_3D* ctx,const DrawSort3D* order){
+    const Program3D* prog=&ctx->shader_shadow;   /* ライト行列は Frame UBO から */
+    glBindFramebuffer(GL_FRAMEBUFFER,ctx->shadow_fbo);
+    glViewport(0,0,SHADOW_MAP_W,SHADOW_MAP_H);
+    ST_PROG(ctx,prog->id);
+    glCullFace(GL_FRONT);
+    for(int cas=0;cas<ctx->shadow_cascades;cas++){
+        glFramebufferTextureLayer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,ctx->shadow_depth_tex,0,cas);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        U1I(ctx,prog,U_CASCADE,cas);
+        unsigned int vao=0;
+        for(int i=0,j;i<ctx->n_draws;i=j){
+            j=next_run(ctx,order,i,ctx->n_draws,true);
+            const DrawCmd3D* d=&ctx->draws[order[i].idx];
+            if(!(d->cascades&(1u<<cas))) continue;      /* このカスケードのライト視錐台の外 */
+            Mesh3D* m=mesh_get(ctx,d->mesh);
+            if(!m||!m->cast_shadow) continue;
+            if(m->vao!=vao){ST_VAO(ctx,m->vao);vao=m->vao;}
+            U3F(ctx,prog,U_POS_SCALE,m->pos_scale);
+            U3F(ctx,prog,U_POS_BIAS,m->pos_bias);
+            draw_run(ctx,m,order,i,j);
+        }
+    }
+    glBindVertexArray(0);
+    glCullFace(GL_BACK);
+    bind_main_target(ctx);
+}
+
+/* 並べ替え済みの [s,e) をメインパスで描く */
+static void main_pass(ENG_3D* ctx,const DrawSort3D* order,int s,int e){
+    if(s>=e) return;
+    gpu_timer_begin(ctx,GPU_PASS_MAIN);
+    const Program3D* prog=&ctx->shader_main;
+    ST_PROG(ctx,prog->id);
+    if(ctx->shadow_on){glActiveTexture(GL_TEXTURE2);ST_TEX(ctx,GL_TEXTURE_2D_ARRAY,ctx->shadow_depth_tex);}
+    PassState3D st={-1,0,0,0,0,0,UINT32_MAX,false,false};
+    for(int i=s,j;i<e;i=j){
+        if(KEY_PASS(order[i].key)==KEY_PASS_SHADOW) break;   /* 以降は影のみ */
+        j=next_run(ctx,order,i,e,false);
+        ENG_3D_MeshID id=ctx->draws[order[i].idx].mesh;
+        Mesh3D* m=mesh_get(ctx,id);
+        if(!m) continue;
+        if(id!=st.mesh){bind_mesh_material(ctx,prog,m,&st);st.mesh=id;}
+        bind_albedo(ctx,prog,draw_albedo(ctx,&ctx->draws[order[i].idx]),&st);
+        draw_run(ctx,m,order,i,j);
+    }
     glBindVertexArray(0);
-    if(m->wireframe) glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
-    if(m->transparent) glDepthMask(GL_TRUE);
+    if(st.wire)  glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+    if(st.blend) glDepthMask(GL_TRUE);
+    gpu_timer_end(ctx);
+}
+
+static void flush_draws(ENG_3D* ctx){
+    const DrawSort3D* order=NULL;
+    if(ctx->n_draws>0){
+        order=sort_draws(ctx);
+        if(order&&!upload_instances(ctx,order)) order=NULL;
+    }
+    if(order&&ctx->shadow_on){
+        gpu_timer_begin(ctx,GPU_PASS_SHADOW);
+        shadow_pass(ctx,order);
+        gpu_timer_end(ctx);
+    }
+    int s=0;
+    for(size_t k=0;k<ctx->n_ops;k++){
+        const FrameOp3D* op=&ctx->ops[k];
+        if(order) main_pass(ctx,order,s,op->end);
+        s=op->end;
+        if(op->type==FRAME_OP_SKYBOX) skybox_exec(ctx);
+        else particles_exec(ctx,op);
+    }
+    if(order) main_pass(ctx,order,s,ctx->n_draws);
+    ctx->n_draws=0; ctx->n_ops=0; ctx->n_fx=0;
+}
+
+/* ══════════════════════════════════════════════════════
+ * 内部: カスケードシャドウ
+ *   カメラ視錐台を near..shadow_dist で分割 (対数と一様の混合) し、
+ *   各スライスを包む球に正射影を合わせる。球なのでカメラが回っても
+ *   範囲が変わらず、ワールド原点をテクセル格子にスナップして
+ *   移動時のちらつきも抑える
+ * ══════════════════════════════════════════════════════*/
+static void update_cascades(ENG_3D* ctx,float aspect){
+    int   nc=ctx->shadow_cascades;
+    float n=ctx->near_z, far=fminf(ctx->shadow_dist,ctx->far_z);
+    vec3 f,r,u,wup={0,1,0};
+    v3_sub(f,ctx->cam_target,ctx->cam_pos); v3_norm(f);
+    v3_cross(r,f,wup);
+    if(v3_len(r)<1e-4f){vec3 alt={0,0,1};v3_cross(r,f,alt);}
+    v3_norm(r); v3_cross(u,r,f);
+    float th=tanf(DEG2RAD(ctx->fov)*0.5f);
+    vec3 L={ctx->dir_dir[0],ctx->dir_dir[1],ctx->dir_dir[2]}; v3_norm(L);
+    vec3 lup={0,1,0};
+    if(fabsf(L[1])>0.99f){lup[1]=0.f;lup[2]=1.f;}
+    float prev=n, half=(float)SHADOW_MAP_W*0.5f;
+    for(int c=0;c<nc;c++){
+        float p=(float)(c+1)/(float)nc;
+        float split=CASCADE_LAMBDA*n*powf(far/n,p)+(1.f-CASCADE_LAMBDA)*(n+(far-n)*p);
+        /* スライスの 8 頂点を包む球 */
+        vec3 corners[8], center={0,0,0};
+        for(int k=0;k<8;k++){
+            float d=(k&4)?split:prev, hh=d*th, hw=hh*aspect;
+            float sx=(k&1)?1.f:-1.f, sy=(k&2)?1.f:-1.f;
+            for(int a=0;a<3;a++) corners[k][a]=ctx->cam_pos[a]+f[a]*d+r[a]*hw*sx+u[a]*hh*sy;
+            v3_add(center,center,corners[k]);
+        }
+        v3_scale(center,center,1.f/8.f);
+        float rad=0.f;
+        for(int k=0;k<8;k++){vec3 dv;v3_sub(dv,corners[k],center);float l=v3_len(dv);if(l>rad)rad=l;}
+        rad=ceilf(rad*16.f)/16.f;
+        /* スライス外 (ライト側) のキャスターも収まるよう far 分だけ引く */
+        vec3 eye; for(int a=0;a<3;a++) eye[a]=center[a]-L[a]*(rad+far);
+        mat4 lp,lv,ls;
+        m4_ortho(lp,-rad,rad,-rad,rad,0.f,2.f*rad+far);
+        m4_lookat(lv,eye,center,lup);
+        m4_mul(ls,lp,lv);
+        float ox=ls[12]*half, oy=ls[13]*half;
+        lp[12]+=(roundf(ox)-ox)/half; lp[13]+=(roundf(oy)-oy)/half;
+        m4_mul(ctx->mat_light_space[c],lp,lv);
+        frustum_from_mat(ctx->light_frustum[c],ctx->mat_light_space[c]);
+        ctx->cascade_splits[c]=split;
+        prev=split;
+    }
+    for(int c=nc;c<ENG_3D_MAX_CASCADES;c++){m4_id(ctx->mat_light_space[c]);ctx->cascade_splits[c]=0.f;}
 }
 
 /* ══════════════════════════════════════════════════════
@@ -1462,130 +4821,199 @@ void eng3d_begin(ENG_3D* ctx,float r,float g,float b){
     vec3 up={0,1,0};
     m4_lookat(ctx->mat_view,ctx->cam_pos,ctx->cam_target,up);
     /* シャドウ行列だけ事前計算 */
-    if(ctx->shadow_on){
-        float os=ctx->shadow_ortho;
-        mat4 lp,lv;
-        vec3 ld={ctx->dir_dir[0],ctx->dir_dir[1],ctx->dir_dir[2]};
-        vec3 le={-ld[0]*os,-ld[1]*os,-ld[2]*os};
-        vec3 lt={0,0,0};
-        m4_ortho(lp,-os,os,-os,os,-os*2.f,os*2.f);
-        m4_lookat(lv,le,lt,up);
-        m4_mul(ctx->mat_light_space,lp,lv);
-    } else {
-        m4_id(ctx->mat_light_space);
-    }
-    if(ctx->bloom_on) glBindFramebuffer(GL_FRAMEBUFFER,ctx->bloom_fbo);
-    else              glBindFramebuffer(GL_FRAMEBUFFER,0);
-    glViewport(0,0,ctx->w,ctx->h);
+    if(ctx->shadow_on) update_cascades(ctx,aspect);
+    else for(int c=0;c<ENG_3D_MAX_CASCADES;c++){m4_id(ctx->mat_light_space[c]);ctx->cascade_splits[c]=0.f;}
+    mat4 vp; m4_mul(vp,ctx->mat_proj,ctx->mat_view);
+    frustum_from_mat(ctx->frustum,vp);
+    ctx->lod_proj=1.f/tanf(DEG2RAD(ctx->fov)*0.5f);
+    ctx->n_draws=0; ctx->n_ops=0; ctx->n_fx=0; ctx->n_culled=0;
+    memset(&ctx->stats,0,sizeof(ctx->stats));
+    if(ctx->n_tex_loads) tex_stream(ctx);
+    gpu_timer_frame(ctx);
+    bind_main_target(ctx);
     glClearColor(r,g,b,1.f);
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-    glUseProgram(ctx->shader_main);
-    set_lighting_uniforms(ctx,ctx->shader_main);
+    update_frame_ubo(ctx);
 }
 
-void eng3d_draw(ENG_3D* ctx,ENG_3D_MeshID mesh_id,
+/* 画面高さに対する境界球の直径 s から LOD を選ぶ。hist は物体ごとの前回の段
+ * (シーンノードの lod 列)。あれば前回の段に留まりやすいよう閾値を lod_hyst だけ
+ * ずらして書き戻す。NULL (eng3d_draw の匿名描画) はヒステリシス無し */
+static int select_lod(ENG_3D* ctx,const Mesh3D* m,const ENG_3D_AABB* wb,uint8_t* hist){
+    float d2=0.f, r2=0.f;
+    for(int k=0;k<3;k++){
+        float c=(wb->min[k]+wb->max[k])*0.5f, h=(wb->max[k]-wb->min[k])*0.5f, d=c-ctx->cam_pos[k];
+        d2+=d*d; r2+=h*h;
+    }
+    int lod=0;
+    if(d2>r2){
+        float s=sqrtf(r2/d2)*ctx->lod_proj;
+        int prev=hist&&*hist!=NODE_LOD_NONE?*hist:-1;
+        for(int k=1;k<m->n_lods;k++){
+            float t=ctx->lod_screen[k-1];
+            if(prev>=0) t*=prev>=k?1.f+ctx->lod_hyst:1.f-ctx->lod_hyst;
+            if(s>=t) break;
+            lod=k;
+        }
+    }
+    if(hist) *hist=(uint8_t)lod;
+    return lod;
+}
+
+/* lod_hist は LOD ヒステリシスの記憶 (ノード描画の lod 列。匿名描画は NULL) */
+static void draw_record_mat(ENG_3D* ctx,ENG_3D_MeshID mesh_id,Mesh3D* m,ENG_3D_TexID tex,const mat4 model,uint8_t* lod_hist){
+    ENG_3D_AABB wb;
+    bool caster=ctx->shadow_on&&m->cast_shadow;
+    if(ctx->cull_on||m->n_lods>1||caster) wb=aabb_mat_internal(m->bounds,model);
+    /* キャスターはどのカスケードのライト視錐台に入るかを記録し、シャドウパスは
+     * 入っている層にだけ描く */
+    uint8_t cascades=0;
+    if(caster)
+        for(int c=0;c<ctx->shadow_cascades;c++)
+            if(aabb_in_frustum(ctx->light_frustum[c],&wb)) cascades|=(uint8_t)(1u<<c);
+    /* 視錐台カリング。画面外でもライト視錐台内のキャスターは影のみ描く */
+    bool shadow_only=false;
+    if(ctx->cull_on&&!aabb_in_frustum(ctx->frustum,&wb)){
+        ctx->n_culled++;
+        if(!cascades) return;
+        shadow_only=true;
+    }
+    /* ここでは記録のみ。GL への発行は eng3d_end の flush_draws で行う */
+    if(ctx->n_draws>=ctx->cap_draws){
+        int cap=ctx->cap_draws?ctx->cap_draws*2:256;
+        DrawCmd3D* nd=(DrawCmd3D*)realloc(ctx->draws,(size_t)cap*sizeof(DrawCmd3D));
+        if(!nd)return;
+        ctx->draws=nd; ctx->cap_draws=cap;
+    }
+    DrawCmd3D* c=&ctx->draws[ctx->n_draws++];
+    c->mesh=mesh_id;
+    c->tex=tex;
+    c->cascades=cascades;
+    c->lod=m->n_lods>1?select_lod(ctx,m,&wb,lod_hist):0;
+    m4_copy(c->model,model);
+    c->key=draw_sort_key(ctx,mesh_id,m,tex?tex:m->tex_id,model,c->lod,shadow_only);
+}
+
+static void draw_record(ENG_3D* ctx,ENG_3D_MeshID mesh_id,ENG_3D_TexID tex,
     float px,float py,float pz,
     float rx,float ry,float rz,
     float sx,float sy,float sz)
 {
     if(!ctx)return;
+    Mesh3D* m=mesh_get(ctx,mesh_id);
+    if(!m)return;
     if(sx==0&&sy==0&&sz==0){sx=sy=sz=1.f;}
-    /* シャドウパス */
-    if(ctx->shadow_on&&mesh_id>=1&&mesh_id<=ENG_3D_MAX_MESHES
-       &&ctx->meshes[mesh_id-1].used&&ctx->meshes[mesh_id-1].cast_shadow)
-    {
-        mat4 model; m4_trs(model,px,py,pz,rx,ry,rz,sx,sy,sz);
-        glBindFramebuffer(GL_FRAMEBUFFER,ctx->shadow_fbo);
-        glViewport(0,0,SHADOW_MAP_W,SHADOW_MAP_H);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glUseProgram(ctx->shader_shadow);
-        glCullFace(GL_FRONT);
-        glUniformMatrix4fv(UL(ctx->shader_shadow,"uModel"),1,GL_FALSE,model);
-        glUniformMatrix4fv(UL(ctx->shader_shadow,"uLightSpace"),1,GL_FALSE,ctx->mat_light_space);
-        glBindVertexArray(ctx->meshes[mesh_id-1].vao);
-        glDrawElements(GL_TRIANGLES,(GLsizei)ctx->meshes[mesh_id-1].index_count,GL_UNSIGNED_INT,0);
-        glBindVertexArray(0);
-        glCullFace(GL_BACK);
-        if(ctx->bloom_on) glBindFramebuffer(GL_FRAMEBUFFER,ctx->bloom_fbo);
-        else              glBindFramebuffer(GL_FRAMEBUFFER,0);
-        glViewport(0,0,ctx->w,ctx->h);
-        glUseProgram(ctx->shader_main);
-    }
-    draw_mesh_internal(ctx,ctx->shader_main,mesh_id,px,py,pz,rx,ry,rz,sx,sy,sz);
+    mat4 model; m4_trs(model,px,py,pz,rx,ry,rz,sx,sy,sz);
+    draw_record_mat(ctx,mesh_id,m,tex,model,NULL);
+}
+
+void eng3d_draw(ENG_3D* ctx,ENG_3D_MeshID mesh_id,
+    float px,float py,float pz,
+    float rx,float ry,float rz,
+    float sx,float sy,float sz)
+{
+    draw_record(ctx,mesh_id,0,px,py,pz,rx,ry,rz,sx,sy,sz);
+}
+void eng3d_draw_tex(ENG_3D* ctx,ENG_3D_MeshID mesh_id,ENG_3D_TexID tex,
+    float px,float py,float pz,
+    float rx,float ry,float rz,
+    float sx,float sy,float sz)
+{
+    draw_record(ctx,mesh_id,tex,px,py,pz,rx,ry,rz,sx,sy,sz);
+}
+
+void eng3d_cull_enable(ENG_3D* ctx,bool on){ctx->cull_on=on;}
+void eng3d_lod_params(ENG_3D* ctx,float s1,float s2,float s3,float hysteresis){
+    ctx->lod_screen[0]=s1; ctx->lod_screen[1]=s2; ctx->lod_screen[2]=s3;
+    ctx->lod_hyst=CLAMP(hysteresis,0.f,0.9f);
 }
+int  eng3d_cull_count (ENG_3D* ctx){return ctx->n_culled;}
 
 void eng3d_end(ENG_3D* ctx){
+    flush_draws(ctx);
     if(ctx->bloom_on){
+        gpu_timer_begin(ctx,GPU_PASS_POST);
         /* 水平ブラー */
         glBindFramebuffer(GL_FRAMEBUFFER,ctx->bloom_fbo2);
         glClear(GL_COLOR_BUFFER_BIT);
-        glUseProgram(ctx->shader_blur);
-        glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,ctx->bloom_color_tex);
-        U1I(ctx->shader_blur,"uImage",0);
-        glUniform1i(UL(ctx->shader_blur,"uHorizontal"),1);
-        glBindVertexArray(ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); glBindVertexArray(0);
+        ST_PROG(ctx,ctx->shader_blur.id);
+        glActiveTexture(GL_TEXTURE0); ST_TEX(ctx,GL_TEXTURE_2D,ctx->bloom_color_tex);
+        U1I(ctx,&ctx->shader_blur,U_HORIZONTAL,1);
+        ST_VAO(ctx,ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); stat_draw(ctx,2,1); glBindVertexArray(0);
         /* 垂直ブラー */
         glBindFramebuffer(GL_FRAMEBUFFER,ctx->bloom_fbo);
         glClear(GL_COLOR_BUFFER_BIT);
-        glBindTexture(GL_TEXTURE_2D,ctx->bloom_color_tex2);
-        glUniform1i(UL(ctx->shader_blur,"uHorizontal"),0);
-        glBindVertexArray(ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); glBindVertexArray(0);
+        ST_TEX(ctx,GL_TEXTURE_2D,ctx->bloom_color_tex2);
+        U1I(ctx,&ctx->shader_blur,U_HORIZONTAL,0);
+        ST_VAO(ctx,ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); stat_draw(ctx,2,1); glBindVertexArray(0);
         /* 合成 */
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
+        glBindFramebuffer(GL_FRAMEBUFFER,ctx->target_fbo);
         glViewport(0,0,ctx->w,ctx->h);
         glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-        glUseProgram(ctx->shader_combine);
-        glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,ctx->bloom_color_tex);
-        glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D,ctx->bloom_color_tex2);
-        U1I(ctx->shader_combine,"uScene",0);
-        U1I(ctx->shader_combine,"uBloom",1);
-        U1F(ctx->shader_combine,"uThreshold",ctx->bloom_threshold);
-        U1F(ctx->shader_combine,"uIntensity",ctx->bloom_intensity);
-        glBindVertexArray(ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); glBindVertexArray(0);
+        ST_PROG(ctx,ctx->shader_combine.id);
+        glActiveTexture(GL_TEXTURE0); ST_TEX(ctx,GL_TEXTURE_2D,ctx->bloom_color_tex);
+        glActiveTexture(GL_TEXTURE1); ST_TEX(ctx,GL_TEXTURE_2D,ctx->bloom_color_tex2);
+        U1F(ctx,&ctx->shader_combine,U_THRESHOLD,ctx->bloom_threshold);
+        U1F(ctx,&ctx->shader_combine,U_INTENSITY,ctx->bloom_intensity);
+        ST_VAO(ctx,ctx->quad_vao); glDrawArrays(GL_TRIANGLES,0,6); stat_draw(ctx,2,1); glBindVertexArray(0);
+        gpu_timer_end(ctx);
     }
-    SDL_GL_SwapWindow(ctx->window);
+    ctx->stats.culled=ctx->n_culled;
+    ctx->stats_last=ctx->stats;
+    if(!ctx->headless) SDL_GL_SwapWindow(ctx->window);
+}
+
+bool eng3d_frame_stats(ENG_3D* ctx,ENG_3D_FrameStats* out){
+    if(!ctx||!out) return false;
+    *out=ctx->stats_last;
+    return true;
+}
+
+bool eng3d_gpu_stats(ENG_3D* ctx,ENG_3D_GpuStats* out){
+    if(!ctx||!out) return false;
+    *out=ctx->gpu_stats;
+    return out->valid;
 }
 
 /* ══════════════════════════════════════════════════════
  * パーティクルシステム
  * ══════════════════════════════════════════════════════*/
 ENG_3D_EmitterID eng3d_emitter_create(ENG_3D* ctx,int max_p){
-    for(int i=0;i<ENG_3D_MAX_EMITTERS;i++) if(!ctx->emitters[i].used){
-        Emitter3D* e=&ctx->emitters[i]; memset(e,0,sizeof(*e));
-        if(max_p<1)max_p=100;
-        e->max_parts=(max_p>MAX_PARTICLES)?MAX_PARTICLES:max_p;
-        e->rate=10.f; e->life_min=1.f; e->life_max=2.f;
-        e->vel[1]=1.f; e->spread=0.5f;
-        e->size_s=0.1f;
-        e->color_s[0]=e->color_s[1]=e->color_s[2]=e->color_s[3]=1.f;
-        e->active=true; e->used=true;
-        emitter_init_vbo(e);
-        return i+1;
-    }
-    return 0;
+    ENG_3D_EmitterID id=handle_alloc(&ctx->emitters);
+    Emitter3D* e=emitter_get(ctx,id);
+    if(!e) return 0;
+    if(max_p<1)max_p=100;
+    e->max_parts=(max_p>MAX_PARTICLES)?MAX_PARTICLES:max_p;
+    e->rate=10.f; e->life_min=1.f; e->life_max=2.f;
+    e->vel[1]=1.f; e->spread=0.5f;
+    e->size_s=0.1f;
+    e->color_s[0]=e->color_s[1]=e->color_s[2]=e->color_s[3]=1.f;
+    e->active=true;
+    emitter_init_vbo(e);
+    return id;
 }
 void eng3d_emitter_destroy(ENG_3D* ctx,ENG_3D_EmitterID id){
-    if(id<1||id>ENG_3D_MAX_EMITTERS||!ctx->emitters[id-1].used)return;
-    Emitter3D* e=&ctx->emitters[id-1];
+    Emitter3D* e=emitter_get(ctx,id);
+    if(!e)return;
     glDeleteVertexArrays(1,&e->vao); glDeleteBuffers(1,&e->vbo);
-    memset(e,0,sizeof(*e));
-}
-void eng3d_emitter_pos    (ENG_3D* c,ENG_3D_EmitterID id,float x,float y,float z){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].pos[0]=x;c->emitters[id-1].pos[1]=y;c->emitters[id-1].pos[2]=z;}
-void eng3d_emitter_rate   (ENG_3D* c,ENG_3D_EmitterID id,float r){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].rate=r;}
-void eng3d_emitter_life   (ENG_3D* c,ENG_3D_EmitterID id,float mn,float mx){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].life_min=mn;c->emitters[id-1].life_max=mx;}
-void eng3d_emitter_velocity(ENG_3D* c,ENG_3D_EmitterID id,float vx,float vy,float vz,float sp){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;Emitter3D*e=&c->emitters[id-1];e->vel[0]=vx;e->vel[1]=vy;e->vel[2]=vz;e->spread=sp;}
-void eng3d_emitter_gravity (ENG_3D* c,ENG_3D_EmitterID id,float gx,float gy,float gz){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;Emitter3D*e=&c->emitters[id-1];e->grav[0]=gx;e->grav[1]=gy;e->grav[2]=gz;}
-void eng3d_emitter_color  (ENG_3D* c,ENG_3D_EmitterID id,float r,float g,float b,float a){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;float*cs=c->emitters[id-1].color_s;cs[0]=r;cs[1]=g;cs[2]=b;cs[3]=a;}
-void eng3d_emitter_color_end(ENG_3D* c,ENG_3D_EmitterID id,float r,float g,float b,float a){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;float*ce=c->emitters[id-1].color_e;ce[0]=r;ce[1]=g;ce[2]=b;ce[3]=a;}
-void eng3d_emitter_size   (ENG_3D* c,ENG_3D_EmitterID id,float s,float e){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].size_s=s;c->emitters[id-1].size_e=e;}
-void eng3d_emitter_texture(ENG_3D* c,ENG_3D_EmitterID id,ENG_3D_TexID t){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].tex_id=t;}
-void eng3d_emitter_active (ENG_3D* c,ENG_3D_EmitterID id,bool on){if(id<1||id>ENG_3D_MAX_EMITTERS||!c->emitters[id-1].used)return;c->emitters[id-1].active=on;}
+    handle_free(&ctx->emitters,id);
+}
+void eng3d_emitter_pos    (ENG_3D* c,ENG_3D_EmitterID id,float x,float y,float z){Emitter3D*e=emitter_get(c,id);if(!e)return;e->pos[0]=x;e->pos[1]=y;e->pos[2]=z;}
+void eng3d_emitter_rate   (ENG_3D* c,ENG_3D_EmitterID id,float r){Emitter3D*e=emitter_get(c,id);if(!e)return;e->rate=r;}
+void eng3d_emitter_life   (ENG_3D* c,ENG_3D_EmitterID id,float mn,float mx){Emitter3D*e=emitter_get(c,id);if(!e)return;e->life_min=mn;e->life_max=mx;}
+void eng3d_emitter_velocity(ENG_3D* c,ENG_3D_EmitterID id,float vx,float vy,float vz,float sp){Emitter3D*e=emitter_get(c,id);if(!e)return;e->vel[0]=vx;e->vel[1]=vy;e->vel[2]=vz;e->spread=sp;}
+void eng3d_emitter_gravity (ENG_3D* c,ENG_3D_EmitterID id,float gx,float gy,float gz){Emitter3D*e=emitter_get(c,id);if(!e)return;e->grav[0]=gx;e->grav[1]=gy;e->grav[2]=gz;}
+void eng3d_emitter_color  (ENG_3D* c,ENG_3D_EmitterID id,float r,float g,float b,float a){Emitter3D*e=emitter_get(c,id);if(!e)return;float*cs=e->color_s;cs[0]=r;cs[1]=g;cs[2]=b;cs[3]=a;}
+void eng3d_emitter_color_end(ENG_3D* c,ENG_3D_EmitterID id,float r,float g,float b,float a){Emitter3D*e=emitter_get(c,id);if(!e)return;float*ce=e->color_e;ce[0]=r;ce[1]=g;ce[2]=b;ce[3]=a;}
+void eng3d_emitter_size   (ENG_3D* c,ENG_3D_EmitterID id,float s,float e){Emitter3D*em=emitter_get(c,id);if(!em)return;em->size_s=s;em->size_e=e;}
+void eng3d_emitter_texture(ENG_3D* c,ENG_3D_EmitterID id,ENG_3D_TexID t){Emitter3D*e=emitter_get(c,id);if(!e)return;e->tex_id=t;}
+void eng3d_emitter_active (ENG_3D* c,ENG_3D_EmitterID id,bool on){Emitter3D*e=emitter_get(c,id);if(!e)return;e->active=on;}
 
 static float randf(void){ return (float)rand()/(float)RAND_MAX; }
 
 void eng3d_emitter_burst(ENG_3D* ctx,ENG_3D_EmitterID id,int count){
-    if(id<1||id>ENG_3D_MAX_EMITTERS||!ctx->emitters[id-1].used)return;
-    Emitter3D* e=&ctx->emitters[id-1];
+    Emitter3D* e=emitter_get(ctx,id);
+    if(!e)return;
     for(int i=0;i<count;i++){
         for(int j=0;j<e->max_parts;j++){
             if(!e->parts[j].alive){
@@ -1605,14 +5033,16 @@ void eng3d_emitter_burst(ENG_3D* ctx,ENG_3D_EmitterID id,int count){
 }
 
 void eng3d_emitter_update_draw(ENG_3D* ctx,ENG_3D_EmitterID id){
-    if(id<1||id>ENG_3D_MAX_EMITTERS||!ctx->emitters[id-1].used)return;
-    Emitter3D* e=&ctx->emitters[id-1];
+    Emitter3D* e=emitter_get(ctx,id);
+    if(!e)return;
     float dt=ctx->delta;
     if(e->active){
         e->accum+=e->rate*dt;
         while(e->accum>=1.f){eng3d_emitter_burst(ctx,id,1);e->accum-=1.f;}
     }
-    float* inst=(float*)malloc((size_t)e->max_parts*8*sizeof(float));
+    /* 頂点はフレームの共有バッファへ。転送と描画は eng3d_end (不透明メッシュの後) */
+    float* inst=grow_buf((void**)&ctx->fx_data,&ctx->cap_fx,ctx->n_fx+(size_t)e->max_parts*8,sizeof(float))
+               ?ctx->fx_data+ctx->n_fx:NULL;
     int alive=0;
     for(int i=0;i<e->max_parts;i++){
         Particle* p=&e->parts[i]; if(!p->alive)continue;
@@ -1623,81 +5053,267 @@ void eng3d_emitter_update_draw(ENG_3D* ctx,ENG_3D_EmitterID id){
         for(int k=0;k<3;k++) p->pos[k]+=p->vel[k]*dt;
         for(int k=0;k<4;k++) p->color[k]=e->color_s[k]+(e->color_e[k]-e->color_s[k])*t;
         p->size=e->size_s+(e->size_e-e->size_s)*t;
-        inst[alive*8+0]=p->pos[0]; inst[alive*8+1]=p->pos[1]; inst[alive*8+2]=p->pos[2];
-        inst[alive*8+3]=p->color[0]; inst[alive*8+4]=p->color[1];
-        inst[alive*8+5]=p->color[2]; inst[alive*8+6]=p->color[3];
-        inst[alive*8+7]=p->size;
+        if(inst){
+            inst[alive*8+0]=p->pos[0]; inst[alive*8+1]=p->pos[1]; inst[alive*8+2]=p->pos[2];
+            inst[alive*8+3]=p->color[0]; inst[alive*8+4]=p->color[1];
+            inst[alive*8+5]=p->color[2]; inst[alive*8+6]=p->color[3];
+            inst[alive*8+7]=p->size;
+        }
         alive++;
     }
-    if(alive>0){
-        glUseProgram(ctx->shader_particle);
-        UM4(ctx->shader_particle,"uView",ctx->mat_view);
-        UM4(ctx->shader_particle,"uProj",ctx->mat_proj);
-        int hasTex=0;
-        if(e->tex_id>=1&&e->tex_id<=ENG_3D_MAX_TEXTURES&&ctx->tex_used[e->tex_id-1]){
-            glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D,ctx->textures[e->tex_id-1]);
-            U1I(ctx->shader_particle,"uTex",0); hasTex=1;
-        }
-        U1I(ctx->shader_particle,"uHasTex",hasTex);
-        glBindVertexArray(e->vao);
-        glBindBuffer(GL_ARRAY_BUFFER,e->vbo);
-        glBufferSubData(GL_ARRAY_BUFFER,0,(GLsizeiptr)(alive*8*sizeof(float)),inst);
-        glDisable(GL_CULL_FACE);
-        glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA,GL_ONE);
-        glDepthMask(GL_FALSE);
-        glDrawArraysInstanced(GL_TRIANGLE_FAN,0,4,alive);
-        glDepthMask(GL_TRUE);
-        glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_CULL_FACE);
-        glBindVertexArray(0);
+    ctx->stats.particles+=alive;
+    FrameOp3D* op=alive>0&&inst?frame_op(ctx,FRAME_OP_PARTICLES):NULL;
+    if(!op) return;
+    op->emitter=id; op->first=ctx->n_fx; op->count=alive;
+    ctx->n_fx+=(size_t)alive*8;
+}
+
+static void particles_exec(ENG_3D* ctx,const FrameOp3D* op){
+    Emitter3D* e=emitter_get(ctx,op->emitter);
+    if(!e) return;                                  /* eng3d_end までに破棄された */
+    gpu_timer_begin(ctx,GPU_PASS_PARTICLE);
+    ST_PROG(ctx,ctx->shader_particle.id);   /* ビュー/射影は Frame UBO から */
+    int hasTex=0;
+    const Tex3D* t=tex_get(ctx,e->tex_id);
+    if(t&&!t->pool){                                    /* プールのものはメッシュ専用 */
+        glActiveTexture(GL_TEXTURE0); ST_TEX(ctx,GL_TEXTURE_2D,t->gl);
+        hasTex=1;
     }
-    free(inst);
+    U1I(ctx,&ctx->shader_particle,U_HAS_TEX,hasTex);
+    ST_VAO(ctx,e->vao);
+    glBindBuffer(GL_ARRAY_BUFFER,e->vbo);
+    ST_SUBDATA(ctx,GL_ARRAY_BUFFER,0,(GLsizeiptr)((size_t)op->count*8*sizeof(float)),ctx->fx_data+op->first);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA,GL_ONE);
+    glDepthMask(GL_FALSE);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN,0,4,op->count);
+    stat_draw(ctx,2,op->count);
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_CULL_FACE);
+    glBindVertexArray(0);
+    gpu_timer_end(ctx);
 }
 
 /* ══════════════════════════════════════════════════════
  * シーングラフ
  * ══════════════════════════════════════════════════════*/
-ENG_3D_NodeID eng3d_node_create(ENG_3D* ctx){
-    for(int i=0;i<ENG_3D_MAX_NODES;i++) if(!ctx->nodes[i].used){
-        SceneNode* n=&ctx->nodes[i]; memset(n,0,sizeof(*n));
-        n->lscale[0]=n->lscale[1]=n->lscale[2]=1.f;
-        n->parent=-1; n->active=true; n->used=true; return i+1;
+static void scene_cols(SceneGraph3D* g,void** col[SCENE_COLS],size_t sz[SCENE_COLS]){
+    col[0]=(void**)&g->id;    sz[0]=sizeof(*g->id);
+    col[1]=(void**)&g->parent;sz[1]=sizeof(*g->parent);
+    col[2]=(void**)&g->pidx;  sz[2]=sizeof(*g->pidx);
+    col[3]=(void**)&g->mesh;  sz[3]=sizeof(*g->mesh);
+    col[4]=(void**)&g->flags; sz[4]=sizeof(*g->flags);
+    col[5]=(void**)&g->trs;   sz[5]=sizeof(*g->trs);
+    col[6]=(void**)&g->local; sz[6]=sizeof(*g->local);
+    col[7]=(void**)&g->world; sz[7]=sizeof(*g->world);
+    col[8]=(void**)&g->lod;   sz[8]=sizeof(*g->lod);
+}
+
+static bool scene_reserve(SceneGraph3D* g,int need){
+    if(need<=g->cap) return true;
+    int cap=g->cap?g->cap*2:64;
+    void** col[SCENE_COLS]; size_t sz[SCENE_COLS];
+    scene_cols(g,col,sz);
+    for(int c=0;c<SCENE_COLS;c++){
+        void* q=realloc(*col[c],(size_t)cap*sz[c]);
+        if(!q) return false;
+        *col[c]=q;
     }
-    return 0;
+    int* t=(int*)realloc(g->sort_tmp,((size_t)cap*3+1)*sizeof(int));
+    if(!t) return false;
+    g->sort_tmp=t;
+    uint8_t* sc=(uint8_t*)realloc(g->scratch,(size_t)cap*sizeof(mat4));
+    if(!sc) return false;
+    g->scratch=sc;
+    g->cap=cap;
+    return true;
 }
-void eng3d_node_destroy(ENG_3D* ctx,ENG_3D_NodeID id){if(id<1||id>ENG_3D_MAX_NODES)return;memset(&ctx->nodes[id-1],0,sizeof(SceneNode));}
-void eng3d_node_parent(ENG_3D* ctx,ENG_3D_NodeID child,ENG_3D_NodeID parent){if(child<1||child>ENG_3D_MAX_NODES)return;ctx->nodes[child-1].parent=(parent>=1&&parent<=ENG_3D_MAX_NODES)?(int)(parent-1):-1;}
-void eng3d_node_mesh  (ENG_3D* ctx,ENG_3D_NodeID id,ENG_3D_MeshID mesh){if(id<1||id>ENG_3D_MAX_NODES)return;ctx->nodes[id-1].mesh=mesh;}
-void eng3d_node_pos   (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){if(id<1||id>ENG_3D_MAX_NODES)return;SceneNode*n=&ctx->nodes[id-1];n->lpos[0]=x;n->lpos[1]=y;n->lpos[2]=z;}
-void eng3d_node_rot   (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){if(id<1||id>ENG_3D_MAX_NODES)return;SceneNode*n=&ctx->nodes[id-1];n->lrot[0]=x;n->lrot[1]=y;n->lrot[2]=z;}
-void eng3d_node_scale (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){if(id<1||id>ENG_3D_MAX_NODES)return;SceneNode*n=&ctx->nodes[id-1];n->lscale[0]=x;n->lscale[1]=y;n->lscale[2]=z;}
-void eng3d_node_active(ENG_3D* ctx,ENG_3D_NodeID id,bool on){if(id<1||id>ENG_3D_MAX_NODES)return;ctx->nodes[id-1].active=on;}
-
-static void node_world_mat(ENG_3D* ctx,int idx,mat4 out){
-    SceneNode* n=&ctx->nodes[idx];
-    mat4 local;
-    m4_trs(local,n->lpos[0],n->lpos[1],n->lpos[2],
-                 n->lrot[0],n->lrot[1],n->lrot[2],
-                 n->lscale[0],n->lscale[1],n->lscale[2]);
-    if(n->parent>=0){
-        mat4 pmat; node_world_mat(ctx,n->parent,pmat);
-        m4_mul(out,pmat,local);
-    } else {
-        m4_copy(out,local);
+
+static void scene_free(SceneGraph3D* g){
+    void** col[SCENE_COLS]; size_t sz[SCENE_COLS];
+    scene_cols(g,col,sz);
+    for(int c=0;c<SCENE_COLS;c++) free(*col[c]);
+    free(g->sort_tmp); free(g->scratch);
+    free(g->bvh.nodes); free(g->bvh.prim); free(g->bvh.pbox); free(g->bvh.cent);
+    free(g->bvh.up); free(g->bvh.slot); free(g->bvh.leaf); free(g->bvh.dirty);
+    memset(g,0,sizeof(*g));
+}
+
+/* 親が子より前に来るよう深さで安定に並べ直し、pidx を引き直す。
+ * 破棄済みの親を指すノードはここで根になる */
+static void scene_sort(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    int n=g->n;
+    int* depth=g->sort_tmp; int* perm=depth+g->cap; int* cnt=perm+g->cap;
+    for(int i=0;i<n;i++){
+        const SceneNode* p=node_get(ctx,g->parent[i]);
+        if(!p&&g->parent[i]){ g->parent[i]=0; g->flags[i]|=NODE_WORLD_DIRTY; g->dirty=true; }
+        g->pidx[i]=p?p->idx:-1;
+        depth[i]=-1;
+    }
+    int max_d=0;
+    for(int i=0;i<n;i++){
+        if(depth[i]>=0) continue;
+        int d=0,j=i;
+        while(j>=0&&depth[j]<0){ j=g->pidx[j]; d++; }
+        int base=j>=0?depth[j]+1:0;
+        for(j=i;j>=0&&depth[j]<0;j=g->pidx[j]) depth[j]=base+--d;
+        if(depth[i]>max_d) max_d=depth[i];
+    }
+    memset(cnt,0,(size_t)(max_d+1)*sizeof(int));
+    for(int i=0;i<n;i++) cnt[depth[i]]++;
+    for(int d=0,sum=0;d<=max_d;d++){ int c=cnt[d]; cnt[d]=sum; sum+=c; }
+    for(int i=0;i<n;i++) perm[cnt[depth[i]]++]=i;
+    int* inv=depth;                                  /* 深さはもう使わない */
+    for(int k=0;k<n;k++) inv[perm[k]]=k;
+    void** col[SCENE_COLS]; size_t sz[SCENE_COLS];
+    scene_cols(g,col,sz);
+    for(int c=0;c<SCENE_COLS;c++){
+        uint8_t* a=(uint8_t*)*col[c];
+        for(int k=0;k<n;k++) memcpy(g->scratch+(size_t)k*sz[c],a+(size_t)perm[k]*sz[c],sz[c]);
+        memcpy(a,g->scratch,(size_t)n*sz[c]);
+    }
+    for(int k=0;k<n;k++){
+        if(g->pidx[k]>=0) g->pidx[k]=inv[g->pidx[k]];
+        node_get(ctx,g->id[k])->idx=k;
+    }
+    g->order_dirty=false;
+    g->bvh_rebuild=true;
+}
+
+/* 行 i の箱が変わった印。作り直し待ちなら要らない (詰め直せなければ作り直す) */
+static void bvh_mark(SceneGraph3D* g,int i){
+    SceneBVH3D* b=&g->bvh;
+    if(g->bvh_rebuild||(g->flags[i]&NODE_BVH_DIRTY)) return;
+    if(!grow_buf((void**)&b->dirty,&b->cap_dirty,(size_t)b->n_dirty+1,sizeof(int))){ g->bvh_rebuild=true; return; }
+    g->flags[i]|=NODE_BVH_DIRTY;
+    b->dirty[b->n_dirty++]=i;
+}
+
+/* 並び順に 1 回なめ、DIRTY なノードとワールド行列が変わった親の子だけを計算し直す */
+static void scene_update(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    if(g->order_dirty) scene_sort(ctx);
+    if(!g->dirty) return;
+    for(int i=0;i<g->n;i++){
+        uint8_t f=g->flags[i];
+        int p=g->pidx[i];
+        bool pm=p>=0&&(g->flags[p]&NODE_MOVED);
+        if(!(f&(NODE_LOCAL_DIRTY|NODE_WORLD_DIRTY))&&!pm){ g->flags[i]=f&~NODE_MOVED; continue; }
+        if(f&NODE_LOCAL_DIRTY){
+            const float* t=g->trs[i];
+            m4_trs(g->local[i],t[0],t[1],t[2],t[3],t[4],t[5],t[6],t[7],t[8]);
+        }
+        if(p>=0) m4_mul(g->world[i],g->world[p],g->local[i]);
+        else     m4_copy(g->world[i],g->local[i]);
+        g->flags[i]=(uint8_t)((f&~(NODE_LOCAL_DIRTY|NODE_WORLD_DIRTY))|NODE_MOVED);
+        bvh_mark(g,i);
+    }
+    g->dirty=false;
+}
+
+/* 並び位置 (無効 ID は -1) */
+static int node_index(ENG_3D* ctx,ENG_3D_NodeID id){
+    const SceneNode* n=node_get(ctx,id);
+    return n?n->idx:-1;
+}
+
+ENG_3D_NodeID eng3d_node_create(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    if(!scene_reserve(g,g->n+1)) return 0;
+    ENG_3D_NodeID id=handle_alloc(&ctx->nodes);
+    SceneNode* n=node_get(ctx,id);
+    if(!n) return 0;
+    int i=n->idx=g->n++;
+    g->id[i]=id; g->parent[i]=0; g->pidx[i]=-1; g->mesh[i]=0; g->lod[i]=NODE_LOD_NONE;
+    g->flags[i]=NODE_ACTIVE|NODE_LOCAL_DIRTY;
+    float* t=g->trs[i]; memset(t,0,6*sizeof(float)); t[6]=t[7]=t[8]=1.f;
+    g->dirty=true; g->bvh_rebuild=true;
+    return id;
+}
+/* 末尾を空いた位置へ詰める。子の付け替えと順序は次の更新で直す */
+void eng3d_node_destroy(ENG_3D* ctx,ENG_3D_NodeID id){
+    SceneGraph3D* g=&ctx->scene;
+    int i=node_index(ctx,id);
+    if(i<0) return;
+    handle_free(&ctx->nodes,id);
+    int last=--g->n;
+    if(i!=last){
+        void** col[SCENE_COLS]; size_t sz[SCENE_COLS];
+        scene_cols(g,col,sz);
+        for(int c=0;c<SCENE_COLS;c++){
+            uint8_t* a=(uint8_t*)*col[c];
+            memcpy(a+(size_t)i*sz[c],a+(size_t)last*sz[c],sz[c]);
+        }
+        node_get(ctx,g->id[i])->idx=i;
     }
+    g->order_dirty=true;
+}
+void eng3d_node_parent(ENG_3D* ctx,ENG_3D_NodeID child,ENG_3D_NodeID parent){
+    SceneGraph3D* g=&ctx->scene;
+    int c=node_index(ctx,child);
+    if(c<0) return;
+    int p=node_index(ctx,parent);
+    for(int a=p;a>=0;a=node_index(ctx,g->parent[a])) if(a==c) return;   /* 循環は作らない */
+    g->parent[c]=p>=0?parent:0;
+    g->flags[c]|=NODE_WORLD_DIRTY; g->dirty=true; g->vis_dirty=true;
+    if(p<c&&!g->order_dirty) g->pidx[c]=p;           /* 既に親が前にあれば並べ直さない */
+    else g->order_dirty=true;
+}
+void eng3d_node_mesh  (ENG_3D* ctx,ENG_3D_NodeID id,ENG_3D_MeshID mesh){int i=node_index(ctx,id);if(i<0)return;ctx->scene.mesh[i]=mesh;ctx->scene.lod[i]=NODE_LOD_NONE;bvh_mark(&ctx->scene,i);}
+static void node_set_trs(ENG_3D* ctx,ENG_3D_NodeID id,int k,float x,float y,float z){
+    SceneGraph3D* g=&ctx->scene;
+    int i=node_index(ctx,id);
+    if(i<0) return;
+    float* t=g->trs[i]+k;
+    t[0]=x; t[1]=y; t[2]=z;
+    g->flags[i]|=NODE_LOCAL_DIRTY; g->dirty=true;
+}
+void eng3d_node_pos   (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){node_set_trs(ctx,id,0,x,y,z);}
+void eng3d_node_rot   (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){node_set_trs(ctx,id,3,x,y,z);}
+void eng3d_node_scale (ENG_3D* ctx,ENG_3D_NodeID id,float x,float y,float z){node_set_trs(ctx,id,6,x,y,z);}
+void eng3d_node_active(ENG_3D* ctx,ENG_3D_NodeID id,bool on){
+    int i=node_index(ctx,id);
+    if(i<0) return;
+    uint8_t* f=&ctx->scene.flags[i];
+    *f=(uint8_t)(on?*f|NODE_ACTIVE:*f&~NODE_ACTIVE);
+    ctx->scene.vis_dirty=true;
+}
+
+/* 自身と祖先が全て有効か。親→子の順に呼ぶこと */
+static bool scene_visible(SceneGraph3D* g,int i){
+    uint8_t f=g->flags[i];
+    int p=g->pidx[i];
+    bool vis=(f&NODE_ACTIVE)&&(p<0||(g->flags[p]&NODE_VISIBLE));
+    g->flags[i]=(uint8_t)(vis?f|NODE_VISIBLE:f&~NODE_VISIBLE);
+    return vis;
 }
 
 void eng3d_node_draw(ENG_3D* ctx,ENG_3D_NodeID id){
-    if(id<1||id>ENG_3D_MAX_NODES||!ctx->nodes[id-1].used||!ctx->nodes[id-1].active)return;
-    mat4 wm; node_world_mat(ctx,id-1,wm);
-    SceneNode* n=&ctx->nodes[id-1];
-    eng3d_draw(ctx,n->mesh,wm[12],wm[13],wm[14],
-               n->lrot[0],n->lrot[1],n->lrot[2],
-               n->lscale[0],n->lscale[1],n->lscale[2]);
+    SceneGraph3D* g=&ctx->scene;
+    if(node_index(ctx,id)<0) return;
+    scene_update(ctx);
+    int i=node_index(ctx,id);                        /* 並べ直しで動きうる */
+    Mesh3D* m=mesh_get(ctx,g->mesh[i]);
+    if(!(g->flags[i]&NODE_ACTIVE)||!m) return;
+    draw_record_mat(ctx,g->mesh[i],m,0,g->world[i],&g->lod[i]);
+}
+
+/* 親→子の並びを 1 回なめて全ノードを記録する。無効なノードの子孫も描かない。
+ * カリング・LOD・バッチは eng3d_draw と同じ経路 */
+void eng3d_scene_draw_all(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    scene_update(ctx);
+    for(int i=0;i<g->n;i++){
+        Mesh3D* m=scene_visible(g,i)?mesh_get(ctx,g->mesh[i]):NULL;
+        if(m) draw_record_mat(ctx,g->mesh[i],m,0,g->world[i],&g->lod[i]);
+    }
 }
 void eng3d_node_world_pos(ENG_3D* ctx,ENG_3D_NodeID id,float* x,float* y,float* z){
-    if(id<1||id>ENG_3D_MAX_NODES){if(x)*x=0;if(y)*y=0;if(z)*z=0;return;}
-    mat4 wm; node_world_mat(ctx,id-1,wm);
+    if(node_index(ctx,id)<0){if(x)*x=0;if(y)*y=0;if(z)*z=0;return;}
+    scene_update(ctx);
+    const float* wm=ctx->scene.world[node_index(ctx,id)];
     if(x)*x=wm[12]; if(y)*y=wm[13]; if(z)*z=wm[14];
 }
 
@@ -1705,27 +5321,26 @@ void eng3d_node_world_pos(ENG_3D* ctx,ENG_3D_NodeID id,float* x,float* y,float*
  * キーフレームアニメーション
  * ══════════════════════════════════════════════════════*/
 ENG_3D_AnimID eng3d_anim_create(ENG_3D* ctx){
-    for(int i=0;i<ENG_3D_MAX_ANIMS;i++) if(!ctx->anims[i].used){
-        Anim3D* a=&ctx->anims[i]; memset(a,0,sizeof(*a));
-        a->cur_scale[0]=a->cur_scale[1]=a->cur_scale[2]=1.f;
-        a->used=true; return i+1;
-    }
-    return 0;
+    ENG_3D_AnimID id=handle_alloc(&ctx->anims);
+    Anim3D* a=anim_get(ctx,id);
+    if(!a) return 0;
+    a->cur_scale[0]=a->cur_scale[1]=a->cur_scale[2]=1.f;
+    return id;
 }
-void eng3d_anim_destroy(ENG_3D* ctx,ENG_3D_AnimID id){if(id<1||id>ENG_3D_MAX_ANIMS)return;memset(&ctx->anims[id-1],0,sizeof(Anim3D));}
+void eng3d_anim_destroy(ENG_3D* ctx,ENG_3D_AnimID id){handle_free(&ctx->anims,id);}
 
 static void anim_add_key(AnimKey* keys,int* n,float t,float x,float y,float z){
     if(*n>=MAX_ANIM_KEYS)return;
     keys[*n].t=t;keys[*n].v[0]=x;keys[*n].v[1]=y;keys[*n].v[2]=z;(*n)++;
 }
-void eng3d_anim_key_pos  (ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;Anim3D*a=&ctx->anims[id-1];anim_add_key(a->pos_keys,&a->n_pos,t,x,y,z);if(t>a->duration)a->duration=t;}
-void eng3d_anim_key_rot  (ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;Anim3D*a=&ctx->anims[id-1];anim_add_key(a->rot_keys,&a->n_rot,t,x,y,z);if(t>a->duration)a->duration=t;}
-void eng3d_anim_key_scale(ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;Anim3D*a=&ctx->anims[id-1];anim_add_key(a->scale_keys,&a->n_scale,t,x,y,z);if(t>a->duration)a->duration=t;}
-void eng3d_anim_play(ENG_3D* ctx,ENG_3D_AnimID id){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;ctx->anims[id-1].playing=true;}
-void eng3d_anim_stop(ENG_3D* ctx,ENG_3D_AnimID id){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;ctx->anims[id-1].playing=false;}
-void eng3d_anim_loop(ENG_3D* ctx,ENG_3D_AnimID id,bool on){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;ctx->anims[id-1].loop=on;}
-void eng3d_anim_seek(ENG_3D* ctx,ENG_3D_AnimID id,float t){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;ctx->anims[id-1].time=t;}
-bool eng3d_anim_is_playing(ENG_3D* ctx,ENG_3D_AnimID id){if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return false;return ctx->anims[id-1].playing;}
+void eng3d_anim_key_pos  (ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){Anim3D*a=anim_get(ctx,id);if(!a)return;anim_add_key(a->pos_keys,&a->n_pos,t,x,y,z);if(t>a->duration)a->duration=t;}
+void eng3d_anim_key_rot  (ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){Anim3D*a=anim_get(ctx,id);if(!a)return;anim_add_key(a->rot_keys,&a->n_rot,t,x,y,z);if(t>a->duration)a->duration=t;}
+void eng3d_anim_key_scale(ENG_3D* ctx,ENG_3D_AnimID id,float t,float x,float y,float z){Anim3D*a=anim_get(ctx,id);if(!a)return;anim_add_key(a->scale_keys,&a->n_scale,t,x,y,z);if(t>a->duration)a->duration=t;}
+void eng3d_anim_play(ENG_3D* ctx,ENG_3D_AnimID id){Anim3D*a=anim_get(ctx,id);if(!a)return;a->playing=true;}
+void eng3d_anim_stop(ENG_3D* ctx,ENG_3D_AnimID id){Anim3D*a=anim_get(ctx,id);if(!a)return;a->playing=false;}
+void eng3d_anim_loop(ENG_3D* ctx,ENG_3D_AnimID id,bool on){Anim3D*a=anim_get(ctx,id);if(!a)return;a->loop=on;}
+void eng3d_anim_seek(ENG_3D* ctx,ENG_3D_AnimID id,float t){Anim3D*a=anim_get(ctx,id);if(!a)return;a->time=t;}
+bool eng3d_anim_is_playing(ENG_3D* ctx,ENG_3D_AnimID id){const Anim3D*a=anim_get(ctx,id);return a&&a->playing;}
 
 static void anim_eval(AnimKey* keys,int n,float t,float* out){
     if(n==0){out[0]=out[1]=out[2]=0.f;return;}
@@ -1742,8 +5357,7 @@ static void anim_eval(AnimKey* keys,int n,float t,float* out){
 }
 
 void eng3d_anim_update(ENG_3D* ctx,ENG_3D_AnimID id,float delta){
-    if(id<1||id>ENG_3D_MAX_ANIMS||!ctx->anims[id-1].used)return;
-    Anim3D* a=&ctx->anims[id-1]; if(!a->playing)return;
+    Anim3D* a=anim_get(ctx,id); if(!a||!a->playing)return;
     a->time+=delta;
     if(a->duration>0&&a->time>a->duration){
         if(a->loop) a->time=fmodf(a->time,a->duration);
@@ -1754,44 +5368,280 @@ void eng3d_anim_update(ENG_3D* ctx,ENG_3D_AnimID id,float delta){
     if(a->n_scale>0) anim_eval(a->scale_keys,a->n_scale,a->time,a->cur_scale);
     else {a->cur_scale[0]=a->cur_scale[1]=a->cur_scale[2]=1.f;}
 }
-void eng3d_anim_get_pos  (ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){Anim3D*a=(id>=1&&id<=ENG_3D_MAX_ANIMS&&ctx->anims[id-1].used)?&ctx->anims[id-1]:NULL;if(x)*x=a?a->cur_pos[0]:0;if(y)*y=a?a->cur_pos[1]:0;if(z)*z=a?a->cur_pos[2]:0;}
-void eng3d_anim_get_rot  (ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){Anim3D*a=(id>=1&&id<=ENG_3D_MAX_ANIMS&&ctx->anims[id-1].used)?&ctx->anims[id-1]:NULL;if(x)*x=a?a->cur_rot[0]:0;if(y)*y=a?a->cur_rot[1]:0;if(z)*z=a?a->cur_rot[2]:0;}
-void eng3d_anim_get_scale(ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){Anim3D*a=(id>=1&&id<=ENG_3D_MAX_ANIMS&&ctx->anims[id-1].used)?&ctx->anims[id-1]:NULL;if(x)*x=a?a->cur_scale[0]:1;if(y)*y=a?a->cur_scale[1]:1;if(z)*z=a?a->cur_scale[2]:1;}
+void eng3d_anim_get_pos  (ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){const Anim3D*a=anim_get(ctx,id);if(x)*x=a?a->cur_pos[0]:0;if(y)*y=a?a->cur_pos[1]:0;if(z)*z=a?a->cur_pos[2]:0;}
+void eng3d_anim_get_rot  (ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){const Anim3D*a=anim_get(ctx,id);if(x)*x=a?a->cur_rot[0]:0;if(y)*y=a?a->cur_rot[1]:0;if(z)*z=a?a->cur_rot[2]:0;}
+void eng3d_anim_get_scale(ENG_3D* ctx,ENG_3D_AnimID id,float*x,float*y,float*z){const Anim3D*a=anim_get(ctx,id);if(x)*x=a?a->cur_scale[0]:1;if(y)*y=a?a->cur_scale[1]:1;if(z)*z=a?a->cur_scale[2]:1;}
+
+/* ══════════════════════════════════════════════════════
+ * シーン BVH
+ *   行が増減・並び替えされたらビン分割 SAH で作り直し、
+ *   行列・メッシュが変わっただけなら印の付いた行の箱と、その葉から
+ *   根までの祖先だけを詰め直す (多ければ全体を一括で)。
+ *   詰め直しで木の質 (SAH コスト) が落ちすぎたら作り直す
+ * ══════════════════════════════════════════════════════*/
+static float box_area(const float* mn,const float* mx){
+    float dx=mx[0]-mn[0], dy=mx[1]-mn[1], dz=mx[2]-mn[2];
+    return 2.f*(dx*dy+dy*dz+dz*dx);
+}
+static void box_grow(float* mn,float* mx,const float* bmn,const float* bmx){
+    for(int k=0;k<3;k++){ if(bmn[k]<mn[k])mn[k]=bmn[k]; if(bmx[k]>mx[k])mx[k]=bmx[k]; }
+}
+
+/* 行のワールド AABB。メッシュが無ければ原点の点 */
+static ENG_3D_AABB scene_row_box(ENG_3D* ctx,int row){
+    const SceneGraph3D* g=&ctx->scene;
+    const Mesh3D* m=mesh_get(ctx,g->mesh[row]);
+    if(m) return aabb_mat_internal(m->bounds,g->world[row]);
+    const float* w=g->world[row];
+    ENG_3D_AABB b={{w[12],w[13],w[14]},{w[12],w[13],w[14]}};
+    return b;
+}
+
+/* SAH コストへの寄与 (面積 × 葉なら個数) */
+static float bvh_node_cost(const BvhNode3D* nd){
+    return box_area(nd->min,nd->max)*(float)(nd->count?nd->count:1);
+}
+
+/* ノード i の箱を子 (葉なら prim の箱) から詰め直す */
+static void bvh_node_fit(SceneBVH3D* b,int i){
+    BvhNode3D* nd=&b->nodes[i];
+    for(int k=0;k<3;k++){ nd->min[k]=FLT_MAX; nd->max[k]=-FLT_MAX; }
+    if(nd->count){
+        for(int j=nd->left;j<nd->left+nd->count;j++) box_grow(nd->min,nd->max,b->pbox[j].min,b->pbox[j].max);
+    } else {
+        const BvhNode3D* l=&b->nodes[nd->left]; const BvhNode3D* r=l+1;
+        box_grow(nd->min,nd->max,l->min,l->max); box_grow(nd->min,nd->max,r->min,r->max);
+    }
+}
+
+/* SAH コスト (根の面積比) */
+static float bvh_cost(const SceneBVH3D* b){
+    float root=b->n_nodes?box_area(b->nodes[0].min,b->nodes[0].max):0.f;
+    return root>0.f?b->cost_sum/root:0.f;
+}
+
+/* 全ノードを下から詰め直し、SAH コストを返す */
+static float bvh_fit(SceneBVH3D* b){
+    b->cost_sum=0.f;
+    for(int i=b->n_nodes-1;i>=0;i--){ bvh_node_fit(b,i); b->cost_sum+=bvh_node_cost(&b->nodes[i]); }
+    return bvh_cost(b);
+}
+
+/* 葉 i から根まで詰め直し、コストの和を差し替える */
+static void bvh_fit_up(SceneBVH3D* b,int i){
+    for(;i>=0;i=b->up[i]){
+        BvhNode3D* nd=&b->nodes[i];
+        float old=bvh_node_cost(nd);
+        bvh_node_fit(b,i);
+        b->cost_sum+=bvh_node_cost(nd)-old;
+    }
+}
+
+static void bvh_swap(SceneBVH3D* b,int i,int j){
+    int p=b->prim[i]; b->prim[i]=b->prim[j]; b->prim[j]=p;
+    ENG_3D_AABB x=b->pbox[i]; b->pbox[i]=b->pbox[j]; b->pbox[j]=x;
+    for(int k=0;k<3;k++){ float c=b->cent[i*3+k]; b->cent[i*3+k]=b->cent[j*3+k]; b->cent[j*3+k]=c; }
+}
+
+/* [begin,end) をビン分割 SAH で二つに分ける位置を返す (葉にすべきなら -1) */
+static int bvh_split(SceneBVH3D* b,int begin,int end){
+    int n=end-begin;
+    float cmn[3]={FLT_MAX,FLT_MAX,FLT_MAX}, cmx[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
+    float bmn[3]={FLT_MAX,FLT_MAX,FLT_MAX}, bmx[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
+    for(int i=begin;i<end;i++){
+        box_grow(cmn,cmx,b->cent+i*3,b->cent+i*3);
+        box_grow(bmn,bmx,b->pbox[i].min,b->pbox[i].max);
+    }
+    int axis=0;
+    for(int k=1;k<3;k++) if(cmx[k]-cmn[k]>cmx[axis]-cmn[axis]) axis=k;
+    float ext=cmx[axis]-cmn[axis];
+    if(!(ext>0.f)){                                  /* 重心が全て同じ: 個数で半分に */
+        return n>BVH_LEAF_MAX?begin+n/2:-1;
+    }
+    int cnt[BVH_BINS]={0};
+    float lo[BVH_BINS][3], hi[BVH_BINS][3];
+    for(int j=0;j<BVH_BINS;j++) for(int k=0;k<3;k++){ lo[j][k]=FLT_MAX; hi[j][k]=-FLT_MAX; }
+    float scale=(float)BVH_BINS/ext;
+    for(int i=begin;i<end;i++){
+        int j=(int)((b->cent[i*3+axis]-cmn[axis])*scale);
+        if(j>=BVH_BINS) j=BVH_BINS-1;
+        cnt[j]++; box_grow(lo[j],hi[j],b->pbox[i].min,b->pbox[i].max);
+    }
+    /* 左から累積した面積×個数を、右からの累積と合わせて評価 */
+    float left_cost[BVH_BINS];
+    float mn[3]={FLT_MAX,FLT_MAX,FLT_MAX}, mx[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
+    for(int j=0,c=0;j<BVH_BINS-1;j++){
+        c+=cnt[j]; box_grow(mn,mx,lo[j],hi[j]);
+        left_cost[j]=c?box_area(mn,mx)*(float)c:0.f;
+    }
+    float best=FLT_MAX; int best_j=-1;
+    for(int k=0;k<3;k++){ mn[k]=FLT_MAX; mx[k]=-FLT_MAX; }
+    for(int j=BVH_BINS-1,c=0;j>0;j--){
+        c+=cnt[j]; box_grow(mn,mx,lo[j],hi[j]);
+        float cost=left_cost[j-1]+(c?box_area(mn,mx)*(float)c:0.f);
+        if(c&&c<n&&cost<best){ best=cost; best_j=j; }
+    }
+    float area=box_area(bmn,bmx);
+    if(best_j<0||(n<=BVH_LEAF_MAX&&(area<=0.f||1.f+best/area>=(float)n))) return n>BVH_LEAF_MAX?begin+n/2:-1;
+    int i=begin, e=end;
+    while(i<e){
+        int j=(int)((b->cent[i*3+axis]-cmn[axis])*scale);
+        if(j>=BVH_BINS) j=BVH_BINS-1;
+        if(j<best_j) i++; else bvh_swap(b,i,--e);
+    }
+    return i;
+}
+
+static void bvh_build(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    SceneBVH3D* b=&g->bvh;
+    int n=g->n;
+    b->n_nodes=0; b->n_dirty=0;
+    g->bvh_rebuild=g->vis_dirty=false;
+    if(n==0) return;
+    if(!grow_buf((void**)&b->prim,&b->cap_prim,(size_t)n,sizeof(int))
+       ||!grow_buf((void**)&b->pbox,&b->cap_pbox,(size_t)n,sizeof(ENG_3D_AABB))
+       ||!grow_buf((void**)&b->cent,&b->cap_cent,(size_t)n*3,sizeof(float))
+       ||!grow_buf((void**)&b->slot,&b->cap_slot,(size_t)n,sizeof(int))
+       ||!grow_buf((void**)&b->leaf,&b->cap_leaf,(size_t)n,sizeof(int))
+       ||!grow_buf((void**)&b->nodes,&b->cap_nodes,(size_t)n*2,sizeof(BvhNode3D))
+       ||!grow_buf((void**)&b->up,&b->cap_up,(size_t)n*2,sizeof(int))){
+        g->bvh_rebuild=true; return;                 /* 次の呼び出しでやり直す */
+    }
+    for(int i=0;i<n;i++){
+        g->flags[i]&=(uint8_t)~NODE_BVH_DIRTY;
+        scene_visible(g,i);
+        b->prim[i]=i; b->pbox[i]=scene_row_box(ctx,i);
+        for(int k=0;k<3;k++) b->cent[i*3+k]=0.5f*b->pbox[i].min[k]+0.5f*b->pbox[i].max[k];
+    }
+    /* 深さ優先。保留は深さ+1 個までなので固定長で足りる */
+    struct { int node, begin, end, depth; } st[BVH_DEPTH_MAX+1];
+    int sp=0;
+    b->n_nodes=1; b->up[0]=-1;
+    st[sp].node=0; st[sp].begin=0; st[sp].end=n; st[sp].depth=0; sp++;
+    while(sp){
+        sp--;
+        int ni=st[sp].node, begin=st[sp].begin, end=st[sp].end, depth=st[sp].depth;
+        BvhNode3D* nd=&b->nodes[ni];
+        int mid=depth<BVH_DEPTH_MAX?bvh_split(b,begin,end):-1;
+        if(mid<0){
+            nd->left=begin; nd->count=end-begin;
+            for(int j=begin;j<end;j++){ b->slot[b->prim[j]]=j; b->leaf[b->prim[j]]=ni; }
+            continue;
+        }
+        nd->left=b->n_nodes; nd->count=0;
+        b->up[nd->left]=b->up[nd->left+1]=ni;
+        b->n_nodes+=2;
+        st[sp].node=nd->left+1; st[sp].begin=mid;   st[sp].end=end; st[sp].depth=depth+1; sp++;
+        st[sp].node=nd->left;   st[sp].begin=begin; st[sp].end=mid; st[sp].depth=depth+1; sp++;
+    }
+    b->cost_built=bvh_fit(b);
+}
+
+static void bvh_update(ENG_3D* ctx){
+    SceneGraph3D* g=&ctx->scene;
+    scene_update(ctx);
+    if(g->bvh_rebuild){ bvh_build(ctx); return; }
+    SceneBVH3D* b=&g->bvh;
+    if(g->vis_dirty){
+        for(int i=0;i<g->n;i++) scene_visible(g,i);
+        g->vis_dirty=false;
+    }
+    if(!b->n_dirty) return;
+    bool full=(int64_t)b->n_dirty*BVH_REFIT_FULL>g->n;
+    for(int k=0;k<b->n_dirty;k++){
+        int row=b->dirty[k];
+        g->flags[row]&=(uint8_t)~NODE_BVH_DIRTY;
+        b->pbox[b->slot[row]]=scene_row_box(ctx,row);
+        if(!full) bvh_fit_up(b,b->leaf[row]);
+    }
+    b->n_dirty=0;
+    float cost=full?bvh_fit(b):bvh_cost(b);
+    if(cost>b->cost_built*BVH_REFIT_SLACK) bvh_build(ctx);
+}
 
 /* ══════════════════════════════════════════════════════
  * レイキャスト
+ *   表示中のシーンノードのワールド AABB を BVH で手前から調べ、
+ *   最も近い当たりより奥の部分木は開かない
  * ══════════════════════════════════════════════════════*/
-static bool ray_aabb(const float* ro,const float* rd,const ENG_3D_AABB* aabb,float* t_out){
+/* 入った面の法線も返す (始点が箱の中なら出る面) */
+static bool ray_aabb(const float* ro,const float* rd,const ENG_3D_AABB* aabb,float* t_out,float* n_out){
     float tmin=-FLT_MAX,tmax=FLT_MAX;
+    int amin=0,amax=0;
     for(int i=0;i<3;i++){
         if(fabsf(rd[i])<1e-8f){
             if(ro[i]<aabb->min[i]||ro[i]>aabb->max[i])return false;
         } else {
             float t1=(aabb->min[i]-ro[i])/rd[i], t2=(aabb->max[i]-ro[i])/rd[i];
             if(t1>t2){float tmp=t1;t1=t2;t2=tmp;}
-            if(t1>tmin)tmin=t1; if(t2<tmax)tmax=t2;
+            if(t1>tmin){tmin=t1;amin=i;} if(t2<tmax){tmax=t2;amax=i;}
             if(tmin>tmax)return false;
         }
     }
     if(tmax<0)return false;
-    *t_out=tmin>=0?tmin:tmax;
+    bool inside=tmin<0;
+    *t_out=inside?tmax:tmin;
+    int a=inside?amax:amin;
+    n_out[0]=n_out[1]=n_out[2]=0.f;
+    n_out[a]=(rd[a]>0.f)!=inside?-1.f:1.f;
     return true;
 }
 
+/* 内部ノード用。逆数方向で入る距離だけ求める (0 で打ち切り) */
+static bool ray_node(const float* ro,const float* inv,const BvhNode3D* nd,float* t_in){
+    float tmin=0.f,tmax=FLT_MAX;
+    for(int k=0;k<3;k++){
+        float t1=(nd->min[k]-ro[k])*inv[k], t2=(nd->max[k]-ro[k])*inv[k];
+        if(t1>t2){float tmp=t1;t1=t2;t2=tmp;}
+        tmin=fmaxf(tmin,t1); tmax=fminf(tmax,t2);   /* NaN (0×∞) は無視される */
+    }
+    *t_in=tmin;
+    return tmin<=tmax;
+}
+
 ENG_3D_RayHit eng3d_raycast(ENG_3D* ctx,float ox,float oy,float oz,float dx,float dy,float dz){
     ENG_3D_RayHit hit={0};
     float ro[3]={ox,oy,oz},rd[3]={dx,dy,dz};
     float len=sqrtf(rd[0]*rd[0]+rd[1]*rd[1]+rd[2]*rd[2])+1e-8f;
     rd[0]/=len;rd[1]/=len;rd[2]/=len;
+    bvh_update(ctx);
+    const SceneGraph3D* g=&ctx->scene;
+    const SceneBVH3D* b=&g->bvh;
+    if(!b->n_nodes) return hit;
+    float inv[3], t;
+    for(int k=0;k<3;k++) inv[k]=1.f/(fabsf(rd[k])>1e-8f?rd[k]:copysignf(1e-8f,rd[k]));
+    struct { int node; float t; } st[BVH_DEPTH_MAX+2];
+    int sp=0;
     float best=FLT_MAX;
-    for(int i=0;i<ENG_3D_MAX_MESHES;i++){
-        Mesh3D* m=&ctx->meshes[i]; if(!m->used)continue;
-        float t;
-        if(ray_aabb(ro,rd,&m->bounds,&t)&&t<best){
-            best=t; hit.hit=true; hit.dist=t;
-            hit.x=ro[0]+rd[0]*t; hit.y=ro[1]+rd[1]*t; hit.z=ro[2]+rd[2]*t;
-            hit.mesh_id=i+1;
+    if(ray_node(ro,inv,&b->nodes[0],&t)){ st[0].node=0; st[0].t=t; sp=1; }
+    while(sp){
+        sp--;
+        if(st[sp].t>=best) continue;                 /* 既に手前で当たっている */
+        const BvhNode3D* nd=&b->nodes[st[sp].node];
+        if(nd->count){
+            for(int j=nd->left;j<nd->left+nd->count;j++){
+                int row=b->prim[j];
+                float n[3];
+                if(!(g->flags[row]&NODE_VISIBLE)||!mesh_get(ctx,g->mesh[row])) continue;
+                if(ray_aabb(ro,rd,&b->pbox[j],&t,n)&&t<best){
+                    best=t; hit.hit=true; hit.dist=t;
+                    hit.x=ro[0]+rd[0]*t; hit.y=ro[1]+rd[1]*t; hit.z=ro[2]+rd[2]*t;
+                    hit.nx=n[0]; hit.ny=n[1]; hit.nz=n[2];
+                    hit.mesh_id=g->mesh[row]; hit.node_id=g->id[row];
+                }
+            }
+            continue;
         }
+        float tl,tr;
+        bool hl=ray_node(ro,inv,&b->nodes[nd->left],&tl)&&tl<best;
+        bool hr=ray_node(ro,inv,&b->nodes[nd->left+1],&tr)&&tr<best;
+        if(hl&&hr){                                  /* 遠い方を先に積む */
+            bool lf=tl<=tr;
+            st[sp].node=lf?nd->left+1:nd->left; st[sp].t=lf?tr:tl; sp++;
+            st[sp].node=lf?nd->left:nd->left+1; st[sp].t=lf?tl:tr; sp++;
+        } else if(hl){ st[sp].node=nd->left;   st[sp].t=tl; sp++; }
+        else if(hr){   st[sp].node=nd->left+1; st[sp].t=tr; sp++; }
     }
     return hit;
 }
@@ -1817,6 +5667,13 @@ bool eng3d_aabb_overlap(ENG_3D_AABB a,ENG_3D_AABB b){
           (a.max[1]>=b.min[1]&&a.min[1]<=b.max[1])&&
           (a.max[2]>=b.min[2]&&a.min[2]<=b.max[2]);
 }
+void eng3d_trs_batch(const float* trs,int n,float* out_mats){
+    for(int i=0;i<n;i++,trs+=9,out_mats+=16)
+        m4_trs(out_mats,trs[0],trs[1],trs[2],trs[3],trs[4],trs[5],trs[6],trs[7],trs[8]);
+}
+void eng3d_aabb_transform_batch(const ENG_3D_AABB* in,const float* mats,int n,ENG_3D_AABB* out){
+    for(int i=0;i<n;i++) out[i]=aabb_mat_internal(in[i],mats+(size_t)i*16);
+}
 ENG_3D_AABB eng3d_aabb_transform(ENG_3D_AABB aabb,
     float px,float py,float pz,float rx,float ry,float rz,float sx,float sy,float sz)
 {
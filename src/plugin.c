@@ -29,6 +29,12 @@ static Value p_create(int argc, Value* argv){
     g_ctx = eng3d_create(title,w,h);
     return vB(g_ctx!=NULL);
 }
+static Value p_create_headless(int argc, Value* argv){
+    int w = argc>=1?(int)NUM(&argv[0]):800;
+    int h = argc>=2?(int)NUM(&argv[1]):600;
+    g_ctx = eng3d_create_headless(w,h);
+    return vB(g_ctx!=NULL);
+}
 static Value p_destroy(int argc, Value* argv){ (void)argc;(void)argv; if(g_ctx){eng3d_destroy(g_ctx);g_ctx=NULL;} return vNULL(); }
 static Value p_update (int argc, Value* argv){ (void)argc;(void)argv; return g_ctx?vB(eng3d_update(g_ctx)):vB(false); }
 static Value p_delta  (int argc, Value* argv){ (void)argc;(void)argv; return g_ctx?vN(eng3d_delta(g_ctx)):vN(0); }
@@ -58,7 +64,61 @@ static Value p_draw(int argc, Value* argv){
     eng3d_draw(g_ctx,id,px,py,pz,rx,ry,rz,sx,sy,sz);
     return vNULL();
 }
+static Value p_draw_tex(int argc, Value* argv){
+    if(!g_ctx||argc<2) return vNULL();
+    ENG_3D_MeshID id=(ENG_3D_MeshID)(int)NUM(&argv[0]);
+    ENG_3D_TexID tex=(ENG_3D_TexID)(int)NUM(&argv[1]);
+    float px=argc>=3?(float)NUM(&argv[2]):0;
+    float py=argc>=4?(float)NUM(&argv[3]):0;
+    float pz=argc>=5?(float)NUM(&argv[4]):0;
+    float rx=argc>=6?(float)NUM(&argv[5]):0;
+    float ry=argc>=7?(float)NUM(&argv[6]):0;
+    float rz=argc>=8?(float)NUM(&argv[7]):0;
+    float sx=argc>=9?(float)NUM(&argv[8]):1;
+    float sy=argc>=10?(float)NUM(&argv[9]):1;
+    float sz=argc>=11?(float)NUM(&argv[10]):1;
+    eng3d_draw_tex(g_ctx,id,tex,px,py,pz,rx,ry,rz,sx,sy,sz);
+    return vNULL();
+}
 static Value p_end(int argc, Value* argv){ (void)argc;(void)argv; if(g_ctx) eng3d_end(g_ctx); return vNULL(); }
+static Value p_cull_enable(int argc, Value* argv){if(!g_ctx)return vNULL();eng3d_cull_enable(g_ctx,argc>=1?BOL(&argv[0]):true);return vNULL();}
+static Value p_cull_count (int argc, Value* argv){(void)argc;(void)argv;return g_ctx?vN(eng3d_cull_count(g_ctx)):vN(0);}
+static Value p_lod_params (int argc, Value* argv){
+    if(!g_ctx||argc<3) return vNULL();
+    eng3d_lod_params(g_ctx,(float)NUM(&argv[0]),(float)NUM(&argv[1]),(float)NUM(&argv[2]),argc>=4?(float)NUM(&argv[3]):0.1f);
+    return vNULL();
+}
+
+/* ══════════════════════════════════════════════
+ * 統計
+ * ══════════════════════════════════════════════*/
+static Value p_gpu_stats(int argc, Value* argv){
+    (void)argc;(void)argv;
+    if(!g_ctx) return vNULL();
+    ENG_3D_GpuStats s; eng3d_gpu_stats(g_ctx,&s);
+    Value d={0}; d.type=VALUE_DICT;
+    d.dict.keys=(char**)calloc(6,sizeof(char*)); d.dict.values=(Value*)calloc(6,sizeof(Value));
+    d.dict.keys[0]=strdup("有効");         d.dict.values[0]=vB(s.valid);
+    d.dict.keys[1]=strdup("影");           d.dict.values[1]=vN(s.shadow_ms);
+    d.dict.keys[2]=strdup("メイン");       d.dict.values[2]=vN(s.main_ms);
+    d.dict.keys[3]=strdup("パーティクル"); d.dict.values[3]=vN(s.particle_ms);
+    d.dict.keys[4]=strdup("ポスト");       d.dict.values[4]=vN(s.post_ms);
+    d.dict.keys[5]=strdup("合計");         d.dict.values[5]=vN(s.total_ms);
+    d.dict.length=d.dict.capacity=6; return d;
+}
+static Value p_frame_stats(int argc, Value* argv){
+    (void)argc;(void)argv;
+    if(!g_ctx) return vNULL();
+    ENG_3D_FrameStats s; eng3d_frame_stats(g_ctx,&s);
+    static const char* K[10]={"描画数","インスタンス描画数","三角形数","プログラム切替","テクスチャ切替",
+                              "VAO切替","ユニフォーム転送","転送バイト","カリング数","パーティクル数"};
+    double v[10]={s.draw_calls,s.instanced_draws,(double)s.triangles,s.program_binds,s.texture_binds,
+                  s.vao_binds,s.uniform_uploads,(double)s.upload_bytes,s.culled,s.particles};
+    Value d={0}; d.type=VALUE_DICT;
+    d.dict.keys=(char**)calloc(10,sizeof(char*)); d.dict.values=(Value*)calloc(10,sizeof(Value));
+    for(int i=0;i<10;i++){ d.dict.keys[i]=strdup(K[i]); d.dict.values[i]=vN(v[i]); }
+    d.dict.length=d.dict.capacity=10; return d;
+}
 
 /* ══════════════════════════════════════════════
  * カメラ
@@ -127,6 +187,7 @@ static Value p_spot_light_off(int argc, Value* argv){
 static Value p_shadow_enable(int argc, Value* argv){if(!g_ctx)return vNULL();eng3d_shadow_enable(g_ctx,argc>=1?BOL(&argv[0]):true);return vNULL();}
 static Value p_shadow_bias  (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_shadow_bias(g_ctx,(float)NUM(&argv[0]));return vNULL();}
 static Value p_shadow_size  (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_shadow_size(g_ctx,(float)NUM(&argv[0]));return vNULL();}
+static Value p_shadow_cascades(int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_shadow_cascades(g_ctx,(int)NUM(&argv[0]));return vNULL();}
 static Value p_fog_enable   (int argc, Value* argv){if(!g_ctx)return vNULL();eng3d_fog_enable(g_ctx,argc>=1?BOL(&argv[0]):true);return vNULL();}
 static Value p_fog(int argc, Value* argv){
     if(!g_ctx||argc<7) return vNULL();
@@ -158,7 +219,21 @@ static Value p_mesh_plane   (int argc, Value* argv){if(!g_ctx)return vN(0);retur
 static Value p_mesh_cylinder(int argc, Value* argv){if(!g_ctx)return vN(0);return vN(eng3d_mesh_cylinder(g_ctx,argc>=1?(float)NUM(&argv[0]):0.5f,argc>=2?(float)NUM(&argv[1]):1,argc>=3?(int)NUM(&argv[2]):16));}
 static Value p_mesh_capsule (int argc, Value* argv){if(!g_ctx)return vN(0);return vN(eng3d_mesh_capsule(g_ctx,argc>=1?(float)NUM(&argv[0]):0.5f,argc>=2?(float)NUM(&argv[1]):1,argc>=3?(int)NUM(&argv[2]):16));}
 static Value p_mesh_torus   (int argc, Value* argv){if(!g_ctx)return vN(0);return vN(eng3d_mesh_torus(g_ctx,argc>=1?(float)NUM(&argv[0]):1,argc>=2?(float)NUM(&argv[1]):0.3f,argc>=3?(int)NUM(&argv[2]):32,argc>=4?(int)NUM(&argv[3]):16));}
-static Value p_mesh_load_obj(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_mesh_load_obj(g_ctx,STR(&argv[0])));}
+static Value p_mesh_load_obj(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(argc>=2?eng3d_mesh_load_obj_flags(g_ctx,STR(&argv[0]),(int)NUM(&argv[1])):eng3d_mesh_load_obj(g_ctx,STR(&argv[0])));}
+static Value p_mesh_load_bin(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_mesh_load_bin(g_ctx,STR(&argv[0])));}
+static Value p_mesh_obj_cache(int argc, Value* argv){if(!g_ctx)return vNULL();eng3d_mesh_obj_cache(g_ctx,argc>=1?BOL(&argv[0]):true);return vNULL();}
+static Value p_mesh_build_flags(int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_mesh_build_flags(g_ctx,(int)NUM(&argv[0]));return vNULL();}
+static Value p_mesh_lod_count(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_mesh_lod_info(g_ctx,(ENG_3D_MeshID)(int)NUM(&argv[0]),NULL));}
+static Value p_mesh_acmr(int argc, Value* argv){
+    if(!g_ctx||argc<1) return vNULL();
+    float b=0.f,a=0.f; bool ok=eng3d_mesh_acmr(g_ctx,(ENG_3D_MeshID)(int)NUM(&argv[0]),&b,&a);
+    Value d={0}; d.type=VALUE_DICT;
+    d.dict.keys=(char**)calloc(3,sizeof(char*)); d.dict.values=(Value*)calloc(3,sizeof(Value));
+    d.dict.keys[0]=strdup("有効");   d.dict.values[0]=vB(ok);
+    d.dict.keys[1]=strdup("最適化前"); d.dict.values[1]=vN(b);
+    d.dict.keys[2]=strdup("最適化後"); d.dict.values[2]=vN(a);
+    d.dict.length=d.dict.capacity=3; return d;
+}
 static Value p_mesh_destroy (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_mesh_destroy(g_ctx,(ENG_3D_MeshID)(int)NUM(&argv[0]));return vNULL();}
 static Value p_mesh_vertex_count(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_mesh_vertex_count(g_ctx,(ENG_3D_MeshID)(int)NUM(&argv[0])));}
 
@@ -166,6 +241,21 @@ static Value p_mesh_vertex_count(int argc, Value* argv){if(!g_ctx||argc<1)return
  * テクスチャ
  * ══════════════════════════════════════════════*/
 static Value p_tex_load   (int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_tex_load(g_ctx,STR(&argv[0])));}
+static Value p_tex_load_async(int argc, Value* argv){if(!g_ctx||argc<1)return vN(0);return vN(eng3d_tex_load_async(g_ctx,STR(&argv[0])));}
+static Value p_tex_budget (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_tex_upload_budget(g_ctx,(int)NUM(&argv[0]));return vNULL();}
+static Value p_tex_pending(int argc, Value* argv){(void)argc;(void)argv;if(!g_ctx)return vN(0);return vN(eng3d_tex_pending(g_ctx));}
+static Value p_tex_status(int argc, Value* argv){
+    if(!g_ctx||argc<1) return vNULL();
+    float prog; ENG_3D_TexStatus s=eng3d_tex_status(g_ctx,(ENG_3D_TexID)(int)NUM(&argv[0]),&prog);
+    Value d={0}; d.type=VALUE_DICT;
+    d.dict.keys=(char**)calloc(2,sizeof(char*)); d.dict.values=(Value*)calloc(2,sizeof(Value));
+    d.dict.keys[0]=strdup("状態"); d.dict.values[0]=vN(s);
+    d.dict.keys[1]=strdup("進捗"); d.dict.values[1]=vN(prog);
+    d.dict.length=d.dict.capacity=2; return d;
+}
+static Value p_tex_compress(int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_tex_compress(g_ctx,BOL(&argv[0]));return vNULL();}
+static Value p_tex_pool    (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_tex_pool(g_ctx,BOL(&argv[0]));return vNULL();}
+static Value p_tex_memory  (int argc, Value* argv){if(!g_ctx)return vN(0);return vN((double)eng3d_tex_memory(g_ctx,argc>=1?(ENG_3D_TexID)(int)NUM(&argv[0]):0));}
 static Value p_tex_destroy(int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_tex_destroy(g_ctx,(ENG_3D_TexID)(int)NUM(&argv[0]));return vNULL();}
 
 /* ══════════════════════════════════════════════
@@ -219,6 +309,7 @@ static Value p_node_rot    (int argc, Value* argv){if(!g_ctx||argc<4)return vNUL
 static Value p_node_scale  (int argc, Value* argv){if(!g_ctx||argc<4)return vNULL();eng3d_node_scale(g_ctx,(int)NUM(&argv[0]),(float)NUM(&argv[1]),(float)NUM(&argv[2]),(float)NUM(&argv[3]));return vNULL();}
 static Value p_node_active (int argc, Value* argv){if(!g_ctx||argc<2)return vNULL();eng3d_node_active(g_ctx,(int)NUM(&argv[0]),BOL(&argv[1]));return vNULL();}
 static Value p_node_draw   (int argc, Value* argv){if(!g_ctx||argc<1)return vNULL();eng3d_node_draw(g_ctx,(int)NUM(&argv[0]));return vNULL();}
+static Value p_scene_draw  (int argc, Value* argv){(void)argc;(void)argv;if(!g_ctx)return vNULL();eng3d_scene_draw_all(g_ctx);return vNULL();}
 static Value p_node_world_pos(int argc, Value* argv){
     if(!g_ctx||argc<1) return vNULL();
     float x=0,y=0,z=0;
@@ -271,30 +362,26 @@ static Value p_anim_get_scale(int argc, Value* argv){
 /* ══════════════════════════════════════════════
  * レイキャスト
  * ══════════════════════════════════════════════*/
-static Value p_raycast(int argc, Value* argv){
-    if(!g_ctx||argc<6) return vNULL();
-    ENG_3D_RayHit h=eng3d_raycast(g_ctx,(float)NUM(&argv[0]),(float)NUM(&argv[1]),(float)NUM(&argv[2]),
-                                        (float)NUM(&argv[3]),(float)NUM(&argv[4]),(float)NUM(&argv[5]));
+static Value ray_hit_dict(ENG_3D_RayHit h){
     Value d={0}; d.type=VALUE_DICT;
-    d.dict.keys=(char**)calloc(5,sizeof(char*)); d.dict.values=(Value*)calloc(5,sizeof(Value));
+    d.dict.keys=(char**)calloc(7,sizeof(char*)); d.dict.values=(Value*)calloc(7,sizeof(Value));
     d.dict.keys[0]=strdup("当たり"); d.dict.values[0]=vB(h.hit);
     d.dict.keys[1]=strdup("距離");   d.dict.values[1]=vN(h.dist);
     d.dict.keys[2]=strdup("x");     d.dict.values[2]=vN(h.x);
     d.dict.keys[3]=strdup("y");     d.dict.values[3]=vN(h.y);
     d.dict.keys[4]=strdup("z");     d.dict.values[4]=vN(h.z);
-    d.dict.length=d.dict.capacity=5; return d;
+    d.dict.keys[5]=strdup("ノード"); d.dict.values[5]=vN(h.node_id);
+    d.dict.keys[6]=strdup("メッシュ");d.dict.values[6]=vN(h.mesh_id);
+    d.dict.length=d.dict.capacity=7; return d;
+}
+static Value p_raycast(int argc, Value* argv){
+    if(!g_ctx||argc<6) return vNULL();
+    return ray_hit_dict(eng3d_raycast(g_ctx,(float)NUM(&argv[0]),(float)NUM(&argv[1]),(float)NUM(&argv[2]),
+                                            (float)NUM(&argv[3]),(float)NUM(&argv[4]),(float)NUM(&argv[5])));
 }
 static Value p_raycast_screen(int argc, Value* argv){
     if(!g_ctx||argc<2) return vNULL();
-    ENG_3D_RayHit h=eng3d_raycast_screen(g_ctx,(float)NUM(&argv[0]),(float)NUM(&argv[1]));
-    Value d={0}; d.type=VALUE_DICT;
-    d.dict.keys=(char**)calloc(5,sizeof(char*)); d.dict.values=(Value*)calloc(5,sizeof(Value));
-    d.dict.keys[0]=strdup("当たり"); d.dict.values[0]=vB(h.hit);
-    d.dict.keys[1]=strdup("距離");   d.dict.values[1]=vN(h.dist);
-    d.dict.keys[2]=strdup("x");     d.dict.values[2]=vN(h.x);
-    d.dict.keys[3]=strdup("y");     d.dict.values[3]=vN(h.y);
-    d.dict.keys[4]=strdup("z");     d.dict.values[4]=vN(h.z);
-    d.dict.length=d.dict.capacity=5; return d;
+    return ray_hit_dict(eng3d_raycast_screen(g_ctx,(float)NUM(&argv[0]),(float)NUM(&argv[1])));
 }
 
 /* ══════════════════════════════════════════════
@@ -345,6 +432,7 @@ static Value p_key_code(int argc, Value* argv){
 static HajimuPluginFunc functions[] = {
     /* ライフサイクル */
     {"作成",       p_create,  0, 3},
+    {"ヘッドレス作成", p_create_headless, 0, 2},
     {"破壊",       p_destroy, 0, 0},
     {"更新",       p_update,  0, 0},
     {"デルタ取得", p_delta,   0, 0},
@@ -354,7 +442,14 @@ static HajimuPluginFunc functions[] = {
     /* 描画 */
     {"描画開始",   p_begin,   0, 3},
     {"描画",       p_draw,    1,10},
+    {"テクスチャ描画", p_draw_tex, 2,11},
     {"描画終了",   p_end,     0, 0},
+    {"カリング有効", p_cull_enable, 0, 1},
+    {"カリング数取得", p_cull_count, 0, 0},
+    {"LOD設定",      p_lod_params, 3, 4},
+    /* 統計 */
+    {"GPU時間取得", p_gpu_stats, 0, 0},
+    {"フレーム統計取得", p_frame_stats, 0, 0},
     /* カメラ */
     {"視野設定",   p_cam_perspective, 0, 3},
     {"カメラ位置", p_cam_pos,    3, 3},
@@ -370,6 +465,7 @@ static HajimuPluginFunc functions[] = {
     {"影有効",     p_shadow_enable, 0,1},
     {"影バイアス", p_shadow_bias,   1,1},
     {"影サイズ",   p_shadow_size,   1,1},
+    {"影カスケード数", p_shadow_cascades, 1,1},
     /* フォグ */
     {"霧有効",     p_fog_enable, 0,1},
     {"霧設定",     p_fog,        7,7},
@@ -388,12 +484,24 @@ static HajimuPluginFunc functions[] = {
     {"円柱作成",     p_mesh_cylinder,0,3},
     {"カプセル作成", p_mesh_capsule, 0,3},
     {"トーラス作成", p_mesh_torus,   0,4},
-    {"OBJ読込",      p_mesh_load_obj,1,1},
+    {"OBJ読込",      p_mesh_load_obj,1,2},
+    {"E3DM読込",     p_mesh_load_bin,1,1},
+    {"OBJキャッシュ", p_mesh_obj_cache,0,1},
+    {"メッシュ構築フラグ", p_mesh_build_flags,1,1},
+    {"メッシュACMR", p_mesh_acmr,1,1},
+    {"メッシュLOD数", p_mesh_lod_count,1,1},
     {"メッシュ破壊", p_mesh_destroy, 1,1},
     {"頂点数取得",   p_mesh_vertex_count,1,1},
     /* テクスチャ */
     {"テクスチャ読込", p_tex_load,    1,1},
     {"テクスチャ破壊", p_tex_destroy, 1,1},
+    {"テクスチャ非同期読込", p_tex_load_async, 1,1},
+    {"テクスチャ状態",       p_tex_status,     1,1},
+    {"テクスチャ読込待ち数", p_tex_pending,    0,0},
+    {"テクスチャ転送予算",   p_tex_budget,     1,1},
+    {"テクスチャ圧縮",       p_tex_compress,   1,1},
+    {"テクスチャプール",     p_tex_pool,       1,1},
+    {"テクスチャメモリ",     p_tex_memory,     0,1},
     /* マテリアル */
     {"色設定",         p_mesh_color,      5,5},
     {"テクスチャ設定", p_mesh_texture,    2,2},
@@ -429,6 +537,7 @@ static HajimuPluginFunc functions[] = {
     {"ノード拡縮",p_node_scale,   4,4},
     {"ノード有効",p_node_active,  2,2},
     {"ノード描画",p_node_draw,    1,1},
+    {"シーン描画",p_scene_draw,   0,0},
     {"ワールド位置",p_node_world_pos,1,1},
     /* アニメーション */
     {"動作作成",  p_anim_create,   0,0},
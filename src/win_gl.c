@@ -14,45 +14,69 @@
 /* ── 関数ポインタ実体 ────────────────────────────────*/
 PFNGLACTIVETEXTUREPROC             pfn_glActiveTexture;
 PFNGLATTACHSHADERPROC              pfn_glAttachShader;
+PFNGLBEGINQUERYPROC                pfn_glBeginQuery;
 PFNGLBINDBUFFERPROC                pfn_glBindBuffer;
+PFNGLBINDBUFFERBASEPROC            pfn_glBindBufferBase;
 PFNGLBINDFRAMEBUFFERPROC           pfn_glBindFramebuffer;
 PFNGLBINDRENDERBUFFERPROC          pfn_glBindRenderbuffer;
 PFNGLBINDVERTEXARRAYPROC           pfn_glBindVertexArray;
 PFNGLBUFFERDATAPROC                pfn_glBufferData;
 PFNGLBUFFERSUBDATAPROC             pfn_glBufferSubData;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC    pfn_glCheckFramebufferStatus;
 PFNGLCOMPILESHADERPROC             pfn_glCompileShader;
+PFNGLCOMPRESSEDTEXIMAGE2DPROC      pfn_glCompressedTexImage2D;
+PFNGLCOMPRESSEDTEXIMAGE3DPROC      pfn_glCompressedTexImage3D;
+PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC   pfn_glCompressedTexSubImage3D;
+PFNGLCOPYBUFFERSUBDATAPROC         pfn_glCopyBufferSubData;
+PFNGLCOPYTEXSUBIMAGE3DPROC         pfn_glCopyTexSubImage3D;
 PFNGLCREATEPROGRAMPROC             pfn_glCreateProgram;
 PFNGLCREATESHADERPROC              pfn_glCreateShader;
 PFNGLDELETEBUFFERSPROC             pfn_glDeleteBuffers;
 PFNGLDELETEFRAMEBUFFERSPROC        pfn_glDeleteFramebuffers;
 PFNGLDELETEPROGRAMPROC             pfn_glDeleteProgram;
+PFNGLDELETEQUERIESPROC             pfn_glDeleteQueries;
 PFNGLDELETERENDERBUFFERSPROC       pfn_glDeleteRenderbuffers;
 PFNGLDELETESHADERPROC              pfn_glDeleteShader;
 PFNGLDELETEVERTEXARRAYSPROC        pfn_glDeleteVertexArrays;
 PFNGLDRAWARRAYSINSTANCEDPROC       pfn_glDrawArraysInstanced;
+PFNGLDRAWELEMENTSINSTANCEDPROC     pfn_glDrawElementsInstanced;
+PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC pfn_glDrawElementsInstancedBaseVertex;
 PFNGLENABLEVERTEXATTRIBARRAYPROC   pfn_glEnableVertexAttribArray;
+PFNGLENDQUERYPROC                  pfn_glEndQuery;
 PFNGLFRAMEBUFFERRENDERBUFFERPROC   pfn_glFramebufferRenderbuffer;
 PFNGLFRAMEBUFFERTEXTURE2DPROC      pfn_glFramebufferTexture2D;
+PFNGLFRAMEBUFFERTEXTURELAYERPROC   pfn_glFramebufferTextureLayer;
 PFNGLGENBUFFERSPROC                pfn_glGenBuffers;
 PFNGLGENERATEMIPMAPPROC            pfn_glGenerateMipmap;
 PFNGLGENFRAMEBUFFERSPROC           pfn_glGenFramebuffers;
+PFNGLGENQUERIESPROC                pfn_glGenQueries;
 PFNGLGENRENDERBUFFERSPROC          pfn_glGenRenderbuffers;
 PFNGLGENVERTEXARRAYSPROC           pfn_glGenVertexArrays;
+PFNGLGETCOMPRESSEDTEXIMAGEPROC     pfn_glGetCompressedTexImage;
 PFNGLGETPROGRAMINFOLOGPROC         pfn_glGetProgramInfoLog;
 PFNGLGETPROGRAMIVPROC              pfn_glGetProgramiv;
+PFNGLGETQUERYOBJECTIVPROC          pfn_glGetQueryObjectiv;
+PFNGLGETQUERYOBJECTUI64VPROC       pfn_glGetQueryObjectui64v;
 PFNGLGETSHADERINFOLOGPROC          pfn_glGetShaderInfoLog;
 PFNGLGETSHADERIVPROC               pfn_glGetShaderiv;
+PFNGLGETSTRINGIPROC                pfn_glGetStringi;
+PFNGLGETUNIFORMBLOCKINDEXPROC      pfn_glGetUniformBlockIndex;
 PFNGLGETUNIFORMLOCATIONPROC        pfn_glGetUniformLocation;
 PFNGLLINKPROGRAMPROC               pfn_glLinkProgram;
+PFNGLMAPBUFFERRANGEPROC            pfn_glMapBufferRange;
 PFNGLRENDERBUFFERSTORAGEPROC       pfn_glRenderbufferStorage;
 PFNGLSHADERSOURCEPROC              pfn_glShaderSource;
+PFNGLTEXIMAGE3DPROC                pfn_glTexImage3D;
+PFNGLTEXSUBIMAGE3DPROC             pfn_glTexSubImage3D;
 PFNGLUNIFORM1FPROC                 pfn_glUniform1f;
 PFNGLUNIFORM1FVPROC                pfn_glUniform1fv;
 PFNGLUNIFORM1IPROC                 pfn_glUniform1i;
 PFNGLUNIFORM3FVPROC                pfn_glUniform3fv;
 PFNGLUNIFORM4FVPROC                pfn_glUniform4fv;
+PFNGLUNIFORMBLOCKBINDINGPROC       pfn_glUniformBlockBinding;
 PFNGLUNIFORMMATRIX3FVPROC          pfn_glUniformMatrix3fv;
 PFNGLUNIFORMMATRIX4FVPROC          pfn_glUniformMatrix4fv;
+PFNGLUNMAPBUFFERPROC               pfn_glUnmapBuffer;
 PFNGLUSEPROGRAMPROC                pfn_glUseProgram;
 PFNGLVERTEXATTRIBDIVISORPROC       pfn_glVertexAttribDivisor;
 PFNGLVERTEXATTRIBPOINTERPROC       pfn_glVertexAttribPointer;
@@ -67,45 +91,69 @@ PFNGLVERTEXATTRIBPOINTERPROC       pfn_glVertexAttribPointer;
 int win_gl_load(void) {
     LOAD(pfn_glActiveTexture,           "glActiveTexture")
     LOAD(pfn_glAttachShader,            "glAttachShader")
+    LOAD(pfn_glBeginQuery,              "glBeginQuery")
     LOAD(pfn_glBindBuffer,              "glBindBuffer")
+    LOAD(pfn_glBindBufferBase,          "glBindBufferBase")
     LOAD(pfn_glBindFramebuffer,         "glBindFramebuffer")
     LOAD(pfn_glBindRenderbuffer,        "glBindRenderbuffer")
     LOAD(pfn_glBindVertexArray,         "glBindVertexArray")
     LOAD(pfn_glBufferData,              "glBufferData")
     LOAD(pfn_glBufferSubData,           "glBufferSubData")
+    LOAD(pfn_glCheckFramebufferStatus,  "glCheckFramebufferStatus")
     LOAD(pfn_glCompileShader,           "glCompileShader")
+    LOAD(pfn_glCompressedTexImage2D,    "glCompressedTexImage2D")
+    LOAD(pfn_glCompressedTexImage3D,    "glCompressedTexImage3D")
+    LOAD(pfn_glCompressedTexSubImage3D, "glCompressedTexSubImage3D")
+    LOAD(pfn_glCopyBufferSubData,       "glCopyBufferSubData")
+    LOAD(pfn_glCopyTexSubImage3D,       "glCopyTexSubImage3D")
     LOAD(pfn_glCreateProgram,           "glCreateProgram")
     LOAD(pfn_glCreateShader,            "glCreateShader")
     LOAD(pfn_glDeleteBuffers,           "glDeleteBuffers")
     LOAD(pfn_glDeleteFramebuffers,      "glDeleteFramebuffers")
     LOAD(pfn_glDeleteProgram,           "glDeleteProgram")
+    LOAD(pfn_glDeleteQueries,           "glDeleteQueries")
     LOAD(pfn_glDeleteRenderbuffers,     "glDeleteRenderbuffers")
     LOAD(pfn_glDeleteShader,            "glDeleteShader")
     LOAD(pfn_glDeleteVertexArrays,      "glDeleteVertexArrays")
     LOAD(pfn_glDrawArraysInstanced,     "glDrawArraysInstanced")
+    LOAD(pfn_glDrawElementsInstanced,   "glDrawElementsInstanced")
+    LOAD(pfn_glDrawElementsInstancedBaseVertex, "glDrawElementsInstancedBaseVertex")
     LOAD(pfn_glEnableVertexAttribArray, "glEnableVertexAttribArray")
+    LOAD(pfn_glEndQuery,                "glEndQuery")
     LOAD(pfn_glFramebufferRenderbuffer, "glFramebufferRenderbuffer")
     LOAD(pfn_glFramebufferTexture2D,    "glFramebufferTexture2D")
+    LOAD(pfn_glFramebufferTextureLayer, "glFramebufferTextureLayer")
     LOAD(pfn_glGenBuffers,              "glGenBuffers")
     LOAD(pfn_glGenerateMipmap,          "glGenerateMipmap")
     LOAD(pfn_glGenFramebuffers,         "glGenFramebuffers")
+    LOAD(pfn_glGenQueries,              "glGenQueries")
     LOAD(pfn_glGenRenderbuffers,        "glGenRenderbuffers")
     LOAD(pfn_glGenVertexArrays,         "glGenVertexArrays")
+    LOAD(pfn_glGetCompressedTexImage,   "glGetCompressedTexImage")
     LOAD(pfn_glGetProgramInfoLog,       "glGetProgramInfoLog")
     LOAD(pfn_glGetProgramiv,            "glGetProgramiv")
+    LOAD(pfn_glGetQueryObjectiv,        "glGetQueryObjectiv")
+    LOAD(pfn_glGetQueryObjectui64v,     "glGetQueryObjectui64v")
     LOAD(pfn_glGetShaderInfoLog,        "glGetShaderInfoLog")
     LOAD(pfn_glGetShaderiv,             "glGetShaderiv")
+    LOAD(pfn_glGetStringi,              "glGetStringi")
+    LOAD(pfn_glGetUniformBlockIndex,    "glGetUniformBlockIndex")
     LOAD(pfn_glGetUniformLocation,      "glGetUniformLocation")
     LOAD(pfn_glLinkProgram,             "glLinkProgram")
+    LOAD(pfn_glMapBufferRange,          "glMapBufferRange")
     LOAD(pfn_glRenderbufferStorage,     "glRenderbufferStorage")
     LOAD(pfn_glShaderSource,            "glShaderSource")
+    LOAD(pfn_glTexImage3D,              "glTexImage3D")
+    LOAD(pfn_glTexSubImage3D,           "glTexSubImage3D")
     LOAD(pfn_glUniform1f,               "glUniform1f")
     LOAD(pfn_glUniform1fv,              "glUniform1fv")
     LOAD(pfn_glUniform1i,               "glUniform1i")
     LOAD(pfn_glUniform3fv,              "glUniform3fv")
     LOAD(pfn_glUniform4fv,              "glUniform4fv")
+    LOAD(pfn_glUniformBlockBinding,     "glUniformBlockBinding")
     LOAD(pfn_glUniformMatrix3fv,        "glUniformMatrix3fv")
     LOAD(pfn_glUniformMatrix4fv,        "glUniformMatrix4fv")
+    LOAD(pfn_glUnmapBuffer,             "glUnmapBuffer")
     LOAD(pfn_glUseProgram,              "glUseProgram")
     LOAD(pfn_glVertexAttribDivisor,     "glVertexAttribDivisor")
     LOAD(pfn_glVertexAttribPointer,     "glVertexAttribPointer")
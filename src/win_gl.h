@@ -12,45 +12,69 @@
 /* ── 関数ポインタ extern 宣言 ──────────────────────────*/
 extern PFNGLACTIVETEXTUREPROC             pfn_glActiveTexture;
 extern PFNGLATTACHSHADERPROC              pfn_glAttachShader;
+extern PFNGLBEGINQUERYPROC                pfn_glBeginQuery;
 extern PFNGLBINDBUFFERPROC                pfn_glBindBuffer;
+extern PFNGLBINDBUFFERBASEPROC            pfn_glBindBufferBase;
 extern PFNGLBINDFRAMEBUFFERPROC           pfn_glBindFramebuffer;
 extern PFNGLBINDRENDERBUFFERPROC          pfn_glBindRenderbuffer;
 extern PFNGLBINDVERTEXARRAYPROC           pfn_glBindVertexArray;
 extern PFNGLBUFFERDATAPROC                pfn_glBufferData;
 extern PFNGLBUFFERSUBDATAPROC             pfn_glBufferSubData;
+extern PFNGLCHECKFRAMEBUFFERSTATUSPROC    pfn_glCheckFramebufferStatus;
 extern PFNGLCOMPILESHADERPROC             pfn_glCompileShader;
+extern PFNGLCOMPRESSEDTEXIMAGE2DPROC      pfn_glCompressedTexImage2D;
+extern PFNGLCOMPRESSEDTEXIMAGE3DPROC      pfn_glCompressedTexImage3D;
+extern PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC   pfn_glCompressedTexSubImage3D;
+extern PFNGLCOPYBUFFERSUBDATAPROC         pfn_glCopyBufferSubData;
+extern PFNGLCOPYTEXSUBIMAGE3DPROC         pfn_glCopyTexSubImage3D;
 extern PFNGLCREATEPROGRAMPROC             pfn_glCreateProgram;
 extern PFNGLCREATESHADERPROC              pfn_glCreateShader;
 extern PFNGLDELETEBUFFERSPROC             pfn_glDeleteBuffers;
 extern PFNGLDELETEFRAMEBUFFERSPROC        pfn_glDeleteFramebuffers;
 extern PFNGLDELETEPROGRAMPROC             pfn_glDeleteProgram;
+extern PFNGLDELETEQUERIESPROC             pfn_glDeleteQueries;
 extern PFNGLDELETERENDERBUFFERSPROC       pfn_glDeleteRenderbuffers;
 extern PFNGLDELETESHADERPROC              pfn_glDeleteShader;
 extern PFNGLDELETEVERTEXARRAYSPROC        pfn_glDeleteVertexArrays;
 extern PFNGLDRAWARRAYSINSTANCEDPROC       pfn_glDrawArraysInstanced;
+extern PFNGLDRAWELEMENTSINSTANCEDPROC     pfn_glDrawElementsInstanced;
+extern PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC pfn_glDrawElementsInstancedBaseVertex;
 extern PFNGLENABLEVERTEXATTRIBARRAYPROC   pfn_glEnableVertexAttribArray;
+extern PFNGLENDQUERYPROC                  pfn_glEndQuery;
 extern PFNGLFRAMEBUFFERRENDERBUFFERPROC   pfn_glFramebufferRenderbuffer;
 extern PFNGLFRAMEBUFFERTEXTURE2DPROC      pfn_glFramebufferTexture2D;
+extern PFNGLFRAMEBUFFERTEXTURELAYERPROC   pfn_glFramebufferTextureLayer;
 extern PFNGLGENBUFFERSPROC                pfn_glGenBuffers;
 extern PFNGLGENERATEMIPMAPPROC            pfn_glGenerateMipmap;
 extern PFNGLGENFRAMEBUFFERSPROC           pfn_glGenFramebuffers;
+extern PFNGLGENQUERIESPROC                pfn_glGenQueries;
 extern PFNGLGENRENDERBUFFERSPROC          pfn_glGenRenderbuffers;
 extern PFNGLGENVERTEXARRAYSPROC           pfn_glGenVertexArrays;
+extern PFNGLGETCOMPRESSEDTEXIMAGEPROC     pfn_glGetCompressedTexImage;
 extern PFNGLGETPROGRAMINFOLOGPROC         pfn_glGetProgramInfoLog;
 extern PFNGLGETPROGRAMIVPROC              pfn_glGetProgramiv;
+extern PFNGLGETQUERYOBJECTIVPROC          pfn_glGetQueryObjectiv;
+extern PFNGLGETQUERYOBJECTUI64VPROC       pfn_glGetQueryObjectui64v;
 extern PFNGLGETSHADERINFOLOGPROC          pfn_glGetShaderInfoLog;
 extern PFNGLGETSHADERIVPROC               pfn_glGetShaderiv;
+extern PFNGLGETSTRINGIPROC                pfn_glGetStringi;
+extern PFNGLGETUNIFORMBLOCKINDEXPROC      pfn_glGetUniformBlockIndex;
 extern PFNGLGETUNIFORMLOCATIONPROC        pfn_glGetUniformLocation;
 extern PFNGLLINKPROGRAMPROC               pfn_glLinkProgram;
+extern PFNGLMAPBUFFERRANGEPROC            pfn_glMapBufferRange;
 extern PFNGLRENDERBUFFERSTORAGEPROC       pfn_glRenderbufferStorage;
 extern PFNGLSHADERSOURCEPROC              pfn_glShaderSource;
+extern PFNGLTEXIMAGE3DPROC                pfn_glTexImage3D;
+extern PFNGLTEXSUBIMAGE3DPROC             pfn_glTexSubImage3D;
 extern PFNGLUNIFORM1FPROC                 pfn_glUniform1f;
 extern PFNGLUNIFORM1FVPROC                pfn_glUniform1fv;
 extern PFNGLUNIFORM1IPROC                 pfn_glUniform1i;
 extern PFNGLUNIFORM3FVPROC                pfn_glUniform3fv;
 extern PFNGLUNIFORM4FVPROC                pfn_glUniform4fv;
+extern PFNGLUNIFORMBLOCKBINDINGPROC       pfn_glUniformBlockBinding;
 extern PFNGLUNIFORMMATRIX3FVPROC          pfn_glUniformMatrix3fv;
 extern PFNGLUNIFORMMATRIX4FVPROC          pfn_glUniformMatrix4fv;
+extern PFNGLUNMAPBUFFERPROC               pfn_glUnmapBuffer;
 extern PFNGLUSEPROGRAMPROC                pfn_glUseProgram;
 extern PFNGLVERTEXATTRIBDIVISORPROC       pfn_glVertexAttribDivisor;
 extern PFNGLVERTEXATTRIBPOINTERPROC       pfn_glVertexAttribPointer;
@@ -58,45 +82,69 @@ extern PFNGLVERTEXATTRIBPOINTERPROC       pfn_glVertexAttribPointer;
 /* ── gl* → pfn_gl* マクロ置換 ────────────────────────*/
 #define glActiveTexture            pfn_glActiveTexture
 #define glAttachShader             pfn_glAttachShader
+#define glBeginQuery               pfn_glBeginQuery
 #define glBindBuffer               pfn_glBindBuffer
+#define glBindBufferBase           pfn_glBindBufferBase
 #define glBindFramebuffer          pfn_glBindFramebuffer
 #define glBindRenderbuffer         pfn_glBindRenderbuffer
 #define glBindVertexArray          pfn_glBindVertexArray
 #define glBufferData               pfn_glBufferData
 #define glBufferSubData            pfn_glBufferSubData
+#define glCheckFramebufferStatus   pfn_glCheckFramebufferStatus
 #define glCompileShader            pfn_glCompileShader
+#define glCompressedTexImage2D     pfn_glCompressedTexImage2D
+#define glCompressedTexImage3D     pfn_glCompressedTexImage3D
+#define glCompressedTexSubImage3D  pfn_glCompressedTexSubImage3D
+#define glCopyBufferSubData        pfn_glCopyBufferSubData
+#define glCopyTexSubImage3D        pfn_glCopyTexSubImage3D
 #define glCreateProgram            pfn_glCreateProgram
 #define glCreateShader             pfn_glCreateShader
 #define glDeleteBuffers            pfn_glDeleteBuffers
 #define glDeleteFramebuffers       pfn_glDeleteFramebuffers
 #define glDeleteProgram            pfn_glDeleteProgram
+#define glDeleteQueries            pfn_glDeleteQueries
 #define glDeleteRenderbuffers      pfn_glDeleteRenderbuffers
 #define glDeleteShader             pfn_glDeleteShader
 #define glDeleteVertexArrays       pfn_glDeleteVertexArrays
 #define glDrawArraysInstanced      pfn_glDrawArraysInstanced
+#define glDrawElementsInstanced    pfn_glDrawElementsInstanced
+#define glDrawElementsInstancedBaseVertex pfn_glDrawElementsInstancedBaseVertex
 #define glEnableVertexAttribArray  pfn_glEnableVertexAttribArray
+#define glEndQuery                 pfn_glEndQuery
 #define glFramebufferRenderbuffer  pfn_glFramebufferRenderbuffer
 #define glFramebufferTexture2D     pfn_glFramebufferTexture2D
+#define glFramebufferTextureLayer  pfn_glFramebufferTextureLayer
 #define glGenBuffers               pfn_glGenBuffers
 #define glGenerateMipmap           pfn_glGenerateMipmap
 #define glGenFramebuffers          pfn_glGenFramebuffers
+#define glGenQueries               pfn_glGenQueries
 #define glGenRenderbuffers         pfn_glGenRenderbuffers
 #define glGenVertexArrays          pfn_glGenVertexArrays
+#define glGetCompressedTexImage    pfn_glGetCompressedTexImage
 #define glGetProgramInfoLog        pfn_glGetProgramInfoLog
 #define glGetProgramiv             pfn_glGetProgramiv
+#define glGetQueryObjectiv         pfn_glGetQueryObjectiv
+#define glGetQueryObjectui64v      pfn_glGetQueryObjectui64v
 #define glGetShaderInfoLog         pfn_glGetShaderInfoLog
 #define glGetShaderiv              pfn_glGetShaderiv
+#define glGetStringi               pfn_glGetStringi
+#define glGetUniformBlockIndex     pfn_glGetUniformBlockIndex
 #define glGetUniformLocation       pfn_glGetUniformLocation
 #define glLinkProgram              pfn_glLinkProgram
+#define glMapBufferRange           pfn_glMapBufferRange
 #define glRenderbufferStorage      pfn_glRenderbufferStorage
 #define glShaderSource             pfn_glShaderSource
+#define glTexImage3D               pfn_glTexImage3D
+#define glTexSubImage3D            pfn_glTexSubImage3D
 #define glUniform1f                pfn_glUniform1f
 #define glUniform1fv               pfn_glUniform1fv
 #define glUniform1i                pfn_glUniform1i
 #define glUniform3fv               pfn_glUniform3fv
 #define glUniform4fv               pfn_glUniform4fv
+#define glUniformBlockBinding      pfn_glUniformBlockBinding
 #define glUniformMatrix3fv         pfn_glUniformMatrix3fv
 #define glUniformMatrix4fv         pfn_glUniformMatrix4fv
+#define glUnmapBuffer              pfn_glUnmapBuffer
 #define glUseProgram               pfn_glUseProgram
 #define glVertexAttribDivisor      pfn_glVertexAttribDivisor
 #define glVertexAttribPointer      pfn_glVertexAttribPointer